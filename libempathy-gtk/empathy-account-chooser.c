@@ -25,6 +25,7 @@
 #include "empathy-account-chooser.h"
 
 #include <glib/gi18n-lib.h>
+#include <telepathy-logger/telepathy-logger.h>
 #include <tp-account-widgets/tpaw-pixbuf-utils.h>
 
 #define DEBUG_FLAG EMPATHY_DEBUG_OTHER
@@ -1105,3 +1106,191 @@ empathy_account_chooser_filter_supports_chatrooms (TpAccount *account,
 out:
   callback (supported, callback_data);
 }
+
+/* Which accounts have logs is shared by all the choosers using
+ * empathy_account_chooser_filter_has_logs(), so the logger is asked once per
+ * account rather than every time a chooser is filled or refiltered.
+ *
+ * Only the accounts with logs are remembered: they keep them until they're
+ * deleted, which empathy_account_chooser_filter_has_logs_reset() is told
+ * about, while an account without logs gets some as soon as it's used. */
+static GHashTable *accounts_with_logs = NULL;
+/* account path => HasLogsQuery, the queries to the logger in flight */
+static GHashTable *has_logs_queries = NULL;
+/* Bumped when logs are deleted, so answers from before are not cached */
+static guint has_logs_generation = 0;
+
+typedef struct
+{
+  EmpathyAccountChooserFilterResultCallback callback;
+  gpointer callback_data;
+} HasLogsCallback;
+
+typedef struct
+{
+  gchar *account_path;
+  guint generation;
+  /* HasLogsCallback, most recent first */
+  GSList *callbacks;
+} HasLogsQuery;
+
+static void
+has_logs_callback_free (HasLogsCallback *cb)
+{
+  g_slice_free (HasLogsCallback, cb);
+}
+
+static void
+has_logs_query_free (HasLogsQuery *query)
+{
+  g_free (query->account_path);
+  g_slist_free_full (query->callbacks, (GDestroyNotify) has_logs_callback_free);
+  g_slice_free (HasLogsQuery, query);
+}
+
+static void
+has_logs_got_entities_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  HasLogsQuery *query = user_data;
+  GList *entities;
+  GSList *l;
+  gboolean has_logs = FALSE;
+  GError *error = NULL;
+
+  if (!tpl_log_manager_get_entities_finish (TPL_LOG_MANAGER (manager),
+      result, &entities, &error))
+    {
+      DEBUG ("Could not get entities: %s", error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      has_logs = (entities != NULL);
+      g_list_free_full (entities, g_object_unref);
+    }
+
+  /* It has been replaced if logs were deleted in the meantime */
+  if (g_hash_table_lookup (has_logs_queries, query->account_path) == query)
+    g_hash_table_remove (has_logs_queries, query->account_path);
+
+  if (has_logs && query->generation == has_logs_generation)
+    g_hash_table_add (accounts_with_logs, g_strdup (query->account_path));
+
+  query->callbacks = g_slist_reverse (query->callbacks);
+
+  for (l = query->callbacks; l != NULL; l = g_slist_next (l))
+    {
+      HasLogsCallback *cb = l->data;
+
+      cb->callback (has_logs, cb->callback_data);
+    }
+
+  has_logs_query_free (query);
+}
+
+/**
+ * empathy_account_chooser_filter_has_logs:
+ * @account: a #TpAccount
+ * @callback: an #EmpathyAccountChooserFilterResultCallback accepting the result
+ * @callback_data: data passed to the @callback
+ * @user_data: user data or %NULL
+ *
+ * An #EmpathyAccountChooserFilterFunc that returns accounts having logs.
+ * Once an account is known to have logs, the answer is given right away.
+ *
+ * Returns (via the callback) TRUE if @account has logs
+ */
+void
+empathy_account_chooser_filter_has_logs (TpAccount *account,
+    EmpathyAccountChooserFilterResultCallback callback,
+    gpointer callback_data,
+    gpointer user_data)
+{
+  const gchar *path = tp_proxy_get_object_path (account);
+  TplLogManager *manager;
+  HasLogsCallback *cb;
+  HasLogsQuery *query;
+
+  if (accounts_with_logs == NULL)
+    {
+      accounts_with_logs = g_hash_table_new_full (g_str_hash, g_str_equal,
+          g_free, NULL);
+      has_logs_queries = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+
+  if (g_hash_table_contains (accounts_with_logs, path))
+    {
+      callback (TRUE, callback_data);
+      return;
+    }
+
+  cb = g_slice_new0 (HasLogsCallback);
+  cb->callback = callback;
+  cb->callback_data = callback_data;
+
+  /* Share the answer with the choosers which are asking too */
+  query = g_hash_table_lookup (has_logs_queries, path);
+  if (query != NULL && query->generation == has_logs_generation)
+    {
+      query->callbacks = g_slist_prepend (query->callbacks, cb);
+      return;
+    }
+
+  query = g_slice_new0 (HasLogsQuery);
+  query->account_path = g_strdup (path);
+  query->generation = has_logs_generation;
+  query->callbacks = g_slist_prepend (NULL, cb);
+
+  /* The key is owned by the query */
+  g_hash_table_replace (has_logs_queries, query->account_path, query);
+
+  manager = tpl_log_manager_dup_singleton ();
+  tpl_log_manager_get_entities_async (manager, account,
+      has_logs_got_entities_cb, query);
+  g_object_unref (manager);
+}
+
+/**
+ * empathy_account_chooser_filter_has_logs_add:
+ * @account: a #TpAccount
+ *
+ * Tells empathy_account_chooser_filter_has_logs() that @account has logs,
+ * because an event has just been logged for it.
+ *
+ * Return value: %TRUE if it wasn't known yet, in which case the choosers
+ * using the filter should be refiltered.
+ */
+gboolean
+empathy_account_chooser_filter_has_logs_add (TpAccount *account)
+{
+  const gchar *path = tp_proxy_get_object_path (account);
+
+  /* Nothing has asked yet */
+  if (accounts_with_logs == NULL)
+    return FALSE;
+
+  if (g_hash_table_contains (accounts_with_logs, path))
+    return FALSE;
+
+  g_hash_table_add (accounts_with_logs, g_strdup (path));
+
+  return TRUE;
+}
+
+/**
+ * empathy_account_chooser_filter_has_logs_reset:
+ *
+ * Makes empathy_account_chooser_filter_has_logs() ask the logger again,
+ * after logs have been deleted.
+ */
+void
+empathy_account_chooser_filter_has_logs_reset (void)
+{
+  if (accounts_with_logs == NULL)
+    return;
+
+  g_hash_table_remove_all (accounts_with_logs);
+  has_logs_generation++;
+}
@@ -121,6 +121,13 @@ void empathy_account_chooser_filter_supports_chatrooms (TpAccount *account,
     gpointer callback_data,
     gpointer user_data);
 
+void empathy_account_chooser_filter_has_logs (TpAccount *account,
+    EmpathyAccountChooserFilterResultCallback callback,
+    gpointer callback_data,
+    gpointer user_data);
+gboolean empathy_account_chooser_filter_has_logs_add (TpAccount *account);
+void empathy_account_chooser_filter_has_logs_reset (void);
+
 G_END_DECLS
 
 #endif /* __EMPATHY_ACCOUNT_CHOOSER_H__ */
@@ -46,6 +46,7 @@
 #include "empathy-input-text-view.h"
 #include "empathy-request-util.h"
 #include "empathy-search-bar.h"
+#include "empathy-settings-snapshot.h"
 #include "empathy-spell.h"
 #include "empathy-string-parser.h"
 #include "empathy-theme-manager.h"
@@ -71,6 +72,7 @@ struct _EmpathyChatPriv {
 
 	GSettings         *gsettings_chat;
 	GSettings         *gsettings_ui;
+	EmpathySettingsSnapshot *settings;
 
 	TplLogManager     *log_manager;
 	TplLogWalker      *log_walker;
@@ -164,6 +166,15 @@ struct _EmpathyChatPriv {
 	/* TRUE if empathy_chat_is_room () and there are unread highlighted messages.
 	 * Cleared by empathy_chat_messages_read (). */
 	gboolean           highlighted;
+
+	/* TRUE while chat->view and the contact list are released, see
+	 * empathy_chat_hibernate () */
+	gboolean           hibernated;
+	/* The last RecentItem*s shown in chat->view, used to rebuild it */
+	GQueue             recent_items;
+	/* Logged messages sent at or after this time are in recent_items, so
+	 * they are not fetched again when the view is rebuilt; 0 if none */
+	gint64             backlog_before;
 };
 
 typedef struct {
@@ -201,6 +212,120 @@ G_DEFINE_TYPE (EmpathyChat, empathy_chat, GTK_TYPE_BOX);
 static gboolean chat_scrollable_connect (gpointer user_data);
 static gboolean update_misspelled_words (gpointer data);
 
+/* Number of messages and events kept to rebuild the view of a hibernated
+ * chat */
+#define RECENT_ITEMS_MAX 100
+
+typedef enum {
+	RECENT_MESSAGE,
+	RECENT_EDIT,
+	RECENT_EVENT,
+	RECENT_EVENT_MARKUP,
+} RecentItemType;
+
+typedef struct {
+	RecentItemType  type;
+	EmpathyMessage *message;
+	gboolean        should_highlight;
+	gchar          *text;
+	gchar          *markup;
+} RecentItem;
+
+static void
+recent_item_free (RecentItem *item)
+{
+	tp_clear_object (&item->message);
+	g_free (item->text);
+	g_free (item->markup);
+	g_slice_free (RecentItem, item);
+}
+
+static void
+chat_remember (EmpathyChat    *chat,
+	       RecentItemType  type,
+	       EmpathyMessage *message,
+	       gboolean        should_highlight,
+	       const gchar    *text,
+	       const gchar    *markup)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+	RecentItem *item;
+
+	item = g_slice_new0 (RecentItem);
+	item->type = type;
+	if (message != NULL)
+		item->message = g_object_ref (message);
+	item->should_highlight = should_highlight;
+	item->text = g_strdup (text);
+	item->markup = g_strdup (markup);
+
+	g_queue_push_tail (&priv->recent_items, item);
+
+	while (g_queue_get_length (&priv->recent_items) > RECENT_ITEMS_MAX)
+		recent_item_free (g_queue_pop_head (&priv->recent_items));
+}
+
+/* Messages and events go through these so they can be shown again once a
+ * hibernated chat is woken up. */
+static void
+chat_view_append_message (EmpathyChat    *chat,
+			  EmpathyMessage *message,
+			  gboolean        should_highlight)
+{
+	chat_remember (chat, RECENT_MESSAGE, message, should_highlight,
+		       NULL, NULL);
+
+	if (chat->view != NULL)
+		empathy_theme_adium_append_message (chat->view, message,
+						    should_highlight);
+}
+
+static void
+chat_view_edit_message (EmpathyChat    *chat,
+			EmpathyMessage *message)
+{
+	chat_remember (chat, RECENT_EDIT, message, FALSE, NULL, NULL);
+
+	if (chat->view != NULL)
+		empathy_theme_adium_edit_message (chat->view, message);
+}
+
+static void
+chat_view_append_event (EmpathyChat *chat,
+			const gchar *str)
+{
+	chat_remember (chat, RECENT_EVENT, NULL, FALSE, str, NULL);
+
+	if (chat->view != NULL)
+		empathy_theme_adium_append_event (chat->view, str);
+}
+
+static void
+chat_view_append_event_markup (EmpathyChat *chat,
+			       const gchar *markup_text,
+			       const gchar *fallback_text)
+{
+	chat_remember (chat, RECENT_EVENT_MARKUP, NULL, FALSE, fallback_text,
+		       markup_text);
+
+	if (chat->view != NULL)
+		empathy_theme_adium_append_event_markup (chat->view,
+							 markup_text,
+							 fallback_text);
+}
+
+static void
+chat_view_clear (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+
+	g_queue_foreach (&priv->recent_items, (GFunc) recent_item_free, NULL);
+	g_queue_clear (&priv->recent_items);
+
+	if (chat->view != NULL)
+		empathy_theme_adium_clear (chat->view);
+}
+
 static void
 chat_get_property (GObject    *object,
 		   guint       param_id,
@@ -383,8 +508,8 @@ chat_composing_stop_timeout_cb (EmpathyChat *chat)
 	priv = GET_PRIV (chat);
 
 	priv->composing_stop_timeout_id = 0;
-	send_chat_states = g_settings_get_boolean (priv->gsettings_chat,
-	                                 EMPATHY_PREFS_CHAT_SEND_CHAT_STATES);
+	send_chat_states = EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings,
+	                                 chat_send_chat_states);
 	if (!send_chat_states) {
 		set_chat_state (chat, TP_CHANNEL_CHAT_STATE_ACTIVE);
 	} else {
@@ -402,8 +527,8 @@ chat_composing_start (EmpathyChat *chat)
 
 	priv = GET_PRIV (chat);
 
-	send_chat_states = g_settings_get_boolean (priv->gsettings_chat,
-	                                  EMPATHY_PREFS_CHAT_SEND_CHAT_STATES);
+	send_chat_states = EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings,
+	                                  chat_send_chat_states);
 	if (!send_chat_states) {
 		return;
 	}
@@ -725,7 +850,7 @@ chat_command_msg_cb (GObject *source,
 		DEBUG ("Failed to get channel: %s", error->message);
 		g_error_free (error);
 
-		empathy_theme_adium_append_event (data->chat->view,
+		chat_view_append_event (data->chat,
 			_("Failed to open private chat"));
 		goto OUT;
 	}
@@ -773,7 +898,7 @@ static void
 chat_command_clear (EmpathyChat *chat,
 		    GStrv        strv)
 {
-	empathy_theme_adium_clear (chat->view);
+	chat_view_clear (chat);
 }
 
 static void
@@ -783,13 +908,13 @@ chat_command_topic (EmpathyChat *chat,
 	EmpathyChatPriv *priv = GET_PRIV (chat);
 
 	if (!empathy_tp_chat_supports_subject (priv->tp_chat)) {
-		empathy_theme_adium_append_event (chat->view,
+		chat_view_append_event (chat,
 			_("Topic not supported on this conversation"));
 		return;
 	}
 
 	if (!empathy_tp_chat_can_set_subject (priv->tp_chat)) {
-		empathy_theme_adium_append_event (chat->view,
+		chat_view_append_event (chat,
 			_("You are not allowed to change the topic"));
 		return;
 	}
@@ -961,7 +1086,7 @@ whois_got_contact_cb (GObject *source,
 		EMPATHY_CLIENT_FACTORY (source), result, NULL);
 
 	if (contact == NULL) {
-		empathy_theme_adium_append_event (chat->view, _("Invalid contact ID"));
+		chat_view_append_event (chat, _("Invalid contact ID"));
 		goto out;
 	}
 
@@ -1105,7 +1230,7 @@ chat_command_show_help (EmpathyChat     *chat,
 	}
 
 	str = g_strdup_printf (_("Usage: %s"), _(item->help));
-	empathy_theme_adium_append_event (chat->view, str);
+	chat_view_append_event (chat, str);
 	g_free (str);
 }
 
@@ -1127,7 +1252,7 @@ chat_command_help (EmpathyChat *chat,
 			if (commands[i].help == NULL) {
 				continue;
 			}
-			empathy_theme_adium_append_event (chat->view,
+			chat_view_append_event (chat,
 				_(commands[i].help));
 		}
 		return;
@@ -1148,7 +1273,7 @@ chat_command_help (EmpathyChat *chat,
 		}
 	}
 
-	empathy_theme_adium_append_event (chat->view,
+	chat_view_append_event (chat,
 		_("Unknown command"));
 }
 
@@ -1274,7 +1399,7 @@ chat_send (EmpathyChat  *chat,
 		}
 
 		if (!second_slash) {
-			empathy_theme_adium_append_event (chat->view,
+			chat_view_append_event (chat,
 				_("Unknown command; see /help for the available"
 				  " commands"));
 			return;
@@ -1468,7 +1593,7 @@ chat_message_received (EmpathyChat *chat,
 			empathy_message_get_supersedes (message),
 			empathy_message_get_body (message));
 
-		empathy_theme_adium_edit_message (chat->view, message);
+		chat_view_edit_message (chat, message);
 	} else {
 		gboolean should_highlight = chat_should_highlight (chat, message);
 
@@ -1481,7 +1606,7 @@ chat_message_received (EmpathyChat *chat,
 			empathy_contact_get_alias (sender),
 			empathy_contact_get_handle (sender));
 
-		empathy_theme_adium_append_message (chat->view, message, should_highlight);
+		chat_view_append_message (chat, message, should_highlight);
 
 		if (empathy_message_is_incoming (message)) {
 			priv->unread_messages++;
@@ -1514,8 +1639,9 @@ chat_message_acknowledged_cb (EmpathyTpChat  *tp_chat,
 {
 	EmpathyChatPriv *priv = GET_PRIV (chat);
 
-	empathy_theme_adium_message_acknowledged (chat->view,
-	    message);
+	if (chat->view != NULL)
+		empathy_theme_adium_message_acknowledged (chat->view,
+		    message);
 
 	if (!empathy_message_is_edit (message)) {
 		priv->unread_messages--;
@@ -1560,9 +1686,9 @@ append_balance_error (EmpathyChat *chat,
 	}
 
 	if (str_markup != NULL)
-		empathy_theme_adium_append_event_markup (chat->view, str_markup, str);
+		chat_view_append_event_markup (chat, str_markup, str);
 	else
-		empathy_theme_adium_append_event (chat->view, str);
+		chat_view_append_event (chat, str);
 
 	g_free (str);
 	g_free (str_markup);
@@ -1618,7 +1744,7 @@ chat_send_error_cb (EmpathyTpChat          *tp_chat,
 			str = g_strdup_printf (_("Error sending message: %s"), error);
 	}
 
-	empathy_theme_adium_append_event (chat->view, str);
+	chat_view_append_event (chat, str);
 	g_free (str);
 }
 
@@ -2021,25 +2147,24 @@ chat_input_key_press_event_cb (GtkWidget   *widget,
 					g_string_append (message, empathy_contact_get_alias (l->data));
 					g_string_append (message, " - ");
 				 }
-				 empathy_theme_adium_append_event (chat->view, message->str);
+				 chat_view_append_event (chat, message->str);
 				 g_string_free (message, TRUE);
 			}
 
 			gtk_text_buffer_insert_at_cursor (buffer, text, strlen (text));
 
 			if (len == 1 && is_start_of_buffer) {
-			    gchar *complete_char;
+			    const gchar *complete_char;
 
-			    complete_char = g_settings_get_string (
-				    priv->gsettings_chat,
-				    EMPATHY_PREFS_CHAT_NICK_COMPLETION_CHAR);
+			    complete_char = EMPATHY_SETTINGS_SNAPSHOT_GET (
+				    priv->settings,
+				    chat_nick_completion_char);
 
 			    if (complete_char != NULL) {
 				gtk_text_buffer_insert_at_cursor (buffer,
 								  complete_char,
 								  strlen (complete_char));
 				gtk_text_buffer_insert_at_cursor (buffer, " ", 1);
-				g_free (complete_char);
 			    }
 			}
 
@@ -2082,7 +2207,9 @@ chat_input_has_focus_notify_cb (GtkWidget   *widget,
 				GParamSpec  *pspec,
 				EmpathyChat *chat)
 {
-	empathy_theme_adium_focus_toggled (chat->view, gtk_widget_has_focus (widget));
+	if (chat->view != NULL)
+		empathy_theme_adium_focus_toggled (chat->view,
+			gtk_widget_has_focus (widget));
 }
 
 void
@@ -2500,6 +2627,11 @@ chat_log_filter (TplEvent *event,
 	g_return_val_if_fail (TPL_IS_EVENT (event), FALSE);
 	g_return_val_if_fail (EMPATHY_IS_CHAT (chat), FALSE);
 
+	/* Already shown from recent_items */
+	if (priv->backlog_before != 0 &&
+	    tpl_event_get_timestamp (event) >= priv->backlog_before)
+		return FALSE;
+
 	pending = empathy_tp_chat_get_pending_messages (priv->tp_chat);
 	message = empathy_message_from_tpl_log_event (event);
 
@@ -2521,7 +2653,6 @@ show_pending_messages (EmpathyChat *chat) {
 	const GList *messages, *l;
 
 	g_return_if_fail (EMPATHY_IS_CHAT (chat));
-	g_return_if_fail (chat->view != NULL);
 	g_return_if_fail (priv->tp_chat != NULL);
 
 	messages = empathy_tp_chat_get_pending_messages (priv->tp_chat);
@@ -2540,6 +2671,9 @@ chat_scrollable_set_value (gpointer user_data)
 	GtkAdjustment *adjustment;
 	guint upper;
 
+	if (chat->view == NULL)
+		return G_SOURCE_REMOVE;
+
 	adjustment = gtk_scrollable_get_vadjustment (
 	    GTK_SCROLLABLE (chat->view));
 
@@ -2566,7 +2700,7 @@ got_filtered_messages_cb (GObject *walker,
 	if (!tpl_log_walker_get_events_finish (TPL_LOG_WALKER (walker),
 		result, &messages, &error)) {
 		DEBUG ("%s. Aborting.", error->message);
-		empathy_theme_adium_append_event (chat->view,
+		chat_view_append_event (chat,
 			_("Failed to retrieve recent logs"));
 		g_error_free (error);
 		goto out;
@@ -2663,9 +2797,14 @@ chat_add_logs (EmpathyChat *chat)
 	EmpathyChatPriv *priv = GET_PRIV (chat);
 
 	if (!priv->id) {
+		priv->retrieving_backlogs = FALSE;
 		return G_SOURCE_REMOVE;
 	}
 
+	/* Also keeps the chat from being hibernated while chat->view is
+	 * waiting for the logs */
+	priv->retrieving_backlogs = TRUE;
+
 	/* Turn off scrolling temporarily */
 	empathy_theme_adium_scroll (chat->view, FALSE);
 
@@ -2747,6 +2886,9 @@ chat_scrollable_connect (gpointer user_data)
 	EmpathyChat *chat = EMPATHY_CHAT (user_data);
 	GtkAdjustment *adjustment;
 
+	if (chat->view == NULL)
+		return G_SOURCE_REMOVE;
+
 	adjustment = gtk_scrollable_get_vadjustment (
 	    GTK_SCROLLABLE (chat->view));
 
@@ -2870,7 +3012,7 @@ chat_members_changed_cb (EmpathyTpChat  *tp_chat,
 		str = build_part_message (reason, name, actor, message);
 	}
 
-	empathy_theme_adium_append_event (chat->view, str);
+	chat_view_append_event (chat, str);
 	g_free (str);
 }
 
@@ -2892,7 +3034,7 @@ chat_member_renamed_cb (EmpathyTpChat  *tp_chat,
 		str = g_strdup_printf (_("%s is now known as %s"),
 				       empathy_contact_get_alias (old_contact),
 				       empathy_contact_get_alias (new_contact));
-		empathy_theme_adium_append_event (chat->view, str);
+		chat_view_append_event (chat, str);
 		g_free (str);
 	}
 
@@ -2933,6 +3075,11 @@ chat_update_contacts_visibility (EmpathyChat *chat,
 		show = FALSE;
 	}
 
+	/* Built again by empathy_chat_wake () */
+	if (show && priv->hibernated) {
+		return;
+	}
+
 	if (show && priv->contact_list_view == NULL) {
 		EmpathyIndividualStore *store;
 		gint                     min_width;
@@ -3076,7 +3223,7 @@ chat_invalidated_cb (EmpathyTpChat *tp_chat,
 	priv->tp_chat = NULL;
 	g_object_notify (G_OBJECT (chat), "tp-chat");
 
-	empathy_theme_adium_append_event (chat->view, _("Disconnected"));
+	chat_view_append_event (chat, _("Disconnected"));
 	gtk_widget_set_sensitive (chat->input_text_view, FALSE);
 
 	chat_update_contacts_visibility (chat, FALSE);
@@ -3221,6 +3368,62 @@ chat_hpaned_pos_changed_cb (GtkWidget* hpaned,
 	return TRUE;
 }
 
+/* Create chat->view and the search bar, which only works on it */
+static void
+chat_create_view (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+	EmpathyThemeManager *theme_mgr;
+	GList           *list = NULL;
+
+	/* Add message view. */
+	theme_mgr = empathy_theme_manager_dup_singleton ();
+	chat->view = empathy_theme_manager_create_view (theme_mgr);
+	g_object_unref (theme_mgr);
+	/* If this is a GtkTextView, it's set as a drag destination for text/plain
+	   and other types, even though it's non-editable and doesn't accept any
+	   drags.  This steals drag motion for anything inside the scrollbars,
+	   making drag destinations on chat windows far less useful.
+	 */
+	gtk_drag_dest_unset (GTK_WIDGET (chat->view));
+	g_signal_connect (chat->view, "focus_in_event",
+			  G_CALLBACK (chat_text_view_focus_in_event_cb),
+			  chat);
+	gtk_container_add (GTK_CONTAINER (priv->scrolled_window_chat),
+			   GTK_WIDGET (chat->view));
+	gtk_widget_show (GTK_WIDGET (chat->view));
+
+	/* Add the (invisible) search bar */
+	priv->search_bar = empathy_search_bar_new (chat->view);
+	gtk_box_pack_start (GTK_BOX(priv->vbox_left),
+	                    priv->search_bar,
+	                    FALSE, FALSE, 0);
+	gtk_box_reorder_child (GTK_BOX(priv->vbox_left), priv->search_bar, 1);
+
+	/* Set widget focus order */
+	list = g_list_append (NULL, priv->search_bar);
+	list = g_list_append (list, priv->scrolled_window_input);
+	gtk_container_set_focus_chain (GTK_CONTAINER (priv->vbox_left), list);
+	g_list_free (list);
+}
+
+static void
+chat_update_show_avatars (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+
+	if (priv->tp_chat != NULL) {
+		TpChannel *channel = TP_CHANNEL (priv->tp_chat);
+		TpConnection *conn = tp_channel_get_connection (channel);
+		gboolean supports_avatars =
+			tp_proxy_has_interface_by_id (conn,
+						      TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS);
+
+		empathy_theme_adium_set_show_avatars (chat->view,
+						    supports_avatars);
+	}
+}
+
 static void
 chat_create_ui (EmpathyChat *chat)
 {
@@ -3229,7 +3432,6 @@ chat_create_ui (EmpathyChat *chat)
  	GList           *list = NULL;
 	gchar           *filename;
 	GtkTextBuffer   *buffer;
-	EmpathyThemeManager *theme_mgr;
 
 	filename = empathy_file_lookup ("empathy-chat.ui",
 					"libempathy-gtk");
@@ -3253,23 +3455,6 @@ chat_create_ui (EmpathyChat *chat)
 
 	g_free (filename);
 
-	/* Add message view. */
-	theme_mgr = empathy_theme_manager_dup_singleton ();
-	chat->view = empathy_theme_manager_create_view (theme_mgr);
-	g_object_unref (theme_mgr);
-	/* If this is a GtkTextView, it's set as a drag destination for text/plain
-	   and other types, even though it's non-editable and doesn't accept any
-	   drags.  This steals drag motion for anything inside the scrollbars,
-	   making drag destinations on chat windows far less useful.
-	 */
-	gtk_drag_dest_unset (GTK_WIDGET (chat->view));
-	g_signal_connect (chat->view, "focus_in_event",
-			  G_CALLBACK (chat_text_view_focus_in_event_cb),
-			  chat);
-	gtk_container_add (GTK_CONTAINER (priv->scrolled_window_chat),
-			   GTK_WIDGET (chat->view));
-	gtk_widget_show (GTK_WIDGET (chat->view));
-
 	/* Add input GtkTextView */
 	chat->input_text_view = empathy_input_text_view_new ();
 	g_signal_connect (chat->input_text_view, "notify::has-focus",
@@ -3300,12 +3485,7 @@ chat_create_ui (EmpathyChat *chat)
 			   chat->input_text_view);
 	gtk_widget_show (chat->input_text_view);
 
-	/* Add the (invisible) search bar */
-	priv->search_bar = empathy_search_bar_new (chat->view);
-	gtk_box_pack_start (GTK_BOX(priv->vbox_left),
-	                    priv->search_bar,
-	                    FALSE, FALSE, 0);
-	gtk_box_reorder_child (GTK_BOX(priv->vbox_left), priv->search_bar, 1);
+	chat_create_view (chat);
 
 	/* Initialy hide the topic, will be shown if not empty */
 	gtk_widget_hide (priv->hbox_topic);
@@ -3315,11 +3495,6 @@ chat_create_ui (EmpathyChat *chat)
 			  chat);
 
 	/* Set widget focus order */
-	list = g_list_append (NULL, priv->search_bar);
-	list = g_list_append (list, priv->scrolled_window_input);
-	gtk_container_set_focus_chain (GTK_CONTAINER (priv->vbox_left), list);
-	g_list_free (list);
-
 	list = g_list_append (NULL, priv->vbox_left);
 	list = g_list_append (list, priv->scrolled_window_contacts);
 	gtk_container_set_focus_chain (GTK_CONTAINER (priv->hpaned), list);
@@ -3357,6 +3532,7 @@ chat_finalize (GObject *object)
 
 	g_object_unref (priv->gsettings_chat);
 	g_object_unref (priv->gsettings_ui);
+	g_object_unref (priv->settings);
 
 	g_list_foreach (priv->input_history, (GFunc) chat_input_history_entry_free, NULL);
 	g_list_free (priv->input_history);
@@ -3416,28 +3592,40 @@ chat_finalize (GObject *object)
 	g_free (priv->subject);
 	g_completion_free (priv->completion);
 
+	g_queue_foreach (&priv->recent_items, (GFunc) recent_item_free, NULL);
+	g_queue_clear (&priv->recent_items);
+
 	tp_clear_pointer (&priv->highlight_regex, g_regex_unref);
 
 	G_OBJECT_CLASS (empathy_chat_parent_class)->finalize (object);
 }
 
+static TplLogWalker *
+chat_create_log_walker (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+	TplEntity *target;
+	TplLogWalker *walker;
+
+	if (priv->handle_type == TP_HANDLE_TYPE_ROOM)
+		target = tpl_entity_new_from_room_id (priv->id);
+	else
+		target = tpl_entity_new (priv->id, TPL_ENTITY_CONTACT, NULL, NULL);
+
+	walker = tpl_log_manager_walk_filtered_events (priv->log_manager, priv->account, target,
+						       TPL_EVENT_MASK_TEXT, chat_log_filter, chat);
+	g_object_unref (target);
+
+	return walker;
+}
+
 static void
 chat_constructed (GObject *object)
 {
 	EmpathyChat *chat = EMPATHY_CHAT (object);
 	EmpathyChatPriv *priv = GET_PRIV (chat);
-	TplEntity *target;
 
-	if (priv->tp_chat != NULL) {
-		TpChannel *channel = TP_CHANNEL (priv->tp_chat);
-		TpConnection *conn = tp_channel_get_connection (channel);
-		gboolean supports_avatars =
-			tp_proxy_has_interface_by_id (conn,
-						      TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS);
-
-		empathy_theme_adium_set_show_avatars (chat->view,
-						    supports_avatars);
-	}
+	chat_update_show_avatars (chat);
 
 	/* Add messages from last conversations. Backlog messages are always
 	 * prepended and pending messages are appended, so we can do both
@@ -3445,14 +3633,7 @@ chat_constructed (GObject *object)
 	 * longer needed. Pending messages are handled within
 	 * empathy_chat_set_tp_chat() so we don't have to care about them here.
 	 */
-	if (priv->handle_type == TP_HANDLE_TYPE_ROOM)
-		target = tpl_entity_new_from_room_id (priv->id);
-	else
-		target = tpl_entity_new (priv->id, TPL_ENTITY_CONTACT, NULL, NULL);
-
-	priv->log_walker = tpl_log_manager_walk_filtered_events (priv->log_manager, priv->account, target,
-								 TPL_EVENT_MASK_TEXT, chat_log_filter, chat);
-	g_object_unref (target);
+	priv->log_walker = chat_create_log_walker (chat);
 
 	if (priv->handle_type != TP_HANDLE_TYPE_ROOM) {
 		chat_add_logs (chat);
@@ -3637,9 +3818,11 @@ empathy_chat_init (EmpathyChat *chat)
 		EMPATHY_TYPE_CHAT, EmpathyChatPriv);
 
 	chat->priv = priv;
+	g_queue_init (&priv->recent_items);
 	priv->log_manager = tpl_log_manager_dup_singleton ();
 	priv->gsettings_chat = g_settings_new (EMPATHY_PREFS_CHAT_SCHEMA);
 	priv->gsettings_ui = g_settings_new (EMPATHY_PREFS_UI_SCHEMA);
+	priv->settings = empathy_settings_snapshot_dup_singleton ();
 
 	priv->contacts_width = g_settings_get_int (priv->gsettings_ui,
 		EMPATHY_PREFS_UI_CHAT_WINDOW_PANED_POS);
@@ -4172,7 +4355,7 @@ empathy_chat_set_tp_chat (EmpathyChat   *chat,
 	if (chat->input_text_view) {
 		gtk_widget_set_sensitive (chat->input_text_view, TRUE);
 		if (priv->block_events_timeout_id == 0) {
-			empathy_theme_adium_append_event (chat->view, _("Connected"));
+			chat_view_append_event (chat, _("Connected"));
 		}
 	}
 
@@ -4292,7 +4475,7 @@ empathy_chat_clear (EmpathyChat *chat)
 {
 	g_return_if_fail (EMPATHY_IS_CHAT (chat));
 
-	empathy_theme_adium_clear (chat->view);
+	chat_view_clear (chat);
 }
 
 void
@@ -4300,6 +4483,9 @@ empathy_chat_scroll_down (EmpathyChat *chat)
 {
 	g_return_if_fail (EMPATHY_IS_CHAT (chat));
 
+	if (chat->view == NULL)
+		return;
+
 	empathy_theme_adium_scroll_down (chat->view);
 }
 
@@ -4323,7 +4509,8 @@ empathy_chat_cut (EmpathyChat *chat)
 static gboolean
 copy_from_chat_view (EmpathyChat *chat)
 {
-	if (!empathy_theme_adium_get_has_selection (chat->view))
+	if (chat->view == NULL ||
+	    !empathy_theme_adium_get_has_selection (chat->view))
 		return FALSE;
 
 	empathy_theme_adium_copy_clipboard (chat->view);
@@ -4399,7 +4586,8 @@ empathy_chat_paste (EmpathyChat *chat)
 
 	priv = GET_PRIV (chat);
 
-	if (gtk_widget_get_visible (priv->search_bar)) {
+	if (priv->search_bar != NULL &&
+	    gtk_widget_get_visible (priv->search_bar)) {
 		empathy_search_bar_paste_clipboard (EMPATHY_SEARCH_BAR (priv->search_bar));
 		return;
 	}
@@ -4423,6 +4611,7 @@ empathy_chat_find (EmpathyChat *chat)
 
 	priv = GET_PRIV (chat);
 
+	empathy_chat_wake (chat);
 	empathy_search_bar_show (EMPATHY_SEARCH_BAR (priv->search_bar));
 }
 
@@ -4488,9 +4677,11 @@ empathy_chat_messages_read (EmpathyChat *self)
 	if (priv->retrieving_backlogs)
 		return;
 
+	/* Batched with the other acks of this main loop iteration, so showing
+	 * a backlog and focusing the tab only make one call */
 	if (priv->tp_chat != NULL) {
-		tp_text_channel_ack_all_pending_messages_async (
-			TP_TEXT_CHANNEL (priv->tp_chat), NULL, NULL);
+		empathy_tp_chat_acknowledge_messages (priv->tp_chat,
+			empathy_tp_chat_get_pending_messages (priv->tp_chat));
 	}
 
 	priv->highlighted = FALSE;
@@ -4565,3 +4756,199 @@ empathy_chat_set_text (EmpathyChat *self,
 
 	gtk_text_buffer_set_text (buffer, text, -1);
 }
+
+/* Memory kept by the recent items to rebuild the view, in bytes */
+static gsize
+chat_get_recent_items_size (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+	GList *l;
+	gsize size = 0;
+
+	for (l = priv->recent_items.head; l != NULL; l = l->next) {
+		RecentItem *item = l->data;
+		const gchar *body = NULL;
+
+		size += sizeof (RecentItem);
+		if (item->message != NULL)
+			body = empathy_message_get_body (item->message);
+		if (body != NULL)
+			size += strlen (body);
+		if (item->text != NULL)
+			size += strlen (item->text);
+		if (item->markup != NULL)
+			size += strlen (item->markup);
+	}
+
+	return size;
+}
+
+/**
+ * empathy_chat_hibernate:
+ * @chat: an #EmpathyChat
+ *
+ * Release the message view and the contact list of @chat, which are only
+ * needed when its tab is shown. The #EmpathyTpChat, the unread messages
+ * count and the last messages are kept; the view is rebuilt from them by
+ * empathy_chat_wake ().
+ *
+ * Returns: %TRUE if @chat is hibernated
+ */
+gboolean
+empathy_chat_hibernate (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv;
+	guint n_items;
+	gsize html_size;
+
+	g_return_val_if_fail (EMPATHY_IS_CHAT (chat), FALSE);
+
+	priv = GET_PRIV (chat);
+
+	if (priv->hibernated)
+		return TRUE;
+
+	/* The logs being fetched are for chat->view */
+	if (priv->retrieving_backlogs)
+		return FALSE;
+
+	/* WebKit and malloc don't give the memory back right away, and the
+	 * other tabs share the process, so what the view showed is a better
+	 * measure of what is released than the process' memory */
+	empathy_theme_adium_get_content_size (chat->view, &n_items, &html_size);
+
+	gtk_widget_destroy (priv->search_bar);
+	priv->search_bar = NULL;
+	gtk_widget_destroy (GTK_WIDGET (chat->view));
+	chat->view = NULL;
+
+	if (priv->contact_list_view != NULL) {
+		gtk_widget_destroy (priv->contact_list_view);
+		priv->contact_list_view = NULL;
+	}
+
+	priv->hibernated = TRUE;
+
+	DEBUG ("Hibernated %s: released a view of %u items (%" G_GSIZE_FORMAT
+	       " bytes of HTML), kept %u recent items (%" G_GSIZE_FORMAT
+	       " bytes)", priv->id, n_items, html_size,
+	       g_queue_get_length (&priv->recent_items),
+	       chat_get_recent_items_size (chat));
+
+	return TRUE;
+}
+
+/**
+ * empathy_chat_wake:
+ * @chat: an #EmpathyChat
+ *
+ * Rebuild the view of a chat released by empathy_chat_hibernate (), with
+ * its recent messages and older ones fetched again from the logs. Does
+ * nothing if @chat isn't hibernated.
+ */
+void
+empathy_chat_wake (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv;
+	GtkAdjustment *adjustment;
+	GList *l, *first_unread = NULL;
+	guint unread;
+	gboolean read = TRUE;
+
+	g_return_if_fail (EMPATHY_IS_CHAT (chat));
+
+	priv = GET_PRIV (chat);
+
+	if (!priv->hibernated)
+		return;
+
+	chat_create_view (chat);
+	chat_update_show_avatars (chat);
+	priv->hibernated = FALSE;
+
+	/* The unread messages are the last incoming ones */
+	unread = priv->unread_messages;
+	for (l = priv->recent_items.tail; l != NULL && unread > 0; l = l->prev) {
+		RecentItem *item = l->data;
+
+		if (item->type == RECENT_MESSAGE &&
+		    empathy_message_is_incoming (item->message)) {
+			first_unread = l;
+			unread--;
+		}
+	}
+
+	priv->backlog_before = 0;
+
+	for (l = priv->recent_items.head; l != NULL; l = l->next) {
+		RecentItem *item = l->data;
+
+		if (l == first_unread)
+			read = FALSE;
+
+		switch (item->type) {
+		case RECENT_MESSAGE:
+			if (priv->backlog_before == 0)
+				priv->backlog_before =
+					empathy_message_get_timestamp (item->message);
+
+			if (read)
+				empathy_theme_adium_append_read_message (chat->view,
+					item->message, item->should_highlight);
+			else
+				empathy_theme_adium_append_message (chat->view,
+					item->message, item->should_highlight);
+			break;
+		case RECENT_EDIT:
+			empathy_theme_adium_edit_message (chat->view,
+				item->message);
+			break;
+		case RECENT_EVENT:
+			empathy_theme_adium_append_event (chat->view, item->text);
+			break;
+		case RECENT_EVENT_MARKUP:
+			empathy_theme_adium_append_event_markup (chat->view,
+				item->markup, item->text);
+			break;
+		}
+	}
+
+	/* Walk the logs again from the start, skipping what recent_items
+	 * already has. The scrolled window keeps its adjustment across views so
+	 * stop watching it until the first batch is in. */
+	adjustment = gtk_scrolled_window_get_vadjustment (
+		GTK_SCROLLED_WINDOW (priv->scrolled_window_chat));
+	g_signal_handlers_disconnect_by_func (adjustment,
+		chat_view_adjustment_changed_cb, chat);
+	g_signal_handlers_disconnect_by_func (adjustment,
+		chat_view_adjustment_value_changed_cb, chat);
+	priv->watch_scroll = FALSE;
+	priv->max_page_size = 0;
+
+	g_object_unref (priv->log_walker);
+	priv->log_walker = chat_create_log_walker (chat);
+
+	if (priv->handle_type != TP_HANDLE_TYPE_ROOM && priv->id != NULL)
+		chat_add_logs (chat);
+
+	if (priv->tp_chat != NULL)
+		chat_update_contacts_visibility (chat, priv->show_contacts);
+
+	/* the view only shows them, and then the logs, once its page is
+	 * loaded */
+	DEBUG ("Woke %s up: replaying %u recent items (%" G_GSIZE_FORMAT
+	       " bytes)", priv->id, g_queue_get_length (&priv->recent_items),
+	       chat_get_recent_items_size (chat));
+}
+
+gboolean
+empathy_chat_is_hibernated (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv;
+
+	g_return_val_if_fail (EMPATHY_IS_CHAT (chat), FALSE);
+
+	priv = GET_PRIV (chat);
+
+	return priv->hibernated;
+}
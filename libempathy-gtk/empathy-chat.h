@@ -102,6 +102,10 @@ void               empathy_chat_set_text             (EmpathyChat *self,
 void               empathy_chat_insert_smiley        (GtkTextBuffer *buffer,
                                                       EmpathySmiley *smiley);
 
+gboolean           empathy_chat_hibernate            (EmpathyChat *chat);
+void               empathy_chat_wake                 (EmpathyChat *chat);
+gboolean           empathy_chat_is_hibernated        (EmpathyChat *chat);
+
 G_END_DECLS
 
 #endif /* __EMPATHY_CHAT_H__ */
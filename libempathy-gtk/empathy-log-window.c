@@ -30,16 +30,19 @@
 #include <tp-account-widgets/tpaw-builder.h>
 #include <tp-account-widgets/tpaw-images.h>
 #include <tp-account-widgets/tpaw-camera-monitor.h>
+#include <tp-account-widgets/tpaw-time.h>
 #include <tp-account-widgets/tpaw-utils.h>
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
 #include "action-chain-internal.h"
 #include "empathy-account-chooser.h"
 #include "empathy-call-utils.h"
+#include "empathy-client-factory.h"
 #include "empathy-geometry.h"
 #include "empathy-gsettings.h"
 #include "empathy-images.h"
 #include "empathy-individual-information-dialog.h"
+#include "empathy-log-index.h"
 #include "empathy-request-util.h"
 #include "empathy-theme-manager.h"
 #include "empathy-ui-utils.h"
@@ -74,6 +77,24 @@ struct _EmpathyLogWindowPriv
   GtkWidget *webview;
 
   GtkTreeStore *store_events;
+  /* Row changes not sent to the webview yet, see
+   * log_window_queue_row_change() */
+  GString *pending_rows;
+  guint n_pending_rows;
+  guint flush_rows_id;
+  /* The last pending change if it is an insertion, and its offset in
+   * pending_rows */
+  GtkTreePath *last_insert;
+  gsize last_insert_offset;
+  /* owned icon name => owned filename, or "" */
+  GHashTable *icon_filenames;
+  /* owned conversation key => owned Conversation, the latest top-level
+   * row of each text conversation in store_events, see
+   * get_conversation_for_message() */
+  GHashTable *conversations;
+  /* TplEvents of the messages sent or received while the events were being
+   * fetched, see log_window_add_live_message() */
+  GQueue *live_events;
 
   GtkWidget *account_chooser;
 
@@ -84,6 +105,8 @@ struct _EmpathyLogWindowPriv
 
   TplActionChain *chain;
   TplLogManager *log_manager;
+  /* NULL if searching the index is disabled */
+  EmpathyLogIndex *log_index;
 
   /* Hash of TpChannel<->TpAccount for use by the observer until we can
    * get a TpAccount from a TpConnection or wherever */
@@ -99,6 +122,18 @@ struct _EmpathyLogWindowPriv
   /* Used to cancel logger calls when no longer needed */
   guint count;
 
+  /* DateFetches of the selected events, sorted by date. The ones before
+   * next_render have been shown and freed, see log_window_run_fetches() */
+  GPtrArray *fetches;
+  guint next_fetch;
+  guint next_render;
+  guint n_running;
+  GCancellable *fetch_cancellable;
+  /* monotonic time the fetches started at, and whether rows were shown
+   * since then, for the timings in the debug output */
+  gint64 fetch_time;
+  gboolean fetch_shown;
+
   /* List of owned TplLogSearchHits, free with tpl_log_search_hit_free */
   GList *hits;
   guint source;
@@ -135,18 +170,17 @@ static void log_window_when_changed_cb           (GtkTreeSelection *selection,
 static void log_window_delete_menu_clicked_cb    (GtkMenuItem      *menuitem,
                                                   EmpathyLogWindow *self);
 static void start_spinner                        (void);
+static void log_window_maybe_add_entity          (EmpathyLogWindow *self,
+                                                  TpChannel        *channel,
+                                                  TpAccount        *account);
+static void log_window_append_live_event         (EmpathyLogWindow *self,
+                                                  TplEvent         *event);
 
 static void log_window_create_observer           (EmpathyLogWindow *window);
 static gboolean log_window_events_button_press_event (GtkWidget *webview,
     GdkEventButton *event, EmpathyLogWindow *self);
 static void log_window_update_buttons_sensitivity (EmpathyLogWindow *self);
 
-static void
-empathy_account_chooser_filter_has_logs (TpAccount *account,
-    EmpathyAccountChooserFilterResultCallback callback,
-    gpointer callback_data,
-    gpointer user_data);
-
 enum
 {
   PAGE_EVENTS,
@@ -209,6 +243,19 @@ enum
 /* Seconds between two messages to be considered one conversation */
 #define MAX_GAP 30*60
 
+/* Days of events fetched from the logger at the same time */
+#define MAX_RUNNING_FETCHES 4
+
+/* store_events is a GtkTreeStore, so its iters stay valid until their row
+ * is removed */
+typedef struct
+{
+  GtkTreeIter parent;
+  /* the last message appended under parent, and its timestamp */
+  GtkTreeIter last_child;
+  gint64 last_timestamp;
+} Conversation;
+
 #define WHAT_TYPE_SEPARATOR -1
 
 typedef enum
@@ -349,6 +396,235 @@ toolbutton_av_clicked (GtkToolButton *toolbutton,
       video, gtk_get_current_event_time ());
 }
 
+/* Appends @str as a quoted JavaScript string */
+static void
+append_js_string (GString *script,
+    const gchar *str)
+{
+  const gchar *p;
+
+  g_string_append_c (script, '\'');
+
+  for (p = str; p != NULL && *p != '\0'; p++)
+    {
+      switch (*p)
+        {
+          case '\'':
+          case '\\':
+            g_string_append_c (script, '\\');
+            g_string_append_c (script, *p);
+            break;
+          case '\n':
+            g_string_append (script, "\\n");
+            break;
+          case '\r':
+            g_string_append (script, "\\r");
+            break;
+          default:
+            /* U+2028 and U+2029 end lines in JavaScript */
+            if (p[0] == '\xe2' && p[1] == '\x80' &&
+                (p[2] == '\xa8' || p[2] == '\xa9'))
+              {
+                g_string_append (script,
+                    p[2] == '\xa8' ? "\\u2028" : "\\u2029");
+                p += 2;
+              }
+            else
+              {
+                g_string_append_c (script, *p);
+              }
+        }
+    }
+
+  g_string_append_c (script, '\'');
+}
+
+static void
+log_window_icon_theme_changed_cb (EmpathyLogWindow *self)
+{
+  g_hash_table_remove_all (self->priv->icon_filenames);
+}
+
+static void
+conversation_free (Conversation *conversation)
+{
+  g_slice_free (Conversation, conversation);
+}
+
+/* The events of one day with one contact or room, fetched by
+ * log_window_run_fetches() */
+typedef struct
+{
+  Ctx *ctx;
+  /* the position it was queued at, to keep that order within a day */
+  guint index;
+  /* cancelled when the fetch is no longer needed */
+  GCancellable *cancellable;
+  gboolean running;
+  gboolean done;
+  /* owned TplEvents, once done */
+  GList *events;
+} DateFetch;
+
+static void
+date_fetch_free (DateFetch *fetch)
+{
+  ctx_free (fetch->ctx);
+  g_object_unref (fetch->cancellable);
+  g_list_free_full (fetch->events, g_object_unref);
+  g_slice_free (DateFetch, fetch);
+}
+
+/* The logger can't abort a request, so the running fetches are freed when
+ * their result arrives, and ignored */
+static void
+log_window_cancel_fetches (EmpathyLogWindow *self)
+{
+  guint i;
+
+  g_cancellable_cancel (self->priv->fetch_cancellable);
+  g_object_unref (self->priv->fetch_cancellable);
+  self->priv->fetch_cancellable = g_cancellable_new ();
+
+  for (i = 0; i < self->priv->fetches->len; i++)
+    {
+      DateFetch *fetch = g_ptr_array_index (self->priv->fetches, i);
+
+      /* NULL once shown */
+      if (fetch != NULL && !fetch->running)
+        date_fetch_free (fetch);
+    }
+
+  g_ptr_array_set_size (self->priv->fetches, 0);
+  self->priv->next_fetch = 0;
+  self->priv->next_render = 0;
+  self->priv->n_running = 0;
+}
+
+/* Removes all the events, and so the conversations pointing to them and
+ * the live events not shown yet, and stops fetching the previous ones */
+static void
+log_window_clear_events (EmpathyLogWindow *self)
+{
+  TplEvent *event;
+
+  log_window_cancel_fetches (self);
+
+  while ((event = g_queue_pop_head (self->priv->live_events)) != NULL)
+    g_object_unref (event);
+
+  g_hash_table_remove_all (self->priv->conversations);
+  gtk_tree_store_clear (self->priv->store_events);
+}
+
+/* The file of the @icon_name icon, looked up once per icon name */
+static const gchar *
+log_window_lookup_icon (EmpathyLogWindow *self,
+    const gchar *icon_name)
+{
+  GtkIconInfo *icon_info;
+  gchar *filename;
+
+  if (tp_str_empty (icon_name))
+    return "";
+
+  if (g_hash_table_lookup_extended (self->priv->icon_filenames, icon_name,
+        NULL, (gpointer *) &filename))
+    return filename;
+
+  icon_info = gtk_icon_theme_lookup_icon (gtk_icon_theme_get_default (),
+      icon_name, GTK_ICON_SIZE_MENU, 0);
+
+  if (icon_info != NULL && gtk_icon_info_get_filename (icon_info) != NULL)
+    filename = g_strdup (gtk_icon_info_get_filename (icon_info));
+  else
+    filename = g_strdup ("");
+
+  tp_clear_object (&icon_info);
+
+  g_hash_table_insert (self->priv->icon_filenames, g_strdup (icon_name),
+      filename);
+
+  return filename;
+}
+
+/* Sends the pending row changes to the webview */
+static void
+log_window_flush_rows (EmpathyLogWindow *self)
+{
+  if (self->priv->flush_rows_id != 0)
+    {
+      g_source_remove (self->priv->flush_rows_id);
+      self->priv->flush_rows_id = 0;
+    }
+
+  tp_clear_pointer (&self->priv->last_insert, gtk_tree_path_free);
+
+  if (self->priv->n_pending_rows == 0)
+    return;
+
+  g_string_append (self->priv->pending_rows, "]);");
+
+  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
+      self->priv->pending_rows->str);
+
+  g_string_truncate (self->priv->pending_rows, 0);
+  self->priv->n_pending_rows = 0;
+}
+
+static gboolean
+log_window_flush_rows_cb (gpointer user_data)
+{
+  EmpathyLogWindow *self = user_data;
+
+  self->priv->flush_rows_id = 0;
+  log_window_flush_rows (self);
+
+  return FALSE;
+}
+
+/* Row changes are queued and sent to the webview in a single script per
+ * main loop iteration, before it is redrawn, so a day of logs is laid out
+ * once rather than once per row. Scripts which don't change rows have to
+ * call log_window_flush_rows() first. */
+static void
+log_window_queue_row_change (EmpathyLogWindow *self,
+    const gchar *method,
+    GtkTreePath *path,
+    const gchar *args)
+{
+  GString *script = self->priv->pending_rows;
+  gint *indices;
+  gint depth, i;
+
+  tp_clear_pointer (&self->priv->last_insert, gtk_tree_path_free);
+
+  if (self->priv->n_pending_rows++ == 0)
+    g_string_assign (script, "javascript:applyRowChanges([");
+  else
+    g_string_append_c (script, ',');
+
+  g_string_append_printf (script, "['%s',[", method);
+
+  indices = gtk_tree_path_get_indices_with_depth (path, &depth);
+  for (i = 0; i < depth; i++)
+    g_string_append_printf (script, i == 0 ? "%d" : ",%d", indices[i]);
+
+  g_string_append_c (script, ']');
+
+  if (args != NULL)
+    {
+      g_string_append_c (script, ',');
+      g_string_append (script, args);
+    }
+
+  g_string_append_c (script, ']');
+
+  if (self->priv->flush_rows_id == 0)
+    self->priv->flush_rows_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+        log_window_flush_rows_cb, self, NULL);
+}
+
 static void
 insert_or_change_row (EmpathyLogWindow *self,
     const char *method,
@@ -356,11 +632,9 @@ insert_or_change_row (EmpathyLogWindow *self,
     GtkTreePath *path,
     GtkTreeIter *iter)
 {
-  char *str = gtk_tree_path_to_string (path);
-  char *script, *text, *date, *stock_icon;
-  GString *escaped_text;
-  char *icon = NULL;
-  gint i;
+  char *text, *date, *stock_icon;
+  GString *args;
+  gsize offset;
 
   gtk_tree_model_get (model, iter,
       COL_EVENTS_TEXT, &text,
@@ -368,53 +642,38 @@ insert_or_change_row (EmpathyLogWindow *self,
       COL_EVENTS_ICON, &stock_icon,
       -1);
 
-  if (!tp_str_empty (stock_icon))
+  args = g_string_new (NULL);
+  append_js_string (args, text);
+  g_string_append_c (args, ',');
+  append_js_string (args, log_window_lookup_icon (self, stock_icon));
+  g_string_append_c (args, ',');
+  append_js_string (args, date);
+
+  /* Rows are inserted empty and then set, so the insertion is replaced by
+   * one with the row's contents */
+  if (!tp_strdiff (method, "changeRow") &&
+      self->priv->last_insert != NULL &&
+      gtk_tree_path_compare (path, self->priv->last_insert) == 0)
     {
-      GtkIconInfo *icon_info = gtk_icon_theme_lookup_icon (
-          gtk_icon_theme_get_default (),
-          stock_icon,
-          GTK_ICON_SIZE_MENU, 0);
-
-      if (icon_info != NULL)
-        icon = g_strdup (gtk_icon_info_get_filename (icon_info));
-
-      g_object_unref (icon_info);
+      g_string_truncate (self->priv->pending_rows,
+          self->priv->last_insert_offset);
+      self->priv->n_pending_rows--;
+      method = "insertRow";
     }
 
-  escaped_text = g_string_new (NULL);
+  offset = self->priv->pending_rows->len;
+  log_window_queue_row_change (self, method, path, args->str);
 
-  /* Only need to deal with «'» and «\».
-   *
-   * Note that these never appear in non-ascii utf8 characters, so just
-   * pretend like we have an ascii string...
-   */
-  for (i = 0; text && text[i]; i++)
+  if (!tp_strdiff (method, "insertRow"))
     {
-      gchar c = text[i];
-
-      if (c == '\'' || c == '\\')
-        g_string_append_c (escaped_text, '\\');
-
-      g_string_append_c (escaped_text, c);
+      self->priv->last_insert = gtk_tree_path_copy (path);
+      self->priv->last_insert_offset = offset;
     }
 
-  script = g_strdup_printf ("javascript:%s([%s], '%s', '%s', '%s');",
-      method,
-      g_strdelimit (str, ":", ','),
-      escaped_text->str,
-      icon != NULL ? icon : "",
-      date);
-
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
-      script);
-
-  g_string_free (escaped_text, TRUE);
-  g_free (str);
+  g_string_free (args, TRUE);
   g_free (text);
   g_free (date);
   g_free (stock_icon);
-  g_free (icon);
-  g_free (script);
 }
 
 static void
@@ -440,17 +699,7 @@ store_events_row_deleted (GtkTreeModel *model,
     GtkTreePath *path,
     EmpathyLogWindow *self)
 {
-  char *str = gtk_tree_path_to_string (path);
-  char *script;
-
-  script = g_strdup_printf ("javascript:deleteRow([%s]);",
-      g_strdelimit (str, ":", ','));
-
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
-      script);
-
-  g_free (str);
-  g_free (script);
+  log_window_queue_row_change (self, "deleteRow", path, NULL);
 }
 
 static void
@@ -459,18 +708,8 @@ store_events_has_child_rows (GtkTreeModel *model,
     GtkTreeIter *iter,
     EmpathyLogWindow *self)
 {
-  char *str = gtk_tree_path_to_string (path);
-  char *script;
-
-  script = g_strdup_printf ("javascript:hasChildRows([%s], %u);",
-      g_strdelimit (str, ":", ','),
-      gtk_tree_model_iter_has_child (model, iter));
-
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
-      script);
-
-  g_free (str);
-  g_free (script);
+  log_window_queue_row_change (self, "hasChildRows", path,
+      gtk_tree_model_iter_has_child (model, iter) ? "1" : "0");
 }
 
 static void
@@ -480,29 +719,19 @@ store_events_rows_reordered (GtkTreeModel *model,
     int *new_order,
     EmpathyLogWindow *self)
 {
-  char *str = gtk_tree_path_to_string (path);
   int i, children = gtk_tree_model_iter_n_children (model, iter);
-  char **new_order_strv, *new_order_s;
-  char *script;
+  GString *args;
 
-  new_order_strv = g_new0 (char *, children + 1);
+  args = g_string_new ("[");
 
   for (i = 0; i < children; i++)
-    new_order_strv[i] = g_strdup_printf ("%i", new_order[i]);
-
-  new_order_s = g_strjoinv (",", new_order_strv);
+    g_string_append_printf (args, i == 0 ? "%i" : ",%i", new_order[i]);
 
-  script = g_strdup_printf ("javascript:reorderRows([%s], [%s]);",
-      str == NULL ? "" : g_strdelimit (str, ":", ','),
-      new_order_s);
+  g_string_append_c (args, ']');
 
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
-      script);
+  log_window_queue_row_change (self, "reorderRows", path, args->str);
 
-  g_free (str);
-  g_free (script);
-  g_free (new_order_s);
-  g_strfreev (new_order_strv);
+  g_string_free (args, TRUE);
 }
 
 static gboolean
@@ -554,6 +783,14 @@ empathy_log_window_dispose (GObject *object)
       self->priv->source = 0;
     }
 
+  if (self->priv->flush_rows_id != 0)
+    {
+      g_source_remove (self->priv->flush_rows_id);
+      self->priv->flush_rows_id = 0;
+    }
+
+  tp_clear_pointer (&self->priv->last_insert, gtk_tree_path_free);
+
   if (self->priv->current_dates != NULL)
     {
       g_list_free_full (self->priv->current_dates,
@@ -562,10 +799,12 @@ empathy_log_window_dispose (GObject *object)
     }
 
   tp_clear_pointer (&self->priv->chain, _tpl_action_chain_free);
+  log_window_cancel_fetches (self);
   tp_clear_pointer (&self->priv->channels, g_hash_table_unref);
 
   tp_clear_object (&self->priv->observer);
   tp_clear_object (&self->priv->log_manager);
+  tp_clear_object (&self->priv->log_index);
   tp_clear_object (&self->priv->selected_account);
   tp_clear_object (&self->priv->selected_contact);
   tp_clear_object (&self->priv->events_contact);
@@ -586,6 +825,12 @@ empathy_log_window_finalize (GObject *object)
 
   g_free (self->priv->last_find);
   g_free (self->priv->selected_chat_id);
+  g_string_free (self->priv->pending_rows, TRUE);
+  g_hash_table_unref (self->priv->icon_filenames);
+  g_hash_table_unref (self->priv->conversations);
+  g_queue_free_full (self->priv->live_events, g_object_unref);
+  g_ptr_array_unref (self->priv->fetches);
+  g_object_unref (self->priv->fetch_cancellable);
 
   G_OBJECT_CLASS (empathy_log_window_parent_class)->finalize (object);
 }
@@ -613,6 +858,7 @@ empathy_log_window_init (EmpathyLogWindow *self)
   GFile *gfile;
   GtkWidget *vbox, *accounts, *search, *label, *closeitem;
   GtkWidget *scrolledwindow_events;
+  GSettings *gsettings;
   gchar *uri;
 
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
@@ -620,10 +866,31 @@ empathy_log_window_init (EmpathyLogWindow *self)
 
   self->priv->chain = _tpl_action_chain_new_async (NULL, NULL, NULL);
 
+  self->priv->pending_rows = g_string_new (NULL);
+  self->priv->icon_filenames = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, g_free);
+  g_signal_connect_object (gtk_icon_theme_get_default (), "changed",
+      G_CALLBACK (log_window_icon_theme_changed_cb), self,
+      G_CONNECT_SWAPPED);
+  self->priv->conversations = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) conversation_free);
+  self->priv->live_events = g_queue_new ();
+  self->priv->fetches = g_ptr_array_new ();
+  self->priv->fetch_cancellable = g_cancellable_new ();
+
   self->priv->camera_monitor = tpaw_camera_monitor_dup_singleton ();
 
   self->priv->log_manager = tpl_log_manager_dup_singleton ();
 
+  gsettings = g_settings_new (EMPATHY_PREFS_SCHEMA);
+  if (g_settings_get_boolean (gsettings, EMPATHY_PREFS_LOG_SEARCH_INDEX))
+    {
+      /* Searches go to the logger until the index has caught up */
+      self->priv->log_index = empathy_log_index_dup_singleton ();
+      empathy_log_index_sync (self->priv->log_index);
+    }
+  g_object_unref (gsettings);
+
   self->priv->gsettings_chat = g_settings_new (EMPATHY_PREFS_CHAT_SCHEMA);
   self->priv->gsettings_desktop = g_settings_new (
       EMPATHY_PREFS_DESKTOP_INTERFACE_SCHEMA);
@@ -823,39 +1090,19 @@ entity_equal (TplEntity *a,
       tpl_entity_get_identifier (b));
 }
 
+/* Whether events are being fetched for the selection, in which case they
+ * may or may not include the ones the logger is storing right now */
 static gboolean
-is_same_confroom (TplEvent *e1,
-    TplEvent *e2)
+log_window_is_fetching (EmpathyLogWindow *self)
 {
-  TplEntity *sender1 = tpl_event_get_sender (e1);
-  TplEntity *receiver1 = tpl_event_get_receiver (e1);
-  TplEntity *sender2 = tpl_event_get_sender (e2);
-  TplEntity *receiver2 = tpl_event_get_receiver (e2);
-  TplEntity *room1, *room2;
-
-  if (receiver1 == NULL || receiver2 == NULL)
-    return FALSE;
-
-  if (tpl_entity_get_entity_type (sender1) == TPL_ENTITY_ROOM)
-    room1 = sender1;
-  else if (tpl_entity_get_entity_type (receiver1) == TPL_ENTITY_ROOM)
-    room1 = receiver1;
-  else
-    return FALSE;
-
-  if (tpl_entity_get_entity_type (sender2) == TPL_ENTITY_ROOM)
-    room2 = sender2;
-  else if (tpl_entity_get_entity_type (receiver2) == TPL_ENTITY_ROOM)
-    room2 = receiver2;
-  else
-    return FALSE;
-
-  return g_str_equal (tpl_entity_get_identifier (room1),
-      tpl_entity_get_identifier (room2));
+  return self->priv->fetches->len > 0 || self->priv->chain->running ||
+      !g_queue_is_empty (self->priv->chain->chain);
 }
 
-static void
-maybe_refresh_logs (TpChannel *channel,
+/* Whether the events of @channel are in the selected logs */
+static gboolean
+log_window_channel_is_selected (EmpathyLogWindow *self,
+    TpChannel *channel,
     TpAccount *account)
 {
   GList *accounts = NULL, *entities = NULL, *dates = NULL;
@@ -863,15 +1110,18 @@ maybe_refresh_logs (TpChannel *channel,
   TplEventTypeMask event_mask;
   GDate *anytime = NULL, *today = NULL;
   GDateTime *now = NULL;
-  gboolean refresh = FALSE;
+  gboolean selected = FALSE;
   gboolean anyone;
   const gchar *type;
 
-  if (!log_window_get_selected (log_window,
+  if (account == NULL)
+    return FALSE;
+
+  if (!log_window_get_selected (self,
       &accounts, &entities, &anyone, &dates, &event_mask, NULL))
     {
       DEBUG ("Could not get selected rows");
-      return;
+      return FALSE;
     }
 
   type = tp_channel_get_channel_type (channel);
@@ -899,7 +1149,7 @@ maybe_refresh_logs (TpChannel *channel,
 
   if (anyone)
     {
-      refresh = TRUE;
+      selected = TRUE;
       goto out;
     }
 
@@ -913,7 +1163,7 @@ maybe_refresh_logs (TpChannel *channel,
       if (!tp_strdiff (tp_channel_get_identifier (channel),
                        tpl_entity_get_identifier (ent->data)))
         {
-          refresh = TRUE;
+          selected = TRUE;
           break;
         }
     }
@@ -926,16 +1176,215 @@ maybe_refresh_logs (TpChannel *channel,
   g_list_free_full (entities, g_object_unref);
   g_list_free_full (dates, (GFreeFunc) g_date_free);
 
-  if (refresh)
+  return selected;
+}
+
+/* The logger has just logged an event of @account, which makes it
+ * selectable in the account chooser if it had no logs */
+static void
+log_window_account_has_logs (EmpathyLogWindow *self,
+    TpAccount *account)
+{
+  if (empathy_account_chooser_filter_has_logs_add (account))
+    empathy_account_chooser_refilter (
+        EMPATHY_ACCOUNT_CHOOSER (self->priv->account_chooser));
+}
+
+static void
+maybe_refresh_logs (TpChannel *channel,
+    TpAccount *account)
+{
+  if (account != NULL)
     {
-      DEBUG ("Refreshing logs after received event");
+      log_window_account_has_logs (log_window, account);
+      log_window_maybe_add_entity (log_window, channel, account);
+    }
+
+  if (log_window_channel_is_selected (log_window, channel, account))
+    {
+      DEBUG ("Refreshing logs after call ended");
 
-      /* FIXME:  We need to populate the entities in case we
-       * didn't have any previous logs with this contact. */
       log_window_chats_get_messages (log_window, FALSE);
     }
 }
 
+/* The timestamp the logger gives @message */
+static gint64
+message_get_timestamp (TpMessage *message)
+{
+  gint64 timestamp;
+
+  timestamp = tp_message_get_sent_timestamp (message);
+  if (timestamp == 0)
+    timestamp = tp_message_get_received_timestamp (message);
+  if (timestamp == 0)
+    timestamp = tpaw_time_get_current ();
+
+  return timestamp;
+}
+
+/* The contact or room @channel is with */
+static TplEntity *
+channel_dup_remote_entity (TpChannel *channel)
+{
+  TpHandleType handle_type;
+  TpContact *contact;
+
+  tp_channel_get_handle (channel, &handle_type);
+
+  if (handle_type == TP_HANDLE_TYPE_ROOM)
+    return tpl_entity_new_from_room_id (tp_channel_get_identifier (channel));
+
+  contact = tp_channel_get_target_contact (channel);
+  if (contact != NULL)
+    return tpl_entity_new_from_tp_contact (contact, TPL_ENTITY_CONTACT);
+
+  return tpl_entity_new (tp_channel_get_identifier (channel),
+      TPL_ENTITY_CONTACT, NULL, NULL);
+}
+
+/* The event the logger stores for @message, or NULL if we don't know our
+ * own contact yet */
+static TplEvent *
+log_window_dup_text_event (TpChannel *channel,
+    TpAccount *account,
+    TpMessage *message,
+    gboolean sent)
+{
+  TpContact *self_contact, *sender_contact;
+  TplEntity *self_entity, *remote, *sender, *receiver;
+  TplEvent *event;
+  gchar *text;
+
+  self_contact = tp_connection_get_self_contact (
+      tp_channel_get_connection (channel));
+  if (self_contact == NULL)
+    return NULL;
+
+  self_entity = tpl_entity_new_from_tp_contact (self_contact,
+      TPL_ENTITY_SELF);
+  remote = channel_dup_remote_entity (channel);
+  sender_contact = tp_signalled_message_get_sender (message);
+
+  if (sent)
+    {
+      sender = g_object_ref (self_entity);
+      receiver = g_object_ref (remote);
+    }
+  else if (tpl_entity_get_entity_type (remote) == TPL_ENTITY_ROOM)
+    {
+      /* Messages received in a room are sent to the room by one of its
+       * members */
+      if (sender_contact != NULL)
+        sender = tpl_entity_new_from_tp_contact (sender_contact,
+            TPL_ENTITY_CONTACT);
+      else
+        sender = g_object_ref (remote);
+
+      receiver = g_object_ref (remote);
+    }
+  else
+    {
+      sender = g_object_ref (remote);
+      receiver = g_object_ref (self_entity);
+    }
+
+  text = tp_message_to_text (message, NULL);
+
+  event = g_object_new (TPL_TYPE_TEXT_EVENT,
+      "account", account,
+      "timestamp", message_get_timestamp (message),
+      "sender", sender,
+      "receiver", receiver,
+      "message-type", tp_message_get_message_type (message),
+      "message", text,
+      "message-token", tp_message_get_token (message),
+      "supersedes-token", tp_message_get_supersedes (message),
+      NULL);
+
+  g_free (text);
+  g_object_unref (self_entity);
+  g_object_unref (remote);
+  g_object_unref (sender);
+  g_object_unref (receiver);
+
+  return event;
+}
+
+/* Shows @message in the selected logs, if it's part of them, without
+ * fetching them again */
+static void
+log_window_add_live_message (EmpathyLogWindow *self,
+    TpChannel *channel,
+    TpAccount *account,
+    TpMessage *message,
+    gboolean sent)
+{
+  TplEvent *event;
+
+  if (account == NULL)
+    return;
+
+  log_window_account_has_logs (self, account);
+  log_window_maybe_add_entity (self, channel, account);
+
+  if (!log_window_channel_is_selected (self, channel, account))
+    return;
+
+  event = log_window_dup_text_event (channel, account, message, sent);
+  if (event == NULL)
+    {
+      DEBUG ("Refreshing logs after received event");
+
+      log_window_chats_get_messages (self, FALSE);
+      return;
+    }
+
+  /* Shown once the events have been fetched, unless they include it */
+  if (log_window_is_fetching (self))
+    {
+      g_queue_push_tail (self->priv->live_events, event);
+      return;
+    }
+
+  log_window_append_live_event (self, event);
+  g_object_unref (event);
+}
+
+/* Adds the message to the log index, with the timestamp the logger gives
+ * it so later syncs don't index it again */
+static void
+log_window_index_message (EmpathyLogWindow *self,
+    TpChannel *channel,
+    TpAccount *account,
+    TpMessage *message)
+{
+  TpHandleType handle_type;
+  TpContact *contact;
+  const gchar *alias;
+  gchar *text;
+
+  if (self->priv->log_index == NULL || account == NULL)
+    return;
+
+  tp_channel_get_handle (channel, &handle_type);
+  contact = tp_channel_get_target_contact (channel);
+
+  if (contact != NULL)
+    alias = tp_contact_get_alias (contact);
+  else
+    alias = tp_channel_get_identifier (channel);
+
+  text = tp_message_to_text (message, NULL);
+
+  empathy_log_index_add_text (self->priv->log_index,
+      tp_proxy_get_object_path (account), tp_channel_get_identifier (channel),
+      alias, handle_type == TP_HANDLE_TYPE_ROOM,
+      message_get_timestamp (message), text);
+
+  g_free (text);
+}
+
 static void
 on_msg_sent (TpTextChannel *channel,
     TpSignalledMessage *message,
@@ -945,7 +1394,10 @@ on_msg_sent (TpTextChannel *channel,
 {
   TpAccount *account = g_hash_table_lookup (self->priv->channels, channel);
 
-  maybe_refresh_logs (TP_CHANNEL (channel), account);
+  log_window_index_message (self, TP_CHANNEL (channel), account,
+      TP_MESSAGE (message));
+  log_window_add_live_message (self, TP_CHANNEL (channel), account,
+      TP_MESSAGE (message), TRUE);
 }
 
 static void
@@ -961,7 +1413,9 @@ on_msg_received (TpTextChannel *channel,
       type != TP_CHANNEL_TEXT_MESSAGE_TYPE_ACTION)
     return;
 
-  maybe_refresh_logs (TP_CHANNEL (channel), account);
+  log_window_index_message (self, TP_CHANNEL (channel), account, msg);
+  log_window_add_live_message (self, TP_CHANNEL (channel), account, msg,
+      FALSE);
 }
 
 static void
@@ -1082,53 +1536,34 @@ event_get_target (TplEvent *event)
   return sender;
 }
 
-static gboolean
-model_is_parent (GtkTreeModel *model,
-    GtkTreeIter *iter,
-    TplEvent *event)
+/* The room @event was sent in, or NULL */
+static TplEntity *
+event_get_room (TplEvent *event)
 {
-  TplEvent *stored_event;
-  TplEntity *target;
-  TpAccount *account;
-  gboolean found = FALSE;
-  GtkTreeIter parent;
-
-  if (gtk_tree_model_iter_parent (model, &parent, iter))
-    return FALSE;
-
-  gtk_tree_model_get (model, iter,
-      COL_EVENTS_ACCOUNT, &account,
-      COL_EVENTS_TARGET, &target,
-      COL_EVENTS_EVENT, &stored_event,
-      -1);
-
-  if (G_OBJECT_TYPE (event) == G_OBJECT_TYPE (stored_event) &&
-      account_equal (account, tpl_event_get_account (event)) &&
-      (entity_equal (target, event_get_target (event)) ||
-      is_same_confroom (event, stored_event)))
-    {
-      GtkTreeIter child;
-      gint64 timestamp;
+  TplEntity *sender = tpl_event_get_sender (event);
+  TplEntity *receiver = tpl_event_get_receiver (event);
 
-      gtk_tree_model_iter_nth_child (model, &child, iter,
-          gtk_tree_model_iter_n_children (model, iter) - 1);
+  if (tpl_entity_get_entity_type (sender) == TPL_ENTITY_ROOM)
+    return sender;
 
-      gtk_tree_model_get (model, &child,
-          COL_EVENTS_TS, &timestamp,
-          -1);
+  if (receiver != NULL &&
+      tpl_entity_get_entity_type (receiver) == TPL_ENTITY_ROOM)
+    return receiver;
 
-      if (ABS (tpl_event_get_timestamp (event) - timestamp) < MAX_GAP)
-        {
-          /* The gap is smaller than 30 min */
-          found = TRUE;
-        }
-    }
+  return NULL;
+}
 
-  g_object_unref (stored_event);
-  g_object_unref (account);
-  g_object_unref (target);
+/* Messages sent in a room are one conversation, whoever their target */
+static gchar *
+conversation_key_for_event (TplEvent *event)
+{
+  TplEntity *room = event_get_room (event);
 
-  return found;
+  return g_strdup_printf ("%s %s %s",
+      tp_proxy_get_object_path (tpl_event_get_account (event)),
+      room != NULL ? "room" : "contact",
+      tpl_entity_get_identifier (room != NULL ?
+        room : event_get_target (event)));
 }
 
 static gchar *
@@ -1166,48 +1601,42 @@ get_display_string_for_chat_message (EmpathyMessage *message,
   return g_markup_printf_escaped (format, empathy_contact_get_alias (target));
 }
 
-static void
-get_parent_iter_for_message (TplEvent *event,
-    EmpathyMessage *message,
-    GtkTreeIter *parent)
+/* Looks up the conversation @event belongs to, creating a new one if
+ * there was a gap of more than MAX_GAP since its last message */
+static Conversation *
+get_conversation_for_message (TplEvent *event,
+    EmpathyMessage *message)
 {
-  GtkTreeStore *store;
-  GtkTreeModel *model;
-  GtkTreeIter iter;
-  gboolean parent_found = FALSE;
-  gboolean next;
+  GtkTreeStore *store = log_window->priv->store_events;
+  Conversation *conversation;
+  gint64 timestamp = tpl_event_get_timestamp (event);
+  gchar *key;
 
-  store = log_window->priv->store_events;
-  model = GTK_TREE_MODEL (store);
+  key = conversation_key_for_event (event);
+  conversation = g_hash_table_lookup (log_window->priv->conversations, key);
 
-  for (next = gtk_tree_model_get_iter_first (model, &iter);
-       next;
-       next = gtk_tree_model_iter_next (model, &iter))
+  if (conversation != NULL &&
+      ABS (timestamp - conversation->last_timestamp) < MAX_GAP)
     {
-      if ((parent_found = model_is_parent (model, &iter, event)))
-        break;
-    }
-
-  if (parent_found)
-    {
-      *parent = iter;
+      /* The gap is smaller than 30 min */
+      g_free (key);
     }
   else
     {
       GDateTime *date;
       gchar *body, *pretty_date;
 
-      date = g_date_time_new_from_unix_local (
-          tpl_event_get_timestamp (event));
+      date = g_date_time_new_from_unix_local (timestamp);
 
       pretty_date = g_date_time_format (date,
           C_("A date with the time", "%A, %e %B %Y %X"));
 
       body = get_display_string_for_chat_message (message, event);
 
-      gtk_tree_store_append (store, &iter, NULL);
-      gtk_tree_store_set (store, &iter,
-          COL_EVENTS_TS, tpl_event_get_timestamp (event),
+      conversation = g_slice_new0 (Conversation);
+      gtk_tree_store_append (store, &conversation->parent, NULL);
+      gtk_tree_store_set (store, &conversation->parent,
+          COL_EVENTS_TS, timestamp,
           COL_EVENTS_PRETTY_DATE, pretty_date,
           COL_EVENTS_TEXT, body,
           COL_EVENTS_ICON, "format-justify-fill",
@@ -1216,12 +1645,19 @@ get_parent_iter_for_message (TplEvent *event,
           COL_EVENTS_EVENT, event,
           -1);
 
-      *parent = iter;
+      /* Later messages go to this new row, the previous one is over */
+      g_hash_table_insert (log_window->priv->conversations, key,
+          conversation);
 
       g_free (body);
       g_free (pretty_date);
       g_date_time_unref (date);
     }
+
+  /* The message is appended under the parent right away */
+  conversation->last_timestamp = timestamp;
+
+  return conversation;
 }
 
 static const gchar *
@@ -1259,7 +1695,8 @@ log_window_append_chat_message (TplEvent *event,
     EmpathyMessage *message)
 {
   GtkTreeStore *store = log_window->priv->store_events;
-  GtkTreeIter iter, parent;
+  Conversation *conversation;
+  GtkTreeIter iter;
   gchar *pretty_date, *alias, *body;
   GDateTime *date;
   TpawStringParser *parsers;
@@ -1270,7 +1707,7 @@ log_window_append_chat_message (TplEvent *event,
 
   pretty_date = g_date_time_format (date, "%X");
 
-  get_parent_iter_for_message (event, message, &parent);
+  conversation = get_conversation_for_message (event, message);
 
   alias = g_markup_escape_text (
       tpl_entity_get_alias (tpl_event_get_sender (event)), -1);
@@ -1297,7 +1734,7 @@ log_window_append_chat_message (TplEvent *event,
       body = g_strdup_printf (_("<b>%s:</b> %s"), alias, msg->str);
     }
 
-  gtk_tree_store_append (store, &iter, &parent);
+  gtk_tree_store_append (store, &iter, &conversation->parent);
   gtk_tree_store_set (store, &iter,
       COL_EVENTS_TS, tpl_event_get_timestamp (event),
       COL_EVENTS_PRETTY_DATE, pretty_date,
@@ -1308,6 +1745,8 @@ log_window_append_chat_message (TplEvent *event,
       COL_EVENTS_EVENT, event,
       -1);
 
+  conversation->last_child = iter;
+
   g_string_free (msg, TRUE);
   g_free (body);
   g_free (alias);
@@ -1630,7 +2069,11 @@ model_has_date (GtkTreeModel *model,
 }
 
 static void
-get_events_for_date (TplActionChain *chain, gpointer user_data);
+log_window_queue_fetch (EmpathyLogWindow *self,
+    Ctx *ctx);
+
+static void
+log_window_start_fetches (EmpathyLogWindow *self);
 
 static void
 populate_events_from_search_hits (GList *accounts,
@@ -1684,13 +2127,11 @@ populate_events_from_search_hits (GList *accounts,
 
           ctx = ctx_new (log_window, hit->account, hit->target, hit->date,
               event_mask, subtype, log_window->priv->count);
-          _tpl_action_chain_append (log_window->priv->chain,
-              get_events_for_date, ctx);
+          log_window_queue_fetch (log_window, ctx);
         }
     }
 
-  start_spinner ();
-  _tpl_action_chain_start (log_window->priv->chain);
+  log_window_start_fetches (log_window);
 
   g_date_free (anytime);
 }
@@ -1926,24 +2367,87 @@ populate_entities_from_search_hits (void)
         }
     }
 
-  if (gtk_tree_model_get_iter_first (model, &iter))
-    {
-      gtk_list_store_prepend (store, &iter);
-      gtk_list_store_set (store, &iter,
-          COL_WHO_TYPE, COL_TYPE_SEPARATOR,
-          COL_WHO_NAME, "separator",
-          -1);
+  if (gtk_tree_model_get_iter_first (model, &iter))
+    {
+      gtk_list_store_prepend (store, &iter);
+      gtk_list_store_set (store, &iter,
+          COL_WHO_TYPE, COL_TYPE_SEPARATOR,
+          COL_WHO_NAME, "separator",
+          -1);
+
+      gtk_list_store_prepend (store, &iter);
+      gtk_list_store_set (store, &iter,
+          COL_WHO_TYPE, COL_TYPE_ANY,
+          COL_WHO_NAME, _("Anyone"),
+          -1);
+    }
+
+  /* Select 'Anyone' */
+  if (gtk_tree_model_get_iter_first (model, &iter))
+    gtk_tree_selection_select_iter (selection, &iter);
+}
+
+/* Adds the contact or room of @channel to the Who pane if we had no logs
+ * with them when it was filled */
+static void
+log_window_maybe_add_entity (EmpathyLogWindow *self,
+    TpChannel *channel,
+    TpAccount *account)
+{
+  EmpathyAccountChooser *account_chooser;
+  TpAccount *selected;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  TplLogSearchHit hit = { NULL, };
+
+  /* The Who pane has the search results, or is being filled */
+  if (self->priv->hits != NULL || log_window_is_fetching (self))
+    return;
+
+  account_chooser = EMPATHY_ACCOUNT_CHOOSER (self->priv->account_chooser);
+  selected = empathy_account_chooser_get_account (account_chooser);
+
+  if (!empathy_account_chooser_has_all_selected (account_chooser) &&
+      (selected == NULL || !account_equal (selected, account)))
+    return;
+
+  model = gtk_tree_view_get_model (GTK_TREE_VIEW (self->priv->treeview_who));
+
+  /* Let it add the 'Anyone' row too */
+  if (!gtk_tree_model_get_iter_first (model, &iter))
+    {
+      log_window_who_populate (self);
+      return;
+    }
+
+  hit.account = account;
+  hit.target = channel_dup_remote_entity (channel);
+
+  has_element = FALSE;
+  gtk_tree_model_foreach (model, model_has_entity, &hit);
+  if (!has_element)
+    add_event_to_store (self, account, hit.target);
+
+  g_object_unref (hit.target);
+}
+
+static void
+log_window_set_search_hits (GList *hits)
+{
+  GtkTreeView *view;
+  GtkTreeSelection *selection;
+
+  tp_clear_pointer (&log_window->priv->hits, tpl_log_manager_search_free);
+  log_window->priv->hits = hits;
+
+  view = GTK_TREE_VIEW (log_window->priv->treeview_when);
+  selection = gtk_tree_view_get_selection (view);
 
-      gtk_list_store_prepend (store, &iter);
-      gtk_list_store_set (store, &iter,
-          COL_WHO_TYPE, COL_TYPE_ANY,
-          COL_WHO_NAME, _("Anyone"),
-          -1);
-    }
+  g_signal_handlers_unblock_by_func (selection,
+      log_window_when_changed_cb,
+      log_window);
 
-  /* Select 'Anyone' */
-  if (gtk_tree_model_get_iter_first (model, &iter))
-    gtk_tree_selection_select_iter (selection, &iter);
+  populate_entities_from_search_hits ();
 }
 
 static void
@@ -1952,8 +2456,6 @@ log_manager_searched_new_cb (GObject *manager,
     gpointer user_data)
 {
   GList *hits;
-  GtkTreeView *view;
-  GtkTreeSelection *selection;
   GError *error = NULL;
 
   if (log_window == NULL)
@@ -1967,17 +2469,45 @@ log_manager_searched_new_cb (GObject *manager,
       return;
     }
 
-  tp_clear_pointer (&log_window->priv->hits, tpl_log_manager_search_free);
-  log_window->priv->hits = hits;
+  log_window_set_search_hits (hits);
+}
 
-  view = GTK_TREE_VIEW (log_window->priv->treeview_when);
-  selection = gtk_tree_view_get_selection (view);
+/* The hits of the log index, as the logger would give them */
+static GList *
+log_window_search_index (EmpathyLogWindow *self,
+    const gchar *search_criteria)
+{
+  EmpathyClientFactory *factory;
+  GList *index_hits, *l;
+  GList *hits = NULL;
 
-  g_signal_handlers_unblock_by_func (selection,
-      log_window_when_changed_cb,
-      log_window);
+  factory = empathy_client_factory_dup ();
+  index_hits = empathy_log_index_search (self->priv->log_index,
+      search_criteria, NULL, NULL, NULL);
 
-  populate_entities_from_search_hits ();
+  for (l = index_hits; l != NULL; l = g_list_next (l))
+    {
+      EmpathyLogIndexHit *index_hit = l->data;
+      TplLogSearchHit *hit;
+
+      /* allocated like the logger's, as tpl_log_manager_search_free()
+       * frees them */
+      hit = g_slice_new0 (TplLogSearchHit);
+      hit->account = tp_simple_client_factory_ensure_account (
+          TP_SIMPLE_CLIENT_FACTORY (factory), index_hit->account_path,
+          NULL, NULL);
+      hit->target = tpl_entity_new (index_hit->target_id,
+          index_hit->is_chatroom ? TPL_ENTITY_ROOM : TPL_ENTITY_CONTACT,
+          index_hit->target_alias, NULL);
+      hit->date = g_date_new_julian (g_date_get_julian (&index_hit->date));
+
+      hits = g_list_prepend (hits, hit);
+    }
+
+  g_list_free_full (index_hits, (GDestroyNotify) empathy_log_index_hit_free);
+  g_object_unref (factory);
+
+  return g_list_reverse (hits);
 }
 
 static void
@@ -1989,7 +2519,7 @@ log_window_find_populate (EmpathyLogWindow *self,
   GtkTreeSelection *selection;
   GtkListStore *store;
 
-  gtk_tree_store_clear (self->priv->store_events);
+  log_window_clear_events (self);
 
   view = GTK_TREE_VIEW (self->priv->treeview_who);
   model = gtk_tree_view_get_model (view);
@@ -2021,6 +2551,14 @@ log_window_find_populate (EmpathyLogWindow *self,
   webkit_web_view_mark_text_matches (WEBKIT_WEB_VIEW (self->priv->webview),
       search_criteria, FALSE, 0);
 
+  if (self->priv->log_index != NULL &&
+      empathy_log_index_is_ready (self->priv->log_index))
+    {
+      log_window_set_search_hits (
+          log_window_search_index (self, search_criteria));
+      return;
+    }
+
   tpl_log_manager_search_async (self->priv->log_manager,
       search_criteria, TPL_EVENT_MASK_ANY,
       log_manager_searched_new_cb, NULL);
@@ -2753,7 +3291,7 @@ log_window_chats_accounts_changed_cb (GtkWidget *combobox,
     EmpathyLogWindow *self)
 {
   /* Clear all current messages shown in the textview */
-  gtk_tree_store_clear (self->priv->store_events);
+  log_window_clear_events (self);
 
   log_window_who_populate (self);
 }
@@ -3139,6 +3677,8 @@ log_window_maybe_expand_events (void)
 {
   GtkTreeModel      *model = GTK_TREE_MODEL (log_window->priv->store_events);
 
+  log_window_flush_rows (log_window);
+
   /* If there's only one result, expand it */
   if (gtk_tree_model_iter_n_children (model, NULL) == 1)
     webkit_web_view_execute_script (
@@ -3146,6 +3686,122 @@ log_window_maybe_expand_events (void)
         "javascript:expandAll()");
 }
 
+/* Scrolls to the last conversation or call */
+static void
+log_window_scroll_to_last_row (EmpathyLogWindow *self)
+{
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  gint n;
+
+  model = GTK_TREE_MODEL (self->priv->store_events);
+  n = gtk_tree_model_iter_n_children (model, NULL) - 1;
+
+  if (n >= 0 && gtk_tree_model_iter_nth_child (model, &iter, NULL, n))
+    {
+      GtkTreePath *path;
+      char *str, *script;
+
+      path = gtk_tree_model_get_path (model, &iter);
+      str = gtk_tree_path_to_string (path);
+
+      script = g_strdup_printf ("javascript:scrollToRow([%s]);",
+          g_strdelimit (str, ":", ','));
+
+      /* the rows are rendered before scrolling to them */
+      log_window_flush_rows (self);
+      webkit_web_view_execute_script (
+          WEBKIT_WEB_VIEW (self->priv->webview),
+          script);
+
+      gtk_tree_path_free (path);
+      g_free (str);
+      g_free (script);
+    }
+}
+
+static gboolean
+text_event_equal (TplEvent *a,
+    TplEvent *b)
+{
+  return TPL_IS_TEXT_EVENT (a) && TPL_IS_TEXT_EVENT (b) &&
+      tpl_event_get_timestamp (a) == tpl_event_get_timestamp (b) &&
+      entity_equal (tpl_event_get_sender (a), tpl_event_get_sender (b)) &&
+      !tp_strdiff (tpl_text_event_get_message (TPL_TEXT_EVENT (a)),
+          tpl_text_event_get_message (TPL_TEXT_EVENT (b)));
+}
+
+/* Whether the fetched events already had the live @event */
+static gboolean
+log_window_has_text_event (EmpathyLogWindow *self,
+    TplEvent *event)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (self->priv->store_events);
+  Conversation *conversation;
+  GtkTreeIter iter;
+  gint64 timestamp = tpl_event_get_timestamp (event);
+  gint64 ts;
+  gboolean found = FALSE;
+  gchar *key;
+
+  key = conversation_key_for_event (event);
+  conversation = g_hash_table_lookup (self->priv->conversations, key);
+  g_free (key);
+
+  if (conversation == NULL || conversation->last_timestamp < timestamp)
+    return FALSE;
+
+  /* The messages are sorted, so only the last ones can be as recent */
+  iter = conversation->last_child;
+  do
+    {
+      TplEvent *shown;
+
+      gtk_tree_model_get (model, &iter,
+          COL_EVENTS_TS, &ts,
+          COL_EVENTS_EVENT, &shown,
+          -1);
+
+      found = text_event_equal (event, shown);
+      g_object_unref (shown);
+    }
+  while (!found && ts >= timestamp &&
+      gtk_tree_model_iter_previous (model, &iter));
+
+  return found;
+}
+
+static void
+log_window_append_live_event (EmpathyLogWindow *self,
+    TplEvent *event)
+{
+  EmpathyMessage *message;
+
+  if (log_window_has_text_event (self, event))
+    return;
+
+  message = empathy_message_from_tpl_log_event (event);
+  log_window_append_message (event, message);
+  g_object_unref (message);
+
+  log_window_maybe_expand_events ();
+  log_window_scroll_to_last_row (self);
+}
+
+/* Appends the events queued by log_window_add_live_message() while the
+ * selected ones were being fetched */
+static void
+log_window_append_live_events (EmpathyLogWindow *self)
+{
+  TplEvent *event;
+
+  while ((event = g_queue_pop_head (self->priv->live_events)) != NULL)
+    {
+      log_window_append_live_event (self, event);
+      g_object_unref (event);
+    }
+}
+
 static gboolean
 show_spinner (gpointer data)
 {
@@ -3164,15 +3820,13 @@ show_spinner (gpointer data)
 }
 
 static void
-show_events (TplActionChain *chain,
-    gpointer user_data)
+show_events (void)
 {
+  log_window_append_live_events (log_window);
   log_window_maybe_expand_events ();
   gtk_spinner_stop (GTK_SPINNER (log_window->priv->spinner));
   gtk_notebook_set_current_page (GTK_NOTEBOOK (log_window->priv->notebook),
       PAGE_EVENTS);
-
-  _tpl_action_chain_continue (chain);
 }
 
 static void
@@ -3183,39 +3837,13 @@ start_spinner (void)
       PAGE_EMPTY);
 
   g_timeout_add (1000, show_spinner, NULL);
-  _tpl_action_chain_append (log_window->priv->chain, show_events, NULL);
 }
 
 static void
-log_window_got_messages_for_date_cb (GObject *manager,
-    GAsyncResult *result,
-    gpointer user_data)
+log_window_append_events (Ctx *ctx,
+    GList *events)
 {
-  Ctx *ctx = user_data;
-  GtkTreeModel *model;
-  GtkTreeIter iter;
-  GList *events;
   GList *l;
-  GError *error = NULL;
-  gint n;
-
-  if (log_window == NULL)
-    {
-      ctx_free (ctx);
-      return;
-    }
-
-  if (log_window->priv->count != ctx->count)
-    goto out;
-
-  if (!tpl_log_manager_get_events_for_date_finish (TPL_LOG_MANAGER (manager),
-      result, &events, &error))
-    {
-      DEBUG ("Unable to retrieve messages for the selected date: %s. Aborting",
-          error->message);
-      g_error_free (error);
-      goto out;
-    }
 
   for (l = events; l; l = l->next)
     {
@@ -3265,50 +3893,161 @@ log_window_got_messages_for_date_cb (GObject *manager,
           log_window_append_message (event, msg);
           tp_clear_object (&msg);
         }
-
-      g_object_unref (event);
     }
-  g_list_free (events);
-
-  model = GTK_TREE_MODEL (log_window->priv->store_events);
-  n = gtk_tree_model_iter_n_children (model, NULL) - 1;
-
-  if (n >= 0 && gtk_tree_model_iter_nth_child (model, &iter, NULL, n))
-    {
-      GtkTreePath *path;
-      char *str, *script;
+}
 
-      path = gtk_tree_model_get_path (model, &iter);
-      str = gtk_tree_path_to_string (path);
+static void
+log_window_run_fetches (EmpathyLogWindow *self);
 
-      script = g_strdup_printf ("javascript:scrollToRow([%s]);",
-          g_strdelimit (str, ":", ','));
+static void
+log_window_got_messages_for_date_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  DateFetch *fetch = user_data;
+  EmpathyLogWindow *self = fetch->ctx->self;
+  GError *error = NULL;
 
-      webkit_web_view_execute_script (
-          WEBKIT_WEB_VIEW (log_window->priv->webview),
-          script);
+  if (g_cancellable_is_cancelled (fetch->cancellable))
+    {
+      /* Not in self->priv->fetches any more, and self may be gone */
+      date_fetch_free (fetch);
+      return;
+    }
 
-      gtk_tree_path_free (path);
-      g_free (str);
-      g_free (script);
+  if (!tpl_log_manager_get_events_for_date_finish (TPL_LOG_MANAGER (manager),
+      result, &fetch->events, &error))
+    {
+      DEBUG ("Unable to retrieve messages for the selected date: %s. Aborting",
+          error->message);
+      g_error_free (error);
     }
 
- out:
-  ctx_free (ctx);
+  fetch->running = FALSE;
+  fetch->done = TRUE;
+  self->priv->n_running--;
 
-  _tpl_action_chain_continue (log_window->priv->chain);
+  log_window_run_fetches (self);
 }
 
 static void
-get_events_for_date (TplActionChain *chain, gpointer user_data)
+get_events_for_date (DateFetch *fetch)
 {
-  Ctx *ctx = user_data;
+  Ctx *ctx = fetch->ctx;
+
+  fetch->running = TRUE;
 
   tpl_log_manager_get_events_for_date_async (ctx->self->priv->log_manager,
       ctx->account, ctx->entity, ctx->event_mask,
       ctx->date,
       log_window_got_messages_for_date_cb,
-      ctx);
+      fetch);
+}
+
+/* Shows the days which have been fetched and have no earlier day still
+ * being fetched, then starts fetching the next ones */
+static void
+log_window_run_fetches (EmpathyLogWindow *self)
+{
+  GPtrArray *fetches = self->priv->fetches;
+  gboolean shown = FALSE;
+
+  while (self->priv->next_render < fetches->len)
+    {
+      DateFetch *fetch = g_ptr_array_index (fetches,
+          self->priv->next_render);
+
+      if (!fetch->done)
+        break;
+
+      log_window_append_events (fetch->ctx, fetch->events);
+      date_fetch_free (fetch);
+      g_ptr_array_index (fetches, self->priv->next_render) = NULL;
+      self->priv->next_render++;
+      shown = TRUE;
+    }
+
+  if (shown)
+    {
+      log_window_scroll_to_last_row (self);
+
+      if (!self->priv->fetch_shown && gtk_tree_model_iter_n_children (
+              GTK_TREE_MODEL (self->priv->store_events), NULL) > 0)
+        {
+          DEBUG ("First events shown after %" G_GINT64_FORMAT " ms",
+              (g_get_monotonic_time () - self->priv->fetch_time) / 1000);
+
+          self->priv->fetch_shown = TRUE;
+          gtk_spinner_stop (GTK_SPINNER (self->priv->spinner));
+          gtk_notebook_set_current_page (
+              GTK_NOTEBOOK (self->priv->notebook), PAGE_EVENTS);
+        }
+    }
+
+  while (self->priv->n_running < MAX_RUNNING_FETCHES &&
+      self->priv->next_fetch < fetches->len)
+    {
+      get_events_for_date (g_ptr_array_index (fetches,
+            self->priv->next_fetch));
+      self->priv->next_fetch++;
+      self->priv->n_running++;
+    }
+
+  if (self->priv->next_render == fetches->len)
+    {
+      DEBUG ("%u days of events fetched in %" G_GINT64_FORMAT " ms",
+          fetches->len,
+          (g_get_monotonic_time () - self->priv->fetch_time) / 1000);
+
+      g_ptr_array_set_size (fetches, 0);
+      self->priv->next_fetch = 0;
+      self->priv->next_render = 0;
+
+      show_events ();
+    }
+}
+
+/* Takes @ctx */
+static void
+log_window_queue_fetch (EmpathyLogWindow *self,
+    Ctx *ctx)
+{
+  DateFetch *fetch = g_slice_new0 (DateFetch);
+
+  fetch->ctx = ctx;
+  fetch->index = self->priv->fetches->len;
+  fetch->cancellable = g_object_ref (self->priv->fetch_cancellable);
+
+  g_ptr_array_add (self->priv->fetches, fetch);
+}
+
+static gint
+date_fetch_compare (gconstpointer a,
+    gconstpointer b)
+{
+  const DateFetch *fetch_a = *(DateFetch **) a;
+  const DateFetch *fetch_b = *(DateFetch **) b;
+  gint ret;
+
+  ret = g_date_compare (fetch_a->ctx->date, fetch_b->ctx->date);
+  if (ret == 0)
+    ret = (fetch_a->index > fetch_b->index) - (fetch_a->index < fetch_b->index);
+
+  return ret;
+}
+
+/* Fetches the days queued with log_window_queue_fetch(), a few at a time,
+ * and shows them in chronological order */
+static void
+log_window_start_fetches (EmpathyLogWindow *self)
+{
+  g_ptr_array_sort (self->priv->fetches, date_fetch_compare);
+
+  self->priv->fetch_time = g_get_monotonic_time ();
+  self->priv->fetch_shown = FALSE;
+
+  start_spinner ();
+  log_window_run_fetches (self);
 }
 
 static void
@@ -3348,7 +4087,7 @@ log_window_get_messages_for_dates (EmpathyLogWindow *self,
 
               ctx = ctx_new (self, account, target, date, event_mask, subtype,
                   self->priv->count);
-              _tpl_action_chain_append (self->priv->chain, get_events_for_date, ctx);
+              log_window_queue_fetch (self, ctx);
             }
           else
             {
@@ -3373,7 +4112,7 @@ log_window_get_messages_for_dates (EmpathyLogWindow *self,
                     {
                       ctx = ctx_new (self, account, target, d,
                           event_mask, subtype, self->priv->count);
-                      _tpl_action_chain_append (self->priv->chain, get_events_for_date, ctx);
+                      log_window_queue_fetch (self, ctx);
                     }
 
                   g_date_free (d);
@@ -3382,8 +4121,7 @@ log_window_get_messages_for_dates (EmpathyLogWindow *self,
         }
     }
 
-  start_spinner ();
-  _tpl_action_chain_start (self->priv->chain);
+  log_window_start_fetches (self);
 
   g_list_free_full (accounts, g_object_unref);
   g_list_free_full (targets, g_object_unref);
@@ -3560,7 +4298,7 @@ log_window_chats_get_messages (EmpathyLogWindow *self,
   store = GTK_LIST_STORE (model);
 
   /* Clear all current messages shown in the textview */
-  gtk_tree_store_clear (self->priv->store_events);
+  log_window_clear_events (self);
 
   _tpl_action_chain_clear (self->priv->chain);
   self->priv->count++;
@@ -3660,52 +4398,24 @@ log_window_chats_get_messages (EmpathyLogWindow *self,
   g_list_free_full (dates, (GFreeFunc) g_date_free);
 }
 
-typedef struct {
-  EmpathyAccountChooserFilterResultCallback callback;
-  gpointer user_data;
-} FilterCallbackData;
-
+/* Even when searches don't use the index anymore, it may still have the
+ * deleted messages on the disk */
 static void
-got_entities (GObject *manager,
-    GAsyncResult *result,
-    gpointer user_data)
+log_window_clear_index (const gchar *account_path)
 {
-  FilterCallbackData *data = user_data;
-  GList *entities;
+  EmpathyLogIndex *log_index;
   GError *error = NULL;
 
-  if (!tpl_log_manager_get_entities_finish (TPL_LOG_MANAGER (manager),
-      result, &entities, &error))
+  log_index = empathy_log_index_dup_singleton ();
+  empathy_log_index_clear (log_index, account_path);
+
+  if (!empathy_log_index_save (log_index, &error))
     {
-      DEBUG ("Could not get entities: %s", error->message);
+      DEBUG ("Failed to save the log index: %s", error->message);
       g_error_free (error);
-      data->callback (FALSE, data->user_data);
     }
-  else
-    {
-      data->callback (entities != NULL, data->user_data);
-
-      g_list_free_full (entities, g_object_unref);
-    }
-
-  g_slice_free (FilterCallbackData, data);
-}
-
-static void
-empathy_account_chooser_filter_has_logs (TpAccount *account,
-    EmpathyAccountChooserFilterResultCallback callback,
-    gpointer callback_data,
-    gpointer user_data)
-{
-  TplLogManager *manager = tpl_log_manager_dup_singleton ();
-  FilterCallbackData *cb_data = g_slice_new0 (FilterCallbackData);
-
-  cb_data->callback = callback;
-  cb_data->user_data = callback_data;
-
-  tpl_log_manager_get_entities_async (manager, account, got_entities, cb_data);
 
-  g_object_unref (manager);
+  g_object_unref (log_index);
 }
 
 static void
@@ -3717,15 +4427,22 @@ log_window_logger_clear_account_cb (TpProxy *proxy,
   EmpathyLogWindow *self = EMPATHY_LOG_WINDOW (user_data);
 
   if (error != NULL)
-    g_warning ("Error when clearing logs: %s", error->message);
+    {
+      g_warning ("Error when clearing logs: %s", error->message);
+
+      /* index back the logs which are still there */
+      if (self->priv->log_index != NULL)
+        empathy_log_index_sync (self->priv->log_index);
+    }
 
   /* Refresh the log viewer so the logs are cleared if the account
    * has been deleted */
-  gtk_tree_store_clear (self->priv->store_events);
+  log_window_clear_events (self);
   log_window_who_populate (self);
 
   /* Re-filter the account chooser so the accounts without logs get
    * greyed out */
+  empathy_account_chooser_filter_has_logs_reset ();
   empathy_account_chooser_refilter (
       EMPATHY_ACCOUNT_CHOOSER (self->priv->account_chooser));
 }
@@ -3801,6 +4518,7 @@ log_window_delete_menu_clicked_cb (GtkMenuItem *menuitem,
     {
       DEBUG ("Deleting logs for all the accounts");
 
+      log_window_clear_index (NULL);
       emp_cli_logger_call_clear (logger, -1,
           log_window_logger_clear_account_cb,
           self, NULL, G_OBJECT (self));
@@ -3813,6 +4531,7 @@ log_window_delete_menu_clicked_cb (GtkMenuItem *menuitem,
 
       DEBUG ("Deleting logs for %s", tp_proxy_get_object_path (account));
 
+      log_window_clear_index (tp_proxy_get_object_path (account));
       emp_cli_logger_call_clear_account (logger, -1,
           tp_proxy_get_object_path (account),
           log_window_logger_clear_account_cb,
@@ -23,7 +23,7 @@
 #include <libnotify/notify.h>
 #include <tp-account-widgets/tpaw-pixbuf-utils.h>
 
-#include "empathy-gsettings.h"
+#include "empathy-settings-snapshot.h"
 #include "empathy-ui-utils.h"
 #include "empathy-utils.h"
 
@@ -37,7 +37,7 @@ typedef struct
   /* owned (gchar *) => TRUE */
   GHashTable *capabilities;
   TpAccountManager *account_manager;
-  GSettings *gsettings_notif;
+  EmpathySettingsSnapshot *settings;
 } EmpathyNotifyManagerPriv;
 
 G_DEFINE_TYPE (EmpathyNotifyManager, empathy_notify_manager, G_TYPE_OBJECT);
@@ -74,7 +74,7 @@ notify_manager_dispose (GObject *object)
       priv->account_manager = NULL;
     }
 
-  tp_clear_object (&priv->gsettings_notif);
+  tp_clear_object (&priv->settings);
 
   G_OBJECT_CLASS (empathy_notify_manager_parent_class)->dispose (object);
 }
@@ -126,7 +126,7 @@ empathy_notify_manager_init (EmpathyNotifyManager *self)
 
   self->priv = priv;
 
-  priv->gsettings_notif = g_settings_new (EMPATHY_PREFS_NOTIFICATIONS_SCHEMA);
+  priv->settings = empathy_settings_snapshot_dup_singleton ();
 
   priv->capabilities = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
       NULL);
@@ -186,8 +186,7 @@ empathy_notify_manager_notification_is_enabled  (EmpathyNotifyManager *self)
   EmpathyNotifyManagerPriv *priv = GET_PRIV (self);
   TpConnectionPresenceType presence;
 
-  if (!g_settings_get_boolean (priv->gsettings_notif,
-        EMPATHY_PREFS_NOTIFICATIONS_ENABLED))
+  if (!EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings, notifications_enabled))
     return FALSE;
 
   if (!tp_proxy_is_prepared (priv->account_manager,
@@ -204,8 +203,8 @@ empathy_notify_manager_notification_is_enabled  (EmpathyNotifyManager *self)
   if (presence != TP_CONNECTION_PRESENCE_TYPE_AVAILABLE &&
       presence != TP_CONNECTION_PRESENCE_TYPE_UNSET)
     {
-      if (g_settings_get_boolean (priv->gsettings_notif,
-            EMPATHY_PREFS_NOTIFICATIONS_DISABLED_AWAY))
+      if (EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings,
+            notifications_disabled_away))
         return FALSE;
     }
 
@@ -22,8 +22,8 @@
 
 #include <glib/gi18n-lib.h>
 
-#include "empathy-gsettings.h"
 #include "empathy-presence-manager.h"
+#include "empathy-settings-snapshot.h"
 #include "empathy-utils.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_OTHER
@@ -33,9 +33,13 @@ typedef struct {
   EmpathySound sound_id;
   const char * event_ca_id;
   const char * event_ca_description;
-  const char * key;
+  /* offset of the EmpathySettingsSnapshot field caching the sound's key */
+  glong pref_offset;
 } EmpathySoundEntry;
 
+#define SOUND_PREF(field) G_STRUCT_OFFSET (EmpathySettingsSnapshot, field)
+#define NO_SOUND_PREF -1
+
 typedef struct {
   GtkWidget *widget;
   gint sound_id;
@@ -47,25 +51,25 @@ typedef struct {
 /* NOTE: these entries MUST be in the same order than EmpathySound enum */
 static EmpathySoundEntry sound_entries[LAST_EMPATHY_SOUND] = {
   { EMPATHY_SOUND_MESSAGE_INCOMING, "message-new-instant",
-    N_("Received an instant message"), EMPATHY_PREFS_SOUNDS_INCOMING_MESSAGE } ,
+    N_("Received an instant message"), SOUND_PREF (sounds_incoming_message) } ,
   { EMPATHY_SOUND_MESSAGE_OUTGOING, "message-sent-instant",
-    N_("Sent an instant message"), EMPATHY_PREFS_SOUNDS_OUTGOING_MESSAGE } ,
+    N_("Sent an instant message"), SOUND_PREF (sounds_outgoing_message) } ,
   { EMPATHY_SOUND_CONVERSATION_NEW, "message-new-instant",
-    N_("Incoming chat request"), EMPATHY_PREFS_SOUNDS_NEW_CONVERSATION },
+    N_("Incoming chat request"), SOUND_PREF (sounds_new_conversation) },
   { EMPATHY_SOUND_CONTACT_CONNECTED, "service-login",
-    N_("Contact connected"), EMPATHY_PREFS_SOUNDS_CONTACT_LOGIN },
+    N_("Contact connected"), SOUND_PREF (sounds_contact_login) },
   { EMPATHY_SOUND_CONTACT_DISCONNECTED, "service-logout",
-    N_("Contact disconnected"), EMPATHY_PREFS_SOUNDS_CONTACT_LOGOUT },
+    N_("Contact disconnected"), SOUND_PREF (sounds_contact_logout) },
   { EMPATHY_SOUND_ACCOUNT_CONNECTED, "service-login",
-    N_("Connected to server"), EMPATHY_PREFS_SOUNDS_SERVICE_LOGIN },
+    N_("Connected to server"), SOUND_PREF (sounds_service_login) },
   { EMPATHY_SOUND_ACCOUNT_DISCONNECTED, "service-logout",
-    N_("Disconnected from server"), EMPATHY_PREFS_SOUNDS_SERVICE_LOGOUT },
+    N_("Disconnected from server"), SOUND_PREF (sounds_service_logout) },
   { EMPATHY_SOUND_PHONE_INCOMING, "phone-incoming-call",
-    N_("Incoming voice call"), NULL },
+    N_("Incoming voice call"), NO_SOUND_PREF },
   { EMPATHY_SOUND_PHONE_OUTGOING, "phone-outgoing-calling",
-    N_("Outgoing voice call"), NULL },
+    N_("Outgoing voice call"), NO_SOUND_PREF },
   { EMPATHY_SOUND_PHONE_HANGUP, "phone-hangup",
-    N_("Voice call ended"), NULL },
+    N_("Voice call ended"), NO_SOUND_PREF },
 };
 
 G_DEFINE_TYPE (EmpathySoundManager, empathy_sound_manager, G_TYPE_OBJECT)
@@ -77,7 +81,7 @@ struct _EmpathySoundManagerPrivate
    * Key: An EmpathySound
    * Value : The EmpathyRepeatableSound associated with that EmpathySound. */
   GHashTable *repeating_sounds;
-  GSettings *gsettings_sound;
+  EmpathySettingsSnapshot *settings;
 };
 
 static void
@@ -86,7 +90,7 @@ empathy_sound_manager_dispose (GObject *object)
   EmpathySoundManager *self = (EmpathySoundManager *) object;
 
   tp_clear_pointer (&self->priv->repeating_sounds, g_hash_table_unref);
-  tp_clear_object (&self->priv->gsettings_sound);
+  tp_clear_object (&self->priv->settings);
 
   G_OBJECT_CLASS (empathy_sound_manager_parent_class)->dispose (object);
 }
@@ -145,7 +149,7 @@ empathy_sound_manager_init (EmpathySoundManager *self)
   self->priv->repeating_sounds = g_hash_table_new_full (NULL, NULL,
       NULL, repeating_sounds_item_delete);
 
-  self->priv->gsettings_sound = g_settings_new (EMPATHY_PREFS_SOUNDS_SCHEMA);
+  self->priv->settings = empathy_settings_snapshot_dup_singleton ();
 }
 
 EmpathySoundManager *
@@ -210,21 +214,21 @@ empathy_sound_pref_is_enabled (EmpathySoundManager *self,
   entry = &(sound_entries[sound_id]);
   g_return_val_if_fail (entry->sound_id == sound_id, FALSE);
 
-  if (entry->key == NULL)
+  if (entry->pref_offset == NO_SOUND_PREF)
     return TRUE;
 
-  if (! g_settings_get_boolean (self->priv->gsettings_sound,
-      EMPATHY_PREFS_SOUNDS_ENABLED))
+  if (!EMPATHY_SETTINGS_SNAPSHOT_GET (self->priv->settings, sounds_enabled))
     return FALSE;
 
   if (!empathy_check_available_state ())
     {
-      if (g_settings_get_boolean (self->priv->gsettings_sound,
-            EMPATHY_PREFS_SOUNDS_DISABLED_AWAY))
+      if (EMPATHY_SETTINGS_SNAPSHOT_GET (self->priv->settings,
+            sounds_disabled_away))
         return FALSE;
     }
 
-  return g_settings_get_boolean (self->priv->gsettings_sound, entry->key);
+  return empathy_settings_snapshot_get_boolean_by_offset (self->priv->settings,
+      entry->pref_offset);
 }
 
 /**
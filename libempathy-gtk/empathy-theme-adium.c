@@ -31,6 +31,7 @@
 #include "empathy-gsettings.h"
 #include "empathy-images.h"
 #include "empathy-plist.h"
+#include "empathy-settings-snapshot.h"
 #include "empathy-smiley-manager.h"
 #include "empathy-ui-utils.h"
 #include "empathy-utils.h"
@@ -62,7 +63,7 @@ struct _EmpathyThemeAdiumPriv
   GQueue acked_messages;
   GtkWidget *inspector_window;
 
-  GSettings *gsettings_chat;
+  EmpathySettingsSnapshot *settings;
   GSettings *gsettings_desktop;
 
   gboolean has_focus;
@@ -71,6 +72,11 @@ struct _EmpathyThemeAdiumPriv
   gchar *variant;
   gboolean in_construction;
   gboolean show_avatars;
+
+  /* messages and events added since the template was loaded, and the size
+   * of their HTML */
+  guint n_items;
+  gsize html_size;
 };
 
 struct _EmpathyAdiumData
@@ -123,6 +129,7 @@ enum
 {
   QUEUED_EVENT,
   QUEUED_MESSAGE,
+  QUEUED_READ_MESSAGE,
   QUEUED_EDIT
 };
 
@@ -230,6 +237,8 @@ theme_adium_load_template (EmpathyThemeAdium *self)
   gchar *template;
 
   self->priv->pages_loading++;
+  self->priv->n_items = 0;
+  self->priv->html_size = 0;
   basedir_uri = g_strconcat ("file://", self->priv->data->basedir, NULL);
 
   variant_path = adium_info_dup_path_for_variant (self->priv->data->info,
@@ -256,8 +265,7 @@ theme_adium_parse_body (EmpathyThemeAdium *self,
 
   /* Check if we have to parse smileys */
   parsers = empathy_webkit_get_string_parser (
-    g_settings_get_boolean (self->priv->gsettings_chat,
-      EMPATHY_PREFS_CHAT_SHOW_SMILEYS));
+    EMPATHY_SETTINGS_SNAPSHOT_GET (self->priv->settings, chat_show_smileys));
 
   /* Parse text and construct string with links and smileys replaced
    * by html tags. Also escape text to make sure html code is
@@ -729,6 +737,9 @@ theme_adium_add_html (EmpathyThemeAdium *self,
     }
   g_string_append (string, "\")");
 
+  self->priv->n_items++;
+  self->priv->html_size += string->len;
+
   bytes = g_resources_lookup_data ("/org/gnome/Empathy/Chat/empathy-chat.js",
       G_RESOURCE_LOOKUP_FLAGS_NONE,
       NULL);
@@ -1108,6 +1119,36 @@ empathy_theme_adium_append_message (EmpathyThemeAdium *self,
       should_highlight, js_funcs);
 }
 
+/* Append a message the user has already seen, so it doesn't get the unread
+ * marker even if the view isn't focused */
+void
+empathy_theme_adium_append_read_message (EmpathyThemeAdium *self,
+    EmpathyMessage *msg,
+    gboolean should_highlight)
+{
+  const gchar *js_funcs[] = { "appendNextMessage",
+      "appendNextMessageNoScroll",
+      "appendMessage",
+      "appendMessageNoScroll" };
+  gboolean has_focus;
+
+  if (self->priv->pages_loading != 0)
+    {
+      queue_item (&self->priv->message_queue, QUEUED_READ_MESSAGE, msg, NULL,
+          should_highlight, FALSE);
+      return;
+    }
+
+  has_focus = self->priv->has_focus;
+  self->priv->has_focus = TRUE;
+
+  theme_adium_add_message (self, msg, &self->priv->last_contact,
+      &self->priv->last_timestamp, &self->priv->last_is_backlog,
+      should_highlight, js_funcs);
+
+  self->priv->has_focus = has_focus;
+}
+
 void
 empathy_theme_adium_append_event (EmpathyThemeAdium *self,
     const gchar *str)
@@ -1299,6 +1340,28 @@ empathy_theme_adium_clear (EmpathyThemeAdium *self)
     }
 }
 
+/**
+ * empathy_theme_adium_get_content_size:
+ * @self: an #EmpathyThemeAdium
+ * @n_items: (out) (allow-none): the number of messages and events shown
+ * @html_size: (out) (allow-none): the size of their HTML, in bytes
+ *
+ * Tells how much @self shows, which is what its memory use mostly depends
+ * on.
+ */
+void
+empathy_theme_adium_get_content_size (EmpathyThemeAdium *self,
+    guint *n_items,
+    gsize *html_size)
+{
+  g_return_if_fail (EMPATHY_IS_THEME_ADIUM (self));
+
+  if (n_items != NULL)
+    *n_items = self->priv->n_items;
+  if (html_size != NULL)
+    *html_size = self->priv->html_size;
+}
+
 gboolean
 empathy_theme_adium_find_previous (EmpathyThemeAdium *self,
     const gchar *search_criteria,
@@ -1455,8 +1518,8 @@ theme_adium_context_menu_cb (EmpathyThemeAdium *self,
   GtkWidget *menu;
   EmpathyWebKitMenuFlags flags = EMPATHY_WEBKIT_MENU_CLEAR;
 
-  if (g_settings_get_boolean (self->priv->gsettings_chat,
-        EMPATHY_PREFS_CHAT_WEBKIT_DEVELOPER_TOOLS))
+  if (EMPATHY_SETTINGS_SNAPSHOT_GET (self->priv->settings,
+        chat_webkit_developer_tools))
     flags |= EMPATHY_WEBKIT_MENU_INSPECT;
 
   menu = empathy_webkit_create_context_menu (
@@ -1503,6 +1566,11 @@ theme_adium_load_finished_cb (WebKitWebView *view,
               item->should_highlight);
             break;
 
+          case QUEUED_READ_MESSAGE:
+            empathy_theme_adium_append_read_message (self, item->msg,
+              item->should_highlight);
+            break;
+
           case QUEUED_EDIT:
             empathy_theme_adium_edit_message (self, item->msg);
             break;
@@ -1525,7 +1593,7 @@ theme_adium_finalize (GObject *object)
 
   empathy_adium_data_unref (self->priv->data);
 
-  g_object_unref (self->priv->gsettings_chat);
+  g_object_unref (self->priv->settings);
   g_object_unref (self->priv->gsettings_desktop);
 
   g_free (self->priv->variant);
@@ -1772,7 +1840,7 @@ empathy_theme_adium_init (EmpathyThemeAdium *self)
   g_signal_connect (self, "context-menu",
       G_CALLBACK (theme_adium_context_menu_cb), NULL);
 
-  self->priv->gsettings_chat = g_settings_new (EMPATHY_PREFS_CHAT_SCHEMA);
+  self->priv->settings = empathy_settings_snapshot_dup_singleton ();
   self->priv->gsettings_desktop = g_settings_new (
     EMPATHY_PREFS_DESKTOP_INTERFACE_SCHEMA);
 }
@@ -80,6 +80,10 @@ void empathy_theme_adium_append_message (EmpathyThemeAdium *self,
     EmpathyMessage *msg,
     gboolean should_highlight);
 
+void empathy_theme_adium_append_read_message (EmpathyThemeAdium *self,
+    EmpathyMessage *msg,
+    gboolean should_highlight);
+
 void empathy_theme_adium_append_event (EmpathyThemeAdium *self,
     const gchar *str);
 
@@ -103,6 +107,10 @@ gboolean empathy_theme_adium_get_has_selection (EmpathyThemeAdium *self);
 
 void empathy_theme_adium_clear (EmpathyThemeAdium *self);
 
+void empathy_theme_adium_get_content_size (EmpathyThemeAdium *self,
+    guint *n_items,
+    gsize *html_size);
+
 gboolean empathy_theme_adium_find_previous (EmpathyThemeAdium *self,
     const gchar *search_criteria,
     gboolean new_search,
@@ -716,37 +716,57 @@ empathy_send_file (EmpathyContact *contact,
   g_object_unref (factory);
 }
 
-void
-empathy_send_file_from_uri_list (EmpathyContact *contact,
-    const gchar *uri_list)
+/* Sends @files as one batch, so the FT manager can report their overall
+ * progress. */
+static void
+send_files (EmpathyContact *contact,
+    GList *files)
 {
-  const gchar *nl;
-  GFile *file;
+  EmpathyFTFactory *factory;
+  GtkRecentManager *manager;
+  GList *l;
+
+  factory = empathy_ft_factory_dup_singleton ();
+
+  empathy_ft_factory_new_transfers_outgoing (factory, contact, files,
+      empathy_get_current_action_time ());
+
+  manager = gtk_recent_manager_get_default ();
 
-  /* Only handle a single file for now. It would be wicked cool to be
-     able to do multiple files, offering to zip them or whatever like
-     nautilus-sendto does. Note that text/uri-list is defined to have
-     each line terminated by \r\n, but we can be tolerant of applications
-     that only use \n or don't terminate single-line entries.
-  */
-  nl = strstr (uri_list, "\r\n");
-  if (!nl)
-    nl = strchr (uri_list, '\n');
-
-  if (nl)
+  for (l = files; l != NULL; l = g_list_next (l))
     {
-      gchar *uri = g_strndup (uri_list, nl - uri_list);
-      file = g_file_new_for_uri (uri);
+      gchar *uri = g_file_get_uri (l->data);
+
+      gtk_recent_manager_add_item (manager, uri);
       g_free (uri);
     }
-  else
-    {
-      file = g_file_new_for_uri (uri_list);
-    }
 
-  empathy_send_file (contact, file);
+  g_object_unref (factory);
+}
+
+void
+empathy_send_file_from_uri_list (EmpathyContact *contact,
+    const gchar *uri_list)
+{
+  GList *files = NULL;
+  gchar **uris;
+  guint i;
+
+  g_return_if_fail (EMPATHY_IS_CONTACT (contact));
+
+  /* text/uri-list is defined to have each line terminated by \r\n, but
+   * this also copes with applications only using \n or not terminating
+   * single-line entries. */
+  uris = g_uri_list_extract_uris (uri_list);
+
+  for (i = 0; uris[i] != NULL; i++)
+    files = g_list_prepend (files, g_file_new_for_uri (uris[i]));
 
-  g_object_unref (file);
+  files = g_list_reverse (files);
+  send_files (contact, files);
+
+  g_list_free_full (files, g_object_unref);
+  g_strfreev (uris);
 }
 
 static void
@@ -754,15 +774,21 @@ file_manager_send_file_response_cb (GtkDialog *widget,
     gint response_id,
     EmpathyContact *contact)
 {
-  GFile *file;
+  GSList *files, *l;
+  GList *list = NULL;
 
   if (response_id == GTK_RESPONSE_OK)
     {
-      file = gtk_file_chooser_get_file (GTK_FILE_CHOOSER (widget));
+      files = gtk_file_chooser_get_files (GTK_FILE_CHOOSER (widget));
 
-      empathy_send_file (contact, file);
+      for (l = files; l != NULL; l = g_slist_next (l))
+        list = g_list_prepend (list, l->data);
 
-      g_object_unref (file);
+      list = g_list_reverse (list);
+      send_files (contact, list);
+
+      g_list_free (list);
+      g_slist_free_full (files, g_object_unref);
     }
 
   g_object_unref (contact);
@@ -820,6 +846,7 @@ empathy_send_file_with_file_chooser (EmpathyContact *contact)
       GTK_RESPONSE_OK);
 
   gtk_file_chooser_set_local_only (GTK_FILE_CHOOSER (widget), FALSE);
+  gtk_file_chooser_set_select_multiple (GTK_FILE_CHOOSER (widget), TRUE);
 
   gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (widget),
       g_get_home_dir ());
@@ -49,10 +49,33 @@ static void observe_channels_cb (TpSimpleObserver *observer,
     TpObserveChannelsContext *context,
     gpointer user_data);
 
+/* Chatrooms are indexed by account and room */
+typedef struct
+{
+  TpAccount *account;
+  gchar *room;
+} ChatroomKey;
+
+typedef struct
+{
+  /* the chatroom's link in priv->chatrooms */
+  GList *link;
+  /* the key the chatroom is indexed with, or NULL */
+  ChatroomKey *key;
+  /* TRUE if another chatroom is already indexed with the same key */
+  gboolean shadowed;
+} ChatroomEntry;
+
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyChatroomManager)
 typedef struct
 {
-  GList *chatrooms;
+  /* EmpathyChatroom, in the order they were added */
+  GQueue chatrooms;
+  /* EmpathyChatroom => owned ChatroomEntry */
+  GHashTable *entries;
+  /* borrowed ChatroomKey => borrowed EmpathyChatroom */
+  GHashTable *index;
+  guint n_shadowed;
   gchar *file;
   TpAccountManager *account_manager;
 
@@ -60,7 +83,9 @@ typedef struct
   gint save_timer_id;
   gboolean ready;
   GFileMonitor *monitor;
-  gboolean writing;
+  /* checksum of the file as we last read or wrote it, so we can tell our
+   * own writes from other changes */
+  gchar *file_checksum;
 
   TpBaseClient *observer;
 } EmpathyChatroomManagerPriv;
@@ -83,6 +108,116 @@ enum
 
 G_DEFINE_TYPE (EmpathyChatroomManager, empathy_chatroom_manager, G_TYPE_OBJECT);
 
+static void chatroom_manager_remove_chatroom (EmpathyChatroomManager *manager,
+    EmpathyChatroom *chatroom);
+
+static guint
+chatroom_key_hash (gconstpointer key)
+{
+  const ChatroomKey *k = key;
+
+  return g_direct_hash (k->account) ^ g_str_hash (k->room);
+}
+
+static gboolean
+chatroom_key_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const ChatroomKey *ka = a;
+  const ChatroomKey *kb = b;
+
+  return ka->account == kb->account && !tp_strdiff (ka->room, kb->room);
+}
+
+static void
+chatroom_key_free (ChatroomKey *key)
+{
+  g_object_unref (key->account);
+  g_free (key->room);
+  g_slice_free (ChatroomKey, key);
+}
+
+static void
+chatroom_entry_free (ChatroomEntry *entry)
+{
+  if (entry->key != NULL)
+    chatroom_key_free (entry->key);
+
+  g_slice_free (ChatroomEntry, entry);
+}
+
+static void
+index_chatroom (EmpathyChatroomManager *self,
+    EmpathyChatroom *chatroom,
+    ChatroomEntry *entry)
+{
+  EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
+  ChatroomKey key;
+
+  key.account = empathy_chatroom_get_account (chatroom);
+  key.room = (gchar *) empathy_chatroom_get_room (chatroom);
+
+  if (key.account == NULL || key.room == NULL)
+    return;
+
+  /* The chatroom indexed first keeps the key; this one will be indexed if
+   * that one goes away */
+  if (g_hash_table_contains (priv->index, &key))
+    {
+      entry->shadowed = TRUE;
+      priv->n_shadowed++;
+      return;
+    }
+
+  entry->key = g_slice_new (ChatroomKey);
+  entry->key->account = g_object_ref (key.account);
+  entry->key->room = g_strdup (key.room);
+
+  g_hash_table_insert (priv->index, entry->key, chatroom);
+}
+
+static void
+unindex_chatroom (EmpathyChatroomManager *self,
+    ChatroomEntry *entry)
+{
+  EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
+  ChatroomKey *key = entry->key;
+  GList *l;
+
+  if (entry->shadowed)
+    {
+      entry->shadowed = FALSE;
+      priv->n_shadowed--;
+      return;
+    }
+
+  if (key == NULL)
+    return;
+
+  g_hash_table_remove (priv->index, key);
+  entry->key = NULL;
+
+  /* Index the chatroom this one was shadowing, if any */
+  for (l = priv->chatrooms.head; l != NULL && priv->n_shadowed > 0;
+      l = l->next)
+    {
+      EmpathyChatroom *chatroom = l->data;
+      ChatroomEntry *other = g_hash_table_lookup (priv->entries, chatroom);
+
+      if (other->shadowed &&
+          empathy_chatroom_get_account (chatroom) == key->account &&
+          !tp_strdiff (empathy_chatroom_get_room (chatroom), key->room))
+        {
+          other->shadowed = FALSE;
+          priv->n_shadowed--;
+          index_chatroom (self, chatroom, other);
+          break;
+        }
+    }
+
+  chatroom_key_free (key);
+}
+
 /*
  * API to save/load and parse the chatrooms file.
  */
@@ -93,17 +228,19 @@ chatroom_manager_file_save (EmpathyChatroomManager *manager)
   EmpathyChatroomManagerPriv *priv;
   xmlDocPtr doc;
   xmlNodePtr root;
+  xmlChar *contents;
+  int length;
+  gchar *checksum;
+  GError *error = NULL;
   GList *l;
 
   priv = GET_PRIV (manager);
 
-  priv->writing = TRUE;
-
   doc = xmlNewDoc ((const xmlChar *) "1.0");
   root = xmlNewNode (NULL, (const xmlChar *) "chatrooms");
   xmlDocSetRootElement (doc, root);
 
-  for (l = priv->chatrooms; l; l = l->next)
+  for (l = priv->chatrooms.head; l; l = l->next)
     {
       EmpathyChatroom *chatroom;
       xmlNodePtr       node;
@@ -135,13 +272,38 @@ chatroom_manager_file_save (EmpathyChatroomManager *manager)
   /* Make sure the XML is indented properly */
   xmlIndentTreeOutput = 1;
 
-  DEBUG ("Saving file:'%s'", priv->file);
-  xmlSaveFormatFileEnc (priv->file, doc, "utf-8", 1);
+  xmlDocDumpFormatMemoryEnc (doc, &contents, &length, "utf-8", 1);
   xmlFreeDoc (doc);
 
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, contents, length);
+
+  if (!tp_strdiff (checksum, priv->file_checksum))
+    {
+      DEBUG ("Favorites didn't change, not saving file:'%s'", priv->file);
+      g_free (checksum);
+      goto out;
+    }
+
+  DEBUG ("Saving file:'%s'", priv->file);
+
+  /* The contents are written to a temporary file which is then renamed
+   * over the old one, so readers never see a half-written file */
+  if (!g_file_set_contents (priv->file, (const gchar *) contents, length,
+        &error))
+    {
+      DEBUG ("Failed to save file:'%s': %s", priv->file, error->message);
+      g_error_free (error);
+      g_free (checksum);
+      goto out;
+    }
+
+  g_free (priv->file_checksum);
+  priv->file_checksum = checksum;
+
+out:
+  xmlFree (contents);
   xmlMemoryDump ();
 
-  priv->writing = FALSE;
   return TRUE;
 }
 
@@ -157,12 +319,13 @@ save_timeout (EmpathyChatroomManager *self)
 }
 
 static void
-reset_save_timeout (EmpathyChatroomManager *self)
+queue_save (EmpathyChatroomManager *self)
 {
   EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
 
+  /* Changes made until the timer fires are saved together */
   if (priv->save_timer_id > 0)
-    g_source_remove (priv->save_timer_id);
+    return;
 
   priv->save_timer_id = g_timeout_add_seconds (SAVE_TIMER,
       (GSourceFunc) save_timeout, self);
@@ -173,7 +336,20 @@ chatroom_changed_cb (EmpathyChatroom *chatroom,
     GParamSpec *spec,
     EmpathyChatroomManager *self)
 {
-  reset_save_timeout (self);
+  EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
+
+  if (!tp_strdiff (spec->name, "account") || !tp_strdiff (spec->name, "room"))
+    {
+      ChatroomEntry *entry = g_hash_table_lookup (priv->entries, chatroom);
+
+      unindex_chatroom (self, entry);
+      index_chatroom (self, chatroom, entry);
+    }
+
+  /* Only favorites are saved */
+  if (empathy_chatroom_is_favorite (chatroom) ||
+      !tp_strdiff (spec->name, "favorite"))
+    queue_save (self);
 }
 
 static void
@@ -181,8 +357,15 @@ add_chatroom (EmpathyChatroomManager *self,
     EmpathyChatroom *chatroom)
 {
   EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
+  ChatroomEntry *entry;
+
+  g_queue_push_tail (&priv->chatrooms, g_object_ref (chatroom));
 
-  priv->chatrooms = g_list_prepend (priv->chatrooms, g_object_ref (chatroom));
+  entry = g_slice_new0 (ChatroomEntry);
+  entry->link = priv->chatrooms.tail;
+  g_hash_table_insert (priv->entries, chatroom, entry);
+
+  index_chatroom (self, chatroom, entry);
 
   /* Watch only those properties which are exported in the save file */
   g_signal_connect (chatroom, "notify::name",
@@ -199,9 +382,8 @@ add_chatroom (EmpathyChatroomManager *self,
       G_CALLBACK (chatroom_changed_cb), self);
 }
 
-static void
-chatroom_manager_parse_chatroom (EmpathyChatroomManager *manager,
-    xmlNodePtr node)
+static EmpathyChatroom *
+chatroom_manager_parse_chatroom (xmlNodePtr node)
 {
   EmpathyChatroom *chatroom = NULL;
   TpAccount *account;
@@ -277,54 +459,52 @@ chatroom_manager_parse_chatroom (EmpathyChatroomManager *manager,
     {
       DEBUG ("Failed to create account: %s", error->message);
       g_error_free (error);
-
-      g_free (name);
-      g_free (room);
-      g_free (account_id);
-      return;
+      goto out;
     }
 
   chatroom = empathy_chatroom_new_full (account, room, name, auto_connect);
   empathy_chatroom_set_favorite (chatroom, TRUE);
   empathy_chatroom_set_always_urgent (chatroom, always_urgent);
-  add_chatroom (manager, chatroom);
-  g_signal_emit (manager, signals[CHATROOM_ADDED], 0, chatroom);
+  g_object_unref (account);
 
 out:
   g_free (name);
   g_free (room);
   g_free (account_id);
-  tp_clear_object (&chatroom);
+  return chatroom;
 }
 
 static gboolean
 chatroom_manager_file_parse (EmpathyChatroomManager *manager,
-    const gchar *filename)
+    const gchar *contents,
+    gsize length,
+    GList **chatrooms_out)
 {
   EmpathyChatroomManagerPriv *priv;
   xmlParserCtxtPtr ctxt;
   xmlDocPtr doc;
   xmlNodePtr chatrooms;
   xmlNodePtr node;
+  GList *parsed = NULL;
 
   priv = GET_PRIV (manager);
 
-  DEBUG ("Attempting to parse file:'%s'...", filename);
+  DEBUG ("Attempting to parse file:'%s'...", priv->file);
 
   ctxt = xmlNewParserCtxt ();
 
   /* Parse and validate the file. */
-  doc = xmlCtxtReadFile (ctxt, filename, NULL, 0);
+  doc = xmlCtxtReadMemory (ctxt, contents, length, priv->file, NULL, 0);
   if (doc == NULL)
     {
-      g_warning ("Failed to parse file:'%s'", filename);
+      g_warning ("Failed to parse file:'%s'", priv->file);
       xmlFreeParserCtxt (ctxt);
       return FALSE;
     }
 
   if (!tpaw_xml_validate_from_resource (doc, CHATROOMS_DTD_RESOURCENAME))
     {
-      g_warning ("Failed to validate file:'%s'", filename);
+      g_warning ("Failed to validate file:'%s'", priv->file);
       xmlFreeDoc (doc);
       xmlFreeParserCtxt (ctxt);
       return FALSE;
@@ -335,11 +515,19 @@ chatroom_manager_file_parse (EmpathyChatroomManager *manager,
 
   for (node = chatrooms->children; node; node = node->next)
     {
-      if (strcmp ((gchar *) node->name, "chatroom") == 0)
-        chatroom_manager_parse_chatroom (manager, node);
+      EmpathyChatroom *chatroom;
+
+      if (strcmp ((gchar *) node->name, "chatroom") != 0)
+        continue;
+
+      chatroom = chatroom_manager_parse_chatroom (node);
+      if (chatroom != NULL)
+        parsed = g_list_prepend (parsed, chatroom);
     }
 
-  DEBUG ("Parsed %d chatrooms", g_list_length (priv->chatrooms));
+  *chatrooms_out = g_list_reverse (parsed);
+
+  DEBUG ("Parsed %d chatrooms", g_list_length (*chatrooms_out));
 
   xmlFreeDoc (doc);
   xmlFreeParserCtxt (ctxt);
@@ -347,17 +535,128 @@ chatroom_manager_file_parse (EmpathyChatroomManager *manager,
   return TRUE;
 }
 
+/* Updates the list to match the favorites read from the file. Chatrooms we
+ * already know are updated in place rather than removed and added again. */
+static void
+chatroom_manager_merge (EmpathyChatroomManager *manager,
+    GList *favorites)
+{
+  EmpathyChatroomManagerPriv *priv = GET_PRIV (manager);
+  GHashTable *in_file;
+  GList *l, *next;
+
+  in_file = g_hash_table_new (NULL, NULL);
+
+  for (l = favorites; l != NULL; l = l->next)
+    {
+      EmpathyChatroom *favorite = l->data;
+      EmpathyChatroom *chatroom;
+      const gchar *room = empathy_chatroom_get_room (favorite);
+
+      chatroom = room == NULL ? NULL : empathy_chatroom_manager_find (manager,
+          empathy_chatroom_get_account (favorite), room);
+
+      if (chatroom == NULL)
+        {
+          add_chatroom (manager, favorite);
+          g_signal_emit (manager, signals[CHATROOM_ADDED], 0, favorite);
+          g_hash_table_add (in_file, favorite);
+          continue;
+        }
+
+      if (tp_strdiff (empathy_chatroom_get_name (chatroom),
+            empathy_chatroom_get_name (favorite)))
+        empathy_chatroom_set_name (chatroom,
+            empathy_chatroom_get_name (favorite));
+
+      empathy_chatroom_set_favorite (chatroom, TRUE);
+
+      if (empathy_chatroom_get_auto_connect (chatroom) !=
+          empathy_chatroom_get_auto_connect (favorite))
+        empathy_chatroom_set_auto_connect (chatroom,
+            empathy_chatroom_get_auto_connect (favorite));
+
+      empathy_chatroom_set_always_urgent (chatroom,
+          empathy_chatroom_is_always_urgent (favorite));
+
+      g_hash_table_add (in_file, chatroom);
+    }
+
+  /* Favorites which are not in the file anymore */
+  for (l = priv->chatrooms.head; l != NULL; l = next)
+    {
+      EmpathyChatroom *chatroom = l->data;
+
+      next = l->next;
+
+      if (!empathy_chatroom_is_favorite (chatroom) ||
+          g_hash_table_contains (in_file, chatroom))
+        continue;
+
+      /* Keep the rooms we are in */
+      if (empathy_chatroom_get_tp_chat (chatroom) != NULL)
+        empathy_chatroom_set_favorite (chatroom, FALSE);
+      else
+        chatroom_manager_remove_chatroom (manager, chatroom);
+    }
+
+  g_hash_table_unref (in_file);
+}
+
 static gboolean
 chatroom_manager_get_all (EmpathyChatroomManager *manager)
 {
   EmpathyChatroomManagerPriv *priv;
+  gchar *contents;
+  gsize length;
+  GError *error = NULL;
 
   priv = GET_PRIV (manager);
 
   /* read file in */
-  if (g_file_test (priv->file, G_FILE_TEST_EXISTS) &&
-      !chatroom_manager_file_parse (manager, priv->file))
-    return FALSE;
+  if (g_file_get_contents (priv->file, &contents, &length, &error))
+    {
+      gchar *checksum;
+      GList *chatrooms = NULL;
+
+      checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+          (const guchar *) contents, length);
+
+      if (!tp_strdiff (checksum, priv->file_checksum))
+        {
+          DEBUG ("File '%s' didn't change since we last read or wrote it",
+              priv->file);
+          g_free (checksum);
+          g_free (contents);
+          return TRUE;
+        }
+
+      if (!chatroom_manager_file_parse (manager, contents, length,
+            &chatrooms))
+        {
+          g_free (checksum);
+          g_free (contents);
+          return FALSE;
+        }
+
+      g_free (priv->file_checksum);
+      priv->file_checksum = checksum;
+
+      chatroom_manager_merge (manager, chatrooms);
+
+      g_list_free_full (chatrooms, g_object_unref);
+      g_free (contents);
+    }
+  else if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+    {
+      g_warning ("Failed to read file:'%s': %s", priv->file, error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+  else
+    {
+      g_error_free (error);
+    }
 
   if (!priv->ready)
     {
@@ -431,13 +730,16 @@ clear_chatrooms (EmpathyChatroomManager *self)
   EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
   GList *l, *tmp;
 
-  tmp = priv->chatrooms;
+  tmp = priv->chatrooms.head;
 
   /* Unreffing the chatroom may result in destroying the underlying
    * EmpathyTpChat which will fire the invalidated signal and so make us
-   * re-call this function. We already set priv->chatrooms to NULL so we won't
+   * re-call this function. We already emptied priv->chatrooms so we won't
    * try to destroy twice the same objects. */
-  priv->chatrooms = NULL;
+  g_queue_init (&priv->chatrooms);
+  g_hash_table_remove_all (priv->index);
+  g_hash_table_remove_all (priv->entries);
+  priv->n_shadowed = 0;
 
   for (l = tmp; l != NULL; l = g_list_next (l))
     {
@@ -472,8 +774,11 @@ chatroom_manager_finalize (GObject *object)
     }
 
   clear_chatrooms (self);
+  g_hash_table_unref (priv->index);
+  g_hash_table_unref (priv->entries);
 
   g_free (priv->file);
+  g_free (priv->file_checksum);
 
   (G_OBJECT_CLASS (empathy_chatroom_manager_parent_class)->finalize) (object);
 }
@@ -486,17 +791,15 @@ file_changed_cb (GFileMonitor *monitor,
     gpointer user_data)
 {
   EmpathyChatroomManager *self = user_data;
-  EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
 
-  if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+  /* Saving renames a new file over the old one, which is seen as a
+   * creation */
+  if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+      event_type != G_FILE_MONITOR_EVENT_CREATED)
     return;
 
-  if (priv->writing)
-    return;
-
-  DEBUG ("chatrooms file changed; reloading list");
-
-  clear_chatrooms (self);
+  /* This ignores our own writes and only updates the chatrooms which
+   * changed */
   chatroom_manager_get_all (self);
 }
 
@@ -663,6 +966,10 @@ empathy_chatroom_manager_init (EmpathyChatroomManager *manager)
       EMPATHY_TYPE_CHATROOM_MANAGER, EmpathyChatroomManagerPriv);
 
   manager->priv = priv;
+
+  priv->entries = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) chatroom_entry_free);
+  priv->index = g_hash_table_new (chatroom_key_hash, chatroom_key_equal);
 }
 
 EmpathyChatroomManager *
@@ -687,7 +994,7 @@ empathy_chatroom_manager_add (EmpathyChatroomManager *manager,
       add_chatroom (manager, chatroom);
 
       if (empathy_chatroom_is_favorite (chatroom))
-        reset_save_timeout (manager);
+        queue_save (manager);
 
       g_signal_emit (manager, signals[CHATROOM_ADDED], 0, chatroom);
       return TRUE;
@@ -697,20 +1004,22 @@ empathy_chatroom_manager_add (EmpathyChatroomManager *manager,
 }
 
 static void
-chatroom_manager_remove_link (EmpathyChatroomManager *manager,
-    GList *l)
+chatroom_manager_remove_chatroom (EmpathyChatroomManager *manager,
+    EmpathyChatroom *chatroom)
 {
   EmpathyChatroomManagerPriv *priv;
-  EmpathyChatroom *chatroom;
+  ChatroomEntry *entry;
 
   priv = GET_PRIV (manager);
 
-  chatroom = l->data;
+  entry = g_hash_table_lookup (priv->entries, chatroom);
 
   if (empathy_chatroom_is_favorite (chatroom))
-    reset_save_timeout (manager);
+    queue_save (manager);
 
-  priv->chatrooms = g_list_delete_link (priv->chatrooms, l);
+  unindex_chatroom (manager, entry);
+  g_queue_delete_link (&priv->chatrooms, entry->link);
+  g_hash_table_remove (priv->entries, chatroom);
 
   g_signal_emit (manager, signals[CHATROOM_REMOVED], 0, chatroom);
   g_signal_handlers_disconnect_by_func (chatroom, chatroom_changed_cb, manager);
@@ -723,26 +1032,27 @@ empathy_chatroom_manager_remove (EmpathyChatroomManager *manager,
     EmpathyChatroom        *chatroom)
 {
   EmpathyChatroomManagerPriv *priv;
-  GList *l;
+  const gchar *room;
 
   g_return_if_fail (EMPATHY_IS_CHATROOM_MANAGER (manager));
   g_return_if_fail (EMPATHY_IS_CHATROOM (chatroom));
 
   priv = GET_PRIV (manager);
 
-  for (l = priv->chatrooms; l; l = l->next)
+  if (!g_hash_table_contains (priv->entries, chatroom))
     {
-      EmpathyChatroom *this_chatroom;
-
-      this_chatroom = l->data;
+      /* an equal chatroom may be in the list */
+      room = empathy_chatroom_get_room (chatroom);
+      if (room == NULL)
+        return;
 
-      if (this_chatroom == chatroom ||
-          empathy_chatroom_equal (chatroom, this_chatroom))
-        {
-          chatroom_manager_remove_link (manager, l);
-          break;
-        }
+      chatroom = empathy_chatroom_manager_find (manager,
+          empathy_chatroom_get_account (chatroom), room);
+      if (chatroom == NULL)
+        return;
     }
+
+  chatroom_manager_remove_chatroom (manager, chatroom);
 }
 
 EmpathyChatroom *
@@ -751,29 +1061,17 @@ empathy_chatroom_manager_find (EmpathyChatroomManager *manager,
     const gchar *room)
 {
   EmpathyChatroomManagerPriv *priv;
-  GList *l;
+  ChatroomKey key;
 
   g_return_val_if_fail (EMPATHY_IS_CHATROOM_MANAGER (manager), NULL);
   g_return_val_if_fail (room != NULL, NULL);
 
   priv = GET_PRIV (manager);
 
-  for (l = priv->chatrooms; l; l = l->next)
-    {
-      EmpathyChatroom *chatroom;
-      TpAccount *this_account;
-      const gchar    *this_room;
-
-      chatroom = l->data;
-      this_account = empathy_chatroom_get_account (chatroom);
-      this_room = empathy_chatroom_get_room (chatroom);
-
-      if (this_account && this_room && account == this_account
-          && strcmp (this_room, room) == 0)
-        return chatroom;
-    }
+  key.account = account;
+  key.room = (gchar *) room;
 
-  return NULL;
+  return g_hash_table_lookup (priv->index, &key);
 }
 
 EmpathyChatroom *
@@ -813,17 +1111,18 @@ empathy_chatroom_manager_get_chatrooms (EmpathyChatroomManager *manager,
   priv = GET_PRIV (manager);
 
   if (!account)
-    return g_list_copy (priv->chatrooms);
+    return g_list_copy (priv->chatrooms.head);
 
+  /* walk backwards so prepending keeps the order */
   chatrooms = NULL;
-  for (l = priv->chatrooms; l; l = l->next)
+  for (l = priv->chatrooms.tail; l; l = l->prev)
     {
       EmpathyChatroom *chatroom;
 
       chatroom = l->data;
 
       if (account == empathy_chatroom_get_account (chatroom))
-        chatrooms = g_list_append (chatrooms, chatroom);
+        chatrooms = g_list_prepend (chatrooms, chatroom);
     }
 
   return chatrooms;
@@ -839,7 +1138,7 @@ chatroom_manager_chat_invalidated_cb (EmpathyTpChat *chat,
   EmpathyChatroomManagerPriv *priv = GET_PRIV (manager);
   GList *l;
 
-  for (l = priv->chatrooms; l; l = l->next)
+  for (l = priv->chatrooms.head; l; l = l->next)
     {
       EmpathyChatroom *chatroom = l->data;
 
@@ -853,7 +1152,7 @@ chatroom_manager_chat_invalidated_cb (EmpathyTpChat *chat,
           /* Remove the chatroom from the list, unless it's in the list of
            * favourites..
            * FIXME this policy should probably not be in libempathy */
-          chatroom_manager_remove_link (manager, l);
+          chatroom_manager_remove_chatroom (manager, chatroom);
         }
 
       break;
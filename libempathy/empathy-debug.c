@@ -72,57 +72,137 @@ empathy_debug_flag_is_set (EmpathyDebugFlags flag)
   return (flag & flags) != 0;
 }
 
-GHashTable *flag_to_keys = NULL;
+/* Sender looked up once and kept for the lifetime of the process, so we can
+ * track whether a debug client is listening without a D-Bus round trip. */
+static TpDebugSender *debug_sender = NULL;
+static volatile gint sender_enabled = FALSE;
+
+/* EmpathyDebugFlags -> interned "empathy/<key>" domain */
+static GHashTable *flag_to_domains = NULL;
+G_LOCK_DEFINE_STATIC (flag_to_domains);
 
 static const gchar *
 debug_flag_to_key (EmpathyDebugFlags flag)
 {
-  if (flag_to_keys == NULL)
+  guint i;
+
+  for (i = 0; keys[i].value; i++)
+    {
+      if (keys[i].value == flag)
+        return keys[i].key;
+    }
+
+  return NULL;
+}
+
+static const gchar *
+debug_flag_to_domain (EmpathyDebugFlags flag)
+{
+  const gchar *domain;
+
+  G_LOCK (flag_to_domains);
+
+  if (flag_to_domains == NULL)
+    flag_to_domains = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  domain = g_hash_table_lookup (flag_to_domains, GUINT_TO_POINTER (flag));
+  if (domain == NULL)
+    {
+      const gchar *key = debug_flag_to_key (flag);
+      gchar *tmp;
+
+      if (key != NULL)
+        tmp = g_strdup_printf ("%s/%s", G_LOG_DOMAIN, key);
+      else
+        tmp = g_strdup (G_LOG_DOMAIN);
+
+      domain = g_intern_string (tmp);
+      g_free (tmp);
+
+      g_hash_table_insert (flag_to_domains, GUINT_TO_POINTER (flag),
+          (gpointer) domain);
+    }
+
+  G_UNLOCK (flag_to_domains);
+
+  return domain;
+}
+
+static void
+debug_sender_notify_enabled_cb (GObject *sender,
+    GParamSpec *pspec,
+    gpointer user_data)
+{
+  gboolean enabled;
+
+  g_object_get (sender, "enabled", &enabled, NULL);
+  g_atomic_int_set (&sender_enabled, enabled);
+}
+
+static TpDebugSender *
+debug_get_sender (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
     {
-      guint i;
+      debug_sender = tp_debug_sender_dup ();
 
-      flag_to_keys = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-          NULL, g_free);
+      g_signal_connect (debug_sender, "notify::enabled",
+          G_CALLBACK (debug_sender_notify_enabled_cb), NULL);
+      debug_sender_notify_enabled_cb (G_OBJECT (debug_sender), NULL, NULL);
 
-      for (i = 0; keys[i].value; i++)
-        {
-          GDebugKey key = (GDebugKey) keys[i];
-          g_hash_table_insert (flag_to_keys, GUINT_TO_POINTER (key.value),
-              g_strdup (key.key));
-        }
+      g_once_init_leave (&initialized, 1);
     }
 
-  return g_hash_table_lookup (flag_to_keys, GUINT_TO_POINTER (flag));
+  return debug_sender;
 }
 
 void
 empathy_debug_free (void)
 {
-  if (flag_to_keys == NULL)
-    return;
+  G_LOCK (flag_to_domains);
+  tp_clear_pointer (&flag_to_domains, g_hash_table_unref);
+  G_UNLOCK (flag_to_domains);
+
+  if (debug_sender != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (debug_sender,
+          debug_sender_notify_enabled_cb, NULL);
+      g_atomic_int_set (&sender_enabled, FALSE);
+    }
+}
+
+/**
+ * empathy_debug_is_active:
+ * @flag: the #EmpathyDebugFlags of the caller
+ *
+ * Cheap check used by the DEBUG() macro before anything is formatted.
+ *
+ * Returns: %TRUE if a message for @flag would be printed or sent to a
+ * debug client listening on the bus
+ */
+gboolean
+empathy_debug_is_active (EmpathyDebugFlags flag)
+{
+  if (flag & flags)
+    return TRUE;
+
+  debug_get_sender ();
 
-  g_hash_table_unref (flag_to_keys);
-  flag_to_keys = NULL;
+  return g_atomic_int_get (&sender_enabled);
 }
 
 static void
 log_to_debug_sender (EmpathyDebugFlags flag,
     const gchar *message)
 {
-  TpDebugSender *sender;
-  gchar *domain;
   GTimeVal now;
 
-  sender = tp_debug_sender_dup ();
-
   g_get_current_time (&now);
 
-  domain = g_strdup_printf ("%s/%s", G_LOG_DOMAIN, debug_flag_to_key (flag));
-
-  tp_debug_sender_add_message (sender, &now, domain, G_LOG_LEVEL_DEBUG, message);
-
-  g_free (domain);
-  g_object_unref (sender);
+  tp_debug_sender_add_message (debug_get_sender (), &now,
+      debug_flag_to_domain (flag), G_LOG_LEVEL_DEBUG, message);
 }
 
 void
@@ -133,11 +213,15 @@ empathy_debug (EmpathyDebugFlags flag,
   gchar *message;
   va_list args;
 
+  if (!empathy_debug_is_active (flag))
+    return;
+
   va_start (args, format);
   message = g_strdup_vprintf (format, args);
   va_end (args);
 
-  log_to_debug_sender (flag, message);
+  if (g_atomic_int_get (&sender_enabled))
+    log_to_debug_sender (flag, message);
 
   if (flag & flags)
     g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s", message);
@@ -153,6 +237,17 @@ empathy_debug_flag_is_set (EmpathyDebugFlags flag)
   return FALSE;
 }
 
+gboolean
+empathy_debug_is_active (EmpathyDebugFlags flag)
+{
+  return FALSE;
+}
+
+void
+empathy_debug_free (void)
+{
+}
+
 void
 empathy_debug (EmpathyDebugFlags flag, const gchar *format, ...)
 {
@@ -0,0 +1,410 @@
+/*
+ * empathy-file-hasher.c - Source for EmpathyFileHasher
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-file-hasher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+
+#define DEBUG_FLAG EMPATHY_DEBUG_FT
+#include "empathy-debug.h"
+
+/* Files are read by chunks of this size, into a single page-aligned buffer
+ * which is reused for the whole file. Big enough for the syscall and
+ * checksum setup costs to vanish, small enough to stay in the cache. */
+#define CHUNK_SIZE (1024 * 1024)
+#define BUFFER_ALIGNMENT 4096
+
+/* at most one of each GChecksumType */
+#define MAX_CHECKSUMS 3
+
+struct _EmpathyFileHasher
+{
+  /* all computed in the same pass */
+  GChecksum *checksums[MAX_CHECKSUMS];
+  GChecksumType types[MAX_CHECKSUMS];
+  guint n_checksums;
+
+  /* local files are read with read(2) so we can give the kernel read-ahead
+   * hints; others go through GIO */
+  gchar *path;
+  gint fd;
+  GInputStream *stream;
+
+  guchar *buffer;
+  guint64 offset;
+};
+
+static guchar *
+buffer_alloc (void)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+  gpointer buffer;
+
+  if (posix_memalign (&buffer, BUFFER_ALIGNMENT, CHUNK_SIZE) != 0)
+    g_error ("%s: failed to allocate %u bytes", G_STRLOC, CHUNK_SIZE);
+
+  return buffer;
+#else
+  return g_malloc (CHUNK_SIZE);
+#endif
+}
+
+static void
+buffer_free (guchar *buffer)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+  free (buffer);
+#else
+  g_free (buffer);
+#endif
+}
+
+/**
+ * empathy_file_hasher_new:
+ * @type: the checksum to compute
+ *
+ * Return value: a new #EmpathyFileHasher, to be opened with
+ * empathy_file_hasher_open()
+ */
+EmpathyFileHasher *
+empathy_file_hasher_new (GChecksumType type)
+{
+  EmpathyFileHasher *self;
+
+  self = g_slice_new0 (EmpathyFileHasher);
+  self->fd = -1;
+
+  empathy_file_hasher_add_type (self, type);
+
+  return self;
+}
+
+/**
+ * empathy_file_hasher_add_type:
+ * @self: an #EmpathyFileHasher
+ * @type: another checksum to compute
+ *
+ * Computes the @type checksum as well, from the same reads. This must be
+ * called before the hasher is opened.
+ */
+void
+empathy_file_hasher_add_type (EmpathyFileHasher *self,
+    GChecksumType type)
+{
+  guint i;
+
+  g_return_if_fail (!empathy_file_hasher_is_open (self));
+
+  for (i = 0; i < self->n_checksums; i++)
+    {
+      if (self->types[i] == type)
+        return;
+    }
+
+  g_return_if_fail (self->n_checksums < MAX_CHECKSUMS);
+
+  self->types[self->n_checksums] = type;
+  self->checksums[self->n_checksums] = g_checksum_new (type);
+  self->n_checksums++;
+}
+
+void
+empathy_file_hasher_free (EmpathyFileHasher *self)
+{
+  guint i;
+
+  empathy_file_hasher_close (self);
+
+  if (self->buffer != NULL)
+    buffer_free (self->buffer);
+
+  for (i = 0; i < self->n_checksums; i++)
+    g_checksum_free (self->checksums[i]);
+
+  g_slice_free (EmpathyFileHasher, self);
+}
+
+/**
+ * empathy_file_hasher_open:
+ * @self: an #EmpathyFileHasher
+ * @file: the file to hash
+ * @cancellable: (allow-none): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Opens @file and resets the checksums, so that @self can be reused if the
+ * file has to be hashed again from the start.
+ *
+ * Return value: %TRUE if @file could be opened
+ */
+gboolean
+empathy_file_hasher_open (EmpathyFileHasher *self,
+    GFile *file,
+    GCancellable *cancellable,
+    GError **error)
+{
+  guint i;
+
+  empathy_file_hasher_close (self);
+
+  for (i = 0; i < self->n_checksums; i++)
+    g_checksum_reset (self->checksums[i]);
+
+  self->offset = 0;
+
+  if (self->buffer == NULL)
+    self->buffer = buffer_alloc ();
+
+  self->path = g_file_get_path (file);
+
+  if (self->path == NULL)
+    {
+      self->stream = G_INPUT_STREAM (g_file_read (file, cancellable, error));
+
+      return self->stream != NULL;
+    }
+
+  self->fd = g_open (self->path, O_RDONLY, 0);
+
+  if (self->fd < 0)
+    {
+      int errsv = errno;
+      gchar *display_name = g_filename_display_name (self->path);
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+          _("Error opening file '%s': %s"), display_name,
+          g_strerror (errsv));
+
+      g_free (display_name);
+      g_free (self->path);
+      self->path = NULL;
+      return FALSE;
+    }
+
+#ifdef HAVE_POSIX_FADVISE
+  /* double the kernel read-ahead window */
+  posix_fadvise (self->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  return TRUE;
+}
+
+gboolean
+empathy_file_hasher_is_open (EmpathyFileHasher *self)
+{
+  return self->fd >= 0 || self->stream != NULL;
+}
+
+/**
+ * empathy_file_hasher_is_reading:
+ * @self: an #EmpathyFileHasher
+ * @file: a #GFile
+ *
+ * Checks that the file opened by @self still is @file, and has not been
+ * replaced by renaming another file over it since.
+ *
+ * Return value: %TRUE if @self is reading @file, %FALSE if it's not or if
+ * that can't be determined
+ */
+gboolean
+empathy_file_hasher_is_reading (EmpathyFileHasher *self,
+    GFile *file)
+{
+  GFileInfo *read_info, *file_info;
+  gboolean same = FALSE;
+
+  if (self->fd >= 0)
+    {
+      GStatBuf file_stat;
+      struct stat read_stat;
+      gchar *path = g_file_get_path (file);
+
+      same = path != NULL &&
+          fstat (self->fd, &read_stat) == 0 &&
+          g_stat (path, &file_stat) == 0 &&
+          read_stat.st_dev == file_stat.st_dev &&
+          read_stat.st_ino == file_stat.st_ino;
+
+      g_free (path);
+      return same;
+    }
+
+  if (self->stream == NULL)
+    return FALSE;
+
+  read_info = g_file_input_stream_query_info (
+      G_FILE_INPUT_STREAM (self->stream), G_FILE_ATTRIBUTE_UNIX_INODE,
+      NULL, NULL);
+  file_info = g_file_query_info (file, G_FILE_ATTRIBUTE_UNIX_INODE,
+      G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+  if (read_info != NULL && file_info != NULL &&
+      g_file_info_has_attribute (read_info, G_FILE_ATTRIBUTE_UNIX_INODE) &&
+      g_file_info_has_attribute (file_info, G_FILE_ATTRIBUTE_UNIX_INODE))
+    same = g_file_info_get_attribute_uint64 (read_info,
+          G_FILE_ATTRIBUTE_UNIX_INODE) ==
+        g_file_info_get_attribute_uint64 (file_info,
+          G_FILE_ATTRIBUTE_UNIX_INODE);
+
+  g_clear_object (&read_info);
+  g_clear_object (&file_info);
+
+  return same;
+}
+
+void
+empathy_file_hasher_close (EmpathyFileHasher *self)
+{
+  if (self->fd >= 0)
+    {
+      close (self->fd);
+      self->fd = -1;
+    }
+
+  if (self->stream != NULL)
+    {
+      g_input_stream_close (self->stream, NULL, NULL);
+      g_clear_object (&self->stream);
+    }
+
+  g_free (self->path);
+  self->path = NULL;
+}
+
+static gssize
+hasher_read_fd (EmpathyFileHasher *self,
+    GError **error)
+{
+  gssize bytes_read;
+
+  do
+    bytes_read = read (self->fd, self->buffer, CHUNK_SIZE);
+  while (bytes_read < 0 && errno == EINTR);
+
+  if (bytes_read < 0)
+    {
+      int errsv = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+          _("Error reading from file: %s"), g_strerror (errsv));
+      return -1;
+    }
+
+#ifdef HAVE_POSIX_FADVISE
+  /* have the next chunk read while this one is being hashed */
+  if (bytes_read > 0)
+    posix_fadvise (self->fd, self->offset + bytes_read, CHUNK_SIZE,
+        POSIX_FADV_WILLNEED);
+#endif
+
+  return bytes_read;
+}
+
+/**
+ * empathy_file_hasher_read:
+ * @self: an #EmpathyFileHasher
+ * @cancellable: (allow-none): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Reads and hashes the next chunk of the file. If the file is still being
+ * written, this can be called again once it grew.
+ *
+ * Return value: the number of bytes hashed, 0 at the end of the file, or
+ * -1 on error
+ */
+gssize
+empathy_file_hasher_read (EmpathyFileHasher *self,
+    GCancellable *cancellable,
+    GError **error)
+{
+  gssize bytes_read;
+  guint i;
+
+  g_return_val_if_fail (empathy_file_hasher_is_open (self), -1);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return -1;
+
+  if (self->fd >= 0)
+    bytes_read = hasher_read_fd (self, error);
+  else
+    bytes_read = g_input_stream_read (self->stream, self->buffer,
+        CHUNK_SIZE, cancellable, error);
+
+  if (bytes_read <= 0)
+    return bytes_read;
+
+  for (i = 0; i < self->n_checksums; i++)
+    g_checksum_update (self->checksums[i], self->buffer, bytes_read);
+  self->offset += bytes_read;
+
+  return bytes_read;
+}
+
+guint64
+empathy_file_hasher_get_offset (EmpathyFileHasher *self)
+{
+  return self->offset;
+}
+
+/**
+ * empathy_file_hasher_get_string:
+ * @self: an #EmpathyFileHasher
+ *
+ * Return value: the hexadecimal checksum of what has been read, of the type
+ * @self was created with; no more data can be hashed after this has been
+ * called until the hasher is opened again
+ */
+const gchar *
+empathy_file_hasher_get_string (EmpathyFileHasher *self)
+{
+  return g_checksum_get_string (self->checksums[0]);
+}
+
+/**
+ * empathy_file_hasher_get_string_for_type:
+ * @self: an #EmpathyFileHasher
+ * @type: a #GChecksumType
+ *
+ * Like empathy_file_hasher_get_string(), for one of the types added with
+ * empathy_file_hasher_add_type().
+ *
+ * Return value: the checksum, or %NULL if @self doesn't compute @type
+ */
+const gchar *
+empathy_file_hasher_get_string_for_type (EmpathyFileHasher *self,
+    GChecksumType type)
+{
+  guint i;
+
+  for (i = 0; i < self->n_checksums; i++)
+    {
+      if (self->types[i] == type)
+        return g_checksum_get_string (self->checksums[i]);
+    }
+
+  return NULL;
+}
@@ -0,0 +1,59 @@
+/*
+ * empathy-file-hasher.h - Header for EmpathyFileHasher
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_FILE_HASHER_H__
+#define __EMPATHY_FILE_HASHER_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* EmpathyFileHasher: computes the checksum of a file, possibly while it is
+ * still being written. Its methods do blocking I/O and are meant to be
+ * called from a worker thread. */
+typedef struct _EmpathyFileHasher EmpathyFileHasher;
+
+EmpathyFileHasher * empathy_file_hasher_new (GChecksumType type);
+void empathy_file_hasher_free (EmpathyFileHasher *self);
+
+void empathy_file_hasher_add_type (EmpathyFileHasher *self,
+    GChecksumType type);
+
+gboolean empathy_file_hasher_open (EmpathyFileHasher *self,
+    GFile *file,
+    GCancellable *cancellable,
+    GError **error);
+gboolean empathy_file_hasher_is_open (EmpathyFileHasher *self);
+gboolean empathy_file_hasher_is_reading (EmpathyFileHasher *self,
+    GFile *file);
+void empathy_file_hasher_close (EmpathyFileHasher *self);
+
+gssize empathy_file_hasher_read (EmpathyFileHasher *self,
+    GCancellable *cancellable,
+    GError **error);
+
+guint64 empathy_file_hasher_get_offset (EmpathyFileHasher *self);
+const gchar * empathy_file_hasher_get_string (EmpathyFileHasher *self);
+const gchar * empathy_file_hasher_get_string_for_type (
+    EmpathyFileHasher *self,
+    GChecksumType type);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_FILE_HASHER_H__ */
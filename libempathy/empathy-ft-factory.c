@@ -26,6 +26,7 @@
 
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
+#include "empathy-ft-scheduler.h"
 #include "empathy-request-util.h"
 #include "empathy-utils.h"
 
@@ -231,6 +232,37 @@ ft_handler_outgoing_ready_cb (EmpathyFTHandler *handler,
   g_object_unref (factory);
 }
 
+/* the handlers of a send of several files which are still being created */
+typedef struct {
+  EmpathyFTFactory *factory;
+  EmpathyFTScheduler *scheduler;
+  guint batch;
+  guint n_pending;
+} BatchData;
+
+static void
+ft_handler_outgoing_batch_ready_cb (EmpathyFTHandler *handler,
+    GError *error,
+    gpointer user_data)
+{
+  BatchData *data = user_data;
+
+  if (error == NULL)
+    g_object_set (handler, "batch", data->batch, NULL);
+
+  /* the handler is added to the batch, if at all, from the signal */
+  g_signal_emit (data->factory, signals[NEW_FT_HANDLER], 0, handler, error);
+
+  if (--data->n_pending > 0)
+    return;
+
+  empathy_ft_scheduler_close_batch (data->scheduler, data->batch);
+
+  g_object_unref (data->factory);
+  g_object_unref (data->scheduler);
+  g_slice_free (BatchData, data);
+}
+
 /* public methods */
 
 /**
@@ -270,6 +302,45 @@ empathy_ft_factory_new_transfer_outgoing (EmpathyFTFactory *factory,
       ft_handler_outgoing_ready_cb, g_object_ref (factory));
 }
 
+/**
+ * empathy_ft_factory_new_transfers_outgoing:
+ * @factory: an #EmpathyFTFactory
+ * @contact: the #EmpathyContact destination of the transfers
+ * @sources: (element-type GFile): the #GFile objects to be transferred to
+ * @contact
+ * @user_action_time: the time of the user action which triggered the
+ * transfers
+ *
+ * Like empathy_ft_factory_new_transfer_outgoing(), for several files at
+ * once. The handlers are part of the same #EmpathyFTScheduler batch, see
+ * #EmpathyFTHandler:batch, which is closed once they all are created.
+ */
+void
+empathy_ft_factory_new_transfers_outgoing (EmpathyFTFactory *factory,
+    EmpathyContact *contact,
+    GList *sources,
+    gint64 user_action_time)
+{
+  BatchData *data;
+  GList *l;
+
+  g_return_if_fail (EMPATHY_IS_FT_FACTORY (factory));
+  g_return_if_fail (EMPATHY_IS_CONTACT (contact));
+
+  if (sources == NULL)
+    return;
+
+  data = g_slice_new0 (BatchData);
+  data->factory = g_object_ref (factory);
+  data->scheduler = empathy_ft_scheduler_dup_singleton ();
+  data->batch = empathy_ft_scheduler_new_batch (data->scheduler);
+  data->n_pending = g_list_length (sources);
+
+  for (l = sources; l != NULL; l = g_list_next (l))
+    empathy_ft_handler_new_outgoing (contact, l->data, user_action_time,
+        ft_handler_outgoing_batch_ready_cb, data);
+}
+
 /**
  * empathy_ft_factory_set_destination_for_incoming_handler:
  * @factory: an #EmpathyFTFactory
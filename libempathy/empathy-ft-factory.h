@@ -64,6 +64,10 @@ void empathy_ft_factory_new_transfer_outgoing (EmpathyFTFactory *factory,
     EmpathyContact *contact,
     GFile *source,
     gint64 user_action_time);
+void empathy_ft_factory_new_transfers_outgoing (EmpathyFTFactory *factory,
+    EmpathyContact *contact,
+    GList *sources,
+    gint64 user_action_time);
 void empathy_ft_factory_set_destination_for_incoming_handler (
     EmpathyFTFactory *factory,
     EmpathyFTHandler *handler,
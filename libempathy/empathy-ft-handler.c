@@ -24,11 +24,12 @@
 #include "config.h"
 #include "empathy-ft-handler.h"
 
+#include <math.h>
 #include <glib/gi18n-lib.h>
-#include <tp-account-widgets/tpaw-time.h>
 #include <tp-account-widgets/tpaw-utils.h>
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
+#include "empathy-file-hasher.h"
 #include "empathy-utils.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_FT
@@ -61,6 +62,11 @@
  * other three signals (::hashing-started, ::hashing-progress, ::hashing-done)
  * will be emitted before or after the transfer, depending on the direction
  * (respectively outgoing and incoming) of the handler.
+ * Outgoing files are hashed once empathy_ft_handler_start_transfer() is
+ * called, while the channel request is set up; the channel is requested as
+ * soon as both the hash and the request are ready. Incoming files are
+ * hashed in the background while they are being received, so that their
+ * hashing signals usually only cover what was left to do.
  * At any time between the call to empathy_ft_handler_start_transfer() and
  * the last signal, a ::transfer-error can be emitted, indicating that an
  * error has happened in the operation. The message of the error is localized
@@ -71,7 +77,20 @@ G_DEFINE_TYPE (EmpathyFTHandler, empathy_ft_handler, G_TYPE_OBJECT)
 
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyFTHandler)
 
-#define BUFFER_SIZE 4096
+/* how often hashing progress is reported to the main loop */
+#define HASH_PROGRESS_INTERVAL (200 * G_TIME_SPAN_MILLISECOND)
+
+/* once an incoming transfer is completed, how often its hash thread checks
+ * whether the last bytes reached the file, and for how long */
+#define HASH_FOLLOW_POLL_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+#define HASH_FOLLOW_STALL_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+
+/* the transfer speed is averaged over this many seconds by default */
+#define DEFAULT_SPEED_WINDOW 5
+
+/* ::transfer-progress is emitted at most this often; the connection
+ * manager can report progress for every chunk it writes */
+#define TRANSFER_PROGRESS_INTERVAL (250 * G_TIME_SPAN_MILLISECOND)
 
 enum {
   PROP_CHANNEL = 1,
@@ -83,7 +102,9 @@ enum {
   PROP_MODIFICATION_TIME,
   PROP_TOTAL_BYTES,
   PROP_TRANSFERRED_BYTES,
-  PROP_USER_ACTION_TIME
+  PROP_USER_ACTION_TIME,
+  PROP_SPEED_WINDOW,
+  PROP_BATCH
 };
 
 enum {
@@ -98,13 +119,22 @@ enum {
 };
 
 typedef struct {
-  GInputStream *stream;
+  EmpathyFileHasher *hasher;
   GError *error /* comment to make the style checker happy */;
-  guchar *buffer;
-  GChecksum *checksum;
-  gssize total_read;
+  guint64 total_read;
   guint64 total_bytes;
+  gint64 last_progress;
   EmpathyFTHandler *handler;
+
+  /* Incoming files are hashed while they are being written; the main loop
+   * tells the hash thread how far the transfer went. Protected by the
+   * mutex. */
+  GCancellable *cancellable;
+  gulong cancelled_id;
+  GMutex mutex;
+  GCond cond;
+  guint64 available;
+  gboolean transfer_done;
 } HashingData;
 
 typedef struct {
@@ -136,20 +166,49 @@ typedef struct {
   gchar *content_hash;
   TpFileHashType content_hash_type;
 
+  /* the running hash job, if any */
+  HashingData *hash_data;
+  /* whether ::hashing-started has been emitted */
+  gboolean hash_announced;
+  /* outgoing: whether the hashes have been computed, and whether the
+   * request has been set up; the channel is requested once both are */
+  gboolean hash_ready;
+  gboolean request_ready;
+  /* outgoing: the offered hash types, best first, and the hashes we
+   * computed, indexed by type */
+  GArray *hash_types;
+  gchar *local_hashes[TP_NUM_FILE_HASH_TYPES];
+  /* a hashing error which happened before ::hashing-started */
+  GError *hash_error;
+
   gint64 user_action_time;
 
-  /* time and speed */
+  /* time and speed; the speed is an exponentially weighted moving average
+   * of the rate between two samples, over speed_window seconds */
+  guint speed_window;
   gdouble speed;
   guint remaining_time;
-  gint64 last_update_time;
+  gint64 last_sample_time;
+  guint64 last_sample_bytes;
+
+  /* when ::transfer-progress was last emitted, and the timeout emitting
+   * the latest values if they came in too soon after that */
+  gint64 last_progress_time;
+  guint progress_id;
+
+  /* the EmpathyFTScheduler batch the transfer belongs to, or 0 */
+  guint batch;
 
   gboolean is_completed;
+  /* ::transfer-error is only emitted once */
+  gboolean error_emitted;
 } EmpathyFTHandlerPriv;
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
-static gboolean do_hash_job_incoming (GIOSchedulerJob *job,
-    GCancellable *cancellable, gpointer user_data);
+static gpointer hash_thread_incoming (gpointer user_data);
+static void emit_error_signal (EmpathyFTHandler *handler,
+    const GError *error);
 
 /* GObject implementations */
 static void
@@ -192,6 +251,12 @@ do_get_property (GObject *object,
       case PROP_USER_ACTION_TIME:
         g_value_set_int64 (value, priv->user_action_time);
         break;
+      case PROP_SPEED_WINDOW:
+        g_value_set_uint (value, priv->speed_window);
+        break;
+      case PROP_BATCH:
+        g_value_set_uint (value, priv->batch);
+        break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -237,6 +302,12 @@ do_set_property (GObject *object,
       case PROP_USER_ACTION_TIME:
         priv->user_action_time = g_value_get_int64 (value);
         break;
+      case PROP_SPEED_WINDOW:
+        priv->speed_window = g_value_get_uint (value);
+        break;
+      case PROP_BATCH:
+        priv->batch = g_value_get_uint (value);
+        break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -275,6 +346,12 @@ do_dispose (GObject *object)
 
   g_clear_object (&priv->request);
 
+  if (priv->progress_id != 0)
+    {
+      g_source_remove (priv->progress_id);
+      priv->progress_id = 0;
+    }
+
   G_OBJECT_CLASS (empathy_ft_handler_parent_class)->dispose (object);
 }
 
@@ -282,6 +359,7 @@ static void
 do_finalize (GObject *object)
 {
   EmpathyFTHandlerPriv *priv = GET_PRIV (object);
+  guint i;
 
   DEBUG ("%p", object);
 
@@ -297,6 +375,14 @@ do_finalize (GObject *object)
   g_free (priv->content_hash);
   priv->content_hash = NULL;
 
+  for (i = 0; i < TP_NUM_FILE_HASH_TYPES; i++)
+    g_free (priv->local_hashes[i]);
+
+  if (priv->hash_types != NULL)
+    g_array_unref (priv->hash_types);
+
+  g_clear_error (&priv->hash_error);
+
   G_OBJECT_CLASS (empathy_ft_handler_parent_class)->finalize (object);
 }
 
@@ -421,6 +507,31 @@ empathy_ft_handler_class_init (EmpathyFTHandlerClass *klass)
   g_object_class_install_property (object_class, PROP_USER_ACTION_TIME,
       param_spec);
 
+  /**
+   * EmpathyFTHandler:speed-window:
+   *
+   * The number of seconds the transfer speed, and thus the remaining time,
+   * is averaged over. Older samples still count, but less and less.
+   */
+  param_spec = g_param_spec_uint ("speed-window", "speed window",
+    "Seconds the transfer speed is averaged over",
+    1, G_MAXUINT, DEFAULT_SPEED_WINDOW,
+    G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
+  g_object_class_install_property (object_class, PROP_SPEED_WINDOW,
+      param_spec);
+
+  /**
+   * EmpathyFTHandler:batch:
+   *
+   * The id of the #EmpathyFTScheduler batch the transfer was sent with,
+   * or 0 if it was sent on its own
+   */
+  param_spec = g_param_spec_uint ("batch", "batch",
+    "The scheduler batch of the transfer",
+    0, G_MAXUINT, 0,
+    G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_BATCH, param_spec);
+
   /* signals */
 
   /**
@@ -480,7 +591,8 @@ empathy_ft_handler_class_init (EmpathyFTHandlerClass *klass)
    * @speed: the current speed of the transfer (in KB/s)
    *
    * This signal is emitted to notify clients of the progress of the
-   * transfer.
+   * transfer. It is emitted at most four times per second, and always
+   * when the last bytes have been transferred.
    */
   signals[TRANSFER_PROGRESS] =
     g_signal_new ("transfer-progress", G_TYPE_FROM_CLASS (klass),
@@ -551,13 +663,8 @@ empathy_ft_handler_init (EmpathyFTHandler *self)
 static void
 hash_data_free (HashingData *data)
 {
-  g_free (data->buffer);
-
-  if (data->stream != NULL)
-    g_object_unref (data->stream);
-
-  if (data->checksum != NULL)
-    g_checksum_free (data->checksum);
+  if (data->hasher != NULL)
+    empathy_file_hasher_free (data->hasher);
 
   if (data->error != NULL)
     g_error_free (data->error);
@@ -565,9 +672,188 @@ hash_data_free (HashingData *data)
   if (data->handler != NULL)
     g_object_unref (data->handler);
 
+  g_clear_object (&data->cancellable);
+
+  g_mutex_clear (&data->mutex);
+  g_cond_clear (&data->cond);
+
   g_slice_free (HashingData, data);
 }
 
+static HashingData *
+hash_data_new (EmpathyFTHandler *handler,
+    EmpathyFileHasher *hasher)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  HashingData *data;
+
+  data = g_slice_new0 (HashingData);
+  data->total_bytes = priv->total_bytes;
+  data->handler = g_object_ref (handler);
+  data->hasher = hasher;
+  data->cancellable = g_object_ref (priv->cancellable);
+
+  g_mutex_init (&data->mutex);
+  g_cond_init (&data->cond);
+
+  return data;
+}
+
+/* Called from the main loop when the connection manager reports progress */
+static void
+hash_data_update (HashingData *data,
+    guint64 available,
+    gboolean transfer_done)
+{
+  g_mutex_lock (&data->mutex);
+  data->available = available;
+  data->transfer_done |= transfer_done;
+  g_cond_signal (&data->cond);
+  g_mutex_unlock (&data->mutex);
+}
+
+/* Wakes the hash thread up so it notices it is cancelled */
+static void
+hash_data_cancelled_cb (GCancellable *cancellable,
+    HashingData *data)
+{
+  g_mutex_lock (&data->mutex);
+  g_cond_signal (&data->cond);
+  g_mutex_unlock (&data->mutex);
+}
+
+/* Above this size the cost of the hash starts to show, even though it's
+ * computed while the transfer is being set up or running */
+#define HASH_COST_THRESHOLD (512 * 1024 * 1024)
+
+/* How well the hash types we know of detect corruption, and their relative
+ * CPU cost per byte. */
+static const struct {
+  TpFileHashType type;
+  gint strength;
+  gint cost;
+} hash_types_info[] = {
+  { TP_FILE_HASH_TYPE_MD5, 1, 1 },
+  { TP_FILE_HASH_TYPE_SHA1, 3, 1 },
+  { TP_FILE_HASH_TYPE_SHA256, 4, 2 },
+};
+
+static gboolean
+hash_type_get_score (TpFileHashType type,
+    guint64 size,
+    gint *score)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (hash_types_info); i++)
+    {
+      if (hash_types_info[i].type != type)
+        continue;
+
+      /* the strongest hash for usual files; for big ones SHA-1 is still
+       * sound and twice as fast as SHA-256. MD5 always comes last. */
+      *score = hash_types_info[i].strength;
+      if (size > HASH_COST_THRESHOLD)
+        *score -= 2 * hash_types_info[i].cost;
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gint
+hash_type_compare (gconstpointer a,
+    gconstpointer b,
+    gpointer user_data)
+{
+  guint64 size = *(guint64 *) user_data;
+  gint score_a = 0, score_b = 0;
+
+  hash_type_get_score (*(const guint *) a, size, &score_a);
+  hash_type_get_score (*(const guint *) b, size, &score_b);
+
+  return score_b - score_a;
+}
+
+/**
+ * empathy_ft_hash_types_rank:
+ * @types: (element-type guint): an array of #TpFileHashType
+ * @size: the size of the file to hash
+ *
+ * Sorts @types from the most to the least suitable to hash a file of @size
+ * bytes, weighing how well each detects corruption against its cost.
+ * Duplicates, %TP_FILE_HASH_TYPE_NONE and unknown types are removed.
+ */
+void
+empathy_ft_hash_types_rank (GArray *types,
+    guint64 size)
+{
+  gboolean seen[TP_NUM_FILE_HASH_TYPES] = { FALSE, };
+  guint i = 0;
+
+  while (i < types->len)
+    {
+      guint type = g_array_index (types, guint, i);
+      gint score;
+
+      if (!hash_type_get_score (type, size, &score) || seen[type])
+        {
+          g_array_remove_index (types, i);
+          continue;
+        }
+
+      seen[type] = TRUE;
+      i++;
+    }
+
+  g_array_sort_with_data (types, hash_type_compare, &size);
+}
+
+/**
+ * empathy_ft_hash_types_get_next:
+ * @types: (element-type guint): ranked #TpFileHashType, as sorted by
+ *  empathy_ft_hash_types_rank()
+ * @current: the type which was refused
+ * @digests: the digests computed so far, indexed by #TpFileHashType
+ *
+ * Finds the type to fall back to when the connection manager refused
+ * @current: the next one in @types for which a digest was computed.
+ *
+ * Returns: a #TpFileHashType, or %TP_FILE_HASH_TYPE_NONE if there is none
+ */
+TpFileHashType
+empathy_ft_hash_types_get_next (GArray *types,
+    TpFileHashType current,
+    gchar **digests)
+{
+  guint i;
+
+  for (i = 0; i < types->len; i++)
+    {
+      if (g_array_index (types, guint, i) == current)
+        break;
+    }
+
+  for (i++; i < types->len; i++)
+    {
+      TpFileHashType type = g_array_index (types, guint, i);
+
+      if (digests[type] != NULL)
+        return type;
+    }
+
+  return TP_FILE_HASH_TYPE_NONE;
+}
+
+static gboolean
+hash_type_is_supported (TpFileHashType type)
+{
+  gint score;
+
+  return hash_type_get_score (type, 0, &score);
+}
+
 static GChecksumType
 tp_file_hash_to_g_checksum (TpFileHashType type)
 {
@@ -593,25 +879,125 @@ tp_file_hash_to_g_checksum (TpFileHashType type)
   return retval;
 }
 
+/**
+ * empathy_ft_hash_types_new_hasher:
+ * @types: (element-type guint): ranked #TpFileHashType, as sorted by
+ *  empathy_ft_hash_types_rank()
+ *
+ * Creates a hasher for the best of @types. It also computes the runner-up
+ * in the same pass, in case the connection manager refuses the first one:
+ * that's much cheaper than reading the file again.
+ *
+ * Returns: a new #EmpathyFileHasher
+ */
+EmpathyFileHasher *
+empathy_ft_hash_types_new_hasher (GArray *types)
+{
+  EmpathyFileHasher *hasher;
+
+  g_return_val_if_fail (types->len > 0, NULL);
+
+  hasher = empathy_file_hasher_new (
+      tp_file_hash_to_g_checksum (g_array_index (types, guint, 0)));
+
+  if (types->len > 1)
+    empathy_file_hasher_add_type (hasher,
+        tp_file_hash_to_g_checksum (g_array_index (types, guint, 1)));
+
+  return hasher;
+}
+
+/**
+ * empathy_ft_hash_types_get_digests:
+ * @types: (element-type guint): the types @hasher was created for
+ * @hasher: a hasher created by empathy_ft_hash_types_new_hasher(), which
+ *  read the whole file
+ * @digests: an array of %TP_NUM_FILE_HASH_TYPES strings
+ *
+ * Sets @digests[type] to a copy of the digest @hasher computed for each
+ * type of @types, and leaves the others alone.
+ */
+void
+empathy_ft_hash_types_get_digests (GArray *types,
+    EmpathyFileHasher *hasher,
+    gchar **digests)
+{
+  guint i;
+
+  for (i = 0; i < types->len; i++)
+    {
+      TpFileHashType type = g_array_index (types, guint, i);
+      const gchar *hash = empathy_file_hasher_get_string_for_type (hasher,
+          tp_file_hash_to_g_checksum (type));
+
+      if (hash != NULL)
+        {
+          g_free (digests[type]);
+          digests[type] = g_strdup (hash);
+        }
+    }
+}
+
+/**
+ * empathy_ft_hash_matches:
+ * @computed: the digest of the received file
+ * @received: the digest the sender announced
+ *
+ * Returns: whether the digests are the same. Some peers send upper case
+ *  digests, so case is ignored.
+ */
+gboolean
+empathy_ft_hash_matches (const gchar *computed,
+    const gchar *received)
+{
+  if (computed == NULL || received == NULL)
+    return FALSE;
+
+  return g_ascii_strcasecmp (computed, received) == 0;
+}
+
+static void
+ft_handler_start_hashing_incoming (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  if (priv->hash_data != NULL || priv->hash_error != NULL)
+    return;
+
+  priv->hash_data = hash_data_new (handler, empathy_file_hasher_new (
+        tp_file_hash_to_g_checksum (priv->content_hash_type)));
+  priv->hash_data->cancelled_id = g_cancellable_connect (priv->cancellable,
+      G_CALLBACK (hash_data_cancelled_cb), priv->hash_data, NULL);
+
+  /* it follows the transfer until it's over, so it would hold one of the
+   * few shared GIOScheduler threads for that long */
+  g_thread_unref (g_thread_new ("empathy-ft-hash", hash_thread_incoming,
+        priv->hash_data));
+}
+
 static void
 check_hash_incoming (EmpathyFTHandler *handler)
 {
-  HashingData *hash_data;
   EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
 
-  if (!TPAW_STR_EMPTY (priv->content_hash))
-    {
-      hash_data = g_slice_new0 (HashingData);
-      hash_data->total_bytes = priv->total_bytes;
-      hash_data->handler = g_object_ref (handler);
-      hash_data->checksum = g_checksum_new
-        (tp_file_hash_to_g_checksum (priv->content_hash_type));
+  if (TPAW_STR_EMPTY (priv->content_hash))
+    return;
 
-      g_signal_emit (handler, signals[HASHING_STARTED], 0);
+  /* usually the job has been following the transfer since it started and
+   * only has the last chunks left to read */
+  ft_handler_start_hashing_incoming (handler);
 
-      g_io_scheduler_push_job (do_hash_job_incoming, hash_data, NULL,
-                               G_PRIORITY_DEFAULT, priv->cancellable);
+  priv->hash_announced = TRUE;
+  g_signal_emit (handler, signals[HASHING_STARTED], 0);
+
+  if (priv->hash_error != NULL)
+    {
+      emit_error_signal (handler, priv->hash_error);
+      g_clear_error (&priv->hash_error);
+      return;
     }
+
+  hash_data_update (priv->hash_data, priv->total_bytes, TRUE);
 }
 
 static void
@@ -625,6 +1011,11 @@ emit_error_signal (EmpathyFTHandler *handler,
   if (!g_cancellable_is_cancelled (priv->cancellable))
     g_cancellable_cancel (priv->cancellable);
 
+  /* the operations cancelled above may fail in turn */
+  if (priv->error_emitted)
+    return;
+
+  priv->error_emitted = TRUE;
   g_signal_emit (handler, signals[TRANSFER_ERROR], 0, error);
 }
 
@@ -633,26 +1024,94 @@ update_remaining_time_and_speed (EmpathyFTHandler *handler,
     guint64 transferred_bytes)
 {
   EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
-  gint64 elapsed_time, current_time;
-  guint64 transferred, last_transferred_bytes;
-  gdouble speed;
-  gint remaining_time;
+  gint64 current_time;
+  gdouble elapsed, rate, alpha;
 
-  last_transferred_bytes = priv->transferred_bytes;
   priv->transferred_bytes = transferred_bytes;
 
-  current_time = tpaw_time_get_current ();
-  elapsed_time = current_time - priv->last_update_time;
+  current_time = g_get_monotonic_time ();
+  elapsed = (gdouble) (current_time - priv->last_sample_time) /
+      G_TIME_SPAN_SECOND;
+
+  if (elapsed <= 0 || transferred_bytes < priv->last_sample_bytes)
+    return;
+
+  rate = (transferred_bytes - priv->last_sample_bytes) / elapsed;
+
+  /* Weighting the new sample by how long it covers makes the average
+   * independent of how often the CM reports progress: a sample spanning
+   * the whole window counts for about 63% of it. */
+  alpha = 1 - exp (-elapsed / priv->speed_window);
+
+  if (priv->speed <= 0)
+    priv->speed = rate;
+  else
+    priv->speed += alpha * (rate - priv->speed);
+
+  if (priv->speed > 0 && transferred_bytes <= priv->total_bytes)
+    priv->remaining_time =
+        (priv->total_bytes - transferred_bytes) / priv->speed;
+
+  priv->last_sample_time = current_time;
+  priv->last_sample_bytes = transferred_bytes;
+}
 
-  if (elapsed_time >= 1)
+static void
+emit_transfer_progress (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  if (priv->progress_id != 0)
     {
-      transferred = transferred_bytes - last_transferred_bytes;
-      speed = (gdouble) transferred / (gdouble) elapsed_time;
-      remaining_time = (priv->total_bytes - priv->transferred_bytes) / speed;
-      priv->speed = speed;
-      priv->remaining_time = remaining_time;
-      priv->last_update_time = current_time;
+      g_source_remove (priv->progress_id);
+      priv->progress_id = 0;
     }
+
+  priv->last_progress_time = g_get_monotonic_time ();
+
+  g_signal_emit (handler, signals[TRANSFER_PROGRESS], 0,
+      priv->transferred_bytes, priv->total_bytes, priv->remaining_time,
+      priv->speed);
+}
+
+static gboolean
+transfer_progress_timeout_cb (gpointer user_data)
+{
+  EmpathyFTHandler *handler = user_data;
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  priv->progress_id = 0;
+
+  if (!empathy_ft_handler_is_cancelled (handler))
+    emit_transfer_progress (handler);
+
+  return FALSE;
+}
+
+/* Emits ::transfer-progress now if it hasn't been for long enough, or
+ * when the transfer is complete, else schedules it so the latest values
+ * are emitted once the interval is over. */
+static void
+queue_transfer_progress (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  gint64 next;
+
+  next = priv->last_progress_time + TRANSFER_PROGRESS_INTERVAL;
+
+  if (priv->transferred_bytes >= priv->total_bytes ||
+      g_get_monotonic_time () >= next)
+    {
+      emit_transfer_progress (handler);
+      return;
+    }
+
+  if (priv->progress_id != 0)
+    return;
+
+  priv->progress_id = g_timeout_add (
+      (next - g_get_monotonic_time ()) / G_TIME_SPAN_MILLISECOND + 1,
+      transfer_progress_timeout_cb, handler);
 }
 
 static void
@@ -670,17 +1129,24 @@ ft_transfer_transferred_bytes_cb (TpFileTransferChannel *channel,
 
   if (priv->transferred_bytes == 0)
     {
-      priv->last_update_time = tpaw_time_get_current ();
+      priv->last_sample_time = g_get_monotonic_time ();
+      priv->last_sample_bytes = 0;
       g_signal_emit (handler, signals[TRANSFER_STARTED], 0, channel);
+
+      /* the destination exists now, start hashing it as it grows */
+      if (empathy_ft_handler_is_incoming (handler) && priv->use_hash &&
+          !TPAW_STR_EMPTY (priv->content_hash))
+        ft_handler_start_hashing_incoming (handler);
     }
 
   if (priv->transferred_bytes != bytes)
     {
       update_remaining_time_and_speed (handler, bytes);
 
-      g_signal_emit (handler, signals[TRANSFER_PROGRESS], 0,
-          bytes, priv->total_bytes, priv->remaining_time,
-          priv->speed);
+      if (priv->hash_data != NULL && empathy_ft_handler_is_incoming (handler))
+        hash_data_update (priv->hash_data, bytes, FALSE);
+
+      queue_transfer_progress (handler);
     }
 }
 
@@ -768,6 +1234,11 @@ ft_transfer_state_cb (TpFileTransferChannel *channel,
   if (state == TP_FILE_TRANSFER_STATE_COMPLETED)
     {
       priv->is_completed = TRUE;
+
+      /* don't leave the last progress pending */
+      if (priv->progress_id != 0)
+        emit_transfer_progress (handler);
+
       g_signal_emit (handler, signals[TRANSFER_DONE], 0, channel);
 
       tp_channel_close_async (TP_CHANNEL (channel), NULL, NULL);
@@ -785,6 +1256,68 @@ ft_transfer_state_cb (TpFileTransferChannel *channel,
     }
 }
 
+/* Without a connection manager, the channel never tells us the transfer
+ * stopped. */
+static void
+ft_transfer_invalidated_cb (TpProxy *proxy,
+    guint domain,
+    gint code,
+    gchar *message,
+    EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  GError *error;
+
+  /* the channel is closed once the transfer is completed */
+  if (priv->is_completed || g_cancellable_is_cancelled (priv->cancellable))
+    return;
+
+  DEBUG ("Channel invalidated during the transfer: %s", message);
+
+  /* this also stops the incoming hash thread */
+  error = g_error_new_literal (EMPATHY_FT_ERROR_QUARK,
+      EMPATHY_FT_ERROR_TP_ERROR, _("Error while trying to transfer the file"));
+  emit_error_signal (handler, error);
+  g_error_free (error);
+}
+
+static void ft_handler_push_to_dispatcher (EmpathyFTHandler *handler);
+static void ft_handler_populate_outgoing_request (EmpathyFTHandler *handler);
+static void ft_handler_set_request_hash (EmpathyFTHandler *handler);
+
+/* Connection managers may refuse a hash type they advertised; request the
+ * channel again with the next one, if we computed it already. */
+static gboolean
+ft_handler_retry_with_next_hash (EmpathyFTHandler *handler,
+    const GError *error)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  TpFileHashType type;
+
+  if (!priv->use_hash || g_cancellable_is_cancelled (priv->cancellable))
+    return FALSE;
+
+  if (!g_error_matches (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT) &&
+      !g_error_matches (error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED))
+    return FALSE;
+
+  type = empathy_ft_hash_types_get_next (priv->hash_types,
+      priv->content_hash_type, priv->local_hashes);
+
+  if (type == TP_FILE_HASH_TYPE_NONE)
+    return FALSE;
+
+  DEBUG ("Hash type %u refused, trying %u", priv->content_hash_type, type);
+
+  priv->content_hash_type = type;
+
+  ft_handler_populate_outgoing_request (handler);
+  ft_handler_set_request_hash (handler);
+  ft_handler_push_to_dispatcher (handler);
+
+  return TRUE;
+}
+
 static void
 ft_handler_create_channel_cb (GObject *source,
     GAsyncResult *result,
@@ -807,7 +1340,8 @@ ft_handler_create_channel_cb (GObject *source,
 
   if (error != NULL)
     {
-      emit_error_signal (handler, error);
+      if (!ft_handler_retry_with_next_hash (handler, error))
+        emit_error_signal (handler, error);
 
       g_clear_object (&channel);
       g_error_free (error);
@@ -820,6 +1354,8 @@ ft_handler_create_channel_cb (GObject *source,
       G_CALLBACK (ft_transfer_state_cb), handler, 0);
   tp_g_signal_connect_object (priv->channel, "notify::transferred-bytes",
       G_CALLBACK (ft_transfer_transferred_bytes_cb), handler, 0);
+  tp_g_signal_connect_object (priv->channel, "invalidated",
+      G_CALLBACK (ft_transfer_invalidated_cb), handler, 0);
 
   tp_file_transfer_channel_provide_file_async (priv->channel, priv->gfile,
       ft_transfer_provide_cb, handler);
@@ -843,6 +1379,8 @@ ft_handler_populate_outgoing_request (EmpathyFTHandler *handler)
   gchar *uri;
   TpAccount *account;
 
+  g_clear_object (&priv->request);
+
   uri = g_file_get_uri (priv->gfile);
   account = empathy_contact_get_account (priv->contact);
 
@@ -860,6 +1398,36 @@ ft_handler_populate_outgoing_request (EmpathyFTHandler *handler)
   g_free (uri);
 }
 
+static void
+ft_handler_set_request_hash (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  DEBUG ("Using hash type %u", priv->content_hash_type);
+
+  /* set the checksum in the request...
+   * org.freedesktop.Telepathy.Channel.Type.FileTransfer.ContentHash
+   */
+  tp_account_channel_request_set_file_transfer_hash (priv->request,
+      priv->content_hash_type,
+      priv->local_hashes[priv->content_hash_type]);
+}
+
+static void
+ft_handler_push_request_if_ready (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  if (!priv->request_ready || (priv->use_hash && !priv->hash_ready))
+    return;
+
+  if (priv->use_hash)
+    ft_handler_set_request_hash (handler);
+
+  /* the request is complete now, push it to the dispatcher */
+  ft_handler_push_to_dispatcher (handler);
+}
+
 static gboolean
 hash_job_done (gpointer user_data)
 {
@@ -871,6 +1439,7 @@ hash_job_done (gpointer user_data)
   DEBUG ("Closing stream after hashing.");
 
   priv = GET_PRIV (handler);
+  priv->hash_data = NULL;
 
   if (hash_data->error != NULL)
     {
@@ -879,16 +1448,18 @@ hash_job_done (gpointer user_data)
       goto cleanup;
     }
 
-  DEBUG ("Got file hash %s", g_checksum_get_string (hash_data->checksum));
+  DEBUG ("Got file hash %s",
+      empathy_file_hasher_get_string (hash_data->hasher));
 
   if (empathy_ft_handler_is_incoming (handler))
     {
-      if (g_strcmp0 (g_checksum_get_string (hash_data->checksum),
-                     priv->content_hash))
+      if (!empathy_ft_hash_matches (
+            empathy_file_hasher_get_string (hash_data->hasher),
+            priv->content_hash))
         {
           DEBUG ("Hash mismatch when checking incoming handler: "
                  "received %s, calculated %s", priv->content_hash,
-                 g_checksum_get_string (hash_data->checksum));
+                 empathy_file_hasher_get_string (hash_data->hasher));
 
           error = g_error_new_literal (EMPATHY_FT_ERROR_QUARK,
               EMPATHY_FT_ERROR_HASH_MISMATCH,
@@ -899,32 +1470,46 @@ hash_job_done (gpointer user_data)
         {
           DEBUG ("Hash verification matched, received %s, calculated %s",
                  priv->content_hash,
-                 g_checksum_get_string (hash_data->checksum));
+                 empathy_file_hasher_get_string (hash_data->hasher));
         }
     }
   else
     {
-      /* set the checksum in the request...
-       * org.freedesktop.Telepathy.Channel.Type.FileTransfer.ContentHash
-       */
-      tp_account_channel_request_set_file_transfer_hash (priv->request,
-          TP_FILE_HASH_TYPE_MD5, g_checksum_get_string (hash_data->checksum));
+      empathy_ft_hash_types_get_digests (priv->hash_types, hash_data->hasher,
+          priv->local_hashes);
     }
 
 cleanup:
 
   if (error != NULL)
     {
-      emit_error_signal (handler, error);
-      g_clear_error (&error);
+      if (empathy_ft_handler_is_incoming (handler) &&
+          g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          /* the transfer itself has already been reported as failed */
+          g_clear_error (&error);
+        }
+      else if (!priv->hash_announced)
+        {
+          /* incoming: report it once the transfer is completed */
+          priv->hash_error = error;
+        }
+      else
+        {
+          emit_error_signal (handler, error);
+          g_clear_error (&error);
+        }
+    }
+  else if (empathy_ft_handler_is_incoming (handler))
+    {
+      g_signal_emit (handler, signals[HASHING_DONE], 0);
     }
   else
     {
       g_signal_emit (handler, signals[HASHING_DONE], 0);
 
-      if (!empathy_ft_handler_is_incoming (handler))
-        /* the request is complete now, push it to the dispatcher */
-        ft_handler_push_to_dispatcher (handler);
+      priv->hash_ready = TRUE;
+      ft_handler_push_request_if_ready (handler);
     }
 
   hash_data_free (hash_data);
@@ -936,53 +1521,80 @@ static gboolean
 emit_hashing_progress (gpointer user_data)
 {
   HashingData *hash_data = user_data;
+  EmpathyFTHandlerPriv *priv = GET_PRIV (hash_data->handler);
+
+  /* hashing in the background until the UI is told about it */
+  if (!priv->hash_announced)
+    return FALSE;
 
   g_signal_emit (hash_data->handler, signals[HASHING_PROGRESS], 0,
-      (guint64) hash_data->total_read, (guint64) hash_data->total_bytes);
+      hash_data->total_read, hash_data->total_bytes);
 
   return FALSE;
 }
 
-static gboolean
-do_hash_job (GIOSchedulerJob *job,
+/* Reads and hashes the next chunk of the file. Returns the number of
+ * bytes read, 0 at the end of what has been written so far, or -1 */
+static gssize
+hash_data_read_chunk (HashingData *hash_data,
     GCancellable *cancellable,
-    gpointer user_data)
+    GError **error)
 {
-  HashingData *hash_data = user_data;
   gssize bytes_read;
-  GError *error = NULL;
+  gint64 now;
 
-again:
-  if (hash_data->buffer == NULL)
-    hash_data->buffer = g_malloc0 (BUFFER_SIZE);
+  bytes_read = empathy_file_hasher_read (hash_data->hasher, cancellable,
+      error);
+  if (bytes_read <= 0)
+    return bytes_read;
 
-  bytes_read = g_input_stream_read (hash_data->stream, hash_data->buffer,
-                                    BUFFER_SIZE, cancellable, &error);
-  if (error != NULL)
-    goto out;
+  hash_data->total_read = empathy_file_hasher_get_offset (hash_data->hasher);
 
-  hash_data->total_read += bytes_read;
-
-  /* we now have the chunk */
-  if (bytes_read > 0)
+  /* don't wake the main loop up for each chunk */
+  now = g_get_monotonic_time ();
+  if (now - hash_data->last_progress >= HASH_PROGRESS_INTERVAL ||
+      hash_data->total_read >= hash_data->total_bytes)
     {
-      g_checksum_update (hash_data->checksum, hash_data->buffer, bytes_read);
-      g_io_scheduler_job_send_to_mainloop_async (job, emit_hashing_progress,
-          hash_data, NULL);
+      hash_data->last_progress = now;
+      g_idle_add (emit_hashing_progress, hash_data);
+    }
 
-      g_free (hash_data->buffer);
-      hash_data->buffer = NULL;
+  return bytes_read;
+}
 
-      goto again;
-    }
-  else
-  {
-    g_input_stream_close (hash_data->stream, cancellable, &error);
-  }
+/* Hashes the whole file, from a thread */
+static void
+hash_data_hash_file (HashingData *hash_data,
+    GCancellable *cancellable)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (hash_data->handler);
+  gssize bytes_read;
+  GError *error = NULL;
+
+  if (!empathy_file_hasher_is_open (hash_data->hasher) &&
+      !empathy_file_hasher_open (hash_data->hasher, priv->gfile, cancellable,
+          &error))
+    goto out;
+
+  do
+    bytes_read = hash_data_read_chunk (hash_data, cancellable, &error);
+  while (bytes_read > 0);
+
+  empathy_file_hasher_close (hash_data->hasher);
 
 out:
   if (error != NULL)
     hash_data->error = error;
+}
+
+static gboolean
+do_hash_job (GIOSchedulerJob *job,
+    GCancellable *cancellable,
+    gpointer user_data)
+{
+  HashingData *hash_data = user_data;
+
+  hash_data_hash_file (hash_data, cancellable);
 
   g_io_scheduler_job_send_to_mainloop_async (job, hash_job_done,
       hash_data, NULL);
@@ -990,65 +1602,131 @@ out:
   return FALSE;
 }
 
-static gboolean
-do_hash_job_incoming (GIOSchedulerJob *job,
-    GCancellable *cancellable,
-    gpointer user_data)
+/* Waits until the transfer progresses, is over or is cancelled. Once it
+ * is over, only waits for a while, as bytes can reach the file some time
+ * after the connection manager reported them. */
+static void
+hash_data_wait (HashingData *hash_data,
+    guint64 *available,
+    gboolean *transfer_done)
+{
+  gint64 end_time;
+
+  end_time = g_get_monotonic_time () + HASH_FOLLOW_POLL_INTERVAL;
+
+  g_mutex_lock (&hash_data->mutex);
+
+  while (hash_data->available == *available &&
+      hash_data->transfer_done == *transfer_done &&
+      !g_cancellable_is_cancelled (hash_data->cancellable))
+    {
+      if (!hash_data->transfer_done)
+        g_cond_wait (&hash_data->cond, &hash_data->mutex);
+      else if (!g_cond_wait_until (&hash_data->cond, &hash_data->mutex,
+            end_time))
+        break;
+    }
+
+  *available = hash_data->available;
+  *transfer_done = hash_data->transfer_done;
+
+  g_mutex_unlock (&hash_data->mutex);
+}
+
+/* Incoming files are hashed while the transfer is running, each chunk
+ * being read back shortly after it has been written so it's still in the
+ * page cache. Only when that isn't possible is the whole file read again
+ * once it's complete. The thread sleeps while it waits for the transfer,
+ * which the main loop tells it about. */
+static gpointer
+hash_thread_incoming (gpointer user_data)
 {
   HashingData *hash_data = user_data;
   EmpathyFTHandler *handler = hash_data->handler;
   EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  GCancellable *cancellable = hash_data->cancellable;
+  guint64 available = 0;
+  gboolean transfer_done = FALSE;
+  gint64 stalled_since = 0;
+  gssize bytes_read;
   GError *error = NULL;
 
   DEBUG ("checking integrity for incoming handler");
 
-  /* need to get the stream first */
-  hash_data->stream =
-    G_INPUT_STREAM (g_file_read (priv->gfile, cancellable, &error));
+  while (TRUE)
+    {
+      gboolean is_open = empathy_file_hasher_is_open (hash_data->hasher);
 
-  if (error != NULL)
+      /* the destination may not have been created yet */
+      if (!is_open && !transfer_done)
+        is_open = empathy_file_hasher_open (hash_data->hasher, priv->gfile,
+            cancellable, NULL);
+
+      if (is_open)
+        {
+          bytes_read = hash_data_read_chunk (hash_data, cancellable, &error);
+          if (bytes_read < 0)
+            goto out;
+
+          if (bytes_read > 0)
+            {
+              stalled_since = 0;
+              continue;
+            }
+        }
+
+      /* we are at the end of what has been written so far */
+      if (transfer_done)
+        {
+          if (!is_open || hash_data->total_read >= hash_data->total_bytes)
+            break;
+
+          if (stalled_since == 0)
+            stalled_since = g_get_monotonic_time ();
+          else if (g_get_monotonic_time () - stalled_since >
+              HASH_FOLLOW_STALL_TIMEOUT)
+            break;
+        }
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, &error))
+        goto out;
+
+      hash_data_wait (hash_data, &available, &transfer_done);
+    }
+
+  if (empathy_file_hasher_is_reading (hash_data->hasher, priv->gfile))
     {
-      hash_data->error = error;
-      g_io_scheduler_job_send_to_mainloop_async (job, hash_job_done,
-          hash_data, NULL);
-      return FALSE;
+      empathy_file_hasher_close (hash_data->hasher);
+      goto out;
     }
 
-  return do_hash_job (job, cancellable, user_data);
-}
+  DEBUG ("Could not follow the transfer, hashing the whole file");
 
-static void
-ft_handler_read_async_cb (GObject *source,
-    GAsyncResult *res,
-    gpointer user_data)
-{
-  GFileInputStream *stream;
-  GError *error = NULL;
-  HashingData *hash_data;
-  EmpathyFTHandler *handler = user_data;
-  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  /* hash_data_hash_file() opens it again from the start */
+  empathy_file_hasher_close (hash_data->hasher);
+  hash_data->total_read = 0;
 
-  DEBUG ("GFile read async CB.");
+  hash_data_hash_file (hash_data, cancellable);
 
-  stream = g_file_read_finish (priv->gfile, res, &error);
+out:
   if (error != NULL)
-    {
-      emit_error_signal (handler, error);
-      g_clear_error (&error);
+    hash_data->error = error;
 
-      return;
-    }
+  g_cancellable_disconnect (cancellable, hash_data->cancelled_id);
+  g_idle_add (hash_job_done, hash_data);
 
-  hash_data = g_slice_new0 (HashingData);
-  hash_data->stream = G_INPUT_STREAM (stream);
-  hash_data->total_bytes = priv->total_bytes;
-  hash_data->handler = g_object_ref (handler);
-  /* FIXME: MD5 is the only ContentHashType supported right now */
-  hash_data->checksum = g_checksum_new (G_CHECKSUM_MD5);
+  return NULL;
+}
 
-  g_signal_emit (handler, signals[HASHING_STARTED], 0);
+static void
+ft_handler_start_hashing_outgoing (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  priv->hash_data = hash_data_new (handler,
+      empathy_ft_hash_types_new_hasher (priv->hash_types));
 
-  g_io_scheduler_push_job (do_hash_job, hash_data, NULL,
+  g_io_scheduler_push_job (do_hash_job, priv->hash_data, NULL,
       G_PRIORITY_DEFAULT, priv->cancellable);
 }
 
@@ -1110,36 +1788,26 @@ set_content_hash_type_from_classes (EmpathyFTHandler *handler,
       return FALSE;
     }
 
+  empathy_ft_hash_types_rank (possible_values, priv->total_bytes);
+
   if (possible_values->len == 0)
     {
       /* there are no channel classes with hash support, disable it. */
       priv->use_hash = FALSE;
       priv->content_hash_type = TP_FILE_HASH_TYPE_NONE;
 
+      g_array_unref (possible_values);
       goto out;
     }
 
   priv->use_hash = TRUE;
+  priv->content_hash_type = g_array_index (possible_values, guint, 0);
 
-  if (possible_values->len == 1)
-    {
-      priv->content_hash_type = g_array_index (possible_values, guint, 0);
-    }
-  else
-    {
-      /* order the array and pick the first non zero, so that MD5
-       * is the preferred value.
-       */
-      g_array_sort (possible_values, empathy_uint_compare);
-
-      if (g_array_index (possible_values, guint, 0) == 0)
-        priv->content_hash_type = g_array_index (possible_values, guint, 1);
-      else
-        priv->content_hash_type = g_array_index (possible_values, guint, 0);
-    }
+  if (priv->hash_types != NULL)
+    g_array_unref (priv->hash_types);
+  priv->hash_types = possible_values;
 
 out:
-  g_array_unref (possible_values);
 
   DEBUG ("Hash enabled %s; setting content hash type as %u",
          priv->use_hash ? "True" : "False", priv->content_hash_type);
@@ -1192,20 +1860,86 @@ out:
 }
 
 static void
-ft_handler_complete_request (EmpathyFTHandler *handler)
+ft_handler_setup_file_info_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
 {
+  EmpathyFTHandler *handler = user_data;
   EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  GFileInfo *info;
+  GTimeVal mtime;
+  TpConnection *conn;
+  TpCapabilities *caps = NULL;
+  GError *error = NULL;
+
+  info = g_file_query_info_finish (G_FILE (source), result, &error);
+  if (info == NULL)
+    goto out;
+
+  g_file_info_get_modification_time (info, &mtime);
+
+  /* the request would announce another file than the one being hashed */
+  if ((guint64) g_file_info_get_size (info) != priv->total_bytes ||
+      (guint64) mtime.tv_sec != priv->mtime)
+    {
+      error = g_error_new_literal (EMPATHY_FT_ERROR_QUARK,
+          EMPATHY_FT_ERROR_INVALID_SOURCE_FILE,
+          _("The selected file was modified before it could be sent"));
+      goto out;
+    }
+
+  conn = empathy_contact_get_connection (priv->contact);
+  if (conn != NULL)
+    caps = tp_connection_get_capabilities (conn);
+
+  if (caps != NULL && !tp_capabilities_supports_file_transfer (caps))
+    {
+      error = g_error_new_literal (EMPATHY_FT_ERROR_QUARK,
+          EMPATHY_FT_ERROR_NOT_SUPPORTED,
+          _("File transfer not supported by remote contact"));
+      goto out;
+    }
 
   /* populate the request table with all the known properties */
   ft_handler_populate_outgoing_request (handler);
 
+  priv->request_ready = TRUE;
+  ft_handler_push_request_if_ready (handler);
+
+out:
+  if (error != NULL)
+    {
+      emit_error_signal (handler, error);
+      g_error_free (error);
+    }
+
+  g_clear_object (&info);
+  g_object_unref (handler);
+}
+
+/* Outgoing files are only hashed once the transfer is started, so the
+ * transfers waiting in an #EmpathyFTScheduler queue don't all read their
+ * file at the same time. Meanwhile, the request is set up again, as the
+ * file or the contact's capabilities may have changed while the transfer
+ * was queued. */
+static void
+ft_handler_start_outgoing (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
   if (priv->use_hash)
-    /* start hashing the file */
-    g_file_read_async (priv->gfile, G_PRIORITY_DEFAULT,
-        priv->cancellable, ft_handler_read_async_cb, handler);
-  else
-    /* push directly the handler to the dispatcher */
-    ft_handler_push_to_dispatcher (handler);
+    {
+      priv->hash_announced = TRUE;
+      g_signal_emit (handler, signals[HASHING_STARTED], 0);
+
+      ft_handler_start_hashing_outgoing (handler);
+    }
+
+  g_file_query_info_async (priv->gfile,
+      G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+      G_FILE_ATTRIBUTE_TIME_MODIFIED,
+      G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT, priv->cancellable,
+      ft_handler_setup_file_info_cb, g_object_ref (handler));
 }
 
 static void
@@ -1423,7 +2157,7 @@ empathy_ft_handler_start_transfer (EmpathyFTHandler *handler)
 
   if (priv->channel == NULL)
     {
-      ft_handler_complete_request (handler);
+      ft_handler_start_outgoing (handler);
     }
   else
     {
@@ -1435,6 +2169,8 @@ empathy_ft_handler_start_transfer (EmpathyFTHandler *handler)
           G_CALLBACK (ft_transfer_state_cb), handler, 0);
       tp_g_signal_connect_object (priv->channel, "notify::transferred-bytes",
           G_CALLBACK (ft_transfer_transferred_bytes_cb), handler, 0);
+      tp_g_signal_connect_object (priv->channel, "invalidated",
+          G_CALLBACK (ft_transfer_invalidated_cb), handler, 0);
     }
 }
 
@@ -1457,10 +2193,12 @@ empathy_ft_handler_cancel_transfer (EmpathyFTHandler *handler)
 
   /* if we don't have a channel, we are hashing, so
    * we can just cancel the GCancellable to stop it.
+   * otherwise the channel reports the cancellation, and the cancelled
+   * GCancellable keeps its invalidation from being reported as well.
    */
-  if (priv->channel == NULL)
-    g_cancellable_cancel (priv->cancellable);
-  else
+  g_cancellable_cancel (priv->cancellable);
+
+  if (priv->channel != NULL)
     tp_channel_close_async (TP_CHANNEL (priv->channel), NULL, NULL);
 }
 
@@ -1490,7 +2228,7 @@ empathy_ft_handler_incoming_set_destination (EmpathyFTHandler *handler,
    * anyway, so that clients won't be expecting us to checksum.
    */
   if (TPAW_STR_EMPTY (priv->content_hash) ||
-      priv->content_hash_type == TP_FILE_HASH_TYPE_NONE)
+      !hash_type_is_supported (priv->content_hash_type))
     priv->use_hash = FALSE;
   else
     priv->use_hash = TRUE;
@@ -1704,3 +2442,24 @@ empathy_ft_handler_is_cancelled (EmpathyFTHandler *handler)
 
   return g_cancellable_is_cancelled (priv->cancellable);
 }
+
+/**
+ * empathy_ft_handler_get_batch:
+ * @handler: an #EmpathyFTHandler
+ *
+ * Returns the #EmpathyFTScheduler batch @handler was sent with, see
+ * #EmpathyFTHandler:batch.
+ *
+ * Return value: the id of the batch, or 0 if @handler isn't part of one
+ */
+guint
+empathy_ft_handler_get_batch (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_HANDLER (handler), 0);
+
+  priv = GET_PRIV (handler);
+
+  return priv->batch;
+}
@@ -29,6 +29,7 @@
 #include <telepathy-glib/telepathy-glib.h>
 
 #include "empathy-contact.h"
+#include "empathy-file-hasher.h"
 
 G_BEGIN_DECLS
 
@@ -107,6 +108,19 @@ guint64 empathy_ft_handler_get_transferred_bytes (EmpathyFTHandler *handler);
 guint64 empathy_ft_handler_get_total_bytes (EmpathyFTHandler *handler);
 gboolean empathy_ft_handler_is_completed (EmpathyFTHandler *handler);
 gboolean empathy_ft_handler_is_cancelled (EmpathyFTHandler *handler);
+guint empathy_ft_handler_get_batch (EmpathyFTHandler *handler);
+
+void empathy_ft_hash_types_rank (GArray *types,
+    guint64 size);
+EmpathyFileHasher * empathy_ft_hash_types_new_hasher (GArray *types);
+void empathy_ft_hash_types_get_digests (GArray *types,
+    EmpathyFileHasher *hasher,
+    gchar **digests);
+TpFileHashType empathy_ft_hash_types_get_next (GArray *types,
+    TpFileHashType current,
+    gchar **digests);
+gboolean empathy_ft_hash_matches (const gchar *computed,
+    const gchar *received);
 
 G_END_DECLS
 
@@ -0,0 +1,1057 @@
+/*
+ * empathy-ft-scheduler.c - Source for EmpathyFTScheduler
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-ft-scheduler.h"
+
+#include "empathy-utils.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_FT
+#include "empathy-debug.h"
+
+/**
+ * SECTION:empathy-ft-scheduler
+ * @title: EmpathyFTScheduler
+ * @short_description: queues file transfers
+ * @include: libempathy/empathy-ft-scheduler.h
+ *
+ * #EmpathyFTScheduler decides when file transfers start, so that sending a
+ * lot of files doesn't have them all compete for the bandwidth and the disk.
+ * Transfers wait in a queue until fewer than #EmpathyFTScheduler:max-active
+ * transfers are running overall, and fewer than
+ * #EmpathyFTScheduler:max-active-per-contact with their contact; contacts
+ * of different accounts are told apart even if they have the same id.
+ * Queued transfers can be paused, which keeps them in the queue without
+ * starting them until they are resumed.
+ *
+ * Transfers can be grouped in batches, e.g. the files dropped on a contact
+ * at once, whose overall progress is reported by the ::batch-progress
+ * signal. A batch stays open while its transfers are being added, which
+ * can take several main loop iterations as #EmpathyFTHandler objects are
+ * created asynchronously, and is done once it has been closed and all its
+ * transfers are finished.
+ *
+ * #EmpathyFTHandler objects are queued with
+ * empathy_ft_scheduler_add_handler(), which calls
+ * empathy_ft_handler_start_transfer() when their turn comes. Outgoing
+ * handlers only hash their file from then on, so the hashing is limited
+ * too.
+ */
+
+G_DEFINE_TYPE (EmpathyFTScheduler, empathy_ft_scheduler, G_TYPE_OBJECT);
+
+#define DEFAULT_MAX_ACTIVE 4
+#define DEFAULT_MAX_ACTIVE_PER_CONTACT 2
+
+enum {
+  PROP_MAX_ACTIVE = 1,
+  PROP_MAX_ACTIVE_PER_CONTACT,
+  PROP_SMALLEST_FIRST
+};
+
+enum {
+  BATCH_PROGRESS,
+  BATCH_DONE,
+  HANDLER_STARTED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+typedef struct {
+  guint id;
+  guint n_items;
+  guint n_finished;
+  guint64 total_bytes;
+  guint64 transferred_bytes;
+  /* whether empathy_ft_scheduler_close_batch() has been called */
+  gboolean closed;
+} Batch;
+
+typedef struct {
+  guint id;
+  /* the account path and the contact id, see item_new() */
+  gchar *contact_key;
+  guint64 size;
+  guint64 transferred_bytes;
+  /* borrowed from the batches table, or NULL */
+  Batch *batch;
+
+  gboolean active;
+  gboolean paused;
+  /* the item's link in priv->queue, while it is waiting */
+  GList *link;
+
+  EmpathyFTSchedulerStartFunc start;
+  gpointer user_data;
+  GDestroyNotify destroy;
+} Item;
+
+typedef struct {
+  guint max_active;
+  guint max_active_per_contact;
+  gboolean smallest_first;
+
+  /* guint id => owned Item */
+  GHashTable *items;
+  /* borrowed Item, in the order they were added */
+  GQueue queue;
+  guint n_active;
+  /* owned contact key => number of active items as a guint */
+  GHashTable *active_per_contact;
+
+  /* guint id => owned Batch */
+  GHashTable *batches;
+
+  guint last_id;
+  guint dispatch_id;
+} EmpathyFTSchedulerPriv;
+
+#define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyFTScheduler)
+
+static EmpathyFTScheduler *scheduler_singleton = NULL;
+
+static Item *
+item_new (guint id,
+    const gchar *account_path,
+    const gchar *contact_id,
+    guint64 size)
+{
+  Item *item;
+
+  item = g_slice_new0 (Item);
+  item->id = id;
+  /* contact ids are only unique within an account; object paths can't
+   * contain spaces, so the key is unambiguous */
+  item->contact_key = g_strdup_printf ("%s %s", account_path, contact_id);
+  item->size = size;
+
+  return item;
+}
+
+static void
+item_free (Item *item)
+{
+  if (item->destroy != NULL)
+    item->destroy (item->user_data);
+
+  g_free (item->contact_key);
+  g_slice_free (Item, item);
+}
+
+static void
+batch_free (Batch *batch)
+{
+  g_slice_free (Batch, batch);
+}
+
+static guint
+scheduler_get_active_for_contact (EmpathyFTScheduler *self,
+    const gchar *contact_key)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (self);
+
+  return GPOINTER_TO_UINT (g_hash_table_lookup (priv->active_per_contact,
+        contact_key));
+}
+
+static void
+scheduler_set_active_for_contact (EmpathyFTScheduler *self,
+    const gchar *contact_key,
+    guint n_active)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (self);
+
+  if (n_active == 0)
+    g_hash_table_remove (priv->active_per_contact, contact_key);
+  else
+    g_hash_table_insert (priv->active_per_contact, g_strdup (contact_key),
+        GUINT_TO_POINTER (n_active));
+}
+
+static gboolean
+scheduler_can_start (EmpathyFTScheduler *self,
+    Item *item)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (self);
+
+  if (item->paused)
+    return FALSE;
+
+  return priv->max_active_per_contact == 0 ||
+      scheduler_get_active_for_contact (self, item->contact_key) <
+        priv->max_active_per_contact;
+}
+
+/* The next item to start: the first one which can be, or the smallest of
+ * them. Ties are broken by the order they were added in. */
+static Item *
+scheduler_pick_next (EmpathyFTScheduler *self)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (self);
+  Item *best = NULL;
+  GList *l;
+
+  for (l = priv->queue.head; l != NULL; l = g_list_next (l))
+    {
+      Item *item = l->data;
+
+      if (!scheduler_can_start (self, item))
+        continue;
+
+      if (!priv->smallest_first)
+        return item;
+
+      if (best == NULL || item->size < best->size)
+        best = item;
+    }
+
+  return best;
+}
+
+static void
+scheduler_start_item (EmpathyFTScheduler *self,
+    Item *item)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (self);
+
+  g_queue_delete_link (&priv->queue, item->link);
+  item->link = NULL;
+  item->active = TRUE;
+
+  priv->n_active++;
+  scheduler_set_active_for_contact (self, item->contact_key,
+      scheduler_get_active_for_contact (self, item->contact_key) + 1);
+
+  DEBUG ("Starting transfer %u with %s (%" G_GUINT64_FORMAT " bytes), "
+      "%u active, %u queued", item->id, item->contact_key, item->size,
+      priv->n_active, priv->queue.length);
+
+  /* this may finish the item right away */
+  item->start (self, item->id, item->user_data);
+}
+
+static gboolean
+scheduler_dispatch_cb (gpointer user_data)
+{
+  EmpathyFTScheduler *self = user_data;
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (self);
+  Item *item;
+
+  priv->dispatch_id = 0;
+
+  while (priv->max_active == 0 || priv->n_active < priv->max_active)
+    {
+      item = scheduler_pick_next (self);
+
+      if (item == NULL)
+        break;
+
+      scheduler_start_item (self, item);
+    }
+
+  return FALSE;
+}
+
+/* Items are started from an idle so they never are from within one of the
+ * public methods, which may be called by the start function itself. */
+static void
+scheduler_queue_dispatch (EmpathyFTScheduler *self)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (self);
+
+  if (priv->dispatch_id != 0)
+    return;
+
+  priv->dispatch_id = g_idle_add (scheduler_dispatch_cb, self);
+}
+
+static void
+scheduler_check_batch_done (EmpathyFTScheduler *self,
+    Batch *batch)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (self);
+
+  if (!batch->closed || batch->n_finished < batch->n_items)
+    return;
+
+  DEBUG ("Batch %u done, %u transfers", batch->id, batch->n_finished);
+
+  g_signal_emit (self, signals[BATCH_DONE], 0, batch->id);
+  g_hash_table_remove (priv->batches, GUINT_TO_POINTER (batch->id));
+}
+
+static void
+scheduler_update_batch (EmpathyFTScheduler *self,
+    Batch *batch)
+{
+  g_signal_emit (self, signals[BATCH_PROGRESS], 0, batch->id,
+      batch->transferred_bytes, batch->total_bytes);
+
+  scheduler_check_batch_done (self, batch);
+}
+
+static void
+do_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_MAX_ACTIVE:
+        g_value_set_uint (value, priv->max_active);
+        break;
+      case PROP_MAX_ACTIVE_PER_CONTACT:
+        g_value_set_uint (value, priv->max_active_per_contact);
+        break;
+      case PROP_SMALLEST_FIRST:
+        g_value_set_boolean (value, priv->smallest_first);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+do_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  EmpathyFTScheduler *self = EMPATHY_FT_SCHEDULER (object);
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_MAX_ACTIVE:
+        priv->max_active = g_value_get_uint (value);
+        break;
+      case PROP_MAX_ACTIVE_PER_CONTACT:
+        priv->max_active_per_contact = g_value_get_uint (value);
+        break;
+      case PROP_SMALLEST_FIRST:
+        priv->smallest_first = g_value_get_boolean (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        return;
+    }
+
+  /* raising a limit may let more items start */
+  if (priv->queue.length > 0)
+    scheduler_queue_dispatch (self);
+}
+
+static void
+do_dispose (GObject *object)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (object);
+
+  if (priv->dispatch_id != 0)
+    {
+      g_source_remove (priv->dispatch_id);
+      priv->dispatch_id = 0;
+    }
+
+  /* drops the references on the queued handlers */
+  g_queue_clear (&priv->queue);
+  g_hash_table_remove_all (priv->items);
+
+  G_OBJECT_CLASS (empathy_ft_scheduler_parent_class)->dispose (object);
+}
+
+static void
+do_finalize (GObject *object)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (object);
+
+  DEBUG ("%p", object);
+
+  g_hash_table_unref (priv->items);
+  g_hash_table_unref (priv->active_per_contact);
+  g_hash_table_unref (priv->batches);
+
+  G_OBJECT_CLASS (empathy_ft_scheduler_parent_class)->finalize (object);
+}
+
+static void
+empathy_ft_scheduler_class_init (EmpathyFTSchedulerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (klass, sizeof (EmpathyFTSchedulerPriv));
+
+  object_class->get_property = do_get_property;
+  object_class->set_property = do_set_property;
+  object_class->dispose = do_dispose;
+  object_class->finalize = do_finalize;
+
+  /**
+   * EmpathyFTScheduler:max-active:
+   *
+   * The maximum number of transfers running at the same time, or 0 for no
+   * limit
+   */
+  param_spec = g_param_spec_uint ("max-active",
+    "max active", "Maximum number of running transfers",
+    0, G_MAXUINT, DEFAULT_MAX_ACTIVE,
+    G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
+  g_object_class_install_property (object_class, PROP_MAX_ACTIVE,
+      param_spec);
+
+  /**
+   * EmpathyFTScheduler:max-active-per-contact:
+   *
+   * The maximum number of transfers running at the same time with a given
+   * contact, or 0 for no limit
+   */
+  param_spec = g_param_spec_uint ("max-active-per-contact",
+    "max active per contact", "Maximum number of running transfers with a "
+    "contact",
+    0, G_MAXUINT, DEFAULT_MAX_ACTIVE_PER_CONTACT,
+    G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
+  g_object_class_install_property (object_class, PROP_MAX_ACTIVE_PER_CONTACT,
+      param_spec);
+
+  /**
+   * EmpathyFTScheduler:smallest-first:
+   *
+   * Whether the smallest queued transfer starts first, rather than the
+   * one queued first
+   */
+  param_spec = g_param_spec_boolean ("smallest-first",
+    "smallest first", "Whether the smallest transfers start first",
+    FALSE,
+    G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
+  g_object_class_install_property (object_class, PROP_SMALLEST_FIRST,
+      param_spec);
+
+  /**
+   * EmpathyFTScheduler::batch-progress
+   * @self: the object which has received the signal
+   * @batch: the id of the batch
+   * @transferred_bytes: the bytes transferred by the transfers of @batch,
+   * finished ones counting for their whole size
+   * @total_bytes: the size of all the transfers of @batch
+   *
+   * This signal is emitted each time a transfer of @batch progresses.
+   */
+  signals[BATCH_PROGRESS] =
+    g_signal_new ("batch-progress", G_TYPE_FROM_CLASS (klass),
+        G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+        g_cclosure_marshal_generic,
+        G_TYPE_NONE,
+        3, G_TYPE_UINT, G_TYPE_UINT64, G_TYPE_UINT64);
+
+  /**
+   * EmpathyFTScheduler::batch-done
+   * @self: the object which has received the signal
+   * @batch: the id of the batch
+   *
+   * This signal is emitted when @batch is closed and all its transfers are
+   * finished. The batch id isn't valid anymore after that.
+   */
+  signals[BATCH_DONE] =
+    g_signal_new ("batch-done", G_TYPE_FROM_CLASS (klass),
+        G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+        g_cclosure_marshal_generic,
+        G_TYPE_NONE,
+        1, G_TYPE_UINT);
+
+  /**
+   * EmpathyFTScheduler::handler-started
+   * @self: the object which has received the signal
+   * @handler: the #EmpathyFTHandler leaving the queue
+   *
+   * This signal is emitted when a handler added with
+   * empathy_ft_scheduler_add_handler() leaves the queue, right before
+   * empathy_ft_handler_start_transfer() is called on it.
+   */
+  signals[HANDLER_STARTED] =
+    g_signal_new ("handler-started", G_TYPE_FROM_CLASS (klass),
+        G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+        g_cclosure_marshal_generic,
+        G_TYPE_NONE,
+        1, EMPATHY_TYPE_FT_HANDLER);
+}
+
+static void
+empathy_ft_scheduler_init (EmpathyFTScheduler *self)
+{
+  EmpathyFTSchedulerPriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+    EMPATHY_TYPE_FT_SCHEDULER, EmpathyFTSchedulerPriv);
+
+  self->priv = priv;
+
+  priv->items = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) item_free);
+  priv->active_per_contact = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  priv->batches = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) batch_free);
+  g_queue_init (&priv->queue);
+}
+
+/* public methods */
+
+/**
+ * empathy_ft_scheduler_dup_singleton:
+ *
+ * Gives the caller a reference to the #EmpathyFTScheduler singleton,
+ * (creating it if necessary).
+ *
+ * Return value: an #EmpathyFTScheduler object
+ */
+EmpathyFTScheduler *
+empathy_ft_scheduler_dup_singleton (void)
+{
+  if (scheduler_singleton != NULL)
+    return g_object_ref (scheduler_singleton);
+
+  scheduler_singleton = empathy_ft_scheduler_new ();
+  g_object_add_weak_pointer (G_OBJECT (scheduler_singleton),
+      (gpointer *) &scheduler_singleton);
+
+  return scheduler_singleton;
+}
+
+/**
+ * empathy_ft_scheduler_new:
+ *
+ * Creates a scheduler which is not shared with the rest of the process,
+ * for instance to test it.
+ *
+ * Return value: a new #EmpathyFTScheduler
+ */
+EmpathyFTScheduler *
+empathy_ft_scheduler_new (void)
+{
+  return g_object_new (EMPATHY_TYPE_FT_SCHEDULER, NULL);
+}
+
+/**
+ * empathy_ft_scheduler_new_batch:
+ * @self: an #EmpathyFTScheduler
+ *
+ * Creates a batch of transfers. Transfers can be added to it until
+ * empathy_ft_scheduler_close_batch() is called.
+ *
+ * Return value: the id of the new batch
+ */
+guint
+empathy_ft_scheduler_new_batch (EmpathyFTScheduler *self)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Batch *batch;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (self), 0);
+
+  priv = GET_PRIV (self);
+
+  batch = g_slice_new0 (Batch);
+  batch->id = ++priv->last_id;
+  g_hash_table_insert (priv->batches, GUINT_TO_POINTER (batch->id), batch);
+
+  return batch->id;
+}
+
+/**
+ * empathy_ft_scheduler_close_batch:
+ * @self: an #EmpathyFTScheduler
+ * @batch: the id of an open batch
+ *
+ * Tells @self that no more transfers will be added to @batch, so that
+ * ::batch-done can be emitted once they all are finished; right away if
+ * they already are.
+ */
+void
+empathy_ft_scheduler_close_batch (EmpathyFTScheduler *self,
+    guint batch)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Batch *b;
+
+  g_return_if_fail (EMPATHY_IS_FT_SCHEDULER (self));
+
+  priv = GET_PRIV (self);
+
+  b = g_hash_table_lookup (priv->batches, GUINT_TO_POINTER (batch));
+  g_return_if_fail (b != NULL && !b->closed);
+
+  b->closed = TRUE;
+  scheduler_check_batch_done (self, b);
+}
+
+/**
+ * empathy_ft_scheduler_get_batch_progress:
+ * @self: an #EmpathyFTScheduler
+ * @batch: the id of a batch
+ * @transferred_bytes: (out) (allow-none): the bytes transferred so far
+ * @total_bytes: (out) (allow-none): the size of the whole batch
+ *
+ * Return value: %FALSE if @batch is unknown or done
+ */
+gboolean
+empathy_ft_scheduler_get_batch_progress (EmpathyFTScheduler *self,
+    guint batch,
+    guint64 *transferred_bytes,
+    guint64 *total_bytes)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Batch *b;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (self), FALSE);
+
+  priv = GET_PRIV (self);
+
+  b = g_hash_table_lookup (priv->batches, GUINT_TO_POINTER (batch));
+  if (b == NULL)
+    return FALSE;
+
+  if (transferred_bytes != NULL)
+    *transferred_bytes = b->transferred_bytes;
+  if (total_bytes != NULL)
+    *total_bytes = b->total_bytes;
+
+  return TRUE;
+}
+
+/**
+ * empathy_ft_scheduler_add:
+ * @self: an #EmpathyFTScheduler
+ * @account_path: the object path of the account of the transfer
+ * @contact_id: the id of the contact the transfer is with
+ * @size: the size of the transfer
+ * @batch: the id of an open batch, see empathy_ft_scheduler_new_batch(),
+ * or 0
+ * @start: called when the transfer can start
+ * @user_data: data for @start
+ * @destroy: (allow-none): called to free @user_data once the transfer is
+ * finished or removed
+ *
+ * Queues a transfer.
+ *
+ * Return value: the id of the transfer in @self
+ */
+guint
+empathy_ft_scheduler_add (EmpathyFTScheduler *self,
+    const gchar *account_path,
+    const gchar *contact_id,
+    guint64 size,
+    guint batch,
+    EmpathyFTSchedulerStartFunc start,
+    gpointer user_data,
+    GDestroyNotify destroy)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Item *item;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (self), 0);
+  g_return_val_if_fail (account_path != NULL, 0);
+  g_return_val_if_fail (contact_id != NULL, 0);
+  g_return_val_if_fail (start != NULL, 0);
+
+  priv = GET_PRIV (self);
+
+  item = item_new (++priv->last_id, account_path, contact_id, size);
+  item->start = start;
+  item->user_data = user_data;
+  item->destroy = destroy;
+
+  if (batch != 0)
+    {
+      item->batch = g_hash_table_lookup (priv->batches,
+          GUINT_TO_POINTER (batch));
+
+      if (item->batch == NULL || item->batch->closed)
+        {
+          g_warning ("%s: unknown or closed batch %u", G_STRFUNC, batch);
+          item->batch = NULL;
+        }
+      else
+        {
+          item->batch->n_items++;
+          item->batch->total_bytes += size;
+        }
+    }
+
+  g_hash_table_insert (priv->items, GUINT_TO_POINTER (item->id), item);
+  g_queue_push_tail (&priv->queue, item);
+  item->link = priv->queue.tail;
+
+  scheduler_queue_dispatch (self);
+
+  return item->id;
+}
+
+/**
+ * empathy_ft_scheduler_progress:
+ * @self: an #EmpathyFTScheduler
+ * @id: the id of a running transfer
+ * @transferred_bytes: how much of it has been transferred
+ *
+ * Updates the progress of the batch of the transfer @id, if any.
+ */
+void
+empathy_ft_scheduler_progress (EmpathyFTScheduler *self,
+    guint id,
+    guint64 transferred_bytes)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Item *item;
+
+  g_return_if_fail (EMPATHY_IS_FT_SCHEDULER (self));
+
+  priv = GET_PRIV (self);
+
+  item = g_hash_table_lookup (priv->items, GUINT_TO_POINTER (id));
+  g_return_if_fail (item != NULL && item->active);
+
+  transferred_bytes = MIN (transferred_bytes, item->size);
+
+  if (item->batch != NULL)
+    {
+      item->batch->transferred_bytes += transferred_bytes;
+      item->batch->transferred_bytes -= item->transferred_bytes;
+    }
+
+  item->transferred_bytes = transferred_bytes;
+
+  if (item->batch != NULL)
+    scheduler_update_batch (self, item->batch);
+}
+
+/**
+ * empathy_ft_scheduler_finished:
+ * @self: an #EmpathyFTScheduler
+ * @id: the id of a running transfer
+ *
+ * Frees the slot of the transfer @id, which succeeded, failed or was
+ * cancelled, for the next queued one.
+ */
+void
+empathy_ft_scheduler_finished (EmpathyFTScheduler *self,
+    guint id)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Item *item;
+  Batch *batch;
+
+  g_return_if_fail (EMPATHY_IS_FT_SCHEDULER (self));
+
+  priv = GET_PRIV (self);
+
+  item = g_hash_table_lookup (priv->items, GUINT_TO_POINTER (id));
+  g_return_if_fail (item != NULL && item->active);
+
+  priv->n_active--;
+  scheduler_set_active_for_contact (self, item->contact_key,
+      scheduler_get_active_for_contact (self, item->contact_key) - 1);
+
+  batch = item->batch;
+  if (batch != NULL)
+    {
+      batch->transferred_bytes += item->size - item->transferred_bytes;
+      batch->n_finished++;
+    }
+
+  DEBUG ("Transfer %u finished, %u active, %u queued", id, priv->n_active,
+      priv->queue.length);
+
+  g_hash_table_remove (priv->items, GUINT_TO_POINTER (id));
+
+  if (priv->queue.length > 0)
+    scheduler_queue_dispatch (self);
+
+  if (batch != NULL)
+    scheduler_update_batch (self, batch);
+}
+
+/**
+ * empathy_ft_scheduler_pause:
+ * @self: an #EmpathyFTScheduler
+ * @id: the id of a queued transfer
+ *
+ * Keeps the transfer @id in the queue until empathy_ft_scheduler_resume()
+ * is called. Other transfers can start before it meanwhile.
+ *
+ * Return value: %FALSE if the transfer has already started
+ */
+gboolean
+empathy_ft_scheduler_pause (EmpathyFTScheduler *self,
+    guint id)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Item *item;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (self), FALSE);
+
+  priv = GET_PRIV (self);
+
+  item = g_hash_table_lookup (priv->items, GUINT_TO_POINTER (id));
+  if (item == NULL || item->active)
+    return FALSE;
+
+  item->paused = TRUE;
+  return TRUE;
+}
+
+/**
+ * empathy_ft_scheduler_resume:
+ * @self: an #EmpathyFTScheduler
+ * @id: the id of a paused transfer
+ *
+ * Lets the transfer @id start again. It keeps its place in the queue.
+ */
+void
+empathy_ft_scheduler_resume (EmpathyFTScheduler *self,
+    guint id)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Item *item;
+
+  g_return_if_fail (EMPATHY_IS_FT_SCHEDULER (self));
+
+  priv = GET_PRIV (self);
+
+  item = g_hash_table_lookup (priv->items, GUINT_TO_POINTER (id));
+  if (item == NULL || !item->paused)
+    return;
+
+  item->paused = FALSE;
+  scheduler_queue_dispatch (self);
+}
+
+/**
+ * empathy_ft_scheduler_remove:
+ * @self: an #EmpathyFTScheduler
+ * @id: the id of a queued transfer
+ *
+ * Removes the transfer @id from the queue without starting it, and from
+ * its batch.
+ *
+ * Return value: %FALSE if the transfer has already started
+ */
+gboolean
+empathy_ft_scheduler_remove (EmpathyFTScheduler *self,
+    guint id)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Item *item;
+  Batch *batch;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (self), FALSE);
+
+  priv = GET_PRIV (self);
+
+  item = g_hash_table_lookup (priv->items, GUINT_TO_POINTER (id));
+  if (item == NULL || item->active)
+    return FALSE;
+
+  batch = item->batch;
+  if (batch != NULL)
+    {
+      batch->n_items--;
+      batch->total_bytes -= item->size;
+    }
+
+  g_queue_delete_link (&priv->queue, item->link);
+  g_hash_table_remove (priv->items, GUINT_TO_POINTER (id));
+
+  if (batch != NULL)
+    scheduler_update_batch (self, batch);
+
+  return TRUE;
+}
+
+/**
+ * empathy_ft_scheduler_is_queued:
+ * @self: an #EmpathyFTScheduler
+ * @id: the id of a transfer
+ *
+ * Return value: %TRUE if the transfer @id hasn't started yet
+ */
+gboolean
+empathy_ft_scheduler_is_queued (EmpathyFTScheduler *self,
+    guint id)
+{
+  EmpathyFTSchedulerPriv *priv;
+  Item *item;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (self), FALSE);
+
+  priv = GET_PRIV (self);
+
+  item = g_hash_table_lookup (priv->items, GUINT_TO_POINTER (id));
+
+  return item != NULL && !item->active;
+}
+
+/* EmpathyFTHandler transfers */
+
+typedef struct {
+  /* borrowed, the scheduler owns us */
+  EmpathyFTScheduler *scheduler;
+  EmpathyFTHandler *handler;
+  guint id;
+} HandlerData;
+
+static void
+handler_data_free (HandlerData *data)
+{
+  g_signal_handlers_disconnect_matched (data->handler, G_SIGNAL_MATCH_DATA,
+      0, 0, NULL, NULL, data);
+  g_object_unref (data->handler);
+  g_slice_free (HandlerData, data);
+}
+
+static void
+handler_transfer_progress_cb (EmpathyFTHandler *handler,
+    guint64 current_bytes,
+    guint64 total_bytes,
+    guint remaining_time,
+    gdouble speed,
+    HandlerData *data)
+{
+  empathy_ft_scheduler_progress (data->scheduler, data->id, current_bytes);
+}
+
+static void
+handler_transfer_done_cb (EmpathyFTHandler *handler,
+    TpFileTransferChannel *channel,
+    HandlerData *data)
+{
+  /* frees data */
+  empathy_ft_scheduler_finished (data->scheduler, data->id);
+}
+
+static void
+handler_transfer_error_cb (EmpathyFTHandler *handler,
+    GError *error,
+    HandlerData *data)
+{
+  /* frees data */
+  empathy_ft_scheduler_finished (data->scheduler, data->id);
+}
+
+static void
+handler_start (EmpathyFTScheduler *self,
+    guint id,
+    gpointer user_data)
+{
+  HandlerData *data = user_data;
+
+  /* cancelled while it was queued */
+  if (empathy_ft_handler_is_cancelled (data->handler))
+    {
+      empathy_ft_scheduler_finished (self, id);
+      return;
+    }
+
+  g_signal_connect (data->handler, "transfer-progress",
+      G_CALLBACK (handler_transfer_progress_cb), data);
+  g_signal_connect (data->handler, "transfer-done",
+      G_CALLBACK (handler_transfer_done_cb), data);
+  g_signal_connect (data->handler, "transfer-error",
+      G_CALLBACK (handler_transfer_error_cb), data);
+
+  g_signal_emit (self, signals[HANDLER_STARTED], 0, data->handler);
+  empathy_ft_handler_start_transfer (data->handler);
+}
+
+/**
+ * empathy_ft_scheduler_add_handler:
+ * @self: an #EmpathyFTScheduler
+ * @handler: an #EmpathyFTHandler ready to be started
+ * @batch: the id of an open batch, usually the #EmpathyFTHandler:batch of
+ * @handler, or 0
+ *
+ * Queues @handler, and calls empathy_ft_handler_start_transfer() on it
+ * when its turn comes. Its signals are to be connected before that.
+ *
+ * Return value: the id of the transfer in @self
+ */
+guint
+empathy_ft_scheduler_add_handler (EmpathyFTScheduler *self,
+    EmpathyFTHandler *handler,
+    guint batch)
+{
+  HandlerData *data;
+  EmpathyContact *contact;
+  TpAccount *account = NULL;
+  const gchar *contact_id = NULL;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (self), 0);
+  g_return_val_if_fail (EMPATHY_IS_FT_HANDLER (handler), 0);
+
+  contact = empathy_ft_handler_get_contact (handler);
+  if (contact != NULL)
+    {
+      account = empathy_contact_get_account (contact);
+      contact_id = empathy_contact_get_id (contact);
+    }
+
+  data = g_slice_new0 (HandlerData);
+  data->scheduler = self;
+  data->handler = g_object_ref (handler);
+  data->id = empathy_ft_scheduler_add (self,
+      account != NULL ? tp_proxy_get_object_path (account) : "",
+      contact_id != NULL ? contact_id : "",
+      empathy_ft_handler_get_total_bytes (handler), batch, handler_start,
+      data, (GDestroyNotify) handler_data_free);
+
+  return data->id;
+}
+
+/**
+ * empathy_ft_scheduler_lookup_handler:
+ * @self: an #EmpathyFTScheduler
+ * @handler: an #EmpathyFTHandler
+ *
+ * Return value: the id of @handler's transfer if it was added with
+ * empathy_ft_scheduler_add_handler() and isn't finished, or 0
+ */
+guint
+empathy_ft_scheduler_lookup_handler (EmpathyFTScheduler *self,
+    EmpathyFTHandler *handler)
+{
+  EmpathyFTSchedulerPriv *priv;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (self), 0);
+
+  priv = GET_PRIV (self);
+
+  g_hash_table_iter_init (&iter, priv->items);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Item *item = value;
+
+      if (item->start == handler_start &&
+          ((HandlerData *) item->user_data)->handler == handler)
+        return item->id;
+    }
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * empathy-ft-scheduler.h - Header for EmpathyFTScheduler
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_FT_SCHEDULER_H__
+#define __EMPATHY_FT_SCHEDULER_H__
+
+#include <glib-object.h>
+
+#include "empathy-ft-handler.h"
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_FT_SCHEDULER empathy_ft_scheduler_get_type()
+#define EMPATHY_FT_SCHEDULER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   EMPATHY_TYPE_FT_SCHEDULER, EmpathyFTScheduler))
+#define EMPATHY_FT_SCHEDULER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   EMPATHY_TYPE_FT_SCHEDULER, EmpathyFTSchedulerClass))
+#define EMPATHY_IS_FT_SCHEDULER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EMPATHY_TYPE_FT_SCHEDULER))
+#define EMPATHY_IS_FT_SCHEDULER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), EMPATHY_TYPE_FT_SCHEDULER))
+#define EMPATHY_FT_SCHEDULER_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   EMPATHY_TYPE_FT_SCHEDULER, EmpathyFTSchedulerClass))
+
+typedef struct {
+  GObject parent;
+  gpointer priv;
+} EmpathyFTScheduler;
+
+typedef struct {
+  GObjectClass parent_class;
+} EmpathyFTSchedulerClass;
+
+/**
+ * EmpathyFTSchedulerStartFunc:
+ * @self: the scheduler
+ * @id: the id of the transfer to start
+ * @user_data: the data passed to empathy_ft_scheduler_add()
+ *
+ * Called when a transfer leaves the queue. The transfer then has to report
+ * its progress with empathy_ft_scheduler_progress() and its end with
+ * empathy_ft_scheduler_finished().
+ */
+typedef void (* EmpathyFTSchedulerStartFunc) (EmpathyFTScheduler *self,
+    guint id,
+    gpointer user_data);
+
+GType empathy_ft_scheduler_get_type (void);
+
+EmpathyFTScheduler * empathy_ft_scheduler_dup_singleton (void);
+EmpathyFTScheduler * empathy_ft_scheduler_new (void);
+
+guint empathy_ft_scheduler_new_batch (EmpathyFTScheduler *self);
+void empathy_ft_scheduler_close_batch (EmpathyFTScheduler *self,
+    guint batch);
+gboolean empathy_ft_scheduler_get_batch_progress (EmpathyFTScheduler *self,
+    guint batch,
+    guint64 *transferred_bytes,
+    guint64 *total_bytes);
+
+guint empathy_ft_scheduler_add (EmpathyFTScheduler *self,
+    const gchar *account_path,
+    const gchar *contact_id,
+    guint64 size,
+    guint batch,
+    EmpathyFTSchedulerStartFunc start,
+    gpointer user_data,
+    GDestroyNotify destroy);
+void empathy_ft_scheduler_progress (EmpathyFTScheduler *self,
+    guint id,
+    guint64 transferred_bytes);
+void empathy_ft_scheduler_finished (EmpathyFTScheduler *self,
+    guint id);
+
+gboolean empathy_ft_scheduler_pause (EmpathyFTScheduler *self,
+    guint id);
+void empathy_ft_scheduler_resume (EmpathyFTScheduler *self,
+    guint id);
+gboolean empathy_ft_scheduler_remove (EmpathyFTScheduler *self,
+    guint id);
+gboolean empathy_ft_scheduler_is_queued (EmpathyFTScheduler *self,
+    guint id);
+
+guint empathy_ft_scheduler_add_handler (EmpathyFTScheduler *self,
+    EmpathyFTHandler *handler,
+    guint batch);
+guint empathy_ft_scheduler_lookup_handler (EmpathyFTScheduler *self,
+    EmpathyFTHandler *handler);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_FT_SCHEDULER_H__ */
@@ -30,6 +30,11 @@ G_BEGIN_DECLS
 #define EMPATHY_PREFS_AUTOCONNECT                  "autoconnect"
 #define EMPATHY_PREFS_AUTOAWAY                     "autoaway"
 #define EMPATHY_PREFS_FILE_TRANSFER_DEFAULT_FOLDER "file-transfer-default-folder"
+#define EMPATHY_PREFS_FILE_TRANSFER_SPEED_WINDOW   "file-transfer-speed-window"
+#define EMPATHY_PREFS_FILE_TRANSFER_MAX_ACTIVE     "file-transfer-max-active"
+#define EMPATHY_PREFS_FILE_TRANSFER_MAX_ACTIVE_PER_CONTACT "file-transfer-max-active-per-contact"
+#define EMPATHY_PREFS_FILE_TRANSFER_SMALLEST_FIRST "file-transfer-smallest-first"
+#define EMPATHY_PREFS_LOG_SEARCH_INDEX             "log-search-index"
 #define EMPATHY_PREFS_SANITY_CLEANING_NUMBER       "sanity-cleaning-number"
 
 #define EMPATHY_PREFS_NOTIFICATIONS_SCHEMA EMPATHY_PREFS_SCHEMA ".notifications"
@@ -75,6 +80,7 @@ G_BEGIN_DECLS
 #define EMPATHY_PREFS_UI_MAIN_WINDOW_HIDDEN        "main-window-hidden"
 #define EMPATHY_PREFS_UI_SHOW_BALANCES             "show-balance-in-roster"
 #define EMPATHY_PREFS_UI_CHAT_WINDOW_PANED_POS     "chat-window-paned-pos"
+#define EMPATHY_PREFS_UI_CHAT_HIBERNATION_DELAY    "chat-hibernation-delay"
 #define EMPATHY_PREFS_UI_SHOW_OFFLINE              "show-offline"
 #define EMPATHY_PREFS_UI_SHOW_GROUPS               "show-groups"
 
@@ -0,0 +1,1642 @@
+/*
+ * empathy-log-index.c - Source for EmpathyLogIndex
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-log-index.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include <telepathy-logger/telepathy-logger.h>
+
+#include "empathy-utils.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_OTHER
+#include "empathy-debug.h"
+
+/**
+ * SECTION:empathy-log-index
+ * @title: EmpathyLogIndex
+ * @short_description: full-text index of the text logs
+ * @include: libempathy/empathy-log-index.h
+ *
+ * #EmpathyLogIndex keeps an inverted index of the words of the logged text
+ * messages, so the log viewer doesn't have to ask the logger to scan all
+ * the logs for each search.
+ *
+ * empathy_log_index_sync() walks the logs in the background, one logger
+ * call per idle, and only fetches the days which haven't been indexed yet.
+ * Messages sent or received while the index is alive are added with
+ * empathy_log_index_add_text(). The index is saved in the user's cache
+ * directory, so the next walk only has to catch up with what was logged in
+ * the meantime.
+ *
+ * Queries are made of words, which match the words starting with them, and
+ * of double-quoted phrases, which match these exact words in a row.
+ */
+
+G_DEFINE_TYPE (EmpathyLogIndex, empathy_log_index, G_TYPE_OBJECT);
+
+#define FILE_MAGIC "EmpathyLogIndex 1"
+/* seconds between a change and saving the index */
+#define SAVE_TIMEOUT 30
+
+enum {
+  PROP_FILENAME = 1,
+  PROP_READY
+};
+
+/* A contact or room of an account */
+typedef struct {
+  /* both in priv->strings */
+  const gchar *account_path;
+  const gchar *target_id;
+  gchar *alias;
+  gboolean is_chatroom;
+  /* Julian day up to which the logs have been indexed, 0 if none was */
+  guint32 synced;
+} Entity;
+
+/* A text message */
+typedef struct {
+  /* borrowed from priv->entities */
+  Entity *entity;
+  gint64 timestamp;
+  guint32 julian;
+  guint n_words;
+  /* in priv->strings */
+  const gchar **words;
+} Doc;
+
+typedef struct {
+  guint doc;
+  guint pos;
+} Posting;
+
+/* A pending logger call of the sync. Its type depends on which fields are
+ * set: none fetches the accounts, @account its entities, @target their
+ * dates and @date their events. */
+typedef struct {
+  /* weak pointer while the call is pending */
+  EmpathyLogIndex *self;
+  TpAccount *account;
+  TplEntity *target;
+  GDate *date;
+} SyncStep;
+
+typedef struct {
+  gchar *filename;
+
+  /* interned account paths, target ids and words */
+  GStringChunk *strings;
+  /* owned Entity => itself */
+  GHashTable *entities;
+  /* owned Doc, indexed by their id */
+  GPtrArray *docs;
+  /* borrowed Doc => itself, to skip the messages already indexed */
+  GHashTable *doc_set;
+  /* word in priv->strings => owned GArray of Posting */
+  GHashTable *postings;
+  /* the keys of priv->postings, sorted; rebuilt when words_dirty */
+  GPtrArray *sorted_words;
+  gboolean words_dirty;
+
+  /* whether a whole sync was done, by this process or a previous one */
+  gboolean complete;
+  gboolean ready;
+
+  TplLogManager *log_manager;
+  /* owned SyncStep */
+  GQueue sync_queue;
+  gboolean syncing;
+  guint sync_id;
+  gint64 sync_start;
+  guint sync_added;
+
+  gboolean dirty;
+  guint save_id;
+} EmpathyLogIndexPriv;
+
+#define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyLogIndex)
+
+static EmpathyLogIndex *index_singleton = NULL;
+
+static guint
+entity_hash (gconstpointer key)
+{
+  const Entity *entity = key;
+
+  return g_direct_hash (entity->account_path) ^
+      g_direct_hash (entity->target_id);
+}
+
+static gboolean
+entity_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const Entity *entity_a = a;
+  const Entity *entity_b = b;
+
+  /* the strings are interned */
+  return entity_a->account_path == entity_b->account_path &&
+      entity_a->target_id == entity_b->target_id;
+}
+
+static void
+entity_free (Entity *entity)
+{
+  g_free (entity->alias);
+  g_slice_free (Entity, entity);
+}
+
+static guint
+doc_hash (gconstpointer key)
+{
+  const Doc *doc = key;
+  guint hash;
+  guint i;
+
+  hash = entity_hash (doc->entity) ^ g_int64_hash (&doc->timestamp);
+
+  for (i = 0; i < doc->n_words; i++)
+    hash = hash * 31 + g_direct_hash (doc->words[i]);
+
+  return hash;
+}
+
+static gboolean
+doc_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const Doc *doc_a = a;
+  const Doc *doc_b = b;
+
+  if (doc_a->entity != doc_b->entity ||
+      doc_a->timestamp != doc_b->timestamp ||
+      doc_a->n_words != doc_b->n_words)
+    return FALSE;
+
+  return memcmp (doc_a->words, doc_b->words,
+      doc_a->n_words * sizeof (gchar *)) == 0;
+}
+
+static void
+doc_free (Doc *doc)
+{
+  g_free (doc->words);
+  g_slice_free (Doc, doc);
+}
+
+static SyncStep *
+sync_step_new (EmpathyLogIndex *self,
+    TpAccount *account,
+    TplEntity *target,
+    const GDate *date)
+{
+  SyncStep *step = g_slice_new0 (SyncStep);
+
+  step->self = self;
+
+  if (account != NULL)
+    step->account = g_object_ref (account);
+  if (target != NULL)
+    step->target = g_object_ref (target);
+  if (date != NULL)
+    step->date = g_date_new_julian (g_date_get_julian (date));
+
+  return step;
+}
+
+static void
+sync_step_free (SyncStep *step)
+{
+  tp_clear_object (&step->account);
+  tp_clear_object (&step->target);
+  tp_clear_pointer (&step->date, g_date_free);
+  g_slice_free (SyncStep, step);
+}
+
+/* Lower-cased, normalized words of @text, split on anything which isn't a
+ * letter or a digit. Free with g_strfreev(). */
+static gchar **
+log_index_tokenize (const gchar *text)
+{
+  GPtrArray *words;
+  gchar *folded, *normalized;
+  const gchar *p, *start = NULL;
+
+  words = g_ptr_array_new ();
+
+  if (text == NULL || !g_utf8_validate (text, -1, NULL))
+    goto out;
+
+  folded = g_utf8_casefold (text, -1);
+  normalized = g_utf8_normalize (folded, -1, G_NORMALIZE_ALL_COMPOSE);
+  g_free (folded);
+
+  for (p = normalized; *p != '\0'; p = g_utf8_next_char (p))
+    {
+      if (g_unichar_isalnum (g_utf8_get_char (p)))
+        {
+          if (start == NULL)
+            start = p;
+        }
+      else if (start != NULL)
+        {
+          g_ptr_array_add (words, g_strndup (start, p - start));
+          start = NULL;
+        }
+    }
+
+  if (start != NULL)
+    g_ptr_array_add (words, g_strdup (start));
+
+  g_free (normalized);
+
+out:
+  g_ptr_array_add (words, NULL);
+
+  return (gchar **) g_ptr_array_free (words, FALSE);
+}
+
+static Entity *
+log_index_ensure_entity (EmpathyLogIndex *self,
+    const gchar *account_path,
+    const gchar *target_id,
+    const gchar *alias,
+    gboolean is_chatroom)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+  Entity key, *entity;
+
+  key.account_path = g_string_chunk_insert_const (priv->strings,
+      account_path);
+  key.target_id = g_string_chunk_insert_const (priv->strings, target_id);
+
+  entity = g_hash_table_lookup (priv->entities, &key);
+  if (entity == NULL)
+    {
+      entity = g_slice_new0 (Entity);
+      entity->account_path = key.account_path;
+      entity->target_id = key.target_id;
+      entity->is_chatroom = is_chatroom;
+      g_hash_table_add (priv->entities, entity);
+    }
+
+  if (!tp_str_empty (alias) && tp_strdiff (alias, entity->alias))
+    {
+      g_free (entity->alias);
+      entity->alias = g_strdup (alias);
+    }
+
+  return entity;
+}
+
+/* Takes ownership of @words, which have to be interned. Returns FALSE if
+ * the message was already indexed. */
+static gboolean
+log_index_add_doc (EmpathyLogIndex *self,
+    Entity *entity,
+    gint64 timestamp,
+    guint32 julian,
+    const gchar **words,
+    guint n_words)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+  Doc *doc;
+  guint id, i;
+
+  doc = g_slice_new0 (Doc);
+  doc->entity = entity;
+  doc->timestamp = timestamp;
+  doc->julian = julian;
+  doc->words = words;
+  doc->n_words = n_words;
+
+  if (g_hash_table_contains (priv->doc_set, doc))
+    {
+      doc_free (doc);
+      return FALSE;
+    }
+
+  id = priv->docs->len;
+  g_ptr_array_add (priv->docs, doc);
+  g_hash_table_add (priv->doc_set, doc);
+
+  for (i = 0; i < n_words; i++)
+    {
+      GArray *postings;
+      Posting posting = { id, i };
+
+      postings = g_hash_table_lookup (priv->postings, words[i]);
+      if (postings == NULL)
+        {
+          postings = g_array_new (FALSE, FALSE, sizeof (Posting));
+          g_hash_table_insert (priv->postings, (gpointer) words[i], postings);
+          priv->words_dirty = TRUE;
+        }
+
+      g_array_append_val (postings, posting);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+log_index_add_text (EmpathyLogIndex *self,
+    Entity *entity,
+    gint64 timestamp,
+    guint32 julian,
+    const gchar *text)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+  gchar **tokens;
+  const gchar **words;
+  guint n_words, i;
+
+  tokens = log_index_tokenize (text);
+  n_words = g_strv_length (tokens);
+
+  if (n_words == 0)
+    {
+      g_strfreev (tokens);
+      return FALSE;
+    }
+
+  words = g_new (const gchar *, n_words);
+  for (i = 0; i < n_words; i++)
+    words[i] = g_string_chunk_insert_const (priv->strings, tokens[i]);
+
+  g_strfreev (tokens);
+
+  return log_index_add_doc (self, entity, timestamp, julian, words, n_words);
+}
+
+static gboolean
+log_index_save_cb (gpointer user_data)
+{
+  EmpathyLogIndex *self = user_data;
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+  GError *error = NULL;
+
+  priv->save_id = 0;
+
+  if (!empathy_log_index_save (self, &error))
+    {
+      DEBUG ("Failed to save the log index: %s", error->message);
+      g_error_free (error);
+    }
+
+  return FALSE;
+}
+
+/* Saves are coalesced, as a sync adds events for each day it fetches */
+static void
+log_index_queue_save (EmpathyLogIndex *self)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+
+  priv->dirty = TRUE;
+
+  if (priv->save_id != 0 || priv->filename == NULL)
+    return;
+
+  priv->save_id = g_timeout_add_seconds (SAVE_TIMEOUT, log_index_save_cb,
+      self);
+}
+
+static void
+log_index_set_ready (EmpathyLogIndex *self)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+
+  if (priv->ready)
+    return;
+
+  priv->ready = TRUE;
+  g_object_notify (G_OBJECT (self), "ready");
+}
+
+static void
+log_index_load (EmpathyLogIndex *self)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+  GPtrArray *entities;
+  gchar *contents, *line, *next;
+  gint64 start;
+  GError *error = NULL;
+
+  if (!g_file_get_contents (priv->filename, &contents, NULL, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        DEBUG ("Failed to read %s: %s", priv->filename, error->message);
+
+      g_error_free (error);
+      return;
+    }
+
+  start = g_get_monotonic_time ();
+  entities = g_ptr_array_new ();
+
+  for (line = contents; line != NULL; line = next)
+    {
+      gchar **fields;
+
+      next = strchr (line, '\n');
+      if (next != NULL)
+        *next++ = '\0';
+
+      if (line == contents)
+        {
+          if (tp_strdiff (line, FILE_MAGIC))
+            {
+              DEBUG ("%s has an unknown format, ignoring it", priv->filename);
+              break;
+            }
+
+          continue;
+        }
+
+      fields = g_strsplit (line, "\t", 6);
+
+      if (!tp_strdiff (fields[0], "complete") && fields[1] != NULL)
+        {
+          priv->complete = g_ascii_strtoull (fields[1], NULL, 10);
+        }
+      else if (!tp_strdiff (fields[0], "E") && g_strv_length (fields) == 6)
+        {
+          gchar *account_path, *target_id, *alias;
+          Entity *entity;
+
+          account_path = g_strcompress (fields[1]);
+          target_id = g_strcompress (fields[2]);
+          alias = g_strcompress (fields[3]);
+
+          entity = log_index_ensure_entity (self, account_path, target_id,
+              alias, g_ascii_strtoull (fields[4], NULL, 10));
+          entity->synced = g_ascii_strtoull (fields[5], NULL, 10);
+          g_ptr_array_add (entities, entity);
+
+          g_free (account_path);
+          g_free (target_id);
+          g_free (alias);
+        }
+      else if (!tp_strdiff (fields[0], "D") && g_strv_length (fields) >= 5)
+        {
+          guint id = g_ascii_strtoull (fields[1], NULL, 10);
+          gchar **tokens;
+          const gchar **words;
+          guint n_words, i;
+
+          if (id >= entities->len)
+            goto skip;
+
+          tokens = g_strsplit (fields[4], " ", -1);
+          n_words = g_strv_length (tokens);
+
+          words = g_new (const gchar *, n_words);
+          for (i = 0; i < n_words; i++)
+            words[i] = g_string_chunk_insert_const (priv->strings,
+                tokens[i]);
+
+          log_index_add_doc (self, g_ptr_array_index (entities, id),
+              g_ascii_strtoll (fields[2], NULL, 10),
+              g_ascii_strtoull (fields[3], NULL, 10),
+              words, n_words);
+
+          g_strfreev (tokens);
+        }
+
+skip:
+      g_strfreev (fields);
+    }
+
+  DEBUG ("Loaded %u events from %s in %" G_GINT64_FORMAT " ms",
+      priv->docs->len, priv->filename,
+      (g_get_monotonic_time () - start) / 1000);
+
+  g_ptr_array_unref (entities);
+  g_free (contents);
+
+  if (priv->complete)
+    log_index_set_ready (self);
+}
+
+static void log_index_sync_next (EmpathyLogIndex *self);
+
+static void
+log_index_got_events_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  SyncStep *step = user_data;
+  EmpathyLogIndex *self = step->self;
+  EmpathyLogIndexPriv *priv;
+  Entity *entity;
+  GList *events, *l;
+  guint32 julian;
+  GError *error = NULL;
+
+  if (self == NULL)
+    goto out;
+
+  g_object_remove_weak_pointer (G_OBJECT (self), (gpointer *) &step->self);
+  priv = GET_PRIV (self);
+
+  if (!tpl_log_manager_get_events_for_date_finish (TPL_LOG_MANAGER (manager),
+        result, &events, &error))
+    {
+      DEBUG ("Failed to get events: %s", error->message);
+      g_error_free (error);
+      goto next;
+    }
+
+  julian = g_date_get_julian (step->date);
+  entity = log_index_ensure_entity (self,
+      tp_proxy_get_object_path (step->account),
+      tpl_entity_get_identifier (step->target),
+      tpl_entity_get_alias (step->target),
+      tpl_entity_get_entity_type (step->target) == TPL_ENTITY_ROOM);
+
+  for (l = events; l != NULL; l = g_list_next (l))
+    {
+      TplEvent *event = l->data;
+
+      if (TPL_IS_TEXT_EVENT (event) &&
+          log_index_add_text (self, entity, tpl_event_get_timestamp (event),
+            julian, tpl_text_event_get_message (TPL_TEXT_EVENT (event))))
+        priv->sync_added++;
+    }
+
+  g_list_free_full (events, g_object_unref);
+
+  entity->synced = MAX (entity->synced, julian);
+  log_index_queue_save (self);
+
+next:
+  log_index_sync_next (self);
+out:
+  sync_step_free (step);
+}
+
+static void
+log_index_got_dates_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  SyncStep *step = user_data;
+  EmpathyLogIndex *self = step->self;
+  EmpathyLogIndexPriv *priv;
+  Entity *entity;
+  GList *dates, *l;
+  GError *error = NULL;
+
+  if (self == NULL)
+    goto out;
+
+  g_object_remove_weak_pointer (G_OBJECT (self), (gpointer *) &step->self);
+  priv = GET_PRIV (self);
+
+  if (!tpl_log_manager_get_dates_finish (TPL_LOG_MANAGER (manager),
+        result, &dates, &error))
+    {
+      DEBUG ("Failed to get dates: %s", error->message);
+      g_error_free (error);
+      goto next;
+    }
+
+  entity = log_index_ensure_entity (self,
+      tp_proxy_get_object_path (step->account),
+      tpl_entity_get_identifier (step->target),
+      tpl_entity_get_alias (step->target),
+      tpl_entity_get_entity_type (step->target) == TPL_ENTITY_ROOM);
+
+  /* The days are fetched before moving on to the next entity, oldest
+   * first so entity->synced never skips one. The last synced day is fetched
+   * again as it may have been synced before its end. */
+  for (l = g_list_last (dates); l != NULL; l = g_list_previous (l))
+    {
+      GDate *date = l->data;
+
+      if (g_date_get_julian (date) < entity->synced)
+        break;
+
+      g_queue_push_head (&priv->sync_queue,
+          sync_step_new (self, step->account, step->target, date));
+    }
+
+  g_list_free_full (dates, g_free);
+
+next:
+  log_index_sync_next (self);
+out:
+  sync_step_free (step);
+}
+
+static void
+log_index_got_entities_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  SyncStep *step = user_data;
+  EmpathyLogIndex *self = step->self;
+  EmpathyLogIndexPriv *priv;
+  GList *entities, *l;
+  GError *error = NULL;
+
+  if (self == NULL)
+    goto out;
+
+  g_object_remove_weak_pointer (G_OBJECT (self), (gpointer *) &step->self);
+  priv = GET_PRIV (self);
+
+  if (!tpl_log_manager_get_entities_finish (TPL_LOG_MANAGER (manager),
+        result, &entities, &error))
+    {
+      DEBUG ("Failed to get entities: %s", error->message);
+      g_error_free (error);
+      goto next;
+    }
+
+  for (l = entities; l != NULL; l = g_list_next (l))
+    g_queue_push_tail (&priv->sync_queue,
+        sync_step_new (self, step->account, l->data, NULL));
+
+  g_list_free_full (entities, g_object_unref);
+
+next:
+  log_index_sync_next (self);
+out:
+  sync_step_free (step);
+}
+
+static void
+log_index_account_manager_prepared_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpAccountManager *manager = TP_ACCOUNT_MANAGER (source);
+  SyncStep *step = user_data;
+  EmpathyLogIndex *self = step->self;
+  EmpathyLogIndexPriv *priv;
+  GList *accounts, *l;
+  GError *error = NULL;
+
+  if (self == NULL)
+    goto out;
+
+  g_object_remove_weak_pointer (G_OBJECT (self), (gpointer *) &step->self);
+  priv = GET_PRIV (self);
+
+  if (!tp_proxy_prepare_finish (manager, result, &error))
+    {
+      DEBUG ("Failed to prepare the account manager: %s", error->message);
+      g_error_free (error);
+      goto next;
+    }
+
+  accounts = tp_account_manager_dup_valid_accounts (manager);
+
+  for (l = accounts; l != NULL; l = g_list_next (l))
+    g_queue_push_tail (&priv->sync_queue,
+        sync_step_new (self, l->data, NULL, NULL));
+
+  g_list_free_full (accounts, g_object_unref);
+
+next:
+  log_index_sync_next (self);
+out:
+  sync_step_free (step);
+  g_object_unref (manager);
+}
+
+static gboolean
+log_index_sync_cb (gpointer user_data)
+{
+  EmpathyLogIndex *self = user_data;
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+  SyncStep *step;
+
+  priv->sync_id = 0;
+
+  step = g_queue_pop_head (&priv->sync_queue);
+  if (step == NULL)
+    {
+      DEBUG ("Log index synced, %u new events in %" G_GINT64_FORMAT " ms, "
+          "%u in total", priv->sync_added,
+          (g_get_monotonic_time () - priv->sync_start) / 1000,
+          priv->docs->len);
+
+      priv->syncing = FALSE;
+      priv->complete = TRUE;
+      log_index_queue_save (self);
+      log_index_set_ready (self);
+      return FALSE;
+    }
+
+  g_object_add_weak_pointer (G_OBJECT (self), (gpointer *) &step->self);
+
+  if (step->account == NULL)
+    tp_proxy_prepare_async (tp_account_manager_dup (), NULL,
+        log_index_account_manager_prepared_cb, step);
+  else if (step->target == NULL)
+    tpl_log_manager_get_entities_async (priv->log_manager, step->account,
+        log_index_got_entities_cb, step);
+  else if (step->date == NULL)
+    tpl_log_manager_get_dates_async (priv->log_manager, step->account,
+        step->target, TPL_EVENT_MASK_TEXT, log_index_got_dates_cb, step);
+  else
+    tpl_log_manager_get_events_for_date_async (priv->log_manager,
+        step->account, step->target, TPL_EVENT_MASK_TEXT, step->date,
+        log_index_got_events_cb, step);
+
+  return FALSE;
+}
+
+/* Only one logger call is pending at a time, and the next one is made from
+ * a low priority idle so syncing doesn't get in the way of the UI. */
+static void
+log_index_sync_next (EmpathyLogIndex *self)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+
+  g_assert (priv->sync_id == 0);
+
+  priv->sync_id = g_idle_add_full (G_PRIORITY_LOW, log_index_sync_cb, self,
+      NULL);
+}
+
+/* Whether the words of @doc from @pos are @words, the last one being only
+ * a prefix if @prefix */
+static gboolean
+log_index_doc_has_words (Doc *doc,
+    guint pos,
+    const gchar **words,
+    guint n_words,
+    gboolean prefix)
+{
+  guint i;
+
+  if (pos + n_words > doc->n_words)
+    return FALSE;
+
+  for (i = 0; i < n_words; i++)
+    {
+      if (prefix && i == n_words - 1)
+        return g_str_has_prefix (doc->words[pos + i], words[i]);
+
+      /* both are interned */
+      if (doc->words[pos + i] != words[i])
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gint
+compare_uint (gconstpointer a,
+    gconstpointer b)
+{
+  guint ua = *(const guint *) a;
+  guint ub = *(const guint *) b;
+
+  return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
+
+static gint
+compare_words (gconstpointer a,
+    gconstpointer b)
+{
+  return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* The index in priv->sorted_words of the first word not lower than
+ * @word */
+static guint
+log_index_lower_bound (EmpathyLogIndex *self,
+    const gchar *word)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+  guint low = 0, high;
+
+  if (priv->words_dirty)
+    {
+      GHashTableIter iter;
+      gpointer key;
+
+      g_ptr_array_set_size (priv->sorted_words, 0);
+
+      g_hash_table_iter_init (&iter, priv->postings);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_add (priv->sorted_words, key);
+
+      g_ptr_array_sort (priv->sorted_words, compare_words);
+      priv->words_dirty = FALSE;
+    }
+
+  high = priv->sorted_words->len;
+
+  while (low < high)
+    {
+      guint mid = low + (high - low) / 2;
+
+      if (strcmp (g_ptr_array_index (priv->sorted_words, mid), word) < 0)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  return low;
+}
+
+/* The sorted ids of the docs having @tokens in a row, the last one being
+ * only a prefix if @prefix */
+static GArray *
+log_index_match (EmpathyLogIndex *self,
+    gchar **tokens,
+    gboolean prefix)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+  GArray *matches;
+  const gchar **words;
+  guint n_words, i, j;
+
+  matches = g_array_new (FALSE, FALSE, sizeof (guint));
+  n_words = g_strv_length (tokens);
+  words = g_new0 (const gchar *, n_words);
+
+  /* all the words but a prefix have to be known, and we use their
+   * interned version from there */
+  for (i = 0; i < n_words; i++)
+    {
+      gpointer key;
+
+      if (prefix && i == n_words - 1)
+        words[i] = tokens[i];
+      else if (g_hash_table_lookup_extended (priv->postings, tokens[i], &key,
+            NULL))
+        words[i] = key;
+      else
+        goto out;
+    }
+
+  if (n_words == 1 && prefix)
+    {
+      for (i = log_index_lower_bound (self, words[0]);
+           i < priv->sorted_words->len;
+           i++)
+        {
+          const gchar *word = g_ptr_array_index (priv->sorted_words, i);
+          GArray *postings;
+
+          if (!g_str_has_prefix (word, words[0]))
+            break;
+
+          postings = g_hash_table_lookup (priv->postings, word);
+          for (j = 0; j < postings->len; j++)
+            g_array_append_val (matches,
+                g_array_index (postings, Posting, j).doc);
+        }
+    }
+  else
+    {
+      GArray *postings = g_hash_table_lookup (priv->postings, words[0]);
+
+      for (j = 0; j < postings->len; j++)
+        {
+          Posting *posting = &g_array_index (postings, Posting, j);
+
+          if (log_index_doc_has_words (
+                g_ptr_array_index (priv->docs, posting->doc), posting->pos,
+                words, n_words, prefix))
+            g_array_append_val (matches, posting->doc);
+        }
+    }
+
+  g_array_sort (matches, compare_uint);
+
+  /* drop the duplicates */
+  for (i = 0, j = 0; i < matches->len; i++)
+    {
+      if (j > 0 && g_array_index (matches, guint, j - 1) ==
+          g_array_index (matches, guint, i))
+        continue;
+
+      g_array_index (matches, guint, j++) = g_array_index (matches, guint, i);
+    }
+  g_array_set_size (matches, j);
+
+out:
+  g_free (words);
+
+  return matches;
+}
+
+/* Keeps the ids of @a which are in @b, both being sorted */
+static void
+intersect (GArray *a,
+    GArray *b)
+{
+  guint i = 0, j = 0, n = 0;
+
+  while (i < a->len && j < b->len)
+    {
+      guint ua = g_array_index (a, guint, i);
+      guint ub = g_array_index (b, guint, j);
+
+      if (ua < ub)
+        {
+          i++;
+        }
+      else if (ua > ub)
+        {
+          j++;
+        }
+      else
+        {
+          g_array_index (a, guint, n++) = ua;
+          i++;
+          j++;
+        }
+    }
+
+  g_array_set_size (a, n);
+}
+
+/* Restricts @docs to the docs matching @clause, @docs being NULL before
+ * the first clause */
+static void
+log_index_filter (EmpathyLogIndex *self,
+    GArray **docs,
+    const gchar *clause,
+    gboolean prefix)
+{
+  gchar **tokens = log_index_tokenize (clause);
+  GArray *matches;
+
+  if (tokens[0] == NULL)
+    goto out;
+
+  matches = log_index_match (self, tokens, prefix);
+
+  if (*docs == NULL)
+    {
+      *docs = matches;
+    }
+  else
+    {
+      intersect (*docs, matches);
+      g_array_unref (matches);
+    }
+
+out:
+  g_strfreev (tokens);
+}
+
+static gint
+compare_hits (gconstpointer a,
+    gconstpointer b)
+{
+  const EmpathyLogIndexHit *hit_a = a;
+  const EmpathyLogIndexHit *hit_b = b;
+  gint ret;
+
+  ret = g_date_compare (&hit_a->date, &hit_b->date);
+  if (ret != 0)
+    return ret;
+
+  return g_strcmp0 (hit_a->target_id, hit_b->target_id);
+}
+
+static void
+do_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_FILENAME:
+        g_value_set_string (value, priv->filename);
+        break;
+      case PROP_READY:
+        g_value_set_boolean (value, priv->ready);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+do_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_FILENAME:
+        priv->filename = g_value_dup_string (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+do_constructed (GObject *object)
+{
+  EmpathyLogIndex *self = EMPATHY_LOG_INDEX (object);
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+
+  if (priv->filename != NULL)
+    log_index_load (self);
+
+  G_OBJECT_CLASS (empathy_log_index_parent_class)->constructed (object);
+}
+
+static void
+do_dispose (GObject *object)
+{
+  EmpathyLogIndex *self = EMPATHY_LOG_INDEX (object);
+  EmpathyLogIndexPriv *priv = GET_PRIV (self);
+
+  if (priv->sync_id != 0)
+    {
+      g_source_remove (priv->sync_id);
+      priv->sync_id = 0;
+    }
+
+  g_queue_foreach (&priv->sync_queue, (GFunc) sync_step_free, NULL);
+  g_queue_clear (&priv->sync_queue);
+
+  if (priv->save_id != 0)
+    {
+      g_source_remove (priv->save_id);
+      log_index_save_cb (self);
+    }
+
+  tp_clear_object (&priv->log_manager);
+
+  G_OBJECT_CLASS (empathy_log_index_parent_class)->dispose (object);
+}
+
+static void
+do_finalize (GObject *object)
+{
+  EmpathyLogIndexPriv *priv = GET_PRIV (object);
+
+  DEBUG ("%p", object);
+
+  g_hash_table_unref (priv->doc_set);
+  g_hash_table_unref (priv->postings);
+  g_ptr_array_unref (priv->sorted_words);
+  g_ptr_array_unref (priv->docs);
+  g_hash_table_unref (priv->entities);
+  g_string_chunk_free (priv->strings);
+  g_free (priv->filename);
+
+  G_OBJECT_CLASS (empathy_log_index_parent_class)->finalize (object);
+}
+
+static void
+empathy_log_index_class_init (EmpathyLogIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (klass, sizeof (EmpathyLogIndexPriv));
+
+  object_class->get_property = do_get_property;
+  object_class->set_property = do_set_property;
+  object_class->constructed = do_constructed;
+  object_class->dispose = do_dispose;
+  object_class->finalize = do_finalize;
+
+  /**
+   * EmpathyLogIndex:filename:
+   *
+   * The file the index is loaded from and saved to, or %NULL to keep it in
+   * memory only
+   */
+  param_spec = g_param_spec_string ("filename",
+    "filename", "The file the index is saved to",
+    NULL,
+    G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT_ONLY);
+  g_object_class_install_property (object_class, PROP_FILENAME, param_spec);
+
+  /**
+   * EmpathyLogIndex:ready:
+   *
+   * Whether all the logs have been indexed once, so searching the index
+   * gives the same results as asking the logger
+   */
+  param_spec = g_param_spec_boolean ("ready",
+    "ready", "Whether all the logs are indexed",
+    FALSE,
+    G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_READY, param_spec);
+}
+
+static void
+empathy_log_index_init (EmpathyLogIndex *self)
+{
+  EmpathyLogIndexPriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+    EMPATHY_TYPE_LOG_INDEX, EmpathyLogIndexPriv);
+
+  self->priv = priv;
+
+  priv->strings = g_string_chunk_new (64 * 1024);
+  priv->entities = g_hash_table_new_full (entity_hash, entity_equal,
+      (GDestroyNotify) entity_free, NULL);
+  priv->docs = g_ptr_array_new_with_free_func ((GDestroyNotify) doc_free);
+  priv->doc_set = g_hash_table_new (doc_hash, doc_equal);
+  priv->postings = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify) g_array_unref);
+  priv->sorted_words = g_ptr_array_new ();
+  g_queue_init (&priv->sync_queue);
+}
+
+/* public methods */
+
+/**
+ * empathy_log_index_dup_singleton:
+ *
+ * Gives the caller a reference to the #EmpathyLogIndex singleton,
+ * (creating it if necessary). It is saved in the user's cache directory.
+ *
+ * Return value: an #EmpathyLogIndex object
+ */
+EmpathyLogIndex *
+empathy_log_index_dup_singleton (void)
+{
+  gchar *filename;
+
+  if (index_singleton != NULL)
+    return g_object_ref (index_singleton);
+
+  filename = g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME,
+      "log-index", NULL);
+
+  index_singleton = empathy_log_index_new (filename);
+  g_object_add_weak_pointer (G_OBJECT (index_singleton),
+      (gpointer *) &index_singleton);
+
+  g_free (filename);
+
+  return index_singleton;
+}
+
+/**
+ * empathy_log_index_new:
+ * @filename: (allow-none): the file to load the index from and save it to
+ *
+ * Creates an index which is not shared with the rest of the process, for
+ * instance to test it.
+ *
+ * Return value: a new #EmpathyLogIndex
+ */
+EmpathyLogIndex *
+empathy_log_index_new (const gchar *filename)
+{
+  return g_object_new (EMPATHY_TYPE_LOG_INDEX,
+      "filename", filename,
+      NULL);
+}
+
+/**
+ * empathy_log_index_sync:
+ * @self: an #EmpathyLogIndex
+ *
+ * Starts indexing, in the background, the text events the logger has
+ * stored since the last sync. #EmpathyLogIndex:ready becomes %TRUE once it
+ * is done.
+ */
+void
+empathy_log_index_sync (EmpathyLogIndex *self)
+{
+  EmpathyLogIndexPriv *priv;
+
+  g_return_if_fail (EMPATHY_IS_LOG_INDEX (self));
+
+  priv = GET_PRIV (self);
+
+  if (priv->syncing)
+    return;
+
+  DEBUG ("Syncing the log index");
+
+  priv->syncing = TRUE;
+  priv->sync_start = g_get_monotonic_time ();
+  priv->sync_added = 0;
+
+  if (priv->log_manager == NULL)
+    priv->log_manager = tpl_log_manager_dup_singleton ();
+
+  g_queue_push_tail (&priv->sync_queue, sync_step_new (self, NULL, NULL,
+        NULL));
+  log_index_sync_next (self);
+}
+
+/**
+ * empathy_log_index_is_ready:
+ * @self: an #EmpathyLogIndex
+ *
+ * Return value: the value of #EmpathyLogIndex:ready
+ */
+gboolean
+empathy_log_index_is_ready (EmpathyLogIndex *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_LOG_INDEX (self), FALSE);
+
+  return GET_PRIV (self)->ready;
+}
+
+/**
+ * empathy_log_index_get_n_events:
+ * @self: an #EmpathyLogIndex
+ *
+ * Return value: the number of text events in the index
+ */
+guint
+empathy_log_index_get_n_events (EmpathyLogIndex *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_LOG_INDEX (self), 0);
+
+  return GET_PRIV (self)->docs->len;
+}
+
+/**
+ * empathy_log_index_add_text:
+ * @self: an #EmpathyLogIndex
+ * @account_path: the object path of the account of the conversation
+ * @target_id: the identifier of the contact or room of the conversation
+ * @target_alias: (allow-none): the alias of the contact or room
+ * @is_chatroom: whether @target_id is a room
+ * @timestamp: when the message was sent, as logged
+ * @text: the text of the message
+ *
+ * Indexes a message which has just been sent or received. Adding a message
+ * which the index already has does nothing, so the following syncs don't
+ * index it twice.
+ */
+void
+empathy_log_index_add_text (EmpathyLogIndex *self,
+    const gchar *account_path,
+    const gchar *target_id,
+    const gchar *target_alias,
+    gboolean is_chatroom,
+    gint64 timestamp,
+    const gchar *text)
+{
+  Entity *entity;
+  GDateTime *datetime;
+  GDate date;
+
+  g_return_if_fail (EMPATHY_IS_LOG_INDEX (self));
+  g_return_if_fail (account_path != NULL);
+  g_return_if_fail (target_id != NULL);
+
+  /* the logger files its events by UTC day */
+  datetime = g_date_time_new_from_unix_utc (timestamp);
+  g_date_clear (&date, 1);
+  g_date_set_dmy (&date, g_date_time_get_day_of_month (datetime),
+      g_date_time_get_month (datetime), g_date_time_get_year (datetime));
+  g_date_time_unref (datetime);
+
+  entity = log_index_ensure_entity (self, account_path, target_id,
+      target_alias, is_chatroom);
+
+  if (log_index_add_text (self, entity, timestamp, g_date_get_julian (&date),
+        text))
+    log_index_queue_save (self);
+}
+
+/**
+ * empathy_log_index_clear:
+ * @self: an #EmpathyLogIndex
+ * @account_path: (allow-none): the object path of the account whose
+ *  events are removed, or %NULL to remove them all
+ *
+ * Removes events from the index, when their logs are deleted. The index
+ * is saved a while after; call empathy_log_index_save() to remove them
+ * from the disk right away.
+ */
+void
+empathy_log_index_clear (EmpathyLogIndex *self,
+    const gchar *account_path)
+{
+  EmpathyLogIndexPriv *priv;
+  GPtrArray *docs;
+  GHashTableIter iter;
+  gpointer key;
+  guint n_events, i;
+
+  g_return_if_fail (EMPATHY_IS_LOG_INDEX (self));
+
+  priv = GET_PRIV (self);
+  n_events = priv->docs->len;
+
+  if (account_path != NULL)
+    account_path = g_string_chunk_insert_const (priv->strings, account_path);
+
+  /* doc ids are their position, so the postings are rebuilt with the
+   * docs which are kept */
+  docs = priv->docs;
+  priv->docs = g_ptr_array_new_with_free_func ((GDestroyNotify) doc_free);
+  g_hash_table_remove_all (priv->doc_set);
+  g_hash_table_remove_all (priv->postings);
+  priv->words_dirty = TRUE;
+
+  for (i = 0; i < docs->len; i++)
+    {
+      Doc *doc = g_ptr_array_index (docs, i);
+
+      if (account_path == NULL || doc->entity->account_path == account_path)
+        continue;
+
+      log_index_add_doc (self, doc->entity, doc->timestamp, doc->julian,
+          doc->words, doc->n_words);
+      /* now owned by the new doc */
+      doc->words = NULL;
+    }
+
+  g_ptr_array_unref (docs);
+
+  /* and the next syncs index again whatever the logger still has */
+  g_hash_table_iter_init (&iter, priv->entities);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      Entity *entity = key;
+
+      if (account_path == NULL || entity->account_path == account_path)
+        g_hash_table_iter_remove (&iter);
+    }
+
+  DEBUG ("Removed %u events of %s", n_events - priv->docs->len,
+      account_path != NULL ? account_path : "all the accounts");
+
+  log_index_queue_save (self);
+}
+
+/**
+ * empathy_log_index_search:
+ * @self: an #EmpathyLogIndex
+ * @query: the words and "quoted phrases" to look for
+ * @account_path: (allow-none): only look in the logs of this account
+ * @from: (allow-none): only look in the logs of this day and the next ones
+ * @to: (allow-none): only look in the logs of this day and the previous
+ *  ones
+ *
+ * Finds the days of conversation with events having all the words and
+ * phrases of @query. Words match the words starting with them. Phrases
+ * match these words in a row, the last one also being a prefix if the
+ * phrase isn't closed, e.g. while it is being typed.
+ *
+ * Return value: (transfer full): a list of #EmpathyLogIndexHit, sorted by
+ * date. Free with g_list_free_full() and empathy_log_index_hit_free().
+ */
+GList *
+empathy_log_index_search (EmpathyLogIndex *self,
+    const gchar *query,
+    const gchar *account_path,
+    const GDate *from,
+    const GDate *to)
+{
+  EmpathyLogIndexPriv *priv;
+  GArray *docs = NULL;
+  GHashTable *seen;
+  GList *hits = NULL;
+  gchar **parts;
+  guint32 from_julian = 0, to_julian = G_MAXUINT32;
+  gint64 start;
+  guint i, j;
+
+  g_return_val_if_fail (EMPATHY_IS_LOG_INDEX (self), NULL);
+  g_return_val_if_fail (query != NULL, NULL);
+
+  priv = GET_PRIV (self);
+  start = g_get_monotonic_time ();
+
+  /* The odd parts are quoted. Unquoted parts are split into clauses on
+   * white spaces; the words of a clause, e.g. "foo-bar", have to be in a
+   * row as well. A quoted phrase is exact, unless it is the last part and
+   * wasn't closed. */
+  parts = g_strsplit (query, "\"", -1);
+
+  for (i = 0; parts[i] != NULL; i++)
+    {
+      gchar **clauses;
+
+      if (i % 2 == 1)
+        {
+          log_index_filter (self, &docs, parts[i], parts[i + 1] == NULL);
+          continue;
+        }
+
+      clauses = g_strsplit_set (parts[i], " \t\n", -1);
+
+      for (j = 0; clauses[j] != NULL; j++)
+        log_index_filter (self, &docs, clauses[j], TRUE);
+
+      g_strfreev (clauses);
+    }
+
+  g_strfreev (parts);
+
+  if (docs == NULL)
+    return NULL;
+
+  if (account_path != NULL)
+    account_path = g_string_chunk_insert_const (priv->strings, account_path);
+  if (from != NULL)
+    from_julian = g_date_get_julian (from);
+  if (to != NULL)
+    to_julian = g_date_get_julian (to);
+
+  /* Entity * => their days with hits, as a GHashTable of julians */
+  seen = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_hash_table_unref);
+
+  for (i = 0; i < docs->len; i++)
+    {
+      Doc *doc = g_ptr_array_index (priv->docs,
+          g_array_index (docs, guint, i));
+      EmpathyLogIndexHit *hit;
+      GHashTable *days;
+
+      if (account_path != NULL && doc->entity->account_path != account_path)
+        continue;
+
+      if (doc->julian < from_julian || doc->julian > to_julian)
+        continue;
+
+      days = g_hash_table_lookup (seen, doc->entity);
+      if (days == NULL)
+        {
+          days = g_hash_table_new (NULL, NULL);
+          g_hash_table_insert (seen, doc->entity, days);
+        }
+
+      if (g_hash_table_contains (days, GUINT_TO_POINTER (doc->julian)))
+        continue;
+
+      g_hash_table_add (days, GUINT_TO_POINTER (doc->julian));
+
+      hit = g_slice_new0 (EmpathyLogIndexHit);
+      hit->account_path = g_strdup (doc->entity->account_path);
+      hit->target_id = g_strdup (doc->entity->target_id);
+      hit->target_alias = g_strdup (doc->entity->alias);
+      hit->is_chatroom = doc->entity->is_chatroom;
+      g_date_clear (&hit->date, 1);
+      g_date_set_julian (&hit->date, doc->julian);
+
+      hits = g_list_prepend (hits, hit);
+    }
+
+  hits = g_list_sort (hits, compare_hits);
+
+  DEBUG ("'%s': %u events, %u days in %" G_GINT64_FORMAT " us", query,
+      docs->len, g_list_length (hits), g_get_monotonic_time () - start);
+
+  g_hash_table_unref (seen);
+  g_array_unref (docs);
+
+  return hits;
+}
+
+/**
+ * empathy_log_index_hit_free:
+ * @hit: an #EmpathyLogIndexHit
+ *
+ * Frees a hit returned by empathy_log_index_search().
+ */
+void
+empathy_log_index_hit_free (EmpathyLogIndexHit *hit)
+{
+  g_free (hit->account_path);
+  g_free (hit->target_id);
+  g_free (hit->target_alias);
+  g_slice_free (EmpathyLogIndexHit, hit);
+}
+
+/**
+ * empathy_log_index_save:
+ * @self: an #EmpathyLogIndex
+ * @error: a #GError to fill
+ *
+ * Saves the index to #EmpathyLogIndex:filename right away. It otherwise is
+ * saved a while after it changes.
+ *
+ * Return value: %FALSE if the index couldn't be saved
+ */
+gboolean
+empathy_log_index_save (EmpathyLogIndex *self,
+    GError **error)
+{
+  EmpathyLogIndexPriv *priv;
+  GHashTable *ids;
+  GHashTableIter iter;
+  gpointer key;
+  GString *str;
+  gchar *dir;
+  gint64 start;
+  gboolean ret;
+  guint i, j, n = 0;
+
+  g_return_val_if_fail (EMPATHY_IS_LOG_INDEX (self), FALSE);
+
+  priv = GET_PRIV (self);
+
+  if (priv->filename == NULL || !priv->dirty)
+    return TRUE;
+
+  start = g_get_monotonic_time ();
+
+  if (priv->save_id != 0)
+    {
+      g_source_remove (priv->save_id);
+      priv->save_id = 0;
+    }
+
+  str = g_string_new (FILE_MAGIC "\n");
+  g_string_append_printf (str, "complete\t%d\n", priv->complete);
+
+  /* Entity * => their id in the file */
+  ids = g_hash_table_new (NULL, NULL);
+
+  g_hash_table_iter_init (&iter, priv->entities);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      Entity *entity = key;
+      gchar *account_path, *target_id, *alias;
+
+      account_path = g_strescape (entity->account_path, NULL);
+      target_id = g_strescape (entity->target_id, NULL);
+      alias = g_strescape (entity->alias != NULL ? entity->alias : "", NULL);
+
+      g_string_append_printf (str, "E\t%s\t%s\t%s\t%d\t%u\n", account_path,
+          target_id, alias, entity->is_chatroom, entity->synced);
+      g_hash_table_insert (ids, entity, GUINT_TO_POINTER (n++));
+
+      g_free (account_path);
+      g_free (target_id);
+      g_free (alias);
+    }
+
+  for (i = 0; i < priv->docs->len; i++)
+    {
+      Doc *doc = g_ptr_array_index (priv->docs, i);
+
+      g_string_append_printf (str, "D\t%u\t%" G_GINT64_FORMAT "\t%u\t",
+          GPOINTER_TO_UINT (g_hash_table_lookup (ids, doc->entity)),
+          doc->timestamp, doc->julian);
+
+      /* words have no white spaces */
+      for (j = 0; j < doc->n_words; j++)
+        {
+          if (j > 0)
+            g_string_append_c (str, ' ');
+          g_string_append (str, doc->words[j]);
+        }
+
+      g_string_append_c (str, '\n');
+    }
+
+  g_hash_table_unref (ids);
+
+  dir = g_path_get_dirname (priv->filename);
+  g_mkdir_with_parents (dir, S_IRUSR | S_IWUSR | S_IXUSR);
+  g_free (dir);
+
+  ret = g_file_set_contents (priv->filename, str->str, str->len, error);
+  if (ret)
+    priv->dirty = FALSE;
+
+  DEBUG ("Saved %u events (%" G_GSIZE_FORMAT " bytes) in %" G_GINT64_FORMAT
+      " ms", priv->docs->len, str->len,
+      (g_get_monotonic_time () - start) / 1000);
+
+  g_string_free (str, TRUE);
+
+  return ret;
+}
@@ -0,0 +1,101 @@
+/*
+ * empathy-log-index.h - Header for EmpathyLogIndex
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_LOG_INDEX_H__
+#define __EMPATHY_LOG_INDEX_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_LOG_INDEX empathy_log_index_get_type()
+#define EMPATHY_LOG_INDEX(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   EMPATHY_TYPE_LOG_INDEX, EmpathyLogIndex))
+#define EMPATHY_LOG_INDEX_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   EMPATHY_TYPE_LOG_INDEX, EmpathyLogIndexClass))
+#define EMPATHY_IS_LOG_INDEX(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EMPATHY_TYPE_LOG_INDEX))
+#define EMPATHY_IS_LOG_INDEX_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), EMPATHY_TYPE_LOG_INDEX))
+#define EMPATHY_LOG_INDEX_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   EMPATHY_TYPE_LOG_INDEX, EmpathyLogIndexClass))
+
+typedef struct {
+  GObject parent;
+  gpointer priv;
+} EmpathyLogIndex;
+
+typedef struct {
+  GObjectClass parent_class;
+} EmpathyLogIndexClass;
+
+/**
+ * EmpathyLogIndexHit:
+ * @account_path: the object path of the account the events were logged on
+ * @target_id: the identifier of the contact or room
+ * @target_alias: the alias of the contact or room
+ * @is_chatroom: whether @target_id is a room
+ * @date: the day the events were logged, in UTC like the logger's dates
+ *
+ * A day of conversation with one contact or room having events which
+ * match a query.
+ */
+typedef struct {
+  gchar *account_path;
+  gchar *target_id;
+  gchar *target_alias;
+  gboolean is_chatroom;
+  GDate date;
+} EmpathyLogIndexHit;
+
+GType empathy_log_index_get_type (void);
+
+EmpathyLogIndex * empathy_log_index_dup_singleton (void);
+EmpathyLogIndex * empathy_log_index_new (const gchar *filename);
+
+void empathy_log_index_sync (EmpathyLogIndex *self);
+gboolean empathy_log_index_is_ready (EmpathyLogIndex *self);
+guint empathy_log_index_get_n_events (EmpathyLogIndex *self);
+
+void empathy_log_index_add_text (EmpathyLogIndex *self,
+    const gchar *account_path,
+    const gchar *target_id,
+    const gchar *target_alias,
+    gboolean is_chatroom,
+    gint64 timestamp,
+    const gchar *text);
+void empathy_log_index_clear (EmpathyLogIndex *self,
+    const gchar *account_path);
+
+GList * empathy_log_index_search (EmpathyLogIndex *self,
+    const gchar *query,
+    const gchar *account_path,
+    const GDate *from,
+    const GDate *to);
+void empathy_log_index_hit_free (EmpathyLogIndexHit *hit);
+
+gboolean empathy_log_index_save (EmpathyLogIndex *self,
+    GError **error);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_LOG_INDEX_H__ */
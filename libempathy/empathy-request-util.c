@@ -93,9 +93,21 @@ void
 empathy_join_muc (TpAccount *account,
     const gchar *room_name,
     gint64 timestamp)
+{
+  empathy_join_muc_full (account, room_name, timestamp, NULL, NULL);
+}
+
+/* @callback is optional, but if it's provided, it should call the right
+ * _finish() func that we call in ensure_text_channel_cb() */
+void
+empathy_join_muc_full (TpAccount *account,
+    const gchar *room_name,
+    gint64 timestamp,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
 {
   create_text_channel (account, TP_HANDLE_TYPE_ROOM,
-      room_name, FALSE, timestamp, NULL, NULL);
+      room_name, FALSE, timestamp, callback, user_data);
 }
 
 /* @callback is optional, but if it's provided, it should call the right
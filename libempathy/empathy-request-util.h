@@ -53,6 +53,12 @@ void empathy_join_muc (TpAccount *account,
   const gchar *roomname,
   gint64 timestamp);
 
+void empathy_join_muc_full (TpAccount *account,
+  const gchar *roomname,
+  gint64 timestamp,
+  GAsyncReadyCallback callback,
+  gpointer user_data);
+
 /* Request a sms channel */
 void empathy_sms_contact_id (TpAccount *account,
   const gchar *contact_id,
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-settings-snapshot.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "empathy-gsettings.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_OTHER
+#include "empathy-debug.h"
+
+typedef enum {
+  SCHEMA_CHAT,
+  SCHEMA_NOTIFICATIONS,
+  SCHEMA_SOUNDS,
+  SCHEMA_UI,
+  NB_SCHEMAS
+} SnapshotSchema;
+
+static const gchar *schema_ids[NB_SCHEMAS] = {
+  EMPATHY_PREFS_CHAT_SCHEMA,
+  EMPATHY_PREFS_NOTIFICATIONS_SCHEMA,
+  EMPATHY_PREFS_SOUNDS_SCHEMA,
+  EMPATHY_PREFS_UI_SCHEMA,
+};
+
+typedef struct {
+  SnapshotSchema schema;
+  const gchar *key;
+  gboolean is_string;
+  glong offset;
+} SnapshotKey;
+
+#define BOOLEAN_KEY(schema, key, field) \
+  { schema, key, FALSE, G_STRUCT_OFFSET (EmpathySettingsSnapshot, field) }
+#define STRING_KEY(schema, key, field) \
+  { schema, key, TRUE, G_STRUCT_OFFSET (EmpathySettingsSnapshot, field) }
+
+static const SnapshotKey snapshot_keys[] = {
+  BOOLEAN_KEY (SCHEMA_CHAT, EMPATHY_PREFS_CHAT_SHOW_SMILEYS,
+      chat_show_smileys),
+  BOOLEAN_KEY (SCHEMA_CHAT, EMPATHY_PREFS_CHAT_SEND_CHAT_STATES,
+      chat_send_chat_states),
+  BOOLEAN_KEY (SCHEMA_CHAT, EMPATHY_PREFS_CHAT_AVATAR_IN_ICON,
+      chat_avatar_in_icon),
+  BOOLEAN_KEY (SCHEMA_CHAT, EMPATHY_PREFS_CHAT_WEBKIT_DEVELOPER_TOOLS,
+      chat_webkit_developer_tools),
+  STRING_KEY (SCHEMA_CHAT, EMPATHY_PREFS_CHAT_NICK_COMPLETION_CHAR,
+      chat_nick_completion_char),
+
+  BOOLEAN_KEY (SCHEMA_NOTIFICATIONS, EMPATHY_PREFS_NOTIFICATIONS_ENABLED,
+      notifications_enabled),
+  BOOLEAN_KEY (SCHEMA_NOTIFICATIONS,
+      EMPATHY_PREFS_NOTIFICATIONS_DISABLED_AWAY, notifications_disabled_away),
+  BOOLEAN_KEY (SCHEMA_NOTIFICATIONS, EMPATHY_PREFS_NOTIFICATIONS_FOCUS,
+      notifications_focus),
+  BOOLEAN_KEY (SCHEMA_NOTIFICATIONS,
+      EMPATHY_PREFS_NOTIFICATIONS_CONTACT_SIGNIN,
+      notifications_contact_signin),
+  BOOLEAN_KEY (SCHEMA_NOTIFICATIONS,
+      EMPATHY_PREFS_NOTIFICATIONS_CONTACT_SIGNOUT,
+      notifications_contact_signout),
+
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_ENABLED, sounds_enabled),
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_DISABLED_AWAY,
+      sounds_disabled_away),
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_INCOMING_MESSAGE,
+      sounds_incoming_message),
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_OUTGOING_MESSAGE,
+      sounds_outgoing_message),
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_NEW_CONVERSATION,
+      sounds_new_conversation),
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_SERVICE_LOGIN,
+      sounds_service_login),
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_SERVICE_LOGOUT,
+      sounds_service_logout),
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_CONTACT_LOGIN,
+      sounds_contact_login),
+  BOOLEAN_KEY (SCHEMA_SOUNDS, EMPATHY_PREFS_SOUNDS_CONTACT_LOGOUT,
+      sounds_contact_logout),
+
+  BOOLEAN_KEY (SCHEMA_UI, EMPATHY_PREFS_UI_EVENTS_NOTIFY_AREA,
+      ui_events_notify_area),
+};
+
+struct _EmpathySettingsSnapshotPrivate
+{
+  GSettings *settings[NB_SCHEMAS];
+};
+
+G_DEFINE_TYPE (EmpathySettingsSnapshot, empathy_settings_snapshot,
+    G_TYPE_OBJECT)
+
+static void
+settings_snapshot_load_key (EmpathySettingsSnapshot *self,
+    const SnapshotKey *key)
+{
+  GSettings *settings = self->priv->settings[key->schema];
+
+  if (key->is_string)
+    {
+      gchar **field = &G_STRUCT_MEMBER (gchar *, self, key->offset);
+
+      g_free (*field);
+      *field = g_settings_get_string (settings, key->key);
+    }
+  else
+    {
+      G_STRUCT_MEMBER (gboolean, self, key->offset) =
+        g_settings_get_boolean (settings, key->key);
+    }
+}
+
+static void
+settings_snapshot_changed_cb (GSettings *settings,
+    const gchar *key,
+    EmpathySettingsSnapshot *self)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (snapshot_keys); i++)
+    {
+      const SnapshotKey *k = &snapshot_keys[i];
+
+      if (self->priv->settings[k->schema] != settings ||
+          tp_strdiff (k->key, key))
+        continue;
+
+      DEBUG ("%s.%s changed", schema_ids[k->schema], key);
+      settings_snapshot_load_key (self, k);
+      return;
+    }
+}
+
+static void
+settings_snapshot_dispose (GObject *object)
+{
+  EmpathySettingsSnapshot *self = (EmpathySettingsSnapshot *) object;
+  guint i;
+
+  for (i = 0; i < NB_SCHEMAS; i++)
+    tp_clear_object (&self->priv->settings[i]);
+
+  G_OBJECT_CLASS (empathy_settings_snapshot_parent_class)->dispose (object);
+}
+
+static void
+settings_snapshot_finalize (GObject *object)
+{
+  EmpathySettingsSnapshot *self = (EmpathySettingsSnapshot *) object;
+
+  DEBUG ("%" G_GUINT64_FORMAT " GSettings reads avoided", self->reads_avoided);
+
+  g_free (self->chat_nick_completion_char);
+
+  G_OBJECT_CLASS (empathy_settings_snapshot_parent_class)->finalize (object);
+}
+
+static void
+empathy_settings_snapshot_class_init (EmpathySettingsSnapshotClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = settings_snapshot_dispose;
+  object_class->finalize = settings_snapshot_finalize;
+
+  g_type_class_add_private (object_class,
+      sizeof (EmpathySettingsSnapshotPrivate));
+}
+
+static void
+empathy_settings_snapshot_init (EmpathySettingsSnapshot *self)
+{
+  guint i;
+
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EMPATHY_TYPE_SETTINGS_SNAPSHOT, EmpathySettingsSnapshotPrivate);
+
+  for (i = 0; i < NB_SCHEMAS; i++)
+    {
+      self->priv->settings[i] = g_settings_new (schema_ids[i]);
+
+      g_signal_connect (self->priv->settings[i], "changed",
+          G_CALLBACK (settings_snapshot_changed_cb), self);
+    }
+
+  /* GSettings only emits "changed" for keys which have been read at least
+   * once, so this initial load is also what subscribes us to updates. */
+  for (i = 0; i < G_N_ELEMENTS (snapshot_keys); i++)
+    settings_snapshot_load_key (self, &snapshot_keys[i]);
+}
+
+EmpathySettingsSnapshot *
+empathy_settings_snapshot_dup_singleton (void)
+{
+  static EmpathySettingsSnapshot *snapshot = NULL;
+
+  if (G_LIKELY (snapshot != NULL))
+    return g_object_ref (snapshot);
+
+  snapshot = g_object_new (EMPATHY_TYPE_SETTINGS_SNAPSHOT, NULL);
+
+  g_object_add_weak_pointer (G_OBJECT (snapshot), (gpointer *) &snapshot);
+  return snapshot;
+}
+
+static gboolean
+is_boolean_offset (glong offset)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (snapshot_keys); i++)
+    {
+      if (snapshot_keys[i].offset == offset)
+        return !snapshot_keys[i].is_string;
+    }
+
+  return FALSE;
+}
+
+/**
+ * empathy_settings_snapshot_get_boolean_by_offset:
+ * @self: an #EmpathySettingsSnapshot
+ * @offset: the G_STRUCT_OFFSET() of a boolean field of #EmpathySettingsSnapshot
+ *
+ * Useful for callers which map their own tables to cached keys, such as
+ * #EmpathySoundManager.
+ *
+ * Returns: the cached value of the field
+ */
+gboolean
+empathy_settings_snapshot_get_boolean_by_offset (
+    EmpathySettingsSnapshot *self,
+    glong offset)
+{
+  g_return_val_if_fail (EMPATHY_IS_SETTINGS_SNAPSHOT (self), FALSE);
+  g_return_val_if_fail (is_boolean_offset (offset), FALSE);
+
+  self->reads_avoided++;
+  return G_STRUCT_MEMBER (gboolean, self, offset);
+}
+
+guint64
+empathy_settings_snapshot_get_reads_avoided (EmpathySettingsSnapshot *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_SETTINGS_SNAPSHOT (self), 0);
+
+  return self->reads_avoided;
+}
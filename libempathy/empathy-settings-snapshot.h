@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_SETTINGS_SNAPSHOT_H__
+#define __EMPATHY_SETTINGS_SNAPSHOT_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_SETTINGS_SNAPSHOT         (empathy_settings_snapshot_get_type ())
+#define EMPATHY_SETTINGS_SNAPSHOT(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), EMPATHY_TYPE_SETTINGS_SNAPSHOT, EmpathySettingsSnapshot))
+#define EMPATHY_SETTINGS_SNAPSHOT_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), EMPATHY_TYPE_SETTINGS_SNAPSHOT, EmpathySettingsSnapshotClass))
+#define EMPATHY_IS_SETTINGS_SNAPSHOT(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), EMPATHY_TYPE_SETTINGS_SNAPSHOT))
+#define EMPATHY_IS_SETTINGS_SNAPSHOT_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), EMPATHY_TYPE_SETTINGS_SNAPSHOT))
+#define EMPATHY_SETTINGS_SNAPSHOT_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), EMPATHY_TYPE_SETTINGS_SNAPSHOT, EmpathySettingsSnapshotClass))
+
+typedef struct _EmpathySettingsSnapshot EmpathySettingsSnapshot;
+typedef struct _EmpathySettingsSnapshotClass EmpathySettingsSnapshotClass;
+typedef struct _EmpathySettingsSnapshotPrivate EmpathySettingsSnapshotPrivate;
+
+struct _EmpathySettingsSnapshot
+{
+  GObject parent;
+  EmpathySettingsSnapshotPrivate *priv;
+
+  /* Read-only copies of the GSettings keys used on per-message paths. They
+   * are only updated from the GSettings::changed signal. */
+
+  /* EMPATHY_PREFS_CHAT_SCHEMA */
+  gboolean chat_show_smileys;
+  gboolean chat_send_chat_states;
+  gboolean chat_avatar_in_icon;
+  gboolean chat_webkit_developer_tools;
+  gchar *chat_nick_completion_char;
+
+  /* EMPATHY_PREFS_NOTIFICATIONS_SCHEMA */
+  gboolean notifications_enabled;
+  gboolean notifications_disabled_away;
+  gboolean notifications_focus;
+  gboolean notifications_contact_signin;
+  gboolean notifications_contact_signout;
+
+  /* EMPATHY_PREFS_SOUNDS_SCHEMA */
+  gboolean sounds_enabled;
+  gboolean sounds_disabled_away;
+  gboolean sounds_incoming_message;
+  gboolean sounds_outgoing_message;
+  gboolean sounds_new_conversation;
+  gboolean sounds_service_login;
+  gboolean sounds_service_logout;
+  gboolean sounds_contact_login;
+  gboolean sounds_contact_logout;
+
+  /* EMPATHY_PREFS_UI_SCHEMA */
+  gboolean ui_events_notify_area;
+
+  /* Number of reads answered from this snapshot instead of GSettings */
+  guint64 reads_avoided;
+};
+
+struct _EmpathySettingsSnapshotClass
+{
+  GObjectClass parent_class;
+};
+
+/* Read a cached setting, accounting for the GSettings read it replaces */
+#define EMPATHY_SETTINGS_SNAPSHOT_GET(snapshot, field) \
+  ((snapshot)->reads_avoided++, (snapshot)->field)
+
+GType empathy_settings_snapshot_get_type (void) G_GNUC_CONST;
+
+EmpathySettingsSnapshot * empathy_settings_snapshot_dup_singleton (void);
+
+gboolean empathy_settings_snapshot_get_boolean_by_offset (
+    EmpathySettingsSnapshot *self,
+    glong offset);
+
+guint64 empathy_settings_snapshot_get_reads_avoided (
+    EmpathySettingsSnapshot *self);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_SETTINGS_SNAPSHOT_H__ */
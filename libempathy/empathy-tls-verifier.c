@@ -34,6 +34,11 @@ G_DEFINE_TYPE (EmpathyTLSVerifier, empathy_tls_verifier,
 
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyTLSVerifier);
 
+/* Verification results are kept for a while, so reconnecting doesn't verify
+ * the same chain again and again */
+#define CACHE_MAX_ENTRIES 32
+#define CACHE_TTL (10 * 60 * G_TIME_SPAN_SECOND)
+
 enum {
   PROP_TLS_CERTIFICATE = 1,
   PROP_HOSTNAME,
@@ -50,9 +55,151 @@ typedef struct {
   GSimpleAsyncResult *verify_result;
   GHashTable *details;
 
+  /* where the result of the running verification will be cached */
+  gchar *cache_key;
+
   gboolean dispose_run;
 } EmpathyTLSVerifierPriv;
 
+typedef struct {
+  gboolean success;
+  TpTLSCertificateRejectReason reason;
+  GHashTable *details;
+  gint64 expires;
+} CacheEntry;
+
+/* owned key => owned CacheEntry */
+static GHashTable *verification_cache = NULL;
+/* part of the cache keys, so results of verifications which started before
+ * the trusted certificates changed are never used */
+static guint trust_generation = 0;
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_hash_table_unref (entry->details);
+  g_slice_free (CacheEntry, entry);
+}
+
+/* The key is the fingerprint of the whole chain as sent by the server, the
+ * identities it has to match and the trust generation. */
+static gchar *
+verification_cache_build_key (EmpathyTLSVerifier *self)
+{
+  EmpathyTLSVerifierPriv *priv = GET_PRIV (self);
+  GPtrArray *cert_data;
+  GChecksum *checksum;
+  GString *key;
+  guint idx;
+
+  cert_data = tp_tls_certificate_get_cert_data (priv->certificate);
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+  for (idx = 0; idx < cert_data->len; ++idx)
+    {
+      GArray *data = g_ptr_array_index (cert_data, idx);
+      guint32 len = GUINT32_TO_BE (data->len);
+
+      g_checksum_update (checksum, (const guchar *) &len, sizeof (len));
+      g_checksum_update (checksum, (const guchar *) data->data, data->len);
+    }
+
+  key = g_string_new (g_checksum_get_string (checksum));
+  g_string_append_printf (key, " %u %s", trust_generation, priv->hostname);
+
+  for (idx = 0; priv->reference_identities != NULL &&
+      priv->reference_identities[idx] != NULL; ++idx)
+    g_string_append_printf (key, " %s", priv->reference_identities[idx]);
+
+  g_checksum_free (checksum);
+
+  return g_string_free (key, FALSE);
+}
+
+static CacheEntry *
+verification_cache_lookup (const gchar *key)
+{
+  CacheEntry *entry;
+
+  if (verification_cache == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (verification_cache, key);
+  if (entry == NULL)
+    return NULL;
+
+  if (entry->expires <= g_get_monotonic_time ())
+    {
+      g_hash_table_remove (verification_cache, key);
+      return NULL;
+    }
+
+  return entry;
+}
+
+static void
+verification_cache_evict (void)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  gpointer oldest_key = NULL;
+  gint64 oldest = G_MAXINT64;
+  gint64 now = g_get_monotonic_time ();
+
+  g_hash_table_iter_init (&iter, verification_cache);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      CacheEntry *entry = value;
+
+      if (entry->expires <= now)
+        {
+          g_hash_table_iter_remove (&iter);
+          continue;
+        }
+
+      /* all entries live as long, so the oldest expires first */
+      if (entry->expires < oldest)
+        {
+          oldest = entry->expires;
+          oldest_key = key;
+        }
+    }
+
+  if (g_hash_table_size (verification_cache) >= CACHE_MAX_ENTRIES &&
+      oldest_key != NULL)
+    g_hash_table_remove (verification_cache, oldest_key);
+}
+
+static void
+verification_cache_store (EmpathyTLSVerifier *self,
+    gboolean success,
+    TpTLSCertificateRejectReason reason)
+{
+  EmpathyTLSVerifierPriv *priv = GET_PRIV (self);
+  CacheEntry *entry;
+
+  if (priv->cache_key == NULL)
+    return;
+
+  if (verification_cache == NULL)
+    verification_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, (GDestroyNotify) cache_entry_free);
+
+  if (g_hash_table_size (verification_cache) >= CACHE_MAX_ENTRIES)
+    verification_cache_evict ();
+
+  entry = g_slice_new0 (CacheEntry);
+  entry->success = success;
+  entry->reason = reason;
+  entry->details = tp_asv_new (NULL, NULL);
+  tp_g_hash_table_update (entry->details, priv->details,
+      (GBoxedCopyFunc) g_strdup, (GBoxedCopyFunc) tp_g_value_slice_dup);
+  entry->expires = g_get_monotonic_time () + CACHE_TTL;
+
+  g_hash_table_replace (verification_cache, priv->cache_key, entry);
+  priv->cache_key = NULL;
+}
+
 static gboolean
 verification_output_to_reason (gint res,
     guint verify_output,
@@ -189,6 +336,9 @@ complete_verification (EmpathyTLSVerifier *self)
 
   DEBUG ("Verification successful, completing...");
 
+  verification_cache_store (self, TRUE,
+      TP_TLS_CERTIFICATE_REJECT_REASON_UNKNOWN);
+
   g_simple_async_result_complete_in_idle (priv->verify_result);
 
   tp_clear_object (&priv->verify_result);
@@ -202,6 +352,8 @@ abort_verification (EmpathyTLSVerifier *self,
 
   DEBUG ("Verification error %u, aborting...", reason);
 
+  verification_cache_store (self, FALSE, reason);
+
   g_simple_async_result_set_error (priv->verify_result,
       G_IO_ERROR, reason, "TLS verification failed with reason %u",
       reason);
@@ -431,6 +583,7 @@ empathy_tls_verifier_finalize (GObject *object)
   DEBUG ("%p", object);
 
   tp_clear_boxed (G_TYPE_HASH_TABLE, &priv->details);
+  g_free (priv->cache_key);
   g_free (priv->hostname);
   g_strfreev (priv->reference_identities);
 
@@ -506,6 +659,7 @@ empathy_tls_verifier_verify_async (EmpathyTLSVerifier *self,
   GPtrArray *cert_data;
   GArray *data;
   guint idx;
+  CacheEntry *entry;
   EmpathyTLSVerifierPriv *priv = GET_PRIV (self);
 
   DEBUG ("Starting verification");
@@ -518,6 +672,28 @@ empathy_tls_verifier_verify_async (EmpathyTLSVerifier *self,
   priv->verify_result = g_simple_async_result_new (G_OBJECT (self),
       callback, user_data, NULL);
 
+  g_free (priv->cache_key);
+  priv->cache_key = verification_cache_build_key (self);
+
+  entry = verification_cache_lookup (priv->cache_key);
+  if (entry != NULL)
+    {
+      DEBUG ("Using the cached result of a previous verification");
+
+      g_free (priv->cache_key);
+      priv->cache_key = NULL;
+
+      tp_g_hash_table_update (priv->details, entry->details,
+          (GBoxedCopyFunc) g_strdup, (GBoxedCopyFunc) tp_g_value_slice_dup);
+
+      if (entry->success)
+        complete_verification (self);
+      else
+        abort_verification (self, entry->reason);
+
+      return;
+    }
+
   /* Create a certificate chain */
   chain = gcr_certificate_chain_new ();
   for (idx = 0; idx < cert_data->len; ++idx) {
@@ -595,4 +771,24 @@ empathy_tls_verifier_store_exception (EmpathyTLSVerifier *self)
       DEBUG ("Can't store the pinned certificate: %s", error->message);
 
   g_object_unref (cert);
+
+  empathy_tls_verifier_trust_changed ();
+}
+
+/**
+ * empathy_tls_verifier_trust_changed:
+ *
+ * Forgets the results of previous verifications. This has to be called
+ * when the trusted or pinned certificates change; otherwise, results are
+ * reused for a few minutes.
+ */
+void
+empathy_tls_verifier_trust_changed (void)
+{
+  DEBUG ("Trusted certificates changed, forgetting cached verifications");
+
+  trust_generation++;
+
+  if (verification_cache != NULL)
+    g_hash_table_remove_all (verification_cache);
 }
@@ -74,6 +74,8 @@ gboolean empathy_tls_verifier_verify_finish (EmpathyTLSVerifier *self,
 
 void empathy_tls_verifier_store_exception (EmpathyTLSVerifier *self);
 
+void empathy_tls_verifier_trust_changed (void);
+
 G_END_DECLS
 
 #endif /* #ifndef __EMPATHY_TLS_VERIFIER_H__*/
@@ -38,6 +38,11 @@ struct _EmpathyTpChatPrivate
   GList *members;
   /* Queue of messages signalled but not acked yet */
   GQueue *pending_messages_queue;
+  /* owned TpMessage -> borrowed GList link in pending_messages_queue */
+  GHashTable *pending_messages_index;
+  /* Set of owned TpMessage waiting to be acked by the next flush */
+  GHashTable *acks_to_send;
+  guint flush_acks_id;
 
   /* Subject */
   gboolean supports_subject;
@@ -117,6 +122,73 @@ tp_chat_set_delivery_status (EmpathyTpChat *self,
   }
 }
 
+static void
+tp_chat_ack_messages_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GError *error = NULL;
+
+  if (!tp_text_channel_ack_messages_finish (TP_TEXT_CHANNEL (source), result,
+        &error))
+    {
+      DEBUG ("Failed to ack messages: %s", error->message);
+      g_error_free (error);
+    }
+}
+
+static void
+tp_chat_flush_acks (EmpathyTpChat *self)
+{
+  GList *messages;
+
+  if (self->priv->flush_acks_id != 0)
+    {
+      g_source_remove (self->priv->flush_acks_id);
+      self->priv->flush_acks_id = 0;
+    }
+
+  if (g_hash_table_size (self->priv->acks_to_send) == 0)
+    return;
+
+  messages = g_hash_table_get_keys (self->priv->acks_to_send);
+
+  DEBUG ("Acking %u messages in one call", g_list_length (messages));
+
+  tp_text_channel_ack_messages_async (TP_TEXT_CHANNEL (self), messages,
+      tp_chat_ack_messages_cb, NULL);
+
+  g_list_free (messages);
+  g_hash_table_remove_all (self->priv->acks_to_send);
+}
+
+static gboolean
+tp_chat_flush_acks_cb (gpointer user_data)
+{
+  EmpathyTpChat *self = user_data;
+
+  self->priv->flush_acks_id = 0;
+  tp_chat_flush_acks (self);
+
+  return FALSE;
+}
+
+/* Acks requested during the same main loop iteration are coalesced into a
+ * single AcknowledgePendingMessages call. */
+static void
+tp_chat_queue_ack (EmpathyTpChat *self,
+    TpMessage *message)
+{
+  if (g_hash_table_lookup (self->priv->acks_to_send, message) != NULL)
+    return;
+
+  g_hash_table_insert (self->priv->acks_to_send, g_object_ref (message),
+      message);
+
+  if (self->priv->flush_acks_id == 0)
+    self->priv->flush_acks_id = g_idle_add (tp_chat_flush_acks_cb, self);
+}
+
 static void tp_chat_prepare_ready_async (TpProxy *proxy,
   const TpProxyFeature *feature,
   GAsyncReadyCallback callback,
@@ -293,6 +365,8 @@ tp_chat_build_message (EmpathyTpChat *self,
     }
 
   g_queue_push_tail (self->priv->pending_messages_queue, message);
+  g_hash_table_insert (self->priv->pending_messages_index, g_object_ref (msg),
+      self->priv->pending_messages_queue->tail);
   g_signal_emit (self, signals[MESSAGE_RECEIVED], 0, message);
 }
 
@@ -365,8 +439,7 @@ handle_delivery_report (EmpathyTpChat *self,
       delivery_error, delivery_dbus_error);
 
 out:
-  tp_text_channel_ack_message_async (TP_TEXT_CHANNEL (self),
-    message, NULL, NULL);
+  tp_chat_queue_ack (self, message);
 }
 
 static void
@@ -392,8 +465,7 @@ handle_incoming_message (EmpathyTpChat *self,
     {
       DEBUG ("Empty message with NonTextContent, ignoring and acking.");
 
-      tp_text_channel_ack_message_async (TP_TEXT_CHANNEL (self),
-        message, NULL, NULL);
+      tp_chat_queue_ack (self, message);
       return;
     }
 
@@ -410,19 +482,6 @@ message_received_cb (TpTextChannel *channel,
   handle_incoming_message (self, message, FALSE);
 }
 
-static gboolean
-find_pending_message_func (gconstpointer a,
-    gconstpointer b)
-{
-  EmpathyMessage *msg = (EmpathyMessage *) a;
-  TpMessage *message = (TpMessage *) b;
-
-  if (empathy_message_get_tp_message (msg) == message)
-    return 0;
-
-  return -1;
-}
-
 static void
 pending_message_removed_cb (TpTextChannel   *channel,
     TpMessage *message,
@@ -430,12 +489,12 @@ pending_message_removed_cb (TpTextChannel   *channel,
 {
   GList *m;
 
-  m = g_queue_find_custom (self->priv->pending_messages_queue, message,
-      find_pending_message_func);
-
+  m = g_hash_table_lookup (self->priv->pending_messages_index, message);
   if (m == NULL)
     return;
 
+  g_hash_table_remove (self->priv->pending_messages_index, message);
+
   g_signal_emit (self, signals[MESSAGE_ACKNOWLEDGED], 0, m->data);
 
   g_object_unref (m->data);
@@ -681,6 +740,10 @@ tp_chat_dispose (GObject *object)
   tp_clear_object (&self->priv->remote_contact);
   tp_clear_object (&self->priv->user);
 
+  /* Don't lose acks which haven't been sent yet */
+  tp_chat_flush_acks (self);
+
+  g_hash_table_remove_all (self->priv->pending_messages_index);
   g_queue_foreach (self->priv->pending_messages_queue,
     (GFunc) g_object_unref, NULL);
   g_queue_clear (self->priv->pending_messages_queue);
@@ -699,6 +762,8 @@ tp_chat_finalize (GObject *object)
   DEBUG ("Finalize: %p", object);
 
   g_queue_free (self->priv->pending_messages_queue);
+  g_hash_table_unref (self->priv->pending_messages_index);
+  g_hash_table_unref (self->priv->acks_to_send);
   g_hash_table_unref (self->priv->messages_being_sent);
 
   g_free (self->priv->title);
@@ -1080,6 +1145,10 @@ empathy_tp_chat_init (EmpathyTpChat *self)
       EmpathyTpChatPrivate);
 
   self->priv->pending_messages_queue = g_queue_new ();
+  self->priv->pending_messages_index = g_hash_table_new_full (NULL, NULL,
+      g_object_unref, NULL);
+  self->priv->acks_to_send = g_hash_table_new_full (NULL, NULL,
+      g_object_unref, NULL);
   self->priv->messages_being_sent = g_hash_table_new_full (
       g_str_hash, g_str_equal, g_free, NULL);
 }
@@ -1180,8 +1249,36 @@ empathy_tp_chat_acknowledge_message (EmpathyTpChat *self,
     return;
 
   tp_msg = empathy_message_get_tp_message (message);
-  tp_text_channel_ack_message_async (TP_TEXT_CHANNEL (self),
-             tp_msg, NULL, NULL);
+  tp_chat_queue_ack (self, tp_msg);
+}
+
+/**
+ * empathy_tp_chat_acknowledge_messages:
+ * @self: an #EmpathyTpChat
+ * @messages: (element-type EmpathyMessage): a list of #EmpathyMessage
+ *
+ * Acknowledge all the incoming messages in @messages. Like
+ * empathy_tp_chat_acknowledge_message(), the acks are sent from an idle, in
+ * a single D-Bus call with the others requested meanwhile. Outgoing
+ * messages in the list are ignored.
+ */
+void
+empathy_tp_chat_acknowledge_messages (EmpathyTpChat *self,
+    const GList *messages)
+{
+  const GList *l;
+
+  g_return_if_fail (EMPATHY_IS_TP_CHAT (self));
+
+  for (l = messages; l != NULL; l = g_list_next (l))
+    {
+      EmpathyMessage *message = l->data;
+
+      if (!empathy_message_is_incoming (message))
+        continue;
+
+      tp_chat_queue_ack (self, empathy_message_get_tp_message (message));
+    }
 }
 
 /**
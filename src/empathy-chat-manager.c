@@ -68,6 +68,11 @@ struct _EmpathyChatManagerPriv
 
   TpBaseClient *handler;
 
+  /* Queue of (PendingChat *): rooms joined in the background, whose chat is
+   * created from an idle so joining many of them doesn't freeze the UI */
+  GQueue *pending_chats;
+  guint pending_chats_id;
+
   /* Cached to keep Folks in memory while empathy-chat is running; we don't
    * want to reload it each time the last chat window is closed
    * and re-opened. */
@@ -121,6 +126,21 @@ chat_data_free (ChatData *data)
   g_slice_free (ChatData, data);
 }
 
+typedef struct
+{
+  EmpathyTpChat *tp_chat;
+  TpAccount *account;
+  gint64 user_action_time;
+} PendingChat;
+
+static void
+pending_chat_free (PendingChat *pending)
+{
+  g_object_unref (pending->tp_chat);
+  g_object_unref (pending->account);
+  g_slice_free (PendingChat, pending);
+}
+
 static void
 chat_destroyed_cb (gpointer data,
     GObject *object)
@@ -238,6 +258,115 @@ process_tp_chat (EmpathyChatManager *self,
     }
 }
 
+static gboolean
+process_pending_chat_cb (gpointer user_data)
+{
+  EmpathyChatManager *self = user_data;
+  EmpathyChatManagerPriv *priv = GET_PRIV (self);
+  PendingChat *pending;
+
+  /* The queue may have been emptied by undefer_chat () */
+  pending = g_queue_pop_head (priv->pending_chats);
+  if (pending != NULL)
+    {
+      if (tp_proxy_get_invalidated (pending->tp_chat) == NULL)
+        process_tp_chat (self, pending->tp_chat, pending->account,
+            pending->user_action_time);
+
+      pending_chat_free (pending);
+    }
+
+  if (!g_queue_is_empty (priv->pending_chats))
+    return TRUE;
+
+  DEBUG ("Created the chats of all the rooms joined in the background");
+
+  priv->pending_chats_id = 0;
+  return FALSE;
+}
+
+/* Rooms we joined without the user asking for it, typically auto-connect
+ * rooms at startup, get their chat created one at a time */
+static gboolean
+should_defer_chat (EmpathyTpChat *tp_chat,
+    gint64 user_action_time)
+{
+  TpHandleType handle_type;
+
+  if (user_action_time != TP_USER_ACTION_TIME_NOT_USER_ACTION)
+    return FALSE;
+
+  if (!tp_channel_get_requested (TP_CHANNEL (tp_chat)))
+    return FALSE;
+
+  tp_channel_get_handle (TP_CHANNEL (tp_chat), &handle_type);
+
+  return handle_type == TP_HANDLE_TYPE_ROOM;
+}
+
+static GList *
+find_pending_chat (EmpathyChatManager *self,
+    EmpathyTpChat *tp_chat)
+{
+  EmpathyChatManagerPriv *priv = GET_PRIV (self);
+  GList *l;
+
+  for (l = priv->pending_chats->head; l != NULL; l = g_list_next (l))
+    {
+      PendingChat *pending = l->data;
+
+      if (pending->tp_chat == tp_chat)
+        return l;
+    }
+
+  return NULL;
+}
+
+static void
+defer_chat (EmpathyChatManager *self,
+    EmpathyTpChat *tp_chat,
+    TpAccount *account,
+    gint64 user_action_time)
+{
+  EmpathyChatManagerPriv *priv = GET_PRIV (self);
+  PendingChat *pending;
+
+  if (find_pending_chat (self, tp_chat) != NULL)
+    return;
+
+  pending = g_slice_new0 (PendingChat);
+  pending->tp_chat = g_object_ref (tp_chat);
+  pending->account = g_object_ref (account);
+  pending->user_action_time = user_action_time;
+
+  g_queue_push_tail (priv->pending_chats, pending);
+
+  DEBUG ("Deferring the chat of %s; %u chats waiting",
+      empathy_tp_chat_get_id (tp_chat),
+      g_queue_get_length (priv->pending_chats));
+
+  if (priv->pending_chats_id == 0)
+    priv->pending_chats_id = g_idle_add_full (G_PRIORITY_LOW,
+        process_pending_chat_cb, self, NULL);
+}
+
+/* The chat of a channel which is being handled again is created right away,
+ * so it doesn't have to wait anymore */
+static void
+undefer_chat (EmpathyChatManager *self,
+    EmpathyTpChat *tp_chat)
+{
+  EmpathyChatManagerPriv *priv = GET_PRIV (self);
+  GList *l;
+
+  l = find_pending_chat (self, tp_chat);
+  if (l == NULL)
+    return;
+
+  pending_chat_free (l->data);
+  g_queue_delete_link (priv->pending_chats, l);
+}
+
 static void
 handle_channels (TpSimpleHandler *handler,
     TpAccount *account,
@@ -267,6 +396,13 @@ handle_channels (TpSimpleHandler *handler,
 
       DEBUG ("Now handling channel %s", tp_proxy_get_object_path (tp_chat));
 
+      if (should_defer_chat (tp_chat, user_action_time))
+        {
+          defer_chat (self, tp_chat, account, user_action_time);
+          continue;
+        }
+
+      undefer_chat (self, tp_chat);
       process_tp_chat (self, tp_chat, account, user_action_time);
     }
 
@@ -281,6 +417,7 @@ empathy_chat_manager_init (EmpathyChatManager *self)
   GError *error = NULL;
 
   priv->closed_queue = g_queue_new ();
+  priv->pending_chats = g_queue_new ();
   priv->messages = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, (GDestroyNotify) g_hash_table_unref);
 
@@ -331,6 +468,12 @@ empathy_chat_manager_finalize (GObject *object)
 
   tp_clear_pointer (&priv->messages, g_hash_table_unref);
 
+  if (priv->pending_chats_id != 0)
+    g_source_remove (priv->pending_chats_id);
+
+  g_queue_foreach (priv->pending_chats, (GFunc) pending_chat_free, NULL);
+  g_queue_free (priv->pending_chats);
+
   tp_clear_object (&priv->handler);
   tp_clear_object (&priv->chatroom_mgr);
   tp_clear_object (&priv->individual_mgr);
@@ -42,6 +42,7 @@
 #include "empathy-invite-participant-dialog.h"
 #include "empathy-notify-manager.h"
 #include "empathy-request-util.h"
+#include "empathy-settings-snapshot.h"
 #include "empathy-sound-manager.h"
 #include "empathy-ui-utils.h"
 #include "empathy-utils.h"
@@ -65,6 +66,15 @@ struct _EmpathyChatWindowPriv
 {
   EmpathyChat *current_chat;
   GList *chats;
+  /* Sum of the unread messages of all the chats, kept by the registry */
+  guint nb_unread;
+  /* borrowed EmpathyChat -> ChatTabFields waiting for the next frame, or
+   * NULL if nothing is queued */
+  GHashTable *dirty_chats;
+  guint flush_tick_id;
+  /* idle, or timeout in case the frame clock stops before the tick */
+  guint flush_idle_id;
+  guint hibernation_id;
   gboolean page_added;
   gboolean dnd_same_window;
   EmpathyChatroomManager *chatroom_manager;
@@ -103,8 +113,7 @@ struct _EmpathyChatWindowPriv
   /* Last user action time we acted upon to show a tab */
   guint32 x_user_action_time;
 
-  GSettings *gsettings_chat;
-  GSettings *gsettings_notif;
+  EmpathySettingsSnapshot *settings;
   GSettings *gsettings_ui;
 
   EmpathySoundManager *sound_mgr;
@@ -114,6 +123,49 @@ struct _EmpathyChatWindowPriv
 
 static GList *chat_windows = NULL;
 
+/* How often background chats are checked for hibernation, in seconds */
+#define HIBERNATION_CHECK_INTERVAL 60
+
+/* Longest time queued tab updates wait for a frame, in milliseconds */
+#define FLUSH_FALLBACK_TIMEOUT 100
+
+/* Registry of all the chats in a window, so routing an incoming channel or a
+ * present request to its chat doesn't need to scan every window. */
+typedef struct
+{
+  EmpathyChat *chat;
+  EmpathyChatWindow *window;
+  /* The (account path, ID, SMS flag) key the chat is indexed under, or NULL
+   * if it has no account or ID yet */
+  gchar *key;
+  /* The unread count last added to window->priv->nb_unread */
+  guint nb_unread;
+  /* Monotonic time at which the chat was last the current one */
+  gint64 last_active;
+} ChatEntry;
+
+/* borrowed EmpathyChat -> owned ChatEntry */
+static GHashTable *chats_by_object = NULL;
+/* borrowed key -> borrowed ChatEntry */
+static GHashTable *chats_by_key = NULL;
+
+/* Parts of a tab, and of its window, which depend on the chat's state */
+typedef enum
+{
+  CHAT_TAB_ICON = 1 << 0,
+  CHAT_TAB_SPINNER = 1 << 1,
+  CHAT_TAB_TOOLTIP = 1 << 2,
+  CHAT_TAB_LABEL = 1 << 3,
+  /* The window's title and icon, which sum up the unread messages */
+  CHAT_TAB_WINDOW = 1 << 4,
+  /* The Contact menu, if this is the current chat */
+  CHAT_TAB_CONTACT_MENU = 1 << 5,
+  CHAT_TAB_ALL = (1 << 6) - 1
+} ChatTabFields;
+
+/* Number of tab updates merged into one already waiting for the next frame */
+static guint n_coalesced_updates = 0;
+
 static const guint tab_accel_keys[] =
 {
   GDK_KEY_1, GDK_KEY_2, GDK_KEY_3, GDK_KEY_4, GDK_KEY_5,
@@ -195,23 +247,173 @@ chat_window_accel_cb (GtkAccelGroup *accelgroup,
     gtk_notebook_set_current_page (GTK_NOTEBOOK (self->priv->notebook), num);
 }
 
-static EmpathyChatWindow *
-chat_window_find_chat (EmpathyChat *chat)
+static gchar *
+chat_registry_make_key (TpAccount *account,
+    const gchar *id,
+    gboolean sms_channel)
+{
+  if (account == NULL || TPAW_STR_EMPTY (id))
+    return NULL;
+
+  /* Object paths can't contain a newline */
+  return g_strdup_printf ("%s\n%c\n%s", tp_proxy_get_object_path (account),
+      sms_channel ? '1' : '0', id);
+}
+
+/* Another chat indexed under the same key as @entry, if any */
+static ChatEntry *
+chat_registry_find_other (ChatEntry *entry)
 {
-  GList *l, *ll;
+  GHashTableIter iter;
+  gpointer value;
 
-  for (l = chat_windows; l; l = l->next)
+  g_hash_table_iter_init (&iter, chats_by_object);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
     {
-      EmpathyChatWindow *window = l->data;
+      ChatEntry *other = value;
 
-      ll = g_list_find (window->priv->chats, chat);
-      if (ll)
-        return l->data;
+      if (other != entry && !tp_strdiff (other->key, entry->key))
+        return other;
     }
 
   return NULL;
 }
 
+static void
+chat_registry_unindex (ChatEntry *entry)
+{
+  ChatEntry *other;
+
+  if (entry->key == NULL)
+    return;
+
+  /* Another chat may have taken over the key meanwhile */
+  if (g_hash_table_lookup (chats_by_key, entry->key) == entry)
+    {
+      g_hash_table_remove (chats_by_key, entry->key);
+
+      /* and if one still has it, it has to remain reachable, or a
+       * duplicate would be opened for its contact */
+      other = chat_registry_find_other (entry);
+      if (other != NULL)
+        g_hash_table_insert (chats_by_key, other->key, other);
+    }
+
+  tp_clear_pointer (&entry->key, g_free);
+}
+
+/* Bring the entry up to date with its chat; the key changes when the chat
+ * gets a new TpChat or becomes an SMS channel. */
+static void
+chat_registry_sync (ChatEntry *entry)
+{
+  gchar *key;
+  guint nb_unread;
+
+  key = chat_registry_make_key (empathy_chat_get_account (entry->chat),
+      empathy_chat_get_id (entry->chat),
+      empathy_chat_is_sms_channel (entry->chat));
+
+  if (tp_strdiff (key, entry->key))
+    {
+      chat_registry_unindex (entry);
+
+      /* The table borrows the key of the entry it maps to, so it has to
+       * be replaced as well if another chat had the same one */
+      entry->key = key;
+      if (key != NULL)
+        g_hash_table_replace (chats_by_key, key, entry);
+    }
+  else
+    {
+      g_free (key);
+    }
+
+  nb_unread = empathy_chat_get_nb_unread_messages (entry->chat);
+  entry->window->priv->nb_unread -= entry->nb_unread;
+  entry->window->priv->nb_unread += nb_unread;
+  entry->nb_unread = nb_unread;
+}
+
+static void
+chat_registry_add (EmpathyChatWindow *window,
+    EmpathyChat *chat)
+{
+  ChatEntry *entry;
+
+  if (chats_by_object == NULL)
+    {
+      chats_by_object = g_hash_table_new (NULL, NULL);
+      chats_by_key = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+
+  g_return_if_fail (g_hash_table_lookup (chats_by_object, chat) == NULL);
+
+  entry = g_slice_new0 (ChatEntry);
+  entry->chat = chat;
+  entry->window = window;
+  entry->last_active = g_get_monotonic_time ();
+  g_hash_table_insert (chats_by_object, chat, entry);
+
+  chat_registry_sync (entry);
+}
+
+static void
+chat_registry_remove (EmpathyChat *chat)
+{
+  ChatEntry *entry;
+
+  if (chats_by_object == NULL)
+    return;
+
+  entry = g_hash_table_lookup (chats_by_object, chat);
+  if (entry == NULL)
+    return;
+
+  entry->window->priv->nb_unread -= entry->nb_unread;
+  chat_registry_unindex (entry);
+  g_hash_table_remove (chats_by_object, chat);
+  g_slice_free (ChatEntry, entry);
+}
+
+static void
+chat_registry_remove_window (EmpathyChatWindow *window)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  if (chats_by_object == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, chats_by_object);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      ChatEntry *entry = value;
+
+      if (entry->window != window)
+        continue;
+
+      chat_registry_unindex (entry);
+      g_hash_table_iter_remove (&iter);
+      g_slice_free (ChatEntry, entry);
+    }
+}
+
+static EmpathyChatWindow *
+chat_window_find_chat (EmpathyChat *chat)
+{
+  ChatEntry *entry;
+
+  if (chats_by_object == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (chats_by_object, chat);
+  if (entry == NULL)
+    return NULL;
+
+  return entry->window;
+}
+
 static void
 remove_all_chats (EmpathyChatWindow *self)
 {
@@ -637,13 +839,7 @@ chat_window_contact_menu_update (EmpathyChatWindow *self)
 static guint
 get_all_unread_messages (EmpathyChatWindow *self)
 {
-  GList *l;
-  guint nb = 0;
-
-  for (l = self->priv->chats; l != NULL; l = g_list_next (l))
-    nb += empathy_chat_get_nb_unread_messages (EMPATHY_CHAT (l->data));
-
-  return nb;
+  return self->priv->nb_unread;
 }
 
 static gchar *
@@ -749,8 +945,8 @@ chat_window_icon_update (EmpathyChatWindow *self,
     }
   else
     {
-      avatar_in_icon = g_settings_get_boolean (self->priv->gsettings_chat,
-          EMPATHY_PREFS_CHAT_AVATAR_IN_ICON);
+      avatar_in_icon = EMPATHY_SETTINGS_SNAPSHOT_GET (self->priv->settings,
+          chat_avatar_in_icon);
 
       if (n_chats == 1 && avatar_in_icon)
         {
@@ -843,12 +1039,12 @@ append_markup_printf (GString *string,
 }
 
 static void
-chat_window_update_chat_tab_full (EmpathyChat *chat,
-    gboolean update_contact_menu)
+chat_window_update_chat_tab_fields (ChatEntry *entry,
+    ChatTabFields fields)
 {
-  EmpathyChatWindow *self;
+  EmpathyChat *chat = entry->chat;
   EmpathyContact *remote_contact;
-  gchar *name;
+  gchar *name = NULL;
   const gchar *id;
   TpAccount *account;
   const gchar *subject;
@@ -862,167 +1058,357 @@ chat_window_update_chat_tab_full (EmpathyChat *chat,
   GtkWidget *sending_spinner;
   guint nb_sending;
 
-  self = chat_window_find_chat (chat);
-  if (!self)
-    return;
-
   /* Get information */
-  name = empathy_chat_dup_name (chat);
   account = empathy_chat_get_account (chat);
   subject = empathy_chat_get_subject (chat);
   remote_contact = empathy_chat_get_remote_contact (chat);
+  nb_sending = empathy_chat_get_n_messages_sending (chat);
+
+  if (fields & (CHAT_TAB_TOOLTIP | CHAT_TAB_LABEL))
+    name = empathy_chat_dup_name (chat);
 
-  DEBUG ("Updating chat tab, name=%s, account=%s, subject=%s, "
+  DEBUG ("Updating chat tab, fields=0x%x, account=%s, subject=%s, "
       "remote_contact=%p",
-    name, tp_proxy_get_object_path (account), subject, remote_contact);
+    fields, tp_proxy_get_object_path (account), subject, remote_contact);
 
   /* Update tab image */
-  if (empathy_chat_get_tp_chat (chat) == NULL)
-    {
-      /* No TpChat, we are disconnected */
-      icon_name = NULL;
-    }
-  else if (empathy_chat_get_nb_unread_messages (chat) > 0)
+  if (fields & CHAT_TAB_ICON)
     {
-      icon_name = EMPATHY_IMAGE_MESSAGE;
-    }
-  else if (remote_contact && empathy_chat_is_composing (chat))
-    {
-      icon_name = EMPATHY_IMAGE_TYPING;
+      if (empathy_chat_get_tp_chat (chat) == NULL)
+        {
+          /* No TpChat, we are disconnected */
+          icon_name = NULL;
+        }
+      else if (empathy_chat_get_nb_unread_messages (chat) > 0)
+        {
+          icon_name = EMPATHY_IMAGE_MESSAGE;
+        }
+      else if (remote_contact && empathy_chat_is_composing (chat))
+        {
+          icon_name = EMPATHY_IMAGE_TYPING;
+        }
+      else if (empathy_chat_is_sms_channel (chat))
+        {
+          icon_name = EMPATHY_IMAGE_SMS;
+        }
+      else if (remote_contact)
+        {
+          icon_name = empathy_icon_name_for_contact (remote_contact);
+        }
+      else
+        {
+          icon_name = EMPATHY_IMAGE_GROUP_MESSAGE;
+        }
+
+      tab_image = g_object_get_data (G_OBJECT (chat),
+          "chat-window-tab-image");
+      menu_image = g_object_get_data (G_OBJECT (chat),
+          "chat-window-menu-image");
+
+      if (icon_name != NULL)
+        {
+          gtk_image_set_from_icon_name (GTK_IMAGE (tab_image), icon_name,
+              GTK_ICON_SIZE_MENU);
+          gtk_widget_show (tab_image);
+          gtk_image_set_from_icon_name (GTK_IMAGE (menu_image), icon_name,
+              GTK_ICON_SIZE_MENU);
+          gtk_widget_show (menu_image);
+        }
+      else
+        {
+          gtk_widget_hide (tab_image);
+          gtk_widget_hide (menu_image);
+        }
     }
-  else if (empathy_chat_is_sms_channel (chat))
+
+  /* Update the sending spinner */
+  if (fields & CHAT_TAB_SPINNER)
     {
-      icon_name = EMPATHY_IMAGE_SMS;
+      sending_spinner = g_object_get_data (G_OBJECT (chat),
+        "chat-window-tab-sending-spinner");
+
+      g_object_set (sending_spinner,
+        "active", nb_sending > 0,
+        "visible", nb_sending > 0,
+        NULL);
     }
-  else if (remote_contact)
+
+  if (remote_contact != NULL && name != NULL)
     {
-      icon_name = empathy_icon_name_for_contact (remote_contact);
+      const gchar * const *types;
+
+      types = empathy_contact_get_client_types (remote_contact);
+      if (empathy_client_types_contains_mobile_device ((GStrv) types))
+        {
+          /* I'm on a mobile device ! */
+          gchar *tmp = name;
+
+          name = g_strdup_printf ("☎ %s", name);
+          g_free (tmp);
+        }
     }
-  else
+
+  /* Update tab tooltip */
+  if (fields & CHAT_TAB_TOOLTIP)
     {
-      icon_name = EMPATHY_IMAGE_GROUP_MESSAGE;
-    }
+      tooltip = g_string_new (NULL);
 
-  tab_image = g_object_get_data (G_OBJECT (chat), "chat-window-tab-image");
-  menu_image = g_object_get_data (G_OBJECT (chat), "chat-window-menu-image");
+      if (remote_contact)
+        {
+          id = empathy_contact_get_id (remote_contact);
+          status = empathy_contact_get_presence_message (remote_contact);
+        }
+      else
+        {
+          id = name;
+        }
 
-  if (icon_name != NULL)
-    {
-      gtk_image_set_from_icon_name (GTK_IMAGE (tab_image), icon_name,
-          GTK_ICON_SIZE_MENU);
-      gtk_widget_show (tab_image);
-      gtk_image_set_from_icon_name (GTK_IMAGE (menu_image), icon_name,
-          GTK_ICON_SIZE_MENU);
-      gtk_widget_show (menu_image);
+      if (empathy_chat_is_sms_channel (chat))
+        append_markup_printf (tooltip, "%s ", _("SMS:"));
+
+      append_markup_printf (tooltip, "<b>%s</b><small> (%s)</small>",
+          id, tp_account_get_display_name (account));
+
+      if (nb_sending > 0)
+        {
+          char *tmp = g_strdup_printf (
+            ngettext ("Sending %d message",
+                "Sending %d messages",
+                nb_sending),
+            nb_sending);
+
+          g_string_append (tooltip, "\n");
+          g_string_append (tooltip, tmp);
+
+          sending_spinner = g_object_get_data (G_OBJECT (chat),
+            "chat-window-tab-sending-spinner");
+          gtk_widget_set_tooltip_text (sending_spinner, tmp);
+          g_free (tmp);
+        }
+
+      if (!TPAW_STR_EMPTY (status))
+        append_markup_printf (tooltip, "\n<i>%s</i>", status);
+
+      if (!TPAW_STR_EMPTY (subject))
+        append_markup_printf (tooltip, "\n<b>%s</b> %s",
+            _("Topic:"), subject);
+
+      if (remote_contact && empathy_chat_is_composing (chat))
+        append_markup_printf (tooltip, "\n%s", _("Typing a message."));
+
+      markup = g_string_free (tooltip, FALSE);
+      widget = g_object_get_data (G_OBJECT (chat),
+          "chat-window-tab-tooltip-widget");
+      gtk_widget_set_tooltip_markup (widget, markup);
+
+      widget = g_object_get_data (G_OBJECT (chat),
+          "chat-window-menu-tooltip-widget");
+      gtk_widget_set_tooltip_markup (widget, markup);
+      g_free (markup);
     }
-  else
+
+  /* Update tab and menu label */
+  if (fields & CHAT_TAB_LABEL)
     {
-      gtk_widget_hide (tab_image);
-      gtk_widget_hide (menu_image);
+      if (empathy_chat_is_highlighted (chat))
+        {
+          markup = g_markup_printf_escaped (
+            "<span color=\"red\" weight=\"bold\">%s</span>",
+            name);
+        }
+      else
+        {
+          markup = g_markup_escape_text (name, -1);
+        }
+
+      widget = g_object_get_data (G_OBJECT (chat), "chat-window-tab-label");
+      gtk_label_set_markup (GTK_LABEL (widget), markup);
+      widget = g_object_get_data (G_OBJECT (chat), "chat-window-menu-label");
+      gtk_label_set_markup (GTK_LABEL (widget), markup);
+      g_free (markup);
     }
 
-  /* Update the sending spinner */
-  nb_sending = empathy_chat_get_n_messages_sending (chat);
-  sending_spinner = g_object_get_data (G_OBJECT (chat),
-    "chat-window-tab-sending-spinner");
+  g_free (name);
+}
 
-  g_object_set (sending_spinner,
-    "active", nb_sending > 0,
-    "visible", nb_sending > 0,
-    NULL);
+static void
+chat_window_update_chat_tab_full (EmpathyChat *chat,
+    gboolean update_contact_menu)
+{
+  ChatEntry *entry;
 
-  /* Update tab tooltip */
-  tooltip = g_string_new (NULL);
+  if (chats_by_object == NULL)
+    return;
 
-  if (remote_contact)
+  entry = g_hash_table_lookup (chats_by_object, chat);
+  if (entry == NULL)
+    return;
+
+  /* Keep the registry's key and unread count in step with the chat before
+   * anything reads them */
+  chat_registry_sync (entry);
+
+  /* Whatever was queued is done now */
+  if (entry->window->priv->dirty_chats != NULL)
+    g_hash_table_remove (entry->window->priv->dirty_chats, chat);
+
+  chat_window_update_chat_tab_fields (entry, CHAT_TAB_ALL);
+
+  /* Update the window if it's the current chat */
+  if (entry->window->priv->current_chat == chat)
+    chat_window_update (entry->window, update_contact_menu);
+}
+
+static void
+chat_window_flush_updates (EmpathyChatWindow *self)
+{
+  GHashTable *dirty_chats;
+  GHashTableIter iter;
+  gpointer key, value;
+  gboolean update_window = FALSE;
+  gboolean update_contact_menu = FALSE;
+
+  if (self->priv->flush_tick_id != 0)
     {
-      id = empathy_contact_get_id (remote_contact);
-      status = empathy_contact_get_presence_message (remote_contact);
+      gtk_widget_remove_tick_callback (GTK_WIDGET (self),
+          self->priv->flush_tick_id);
+      self->priv->flush_tick_id = 0;
     }
-  else
+
+  if (self->priv->flush_idle_id != 0)
     {
-      id = name;
+      g_source_remove (self->priv->flush_idle_id);
+      self->priv->flush_idle_id = 0;
     }
 
-  if (empathy_chat_is_sms_channel (chat))
-    append_markup_printf (tooltip, "%s ", _("SMS:"));
+  /* Updating the tabs may queue more changes for the next frame */
+  dirty_chats = self->priv->dirty_chats;
+  self->priv->dirty_chats = NULL;
 
-  append_markup_printf (tooltip, "<b>%s</b><small> (%s)</small>",
-      id, tp_account_get_display_name (account));
+  if (dirty_chats == NULL)
+    return;
 
-  if (nb_sending > 0)
+  g_hash_table_iter_init (&iter, dirty_chats);
+  while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      char *tmp = g_strdup_printf (
-        ngettext ("Sending %d message",
-            "Sending %d messages",
-            nb_sending),
-        nb_sending);
+      EmpathyChat *chat = key;
+      ChatTabFields fields = GPOINTER_TO_UINT (value);
+      ChatEntry *entry;
+
+      entry = g_hash_table_lookup (chats_by_object, chat);
+      if (entry == NULL || entry->window != self)
+        continue;
+
+      chat_window_update_chat_tab_fields (entry, fields);
 
-      g_string_append (tooltip, "\n");
-      g_string_append (tooltip, tmp);
+      if (fields & CHAT_TAB_WINDOW || self->priv->current_chat == chat)
+        update_window = TRUE;
 
-      gtk_widget_set_tooltip_text (sending_spinner, tmp);
-      g_free (tmp);
+      if (fields & CHAT_TAB_CONTACT_MENU && self->priv->current_chat == chat)
+        update_contact_menu = TRUE;
     }
 
-  if (!TPAW_STR_EMPTY (status))
-    append_markup_printf (tooltip, "\n<i>%s</i>", status);
+  g_hash_table_unref (dirty_chats);
 
-  if (!TPAW_STR_EMPTY (subject))
-    append_markup_printf (tooltip, "\n<b>%s</b> %s",
-        _("Topic:"), subject);
+  if (update_window)
+    chat_window_update (self, update_contact_menu);
+}
 
-  if (remote_contact && empathy_chat_is_composing (chat))
-    append_markup_printf (tooltip, "\n%s", _("Typing a message."));
+static gboolean
+chat_window_flush_tick_cb (GtkWidget *widget,
+    GdkFrameClock *frame_clock,
+    gpointer user_data)
+{
+  EmpathyChatWindow *self = EMPATHY_CHAT_WINDOW (widget);
 
-  if (remote_contact != NULL)
-    {
-      const gchar * const *types;
+  self->priv->flush_tick_id = 0;
+  chat_window_flush_updates (self);
 
-      types = empathy_contact_get_client_types (remote_contact);
-      if (empathy_client_types_contains_mobile_device ((GStrv) types))
-        {
-          /* I'm on a mobile device ! */
-          gchar *tmp = name;
+  return G_SOURCE_REMOVE;
+}
 
-          name = g_strdup_printf ("☎ %s", name);
-          g_free (tmp);
-        }
-    }
+static gboolean
+chat_window_flush_idle_cb (gpointer user_data)
+{
+  EmpathyChatWindow *self = user_data;
 
-  markup = g_string_free (tooltip, FALSE);
-  widget = g_object_get_data (G_OBJECT (chat),
-      "chat-window-tab-tooltip-widget");
-  gtk_widget_set_tooltip_markup (widget, markup);
+  self->priv->flush_idle_id = 0;
+  chat_window_flush_updates (self);
 
-  widget = g_object_get_data (G_OBJECT (chat),
-      "chat-window-menu-tooltip-widget");
-  gtk_widget_set_tooltip_markup (widget, markup);
-  g_free (markup);
+  return G_SOURCE_REMOVE;
+}
 
-  /* Update tab and menu label */
-  if (empathy_chat_is_highlighted (chat))
+/* Mark @fields of @chat's tab as out of date. Changes are applied together,
+ * at most once per frame of the chat's window, so a burst of notifications
+ * (typing, presence, unread count...) costs a single update. */
+static void
+chat_window_queue_chat_update (EmpathyChat *chat,
+    ChatTabFields fields)
+{
+  EmpathyChatWindow *self;
+  ChatEntry *entry;
+  GdkWindow *gdk_window;
+  ChatTabFields queued;
+
+  if (chats_by_object == NULL)
+    return;
+
+  entry = g_hash_table_lookup (chats_by_object, chat);
+  if (entry == NULL)
+    return;
+
+  /* Lookups can't wait for the next frame */
+  chat_registry_sync (entry);
+  self = entry->window;
+
+  if (self->priv->dirty_chats == NULL)
+    self->priv->dirty_chats = g_hash_table_new (NULL, NULL);
+
+  queued = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->dirty_chats,
+        chat));
+  if (queued != 0)
+    n_coalesced_updates++;
+
+  g_hash_table_insert (self->priv->dirty_chats, chat,
+      GUINT_TO_POINTER (queued | fields));
+
+  if (self->priv->flush_tick_id != 0 || self->priv->flush_idle_id != 0)
+    return;
+
+  /* The frame clock of a hidden or minimized window is frozen, but its title
+   * and icon are still shown by the window list. The window can also be
+   * hidden before the next frame, so the tick has a timeout as fallback. */
+  gdk_window = gtk_widget_get_window (GTK_WIDGET (self));
+
+  if (gtk_widget_get_mapped (GTK_WIDGET (self)) && gdk_window != NULL &&
+      !(gdk_window_get_state (gdk_window) & GDK_WINDOW_STATE_ICONIFIED))
     {
-      markup = g_markup_printf_escaped (
-        "<span color=\"red\" weight=\"bold\">%s</span>",
-        name);
+      self->priv->flush_tick_id = gtk_widget_add_tick_callback (
+          GTK_WIDGET (self), chat_window_flush_tick_cb, NULL, NULL);
+      self->priv->flush_idle_id = g_timeout_add (FLUSH_FALLBACK_TIMEOUT,
+          chat_window_flush_idle_cb, self);
     }
   else
     {
-      markup = g_markup_escape_text (name, -1);
+      self->priv->flush_idle_id = g_idle_add (chat_window_flush_idle_cb,
+          self);
     }
+}
 
-  widget = g_object_get_data (G_OBJECT (chat), "chat-window-tab-label");
-  gtk_label_set_markup (GTK_LABEL (widget), markup);
-  widget = g_object_get_data (G_OBJECT (chat), "chat-window-menu-label");
-  gtk_label_set_markup (GTK_LABEL (widget), markup);
-  g_free (markup);
-
-  /* Update the window if it's the current chat */
-  if (self->priv->current_chat == chat)
-    chat_window_update (self, update_contact_menu);
+static void
+chat_window_remote_contact_notify_cb (EmpathyChat *chat)
+{
+  chat_window_queue_chat_update (chat,
+      CHAT_TAB_ICON | CHAT_TAB_TOOLTIP | CHAT_TAB_LABEL |
+      CHAT_TAB_CONTACT_MENU);
+}
 
-  g_free (name);
+static void
+chat_window_tp_chat_notify_cb (EmpathyChat *chat,
+    GParamSpec *pspec,
+    gpointer user_data)
+{
+  chat_window_queue_chat_update (chat, CHAT_TAB_ALL);
 }
 
 static void
@@ -1032,11 +1418,14 @@ chat_window_update_chat_tab (EmpathyChat *chat)
 }
 
 static void
-chat_window_chat_notify_cb (EmpathyChat *chat)
+chat_window_chat_notify_cb (EmpathyChat *chat,
+    GParamSpec *pspec,
+    gpointer user_data)
 {
-  EmpathyChatWindow *window;
   EmpathyContact *old_remote_contact;
   EmpathyContact *remote_contact = NULL;
+  const gchar *property;
+  ChatTabFields fields;
 
   old_remote_contact = g_object_get_data (G_OBJECT (chat),
       "chat-window-remote-contact");
@@ -1049,21 +1438,33 @@ chat_window_chat_notify_cb (EmpathyChat *chat)
        * window each time. */
       if (remote_contact)
         g_signal_connect_swapped (remote_contact, "notify",
-            G_CALLBACK (chat_window_update_chat_tab), chat);
+            G_CALLBACK (chat_window_remote_contact_notify_cb), chat);
 
       if (old_remote_contact)
         g_signal_handlers_disconnect_by_func (old_remote_contact,
-            chat_window_update_chat_tab, chat);
+            chat_window_remote_contact_notify_cb, chat);
 
       g_object_set_data_full (G_OBJECT (chat), "chat-window-remote-contact",
           g_object_ref (remote_contact), (GDestroyNotify) g_object_unref);
     }
 
-  chat_window_update_chat_tab (chat);
+  /* Only recompute what depends on the property which changed */
+  property = pspec != NULL ? g_param_spec_get_name (pspec) : NULL;
 
-  window = chat_window_find_chat (chat);
-  if (window != NULL)
-    chat_window_update (window, FALSE);
+  if (!tp_strdiff (property, "name"))
+    fields = CHAT_TAB_TOOLTIP | CHAT_TAB_LABEL;
+  else if (!tp_strdiff (property, "subject"))
+    fields = CHAT_TAB_TOOLTIP;
+  else if (!tp_strdiff (property, "sms-channel"))
+    fields = CHAT_TAB_ICON | CHAT_TAB_TOOLTIP;
+  else if (!tp_strdiff (property, "n-messages-sending"))
+    fields = CHAT_TAB_SPINNER | CHAT_TAB_TOOLTIP;
+  else if (!tp_strdiff (property, "nb-unread-messages"))
+    fields = CHAT_TAB_ICON | CHAT_TAB_WINDOW;
+  else
+    fields = CHAT_TAB_ALL;
+
+  chat_window_queue_chat_update (chat, fields);
 }
 
 static void
@@ -1558,7 +1959,7 @@ chat_window_composing_cb (EmpathyChat *chat,
     gboolean is_composing,
     EmpathyChatWindow *self)
 {
-  chat_window_update_chat_tab (chat);
+  chat_window_queue_chat_update (chat, CHAT_TAB_ICON | CHAT_TAB_TOOLTIP);
 }
 
 static void
@@ -1593,8 +1994,8 @@ chat_window_show_or_update_notification (EmpathyChatWindow *self,
   if (!empathy_notify_manager_notification_is_enabled (self->priv->notify_mgr))
     return;
 
-  res = g_settings_get_boolean (self->priv->gsettings_notif,
-      EMPATHY_PREFS_NOTIFICATIONS_FOCUS);
+  res = EMPATHY_SETTINGS_SNAPSHOT_GET (self->priv->settings,
+      notifications_focus);
 
   if (!res)
     return;
@@ -1844,6 +2245,41 @@ notebook_create_window_cb (GtkNotebook *source,
   return NULL;
 }
 
+/* Release the views of the chats which haven't been looked at for a while */
+static gboolean
+chat_window_hibernate_cb (gpointer user_data)
+{
+  EmpathyChatWindow *self = user_data;
+  gint64 delay, now;
+  GList *l;
+
+  delay = g_settings_get_uint (self->priv->gsettings_ui,
+      EMPATHY_PREFS_UI_CHAT_HIBERNATION_DELAY);
+  if (delay == 0 || chats_by_object == NULL)
+    return G_SOURCE_CONTINUE;
+
+  delay *= 60 * G_USEC_PER_SEC;
+  now = g_get_monotonic_time ();
+
+  for (l = self->priv->chats; l != NULL; l = g_list_next (l))
+    {
+      EmpathyChat *chat = l->data;
+      ChatEntry *entry;
+
+      if (chat == self->priv->current_chat ||
+          empathy_chat_is_hibernated (chat))
+        continue;
+
+      entry = g_hash_table_lookup (chats_by_object, chat);
+      if (entry == NULL || now - entry->last_active < delay)
+        continue;
+
+      empathy_chat_hibernate (chat);
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
 static void
 chat_window_page_switched_cb (GtkNotebook *notebook,
     GtkWidget *child,
@@ -1851,9 +2287,21 @@ chat_window_page_switched_cb (GtkNotebook *notebook,
     EmpathyChatWindow *self)
 {
   EmpathyChat *chat = EMPATHY_CHAT (child);
+  ChatEntry *entry;
 
   DEBUG ("Page switched");
 
+  empathy_chat_wake (chat);
+
+  /* The previous chat was looked at until now */
+  if (self->priv->current_chat != NULL && chats_by_object != NULL)
+    {
+      entry = g_hash_table_lookup (chats_by_object,
+          self->priv->current_chat);
+      if (entry != NULL)
+        entry->last_active = g_get_monotonic_time ();
+    }
+
   if (self->priv->page_added)
     {
       self->priv->page_added = FALSE;
@@ -1902,7 +2350,7 @@ chat_window_page_added_cb (GtkNotebook *notebook,
   g_signal_connect (chat, "part-command-entered",
       G_CALLBACK (chat_window_command_part), NULL);
   g_signal_connect (chat, "notify::tp-chat",
-      G_CALLBACK (chat_window_update_chat_tab), self);
+      G_CALLBACK (chat_window_tp_chat_notify_cb), self);
 
   /* Set flag so we know to perform some special operations on
    * switch page due to the new page being added.
@@ -1911,6 +2359,7 @@ chat_window_page_added_cb (GtkNotebook *notebook,
 
   /* Get list of chats up to date */
   self->priv->chats = g_list_append (self->priv->chats, chat);
+  chat_registry_add (self, chat);
 
   chat_window_update_chat_tab (chat);
 }
@@ -1944,10 +2393,14 @@ chat_window_page_removed_cb (GtkNotebook *notebook,
   g_signal_handlers_disconnect_by_func (chat,
       G_CALLBACK (chat_window_new_message_cb), self);
   g_signal_handlers_disconnect_by_func (chat,
-      G_CALLBACK (chat_window_update_chat_tab), self);
+      G_CALLBACK (chat_window_tp_chat_notify_cb), self);
+
+  if (self->priv->dirty_chats != NULL)
+    g_hash_table_remove (self->priv->dirty_chats, chat);
 
   /* Keep list of chats up to date */
   self->priv->chats = g_list_remove (self->priv->chats, chat);
+  chat_registry_remove (chat);
   empathy_chat_messages_read (chat);
 
   if (self->priv->chats == NULL)
@@ -2319,6 +2772,28 @@ chat_window_chat_manager_chats_changed_cb (EmpathyChatManager *chat_manager,
       num_chats_in_manager > 0);
 }
 
+static void
+chat_window_dispose (GObject *object)
+{
+  EmpathyChatWindow *self = EMPATHY_CHAT_WINDOW (object);
+
+  /* The tick callback can't outlive the widget */
+  if (self->priv->flush_tick_id != 0)
+    {
+      gtk_widget_remove_tick_callback (GTK_WIDGET (self),
+          self->priv->flush_tick_id);
+      self->priv->flush_tick_id = 0;
+    }
+
+  if (self->priv->flush_idle_id != 0)
+    {
+      g_source_remove (self->priv->flush_idle_id);
+      self->priv->flush_idle_id = 0;
+    }
+
+  G_OBJECT_CLASS (empathy_chat_window_parent_class)->dispose (object);
+}
+
 static void
 chat_window_finalize (GObject *object)
 {
@@ -2329,8 +2804,7 @@ chat_window_finalize (GObject *object)
   g_object_unref (self->priv->ui_manager);
   g_object_unref (self->priv->chatroom_manager);
   g_object_unref (self->priv->notify_mgr);
-  g_object_unref (self->priv->gsettings_chat);
-  g_object_unref (self->priv->gsettings_notif);
+  g_object_unref (self->priv->settings);
   g_object_unref (self->priv->gsettings_ui);
   g_object_unref (self->priv->sound_mgr);
   g_clear_object (&self->priv->individual_mgr);
@@ -2356,6 +2830,12 @@ chat_window_finalize (GObject *object)
     }
 
   chat_windows = g_list_remove (chat_windows, self);
+  chat_registry_remove_window (self);
+
+  if (self->priv->hibernation_id != 0)
+    g_source_remove (self->priv->hibernation_id);
+
+  tp_clear_pointer (&self->priv->dirty_chats, g_hash_table_unref);
 
   G_OBJECT_CLASS (empathy_chat_window_parent_class)->finalize (object);
 }
@@ -2385,6 +2865,7 @@ empathy_chat_window_class_init (EmpathyChatWindowClass *klass)
   GParamSpec *spec;
 
   object_class->get_property = chat_window_get_property;
+  object_class->dispose = chat_window_dispose;
   object_class->finalize = chat_window_finalize;
 
   spec = g_param_spec_object ("individual-manager", "individual-manager",
@@ -2462,8 +2943,7 @@ empathy_chat_window_init (EmpathyChatWindow *self)
 
   empathy_set_css_provider (GTK_WIDGET (self));
 
-  self->priv->gsettings_chat = g_settings_new (EMPATHY_PREFS_CHAT_SCHEMA);
-  self->priv->gsettings_notif = g_settings_new (EMPATHY_PREFS_NOTIFICATIONS_SCHEMA);
+  self->priv->settings = empathy_settings_snapshot_dup_singleton ();
   self->priv->gsettings_ui = g_settings_new (EMPATHY_PREFS_UI_SCHEMA);
   self->priv->chatroom_manager = empathy_chatroom_manager_dup_singleton (NULL);
 
@@ -2549,6 +3029,9 @@ empathy_chat_window_init (EmpathyChatWindow *self)
 
   chat_windows = g_list_prepend (chat_windows, self);
 
+  self->priv->hibernation_id = g_timeout_add_seconds (
+      HIBERNATION_CHECK_INTERVAL, chat_window_hibernate_cb, self);
+
   /* Set up private details */
   self->priv->chats = NULL;
   self->priv->current_chat = NULL;
@@ -2679,7 +3162,7 @@ empathy_chat_window_add_chat (EmpathyChatWindow *self,
       G_CALLBACK (chat_window_chat_notify_cb), NULL);
   g_signal_connect (chat, "notify::nb-unread-messages",
       G_CALLBACK (chat_window_chat_notify_cb), NULL);
-  chat_window_chat_notify_cb (chat);
+  chat_window_chat_notify_cb (chat, NULL, NULL);
 
   gtk_notebook_append_page_menu (GTK_NOTEBOOK (self->priv->notebook), child, label,
       popup_label);
@@ -2716,7 +3199,7 @@ empathy_chat_window_remove_chat (EmpathyChatWindow *self,
   if (remote_contact)
     {
       g_signal_handlers_disconnect_by_func (remote_contact,
-          chat_window_update_chat_tab, chat);
+          chat_window_remote_contact_notify_cb, chat);
     }
 
   chat_manager = empathy_chat_manager_dup_singleton ();
@@ -2782,29 +3265,25 @@ empathy_chat_window_find_chat (TpAccount *account,
     const gchar *id,
     gboolean sms_channel)
 {
-  GList *l;
+  ChatEntry *entry;
+  gchar *key;
 
   g_return_val_if_fail (!TPAW_STR_EMPTY (id), NULL);
 
-  for (l = chat_windows; l; l = l->next)
-    {
-      EmpathyChatWindow *window = l->data;
-      GList *ll;
+  if (chats_by_key == NULL)
+    return NULL;
 
-      for (ll = window->priv->chats; ll; ll = ll->next)
-        {
-          EmpathyChat *chat;
+  key = chat_registry_make_key (account, id, sms_channel);
+  if (key == NULL)
+    return NULL;
 
-          chat = ll->data;
+  entry = g_hash_table_lookup (chats_by_key, key);
+  g_free (key);
 
-          if (account == empathy_chat_get_account (chat) &&
-              !tp_strdiff (id, empathy_chat_get_id (chat)) &&
-              sms_channel == empathy_chat_is_sms_channel (chat))
-            return chat;
-        }
-    }
+  if (entry == NULL)
+    return NULL;
 
-  return NULL;
+  return entry->chat;
 }
 
 EmpathyChatWindow *
@@ -2892,3 +3371,11 @@ empathy_chat_window_get_individual_manager (EmpathyChatWindow *self)
 {
   return self->priv->individual_mgr;
 }
+
+/* Number of tab and window updates which were merged into an earlier one
+ * still waiting for the next frame */
+guint
+empathy_chat_window_get_n_coalesced_updates (void)
+{
+  return n_coalesced_updates;
+}
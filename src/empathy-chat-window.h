@@ -84,6 +84,8 @@ EmpathyChatWindow * empathy_chat_window_present_chat (EmpathyChat *chat,
 EmpathyIndividualManager * empathy_chat_window_get_individual_manager (
     EmpathyChatWindow *self);
 
+guint empathy_chat_window_get_n_coalesced_updates (void);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,305 @@
+/*
+*  Copyright (C) 2014 Collabora Ltd.
+*
+*  This library is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU Lesser General Public
+*  License as published by the Free Software Foundation; either
+*  version 2.1 of the License, or (at your option) any later version.
+*
+*  This library is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*  Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public
+*  License along with this library; if not, write to the Free Software
+*  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include "empathy-debug-exporter.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_OTHER
+#include "empathy-debug.h"
+
+/* Lines are formatted and written by chunks of about this size, so the main
+ * loop keeps running between them */
+#define CHUNK_SIZE (64 * 1024)
+
+typedef struct
+{
+  /* owned TpDebugMessage */
+  GPtrArray *messages;
+  /* index of the next message to format */
+  guint next;
+
+  GLogLevelFlags max_level;
+
+  /* The caller's stream, or a GConverterOutputStream on top of it */
+  GOutputStream *stream;
+  gboolean compress;
+
+  GString *chunk;
+  gsize chunk_written;
+
+  EmpathyDebugExportProgressFunc progress;
+  gpointer progress_data;
+} ExportCtx;
+
+static void
+export_ctx_free (ExportCtx *ctx)
+{
+  g_ptr_array_unref (ctx->messages);
+  g_object_unref (ctx->stream);
+  g_string_free (ctx->chunk, TRUE);
+  g_slice_free (ExportCtx, ctx);
+}
+
+static const struct {
+  GLogLevelFlags level;
+  const gchar *name;
+  /* in exported logs */
+  const gchar *upper_name;
+} levels[] = {
+  { G_LOG_LEVEL_ERROR, "Error", "ERROR" },
+  { G_LOG_LEVEL_CRITICAL, "Critical", "CRITICAL" },
+  { G_LOG_LEVEL_WARNING, "Warning", "WARNING" },
+  { G_LOG_LEVEL_MESSAGE, "Message", "MESSAGE" },
+  { G_LOG_LEVEL_INFO, "Info", "INFO" },
+  { G_LOG_LEVEL_DEBUG, "Debug", "DEBUG" },
+};
+
+static guint
+level_to_index (GLogLevelFlags level)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (levels); i++)
+    {
+      if (levels[i].level == level)
+        return i;
+    }
+
+  g_return_val_if_reached (G_N_ELEMENTS (levels) - 1);
+}
+
+/**
+ * empathy_debug_level_to_string:
+ * @level: the level of a #TpDebugMessage
+ *
+ * Returns: the name of @level, as shown in the debug window
+ */
+const gchar *
+empathy_debug_level_to_string (GLogLevelFlags level)
+{
+  return levels[level_to_index (level)].name;
+}
+
+/**
+ * empathy_debug_message_dup_time:
+ * @msg: a #TpDebugMessage
+ *
+ * Returns: the time of @msg, to the microsecond; free with g_free()
+ */
+gchar *
+empathy_debug_message_dup_time (TpDebugMessage *msg)
+{
+  GDateTime *t = tp_debug_message_get_time (msg);
+  gchar *time_str, *text;
+
+  time_str = g_date_time_format (t, "%x %T");
+  text = g_strdup_printf ("%s.%d", time_str, g_date_time_get_microsecond (t));
+
+  g_free (time_str);
+  return text;
+}
+
+static void
+append_message (GString *string,
+    TpDebugMessage *msg)
+{
+  const gchar *category = tp_debug_message_get_category (msg);
+  gchar *time_str;
+
+  time_str = empathy_debug_message_dup_time (msg);
+
+  g_string_append_printf (string, "%s%s%s-%s: %s: %s\n",
+      tp_debug_message_get_domain (msg),
+      category != NULL ? "/" : "", category != NULL ? category : "",
+      levels[level_to_index (tp_debug_message_get_level (msg))].upper_name,
+      time_str, tp_debug_message_get_message (msg));
+
+  g_free (time_str);
+}
+
+/* Format the next messages into ctx->chunk; returns FALSE once they have
+ * all been exported */
+static gboolean
+export_fill_chunk (ExportCtx *ctx)
+{
+  g_string_truncate (ctx->chunk, 0);
+  ctx->chunk_written = 0;
+
+  while (ctx->next < ctx->messages->len && ctx->chunk->len < CHUNK_SIZE)
+    {
+      TpDebugMessage *msg = g_ptr_array_index (ctx->messages, ctx->next);
+
+      ctx->next++;
+
+      if (tp_debug_message_get_level (msg) > ctx->max_level)
+        continue;
+
+      append_message (ctx->chunk, msg);
+    }
+
+  return ctx->chunk->len > 0;
+}
+
+static void export_write_chunk (GTask *task);
+
+static void
+export_close_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GTask *task = user_data;
+  GError *error = NULL;
+
+  if (!g_output_stream_close_finish (G_OUTPUT_STREAM (source), result,
+        &error))
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+
+  g_object_unref (task);
+}
+
+static void
+export_write_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GTask *task = user_data;
+  ExportCtx *ctx = g_task_get_task_data (task);
+  GError *error = NULL;
+  gssize written;
+
+  written = g_output_stream_write_finish (G_OUTPUT_STREAM (source), result,
+      &error);
+  if (written < 0)
+    {
+      DEBUG ("Failed to export debug messages: %s", error->message);
+      g_task_return_error (task, error);
+      g_object_unref (task);
+      return;
+    }
+
+  ctx->chunk_written += written;
+
+  if (ctx->chunk_written == ctx->chunk->len && ctx->progress != NULL)
+    ctx->progress (ctx->next, ctx->messages->len, ctx->progress_data);
+
+  export_write_chunk (task);
+}
+
+static void
+export_write_chunk (GTask *task)
+{
+  ExportCtx *ctx = g_task_get_task_data (task);
+
+  if (ctx->chunk_written == ctx->chunk->len && !export_fill_chunk (ctx))
+    {
+      /* Done. Closing the compressor writes the gzip trailer but leaves
+       * the caller's stream open. */
+      if (ctx->compress)
+        {
+          g_output_stream_close_async (ctx->stream, G_PRIORITY_DEFAULT,
+              g_task_get_cancellable (task), export_close_cb, task);
+          return;
+        }
+
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+      return;
+    }
+
+  g_output_stream_write_async (ctx->stream,
+      ctx->chunk->str + ctx->chunk_written,
+      ctx->chunk->len - ctx->chunk_written,
+      G_PRIORITY_DEFAULT, g_task_get_cancellable (task),
+      export_write_cb, task);
+}
+
+/**
+ * empathy_debug_export_async:
+ * @messages: (element-type TelepathyGLib.DebugMessage): the messages to
+ *  export
+ * @stream: where to write them, which is left open
+ * @flags: #EmpathyDebugExportFlags
+ * @max_level: the least severe level to export
+ * @cancellable: (allow-none): a #GCancellable
+ * @progress: (allow-none): called after each chunk has been written
+ * @progress_data: data for @progress
+ * @callback: called when all the messages have been written
+ * @user_data: data for @callback
+ *
+ * Write @messages to @stream, one line per message. Lines are formatted
+ * while the previous chunk is being written so memory use doesn't depend
+ * on the number of messages.
+ */
+void
+empathy_debug_export_async (GPtrArray *messages,
+    GOutputStream *stream,
+    EmpathyDebugExportFlags flags,
+    GLogLevelFlags max_level,
+    GCancellable *cancellable,
+    EmpathyDebugExportProgressFunc progress,
+    gpointer progress_data,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GTask *task;
+  ExportCtx *ctx;
+
+  g_return_if_fail (messages != NULL);
+  g_return_if_fail (G_IS_OUTPUT_STREAM (stream));
+
+  ctx = g_slice_new0 (ExportCtx);
+  ctx->messages = g_ptr_array_ref (messages);
+  ctx->max_level = max_level;
+  ctx->chunk = g_string_sized_new (CHUNK_SIZE + 1024);
+  ctx->progress = progress;
+  ctx->progress_data = progress_data;
+
+  if (flags & EMPATHY_DEBUG_EXPORT_COMPRESS)
+    {
+      GZlibCompressor *compressor;
+
+      compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+      ctx->stream = g_converter_output_stream_new (stream,
+          G_CONVERTER (compressor));
+      g_filter_output_stream_set_close_base_stream (
+          G_FILTER_OUTPUT_STREAM (ctx->stream), FALSE);
+      ctx->compress = TRUE;
+
+      g_object_unref (compressor);
+    }
+  else
+    {
+      ctx->stream = g_object_ref (stream);
+    }
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_task_data (task, ctx, (GDestroyNotify) export_ctx_free);
+
+  export_write_chunk (task);
+}
+
+gboolean
+empathy_debug_export_finish (GAsyncResult *result,
+    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
@@ -0,0 +1,57 @@
+/*
+*  Copyright (C) 2014 Collabora Ltd.
+*
+*  This library is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU Lesser General Public
+*  License as published by the Free Software Foundation; either
+*  version 2.1 of the License, or (at your option) any later version.
+*
+*  This library is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*  Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public
+*  License along with this library; if not, write to the Free Software
+*  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __EMPATHY_DEBUG_EXPORTER_H__
+#define __EMPATHY_DEBUG_EXPORTER_H__
+
+#include <gio/gio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  EMPATHY_DEBUG_EXPORT_NONE = 0,
+  /* gzip the output */
+  EMPATHY_DEBUG_EXPORT_COMPRESS = 1 << 0,
+} EmpathyDebugExportFlags;
+
+/* Called each time a chunk has been written */
+typedef void (*EmpathyDebugExportProgressFunc) (guint n_exported,
+    guint n_total,
+    gpointer user_data);
+
+void empathy_debug_export_async (GPtrArray *messages,
+    GOutputStream *stream,
+    EmpathyDebugExportFlags flags,
+    GLogLevelFlags max_level,
+    GCancellable *cancellable,
+    EmpathyDebugExportProgressFunc progress,
+    gpointer progress_data,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+gboolean empathy_debug_export_finish (GAsyncResult *result,
+    GError **error);
+
+const gchar * empathy_debug_level_to_string (GLogLevelFlags level);
+gchar * empathy_debug_message_dup_time (TpDebugMessage *msg);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_DEBUG_EXPORTER_H__ */
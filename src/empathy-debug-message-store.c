@@ -0,0 +1,702 @@
+/*
+*  Copyright (C) 2014 Collabora Ltd.
+*
+*  This library is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU Lesser General Public
+*  License as published by the Free Software Foundation; either
+*  version 2.1 of the License, or (at your option) any later version.
+*
+*  This library is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*  Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public
+*  License along with this library; if not, write to the Free Software
+*  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include "empathy-debug-message-store.h"
+
+#include <string.h>
+
+/* EmpathyDebugRingBuffer */
+
+typedef struct
+{
+  TpDebugMessage *msg;
+  /* Arrival order across all the buffers of the process */
+  guint64 serial;
+  GLogLevelFlags level;
+} RingEntry;
+
+struct _EmpathyDebugRingBuffer
+{
+  gint ref_count;
+
+  RingEntry *entries;
+  guint capacity;
+  /* index of the oldest entry */
+  guint head;
+  guint length;
+
+  /* Number of messages removed from the front since the buffer was created.
+   * The absolute position of a message (n_dropped + its index) never
+   * changes, which lets stores refer to it while older ones go away. */
+  guint64 n_dropped;
+};
+
+static guint64 next_serial = 0;
+
+G_DEFINE_BOXED_TYPE (EmpathyDebugRingBuffer, empathy_debug_ring_buffer,
+    empathy_debug_ring_buffer_ref, empathy_debug_ring_buffer_unref)
+
+EmpathyDebugRingBuffer *
+empathy_debug_ring_buffer_new (guint capacity)
+{
+  EmpathyDebugRingBuffer *buffer;
+
+  g_return_val_if_fail (capacity > 0, NULL);
+
+  buffer = g_slice_new0 (EmpathyDebugRingBuffer);
+  buffer->ref_count = 1;
+  buffer->capacity = capacity;
+  buffer->entries = g_new0 (RingEntry, capacity);
+
+  return buffer;
+}
+
+EmpathyDebugRingBuffer *
+empathy_debug_ring_buffer_ref (EmpathyDebugRingBuffer *buffer)
+{
+  g_atomic_int_inc (&buffer->ref_count);
+  return buffer;
+}
+
+void
+empathy_debug_ring_buffer_unref (EmpathyDebugRingBuffer *buffer)
+{
+  if (!g_atomic_int_dec_and_test (&buffer->ref_count))
+    return;
+
+  empathy_debug_ring_buffer_clear (buffer);
+  g_free (buffer->entries);
+  g_slice_free (EmpathyDebugRingBuffer, buffer);
+}
+
+static RingEntry *
+ring_buffer_entry (EmpathyDebugRingBuffer *buffer,
+    guint n)
+{
+  return &buffer->entries[(buffer->head + n) % buffer->capacity];
+}
+
+/* Returns TRUE if the oldest message had to be dropped to make room, in
+ * which case its serial is stored in @dropped_serial */
+static gboolean
+ring_buffer_push (EmpathyDebugRingBuffer *buffer,
+    TpDebugMessage *msg,
+    guint64 *dropped_serial)
+{
+  gboolean dropped = FALSE;
+  RingEntry *entry;
+
+  if (buffer->length == buffer->capacity)
+    {
+      entry = ring_buffer_entry (buffer, 0);
+      *dropped_serial = entry->serial;
+      g_object_unref (entry->msg);
+      entry->msg = NULL;
+
+      buffer->head = (buffer->head + 1) % buffer->capacity;
+      buffer->length--;
+      buffer->n_dropped++;
+      dropped = TRUE;
+    }
+
+  entry = ring_buffer_entry (buffer, buffer->length);
+  entry->msg = g_object_ref (msg);
+  entry->serial = next_serial++;
+  entry->level = tp_debug_message_get_level (msg);
+  buffer->length++;
+
+  return dropped;
+}
+
+guint
+empathy_debug_ring_buffer_get_length (EmpathyDebugRingBuffer *buffer)
+{
+  return buffer->length;
+}
+
+TpDebugMessage *
+empathy_debug_ring_buffer_get_message (EmpathyDebugRingBuffer *buffer,
+    guint n)
+{
+  g_return_val_if_fail (n < buffer->length, NULL);
+
+  return ring_buffer_entry (buffer, n)->msg;
+}
+
+void
+empathy_debug_ring_buffer_append (EmpathyDebugRingBuffer *buffer,
+    TpDebugMessage *msg)
+{
+  guint64 dropped_serial;
+
+  ring_buffer_push (buffer, msg, &dropped_serial);
+}
+
+void
+empathy_debug_ring_buffer_clear (EmpathyDebugRingBuffer *buffer)
+{
+  guint i;
+
+  for (i = 0; i < buffer->length; i++)
+    {
+      RingEntry *entry = ring_buffer_entry (buffer, i);
+
+      tp_clear_object (&entry->msg);
+    }
+
+  buffer->n_dropped += buffer->length;
+  buffer->head = 0;
+  buffer->length = 0;
+}
+
+/* EmpathyDebugMessageStore */
+
+typedef struct
+{
+  /* index in priv->buffers */
+  guint buffer;
+  /* absolute position of the message in that buffer */
+  guint64 position;
+  /* copy of the message's serial, rows are sorted by it */
+  guint64 serial;
+} Row;
+
+struct _EmpathyDebugMessageStorePriv
+{
+  /* owned EmpathyDebugRingBuffer */
+  GPtrArray *buffers;
+  GLogLevelFlags max_level;
+
+  /* Visible rows, only computed once a view asks for them. Deleting the
+   * first rows just moves first_row forward. */
+  GArray *rows;
+  guint first_row;
+  gboolean rows_valid;
+
+  gint stamp;
+};
+
+static void empathy_debug_message_store_tree_model_iface_init (
+    GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (EmpathyDebugMessageStore,
+    empathy_debug_message_store, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+        empathy_debug_message_store_tree_model_iface_init))
+
+#define N_ROWS(self) ((self)->priv->rows->len - (self)->priv->first_row)
+#define ROW(self, n) (&g_array_index ((self)->priv->rows, Row, \
+      (self)->priv->first_row + (n)))
+
+static RingEntry *
+store_row_entry (EmpathyDebugMessageStore *self,
+    Row *row)
+{
+  EmpathyDebugRingBuffer *buffer = g_ptr_array_index (self->priv->buffers,
+      row->buffer);
+
+  g_assert (row->position >= buffer->n_dropped);
+
+  return ring_buffer_entry (buffer, row->position - buffer->n_dropped);
+}
+
+/* Merge the buffers in arrival order, skipping filtered out messages */
+static void
+store_ensure_rows (EmpathyDebugMessageStore *self)
+{
+  guint n_buffers = self->priv->buffers->len;
+  guint *cursors;
+
+  if (self->priv->rows_valid)
+    return;
+
+  cursors = g_new0 (guint, n_buffers);
+
+  while (TRUE)
+    {
+      EmpathyDebugRingBuffer *buffer;
+      RingEntry *oldest = NULL;
+      guint i, oldest_buffer = 0;
+      Row row;
+
+      for (i = 0; i < n_buffers; i++)
+        {
+          RingEntry *entry;
+
+          buffer = g_ptr_array_index (self->priv->buffers, i);
+          if (cursors[i] >= buffer->length)
+            continue;
+
+          entry = ring_buffer_entry (buffer, cursors[i]);
+          if (oldest == NULL || entry->serial < oldest->serial)
+            {
+              oldest = entry;
+              oldest_buffer = i;
+            }
+        }
+
+      if (oldest == NULL)
+        break;
+
+      buffer = g_ptr_array_index (self->priv->buffers, oldest_buffer);
+
+      if (oldest->level <= self->priv->max_level)
+        {
+          row.buffer = oldest_buffer;
+          row.position = buffer->n_dropped + cursors[oldest_buffer];
+          row.serial = oldest->serial;
+          g_array_append_val (self->priv->rows, row);
+        }
+
+      cursors[oldest_buffer]++;
+    }
+
+  g_free (cursors);
+
+  self->priv->rows_valid = TRUE;
+}
+
+static void
+store_delete_row (EmpathyDebugMessageStore *self,
+    guint n)
+{
+  GtkTreePath *path;
+
+  /* Shift the rows before the deleted one, those are usually fewer as old
+   * messages are the ones being dropped */
+  if (n > 0)
+    memmove (ROW (self, 1), ROW (self, 0), n * sizeof (Row));
+
+  self->priv->first_row++;
+
+  if (self->priv->first_row > self->priv->rows->len / 2)
+    {
+      g_array_remove_range (self->priv->rows, 0, self->priv->first_row);
+      self->priv->first_row = 0;
+    }
+
+  self->priv->stamp++;
+
+  path = gtk_tree_path_new_from_indices (n, -1);
+  gtk_tree_model_row_deleted (GTK_TREE_MODEL (self), path);
+  gtk_tree_path_free (path);
+}
+
+static void
+store_message_dropped (EmpathyDebugMessageStore *self,
+    guint64 serial)
+{
+  guint low = 0, high = N_ROWS (self);
+
+  /* Rows are in arrival order; the dropped message may have been filtered
+   * out, in which case there is nothing to delete */
+  while (low < high)
+    {
+      guint mid = low + (high - low) / 2;
+      Row *row = ROW (self, mid);
+
+      if (row->serial == serial)
+        {
+          store_delete_row (self, mid);
+          return;
+        }
+
+      if (row->serial < serial)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+}
+
+/**
+ * empathy_debug_message_store_append:
+ * @self: (allow-none): the store currently displayed, if any
+ * @buffer: the buffer @msg belongs to
+ * @msg: a new message
+ *
+ * Append @msg to @buffer and update @self if it shows @buffer.
+ */
+void
+empathy_debug_message_store_append (EmpathyDebugMessageStore *self,
+    EmpathyDebugRingBuffer *buffer,
+    TpDebugMessage *msg)
+{
+  gboolean dropped;
+  guint64 dropped_serial = 0;
+  RingEntry *entry;
+  GtkTreePath *path;
+  GtkTreeIter iter;
+  Row row;
+  guint i;
+
+  dropped = ring_buffer_push (buffer, msg, &dropped_serial);
+
+  if (self == NULL || !self->priv->rows_valid)
+    return;
+
+  for (i = 0; i < self->priv->buffers->len; i++)
+    {
+      if (g_ptr_array_index (self->priv->buffers, i) == buffer)
+        break;
+    }
+
+  if (i == self->priv->buffers->len)
+    return;
+
+  if (dropped)
+    store_message_dropped (self, dropped_serial);
+
+  entry = ring_buffer_entry (buffer, buffer->length - 1);
+  if (entry->level > self->priv->max_level)
+    return;
+
+  row.buffer = i;
+  row.position = buffer->n_dropped + buffer->length - 1;
+  row.serial = entry->serial;
+  g_array_append_val (self->priv->rows, row);
+
+  self->priv->stamp++;
+
+  iter.stamp = self->priv->stamp;
+  iter.user_data = GUINT_TO_POINTER (N_ROWS (self) - 1);
+
+  path = gtk_tree_path_new_from_indices (N_ROWS (self) - 1, -1);
+  gtk_tree_model_row_inserted (GTK_TREE_MODEL (self), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+/**
+ * empathy_debug_message_store_clear:
+ * @self: an #EmpathyDebugMessageStore
+ *
+ * Drop all the messages of the buffers shown by @self.
+ */
+void
+empathy_debug_message_store_clear (EmpathyDebugMessageStore *self)
+{
+  guint i;
+
+  if (self->priv->rows_valid)
+    {
+      while (N_ROWS (self) > 0)
+        {
+          GtkTreePath *path;
+
+          g_array_set_size (self->priv->rows, self->priv->rows->len - 1);
+          self->priv->stamp++;
+
+          path = gtk_tree_path_new_from_indices (N_ROWS (self), -1);
+          gtk_tree_model_row_deleted (GTK_TREE_MODEL (self), path);
+          gtk_tree_path_free (path);
+        }
+
+      self->priv->first_row = 0;
+    }
+
+  for (i = 0; i < self->priv->buffers->len; i++)
+    empathy_debug_ring_buffer_clear (g_ptr_array_index (self->priv->buffers,
+          i));
+}
+
+TpDebugMessage *
+empathy_debug_message_store_get_message (EmpathyDebugMessageStore *self,
+    GtkTreeIter *iter)
+{
+  guint n = GPOINTER_TO_UINT (iter->user_data);
+
+  g_return_val_if_fail (iter->stamp == self->priv->stamp, NULL);
+  g_return_val_if_fail (n < N_ROWS (self), NULL);
+
+  return store_row_entry (self, ROW (self, n))->msg;
+}
+
+/**
+ * empathy_debug_message_store_dup_messages:
+ * @self: an #EmpathyDebugMessageStore
+ *
+ * Returns: (transfer full) (element-type TelepathyGLib.DebugMessage): the
+ *  messages currently shown by @self, which won't change if the buffers do
+ */
+GPtrArray *
+empathy_debug_message_store_dup_messages (EmpathyDebugMessageStore *self)
+{
+  GPtrArray *messages;
+  guint i;
+
+  store_ensure_rows (self);
+
+  messages = g_ptr_array_new_full (N_ROWS (self), g_object_unref);
+
+  for (i = 0; i < N_ROWS (self); i++)
+    g_ptr_array_add (messages,
+        g_object_ref (store_row_entry (self, ROW (self, i))->msg));
+
+  return messages;
+}
+
+/**
+ * empathy_debug_message_store_iter_matches:
+ * @self: an #EmpathyDebugMessageStore
+ * @iter: a valid #GtkTreeIter for @self
+ * @key: the text to look for
+ *
+ * Returns: %TRUE if the message at @iter contains @key, ignoring the case
+ * of ASCII characters. Nothing is copied.
+ */
+gboolean
+empathy_debug_message_store_iter_matches (EmpathyDebugMessageStore *self,
+    GtkTreeIter *iter,
+    const gchar *key)
+{
+  TpDebugMessage *msg;
+  const gchar *str;
+  gsize key_len, len, i;
+
+  msg = empathy_debug_message_store_get_message (self, iter);
+  if (msg == NULL)
+    return FALSE;
+
+  str = tp_debug_message_get_message (msg);
+  if (str == NULL)
+    return FALSE;
+
+  key_len = strlen (key);
+  len = strlen (str);
+
+  for (i = 0; i + key_len <= len; i++)
+    {
+      if (!g_ascii_strncasecmp (key, str + i, key_len))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* GtkTreeModel implementation */
+
+static GtkTreeModelFlags
+store_get_flags (GtkTreeModel *model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+store_get_n_columns (GtkTreeModel *model)
+{
+  return 1;
+}
+
+static GType
+store_get_column_type (GtkTreeModel *model,
+    gint column)
+{
+  g_return_val_if_fail (column == 0, G_TYPE_INVALID);
+
+  return TP_TYPE_DEBUG_MESSAGE;
+}
+
+static gboolean
+store_iter_nth_child (GtkTreeModel *model,
+    GtkTreeIter *iter,
+    GtkTreeIter *parent,
+    gint n)
+{
+  EmpathyDebugMessageStore *self = EMPATHY_DEBUG_MESSAGE_STORE (model);
+
+  store_ensure_rows (self);
+
+  if (parent != NULL || n < 0 || (guint) n >= N_ROWS (self))
+    return FALSE;
+
+  iter->stamp = self->priv->stamp;
+  iter->user_data = GUINT_TO_POINTER (n);
+
+  return TRUE;
+}
+
+static gboolean
+store_get_iter (GtkTreeModel *model,
+    GtkTreeIter *iter,
+    GtkTreePath *path)
+{
+  if (gtk_tree_path_get_depth (path) != 1)
+    return FALSE;
+
+  return store_iter_nth_child (model, iter, NULL,
+      gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+store_get_path (GtkTreeModel *model,
+    GtkTreeIter *iter)
+{
+  EmpathyDebugMessageStore *self = EMPATHY_DEBUG_MESSAGE_STORE (model);
+
+  g_return_val_if_fail (iter->stamp == self->priv->stamp, NULL);
+
+  return gtk_tree_path_new_from_indices (GPOINTER_TO_INT (iter->user_data),
+      -1);
+}
+
+static void
+store_get_value (GtkTreeModel *model,
+    GtkTreeIter *iter,
+    gint column,
+    GValue *value)
+{
+  EmpathyDebugMessageStore *self = EMPATHY_DEBUG_MESSAGE_STORE (model);
+
+  g_value_init (value, TP_TYPE_DEBUG_MESSAGE);
+  g_value_set_object (value,
+      empathy_debug_message_store_get_message (self, iter));
+}
+
+static gboolean
+store_iter_next (GtkTreeModel *model,
+    GtkTreeIter *iter)
+{
+  EmpathyDebugMessageStore *self = EMPATHY_DEBUG_MESSAGE_STORE (model);
+  guint n = GPOINTER_TO_UINT (iter->user_data) + 1;
+
+  g_return_val_if_fail (iter->stamp == self->priv->stamp, FALSE);
+
+  if (n >= N_ROWS (self))
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter->user_data = GUINT_TO_POINTER (n);
+  return TRUE;
+}
+
+static gboolean
+store_iter_children (GtkTreeModel *model,
+    GtkTreeIter *iter,
+    GtkTreeIter *parent)
+{
+  return store_iter_nth_child (model, iter, parent, 0);
+}
+
+static gboolean
+store_iter_has_child (GtkTreeModel *model,
+    GtkTreeIter *iter)
+{
+  return FALSE;
+}
+
+static gint
+store_iter_n_children (GtkTreeModel *model,
+    GtkTreeIter *iter)
+{
+  EmpathyDebugMessageStore *self = EMPATHY_DEBUG_MESSAGE_STORE (model);
+
+  if (iter != NULL)
+    return 0;
+
+  store_ensure_rows (self);
+
+  return N_ROWS (self);
+}
+
+static gboolean
+store_iter_parent (GtkTreeModel *model,
+    GtkTreeIter *iter,
+    GtkTreeIter *child)
+{
+  return FALSE;
+}
+
+static void
+empathy_debug_message_store_tree_model_iface_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = store_get_flags;
+  iface->get_n_columns = store_get_n_columns;
+  iface->get_column_type = store_get_column_type;
+  iface->get_iter = store_get_iter;
+  iface->get_path = store_get_path;
+  iface->get_value = store_get_value;
+  iface->iter_next = store_iter_next;
+  iface->iter_children = store_iter_children;
+  iface->iter_has_child = store_iter_has_child;
+  iface->iter_n_children = store_iter_n_children;
+  iface->iter_nth_child = store_iter_nth_child;
+  iface->iter_parent = store_iter_parent;
+}
+
+static void
+debug_message_store_finalize (GObject *object)
+{
+  EmpathyDebugMessageStore *self = EMPATHY_DEBUG_MESSAGE_STORE (object);
+
+  g_ptr_array_unref (self->priv->buffers);
+  g_array_unref (self->priv->rows);
+
+  G_OBJECT_CLASS (empathy_debug_message_store_parent_class)->finalize (object);
+}
+
+static void
+empathy_debug_message_store_class_init (EmpathyDebugMessageStoreClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = debug_message_store_finalize;
+
+  g_type_class_add_private (klass, sizeof (EmpathyDebugMessageStorePriv));
+}
+
+static void
+empathy_debug_message_store_init (EmpathyDebugMessageStore *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EMPATHY_TYPE_DEBUG_MESSAGE_STORE, EmpathyDebugMessageStorePriv);
+
+  self->priv->buffers = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) empathy_debug_ring_buffer_unref);
+  self->priv->rows = g_array_new (FALSE, FALSE, sizeof (Row));
+  self->priv->stamp = g_random_int ();
+}
+
+/**
+ * empathy_debug_message_store_new:
+ * @buffers: (element-type EmpathyDebugRingBuffer): the buffers to show
+ * @max_level: the least severe #GLogLevelFlags to show
+ *
+ * The rows are only computed when the store is first queried, so creating a
+ * store for a view which is not displayed costs nothing.
+ *
+ * Returns: a new #EmpathyDebugMessageStore
+ */
+EmpathyDebugMessageStore *
+empathy_debug_message_store_new (GPtrArray *buffers,
+    GLogLevelFlags max_level)
+{
+  EmpathyDebugMessageStore *self;
+  guint i;
+
+  self = g_object_new (EMPATHY_TYPE_DEBUG_MESSAGE_STORE, NULL);
+
+  for (i = 0; i < buffers->len; i++)
+    g_ptr_array_add (self->priv->buffers,
+        empathy_debug_ring_buffer_ref (g_ptr_array_index (buffers, i)));
+
+  self->priv->max_level = max_level;
+
+  return self;
+}
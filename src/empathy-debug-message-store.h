@@ -0,0 +1,103 @@
+/*
+*  Copyright (C) 2014 Collabora Ltd.
+*
+*  This library is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU Lesser General Public
+*  License as published by the Free Software Foundation; either
+*  version 2.1 of the License, or (at your option) any later version.
+*
+*  This library is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*  Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public
+*  License along with this library; if not, write to the Free Software
+*  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __EMPATHY_DEBUG_MESSAGE_STORE_H__
+#define __EMPATHY_DEBUG_MESSAGE_STORE_H__
+
+#include <gtk/gtk.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+/* EmpathyDebugRingBuffer: bounded, ref-counted storage of the debug messages
+ * of one service. Once full, appending drops the oldest message. */
+typedef struct _EmpathyDebugRingBuffer EmpathyDebugRingBuffer;
+
+#define EMPATHY_TYPE_DEBUG_RING_BUFFER (empathy_debug_ring_buffer_get_type ())
+GType empathy_debug_ring_buffer_get_type (void) G_GNUC_CONST;
+
+EmpathyDebugRingBuffer * empathy_debug_ring_buffer_new (guint capacity);
+EmpathyDebugRingBuffer * empathy_debug_ring_buffer_ref (
+    EmpathyDebugRingBuffer *buffer);
+void empathy_debug_ring_buffer_unref (EmpathyDebugRingBuffer *buffer);
+
+guint empathy_debug_ring_buffer_get_length (EmpathyDebugRingBuffer *buffer);
+TpDebugMessage * empathy_debug_ring_buffer_get_message (
+    EmpathyDebugRingBuffer *buffer,
+    guint n);
+void empathy_debug_ring_buffer_append (EmpathyDebugRingBuffer *buffer,
+    TpDebugMessage *msg);
+void empathy_debug_ring_buffer_clear (EmpathyDebugRingBuffer *buffer);
+
+/* EmpathyDebugMessageStore: a GtkTreeModel showing the messages of one or
+ * more ring buffers, merged in arrival order and filtered by level. It has a
+ * single column of type TP_TYPE_DEBUG_MESSAGE. */
+#define EMPATHY_TYPE_DEBUG_MESSAGE_STORE (empathy_debug_message_store_get_type ())
+#define EMPATHY_DEBUG_MESSAGE_STORE(o) (G_TYPE_CHECK_INSTANCE_CAST ((o), \
+    EMPATHY_TYPE_DEBUG_MESSAGE_STORE, EmpathyDebugMessageStore))
+#define EMPATHY_DEBUG_MESSAGE_STORE_CLASS(k) (G_TYPE_CHECK_CLASS_CAST ((k), \
+    EMPATHY_TYPE_DEBUG_MESSAGE_STORE, EmpathyDebugMessageStoreClass))
+#define EMPATHY_IS_DEBUG_MESSAGE_STORE(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), \
+    EMPATHY_TYPE_DEBUG_MESSAGE_STORE))
+#define EMPATHY_IS_DEBUG_MESSAGE_STORE_CLASS(k) (G_TYPE_CHECK_CLASS_TYPE ((k), \
+    EMPATHY_TYPE_DEBUG_MESSAGE_STORE))
+#define EMPATHY_DEBUG_MESSAGE_STORE_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), \
+    EMPATHY_TYPE_DEBUG_MESSAGE_STORE, EmpathyDebugMessageStoreClass))
+
+typedef struct _EmpathyDebugMessageStore EmpathyDebugMessageStore;
+typedef struct _EmpathyDebugMessageStoreClass EmpathyDebugMessageStoreClass;
+typedef struct _EmpathyDebugMessageStorePriv EmpathyDebugMessageStorePriv;
+
+struct _EmpathyDebugMessageStore
+{
+  GObject parent;
+  EmpathyDebugMessageStorePriv *priv;
+};
+
+struct _EmpathyDebugMessageStoreClass
+{
+  GObjectClass parent_class;
+};
+
+GType empathy_debug_message_store_get_type (void) G_GNUC_CONST;
+
+EmpathyDebugMessageStore * empathy_debug_message_store_new (
+    GPtrArray *buffers,
+    GLogLevelFlags max_level);
+
+void empathy_debug_message_store_append (EmpathyDebugMessageStore *self,
+    EmpathyDebugRingBuffer *buffer,
+    TpDebugMessage *msg);
+
+void empathy_debug_message_store_clear (EmpathyDebugMessageStore *self);
+
+TpDebugMessage * empathy_debug_message_store_get_message (
+    EmpathyDebugMessageStore *self,
+    GtkTreeIter *iter);
+
+GPtrArray * empathy_debug_message_store_dup_messages (
+    EmpathyDebugMessageStore *self);
+
+gboolean empathy_debug_message_store_iter_matches (
+    EmpathyDebugMessageStore *self,
+    GtkTreeIter *iter,
+    const gchar *key);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_DEBUG_MESSAGE_STORE_H__ */
@@ -27,6 +27,8 @@
 #include <tp-account-widgets/tpaw-utils.h>
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
+#include "empathy-debug-exporter.h"
+#include "empathy-debug-message-store.h"
 #include "empathy-geometry.h"
 #include "empathy-ui-utils.h"
 #include "empathy-utils.h"
@@ -37,6 +39,13 @@
 G_DEFINE_TYPE (EmpathyDebugWindow, empathy_debug_window,
     GTK_TYPE_WINDOW)
 
+/* Number of messages kept per service, can be overridden with
+ * EMPATHY_DEBUG_BUFFER_SIZE */
+#define DEFAULT_BUFFER_CAPACITY 10000
+
+/* Larger logs are bundled in a local file instead */
+#define PASTEBIN_MAX_SIZE (512 * 1024)
+
 typedef enum
 {
   SERVICE_TYPE_CM = 0,
@@ -75,6 +84,7 @@ struct _EmpathyDebugWindowPriv
   GtkWidget *chooser;
   GtkToolItem *save_button;
   GtkToolItem *send_to_pastebin;
+  GtkToolItem *bundle_button;
   GtkToolItem *copy_button;
   GtkToolItem *clear_button;
   GtkToolItem *pause_button;
@@ -82,12 +92,19 @@ struct _EmpathyDebugWindowPriv
   GtkWidget *level_filter;
 
   /* TreeView */
-  GtkTreeModel *store_filter;
+  EmpathyDebugMessageStore *store;
+  /* owned EmpathyDebugRingBuffer displayed in the view */
+  GPtrArray *shown_buffers;
   GtkWidget *view;
   GtkWidget *scrolled_win;
   GtkWidget *not_supported_label;
   gboolean view_visible;
 
+  /* Exports */
+  GtkWidget *export_progress;
+  GCancellable *export_cancellable;
+  guint n_exports;
+
   /* Connection */
   TpDBusDaemon *dbus;
   TpProxySignalConnection *name_owner_changed_signal;
@@ -108,38 +125,10 @@ struct _EmpathyDebugWindowPriv
   /* Misc. */
   gboolean dispose_run;
   TpAccountManager *am;
-  GtkListStore *all_active_buffer;
+  /* owned EmpathyDebugRingBuffer of all the services, for "All" */
+  GPtrArray *all_buffers;
 };
 
-static const gchar *
-log_level_to_string (GLogLevelFlags level)
-{
-  switch (level)
-    {
-    case G_LOG_LEVEL_ERROR:
-      return "Error";
-      break;
-    case G_LOG_LEVEL_CRITICAL:
-      return "Critical";
-      break;
-    case G_LOG_LEVEL_WARNING:
-      return "Warning";
-      break;
-    case G_LOG_LEVEL_MESSAGE:
-      return "Message";
-      break;
-    case G_LOG_LEVEL_INFO:
-      return "Info";
-      break;
-    case G_LOG_LEVEL_DEBUG:
-      return "Debug";
-      break;
-    default:
-      g_assert_not_reached ();
-      break;
-    }
-}
-
 static gchar *
 get_active_service_name (EmpathyDebugWindow *self)
 {
@@ -156,59 +145,26 @@ get_active_service_name (EmpathyDebugWindow *self)
   return name;
 }
 
-static gboolean
-copy_buffered_messages (GtkTreeModel *buffer,
-    GtkTreePath *path,
-    GtkTreeIter *iter,
-    gpointer data)
-{
-  GtkListStore *active_buffer = data;
-  GtkTreeIter active_buffer_iter;
-  TpDebugMessage *msg;
-
-  gtk_tree_model_get (buffer, iter,
-      COL_DEBUG_MESSAGE, &msg,
-      -1);
-  gtk_list_store_insert_with_values (active_buffer, &active_buffer_iter, -1,
-      COL_DEBUG_MESSAGE, msg,
-      -1);
-
-  g_object_unref (msg);
-
-  return FALSE;
-}
-
-static void
-insert_values_in_buffer (GtkListStore *store,
-    TpDebugMessage *msg)
-{
-  GtkTreeIter iter;
-
-  gtk_list_store_insert_with_values (store, &iter, -1,
-      COL_DEBUG_MESSAGE, msg,
-      -1);
-}
-
 static void
 debug_window_add_message (EmpathyDebugWindow *self,
     TpDebugClient *debug,
     TpDebugMessage *msg)
 {
-  GtkListStore *active_buffer, *pause_buffer;
+  EmpathyDebugRingBuffer *active_buffer, *pause_buffer;
 
   pause_buffer = g_object_get_data (G_OBJECT (debug), "pause-buffer");
   active_buffer = g_object_get_data (G_OBJECT (debug), "active-buffer");
 
   if (self->priv->paused)
     {
-      insert_values_in_buffer (pause_buffer, msg);
+      empathy_debug_ring_buffer_append (pause_buffer, msg);
     }
   else
     {
-      /* Append 'this' message to this service's and All's active-buffers */
-      insert_values_in_buffer (active_buffer, msg);
-
-      insert_values_in_buffer (self->priv->all_active_buffer, msg);
+      /* The store only adds a row if it is showing this service, which
+       * includes "All" */
+      empathy_debug_message_store_append (self->priv->store, active_buffer,
+          msg);
     }
 }
 
@@ -258,6 +214,8 @@ debug_window_set_toolbar_sensitivity (EmpathyDebugWindow *self,
   gtk_widget_set_sensitive (GTK_WIDGET (self->priv->save_button), sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (self->priv->send_to_pastebin),
       sensitive);
+  gtk_widget_set_sensitive (GTK_WIDGET (self->priv->bundle_button),
+      sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (self->priv->copy_button), sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (self->priv->clear_button), sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (self->priv->pause_button), sensitive);
@@ -285,7 +243,7 @@ debug_window_set_toolbar_sensitivity (EmpathyDebugWindow *self,
 }
 
 static gboolean
-debug_window_get_iter_for_active_buffer (GtkListStore *active_buffer,
+debug_window_get_iter_for_active_buffer (EmpathyDebugRingBuffer *active_buffer,
     GtkTreeIter *iter,
     EmpathyDebugWindow *self)
 {
@@ -297,17 +255,18 @@ debug_window_get_iter_for_active_buffer (GtkListStore *active_buffer,
        valid_iter;
        valid_iter = gtk_tree_model_iter_next (model, iter))
     {
-      GtkListStore *stored_active_buffer;
+      EmpathyDebugRingBuffer *stored_active_buffer;
 
       gtk_tree_model_get (model, iter,
           COL_ACTIVE_BUFFER, &stored_active_buffer,
           -1);
       if (active_buffer == stored_active_buffer)
         {
-          g_object_unref (stored_active_buffer);
+          empathy_debug_ring_buffer_unref (stored_active_buffer);
           return valid_iter;
         }
-      g_object_unref (stored_active_buffer);
+      tp_clear_pointer (&stored_active_buffer,
+          empathy_debug_ring_buffer_unref);
     }
 
   return valid_iter;
@@ -366,7 +325,7 @@ debug_window_get_messages_cb (GObject *object,
   EmpathyDebugWindow *self = user_data;
   gchar *active_service_name;
   guint i;
-  GtkListStore *active_buffer;
+  EmpathyDebugRingBuffer *active_buffer;
   gboolean valid_iter;
   GtkTreeIter iter;
   gchar *proxy_service_name;
@@ -430,11 +389,6 @@ debug_window_get_messages_cb (GObject *object,
   tp_g_signal_connect_object (debug, "new-debug-message",
       G_CALLBACK (debug_window_new_debug_message_cb), self, 0);
 
-  /* Now that active-buffer is up to date, we can see which messages are
-   * to be visible */
-  gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (
-        self->priv->store_filter));
-
   /* Set the proxy to signal for new debug messages */
   debug_window_set_enabled (debug, TRUE);
 }
@@ -446,7 +400,7 @@ create_proxy_to_get_messages (EmpathyDebugWindow *self,
 {
   gchar *bus_name, *name = NULL;
   TpDebugClient *new_proxy, *stored_proxy = NULL;
-  GtkTreeModel *pause_buffer, *active_buffer;
+  EmpathyDebugRingBuffer *pause_buffer, *active_buffer;
   gboolean gone;
   GError *error = NULL;
 
@@ -486,8 +440,12 @@ create_proxy_to_get_messages (EmpathyDebugWindow *self,
 
   g_free (bus_name);
 
-  g_object_set_data (G_OBJECT (new_proxy), "active-buffer", active_buffer);
-  g_object_set_data (G_OBJECT (new_proxy), "pause-buffer", pause_buffer);
+  g_object_set_data_full (G_OBJECT (new_proxy), "active-buffer",
+      empathy_debug_ring_buffer_ref (active_buffer),
+      (GDestroyNotify) empathy_debug_ring_buffer_unref);
+  g_object_set_data_full (G_OBJECT (new_proxy), "pause-buffer",
+      empathy_debug_ring_buffer_ref (pause_buffer),
+      (GDestroyNotify) empathy_debug_ring_buffer_unref);
 
   /* Now we call GetMessages with fresh proxy.
    * The old proxy is NULL due to one of the following -
@@ -503,42 +461,29 @@ create_proxy_to_get_messages (EmpathyDebugWindow *self,
 finally:
   g_free (name);
   tp_clear_object (&stored_proxy);
-  g_object_unref (active_buffer);
-  g_object_unref (pause_buffer);
+  empathy_debug_ring_buffer_unref (active_buffer);
+  empathy_debug_ring_buffer_unref (pause_buffer);
 }
 
-static GtkListStore *
-new_list_store_for_service (void)
+static EmpathyDebugRingBuffer *
+new_buffer_for_service (void)
 {
-  return gtk_list_store_new (NUM_DEBUG_COLS,
-             TP_TYPE_DEBUG_MESSAGE); /* COL_DEBUG_MESSAGE */
-}
+  static guint capacity = 0;
 
-static gboolean
-debug_window_visible_func (GtkTreeModel *model,
-    GtkTreeIter *iter,
-    gpointer user_data)
-{
-  EmpathyDebugWindow *self = user_data;
-  GLogLevelFlags filter_value;
-  GtkTreeModel *filter_model;
-  GtkTreeIter filter_iter;
-  TpDebugMessage *msg;
-  gboolean result;
+  if (capacity == 0)
+    {
+      const gchar *env = g_getenv ("EMPATHY_DEBUG_BUFFER_SIZE");
 
-  filter_model = gtk_combo_box_get_model (
-      GTK_COMBO_BOX (self->priv->level_filter));
-  gtk_combo_box_get_active_iter (GTK_COMBO_BOX (self->priv->level_filter),
-      &filter_iter);
+      if (env != NULL)
+        capacity = (guint) g_ascii_strtoull (env, NULL, 10);
 
-  gtk_tree_model_get (model, iter, COL_DEBUG_MESSAGE, &msg, -1);
-  gtk_tree_model_get (filter_model, &filter_iter,
-      COL_LEVEL_VALUE, &filter_value, -1);
+      if (capacity == 0)
+        capacity = DEFAULT_BUFFER_CAPACITY;
 
-  result = (tp_debug_message_get_level (msg) <= filter_value);
-  g_object_unref (msg);
+      DEBUG ("Keeping up to %u messages per service", capacity);
+    }
 
-  return result;
+  return empathy_debug_ring_buffer_new (capacity);
 }
 
 static gboolean
@@ -548,45 +493,42 @@ tree_view_search_equal_func_cb (GtkTreeModel *model,
     GtkTreeIter *iter,
     gpointer search_data)
 {
-  gchar *str;
-  gint key_len;
-  gint len;
-  gint i;
-  gboolean ret = TRUE; /* The return value is counter-intuitive */
+  /* The return value is counter-intuitive */
+  return !empathy_debug_message_store_iter_matches (
+      EMPATHY_DEBUG_MESSAGE_STORE (model), iter, key);
+}
 
-  gtk_tree_model_get (model, iter, column, &str, -1);
+static GLogLevelFlags
+debug_window_get_max_level (EmpathyDebugWindow *self)
+{
+  GtkTreeModel *filter_model;
+  GtkTreeIter filter_iter;
+  GLogLevelFlags filter_value = G_LOG_LEVEL_DEBUG;
 
-  key_len = strlen (key);
-  len = strlen (str) - key_len;
+  filter_model = gtk_combo_box_get_model (
+      GTK_COMBO_BOX (self->priv->level_filter));
 
-  for (i = 0; i <= len; ++i)
-    {
-      if (!g_ascii_strncasecmp (key, str + i, key_len))
-        {
-          ret = FALSE;
-          break;
-        }
-    }
+  if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (self->priv->level_filter),
+        &filter_iter))
+    gtk_tree_model_get (filter_model, &filter_iter,
+        COL_LEVEL_VALUE, &filter_value, -1);
 
-  g_free (str);
-  return ret;
+  return filter_value;
 }
 
+/* Replace the view's model by a new store showing shown_buffers at the
+ * selected level. Its rows are only computed once the view asks for them. */
 static void
-update_store_filter (EmpathyDebugWindow *self,
-    GtkListStore *active_buffer)
+debug_window_update_store (EmpathyDebugWindow *self)
 {
-  debug_window_set_toolbar_sensitivity (self, FALSE);
+  tp_clear_object (&self->priv->store);
 
-  tp_clear_object (&self->priv->store_filter);
-  self->priv->store_filter = gtk_tree_model_filter_new (
-      GTK_TREE_MODEL (active_buffer), NULL);
+  if (self->priv->shown_buffers != NULL)
+    self->priv->store = empathy_debug_message_store_new (
+        self->priv->shown_buffers, debug_window_get_max_level (self));
 
-  gtk_tree_model_filter_set_visible_func (
-      GTK_TREE_MODEL_FILTER (self->priv->store_filter),
-      debug_window_visible_func, self, NULL);
   gtk_tree_view_set_model (GTK_TREE_VIEW (self->priv->view),
-      self->priv->store_filter);
+      GTK_TREE_MODEL (self->priv->store));
 
   /* Since view's model has changed, reset the search column and
    * search_equal_func */
@@ -594,19 +536,41 @@ update_store_filter (EmpathyDebugWindow *self,
       COL_DEBUG_MESSAGE);
   gtk_tree_view_set_search_equal_func (GTK_TREE_VIEW (self->priv->view),
       tree_view_search_equal_func_cb, NULL, NULL);
+}
+
+static void
+debug_window_show_buffers (EmpathyDebugWindow *self,
+    GPtrArray *buffers)
+{
+  debug_window_set_toolbar_sensitivity (self, FALSE);
+
+  g_ptr_array_ref (buffers);
+  tp_clear_pointer (&self->priv->shown_buffers, g_ptr_array_unref);
+  self->priv->shown_buffers = buffers;
+
+  debug_window_update_store (self);
 
   debug_window_set_toolbar_sensitivity (self, TRUE);
 }
 
+static GPtrArray *
+new_buffer_array (void)
+{
+  return g_ptr_array_new_with_free_func (
+      (GDestroyNotify) empathy_debug_ring_buffer_unref);
+}
+
 static void
 refresh_all_buffer (EmpathyDebugWindow *self)
 {
   gboolean valid_iter;
   GtkTreeIter iter;
   GtkTreeModel *service_store = GTK_TREE_MODEL (self->priv->service_store);
+  GPtrArray *buffers;
+  gchar *name;
 
-  /* Clear All's active-buffer */
-  gtk_list_store_clear (self->priv->all_active_buffer);
+  /* "All" merges the services' own buffers, nothing is copied */
+  buffers = new_buffer_array ();
 
   /* Skipping the first service store iter which is reserved for "All" */
   gtk_tree_model_get_iter_first (service_store, &iter);
@@ -615,7 +579,7 @@ refresh_all_buffer (EmpathyDebugWindow *self)
        valid_iter = gtk_tree_model_iter_next (service_store, &iter))
     {
       TpProxy *proxy = NULL;
-      GtkListStore *service_active_buffer;
+      EmpathyDebugRingBuffer *service_active_buffer;
       gboolean gone;
 
       gtk_tree_model_get (service_store, &iter,
@@ -624,42 +588,36 @@ refresh_all_buffer (EmpathyDebugWindow *self)
           COL_ACTIVE_BUFFER, &service_active_buffer,
           -1);
 
-      if (gone)
-        {
-          gtk_tree_model_foreach (GTK_TREE_MODEL (service_active_buffer),
-              copy_buffered_messages, self->priv->all_active_buffer);
-        }
-      else
+      /* The array takes our reference */
+      if (service_active_buffer != NULL)
+        g_ptr_array_add (buffers, service_active_buffer);
+
+      if (!gone && proxy == NULL)
         {
-          if (proxy != NULL)
-            {
-              if (service_active_buffer == NULL)
-                break;
+          GError *error = NULL;
+          TpDBusDaemon *dbus = tp_dbus_daemon_dup (&error);
 
-              /* Copy the debug messages to all_active_buffer */
-              gtk_tree_model_foreach (GTK_TREE_MODEL (service_active_buffer),
-                  copy_buffered_messages, self->priv->all_active_buffer);
-            }
-          else
+          if (error != NULL)
             {
-              GError *error = NULL;
-              TpDBusDaemon *dbus = tp_dbus_daemon_dup (&error);
-
-              if (error != NULL)
-                {
-                  DEBUG ("Failed at duping the dbus daemon: %s", error->message);
-                  g_error_free (error);
-                }
+              DEBUG ("Failed at duping the dbus daemon: %s", error->message);
+              g_error_free (error);
+            }
 
-              create_proxy_to_get_messages (self, &iter, dbus);
+          create_proxy_to_get_messages (self, &iter, dbus);
 
-              g_object_unref (dbus);
-            }
+          g_object_unref (dbus);
         }
 
-      g_object_unref (service_active_buffer);
       tp_clear_object (&proxy);
     }
+
+  tp_clear_pointer (&self->priv->all_buffers, g_ptr_array_unref);
+  self->priv->all_buffers = buffers;
+
+  name = get_active_service_name (self);
+  if (!tp_strdiff (name, "All"))
+    debug_window_show_buffers (self, self->priv->all_buffers);
+  g_free (name);
 }
 
 static void
@@ -668,7 +626,8 @@ debug_window_service_chooser_changed_cb (GtkComboBox *chooser,
 {
   TpDBusDaemon *dbus;
   GError *error = NULL;
-  GtkListStore *stored_active_buffer = NULL;
+  EmpathyDebugRingBuffer *stored_active_buffer = NULL;
+  GPtrArray *buffers;
   gchar *name = NULL;
   GtkTreeIter iter;
   gboolean gone;
@@ -696,17 +655,24 @@ debug_window_service_chooser_changed_cb (GtkComboBox *chooser,
 
   if (tp_strdiff (name, "All") && stored_active_buffer == NULL)
     {
-      DEBUG ("No list store assigned to service %s", name);
+      DEBUG ("No buffer assigned to service %s", name);
       goto finally;
     }
 
   if (!tp_strdiff (name, "All"))
     {
-      update_store_filter (self, self->priv->all_active_buffer);
+      if (self->priv->all_buffers == NULL)
+        self->priv->all_buffers = new_buffer_array ();
+
+      debug_window_show_buffers (self, self->priv->all_buffers);
       goto finally;
     }
 
-  update_store_filter (self, stored_active_buffer);
+  buffers = new_buffer_array ();
+  g_ptr_array_add (buffers,
+      empathy_debug_ring_buffer_ref (stored_active_buffer));
+  debug_window_show_buffers (self, buffers);
+  g_ptr_array_unref (buffers);
 
   dbus = tp_dbus_daemon_dup (&error);
 
@@ -721,7 +687,7 @@ debug_window_service_chooser_changed_cb (GtkComboBox *chooser,
 
 finally:
   g_free (name);
-  tp_clear_object (&stored_active_buffer);
+  tp_clear_pointer (&stored_active_buffer, empathy_debug_ring_buffer_unref);
 }
 
 typedef struct
@@ -915,7 +881,7 @@ debug_window_get_name_owner_cb (TpDBusDaemon *proxy,
   if (!debug_window_service_is_in_model (data->self, out, NULL, FALSE))
     {
       char *name;
-      GtkListStore *active_buffer, *pause_buffer;
+      EmpathyDebugRingBuffer *active_buffer, *pause_buffer;
 
       DEBUG ("Adding %s to list: %s at unique name: %s",
           service_type_to_string (data->type),
@@ -923,8 +889,8 @@ debug_window_get_name_owner_cb (TpDBusDaemon *proxy,
 
       name = service_dup_display_name (self, data->type, data->name);
 
-      active_buffer = new_list_store_for_service ();
-      pause_buffer = new_list_store_for_service ();
+      active_buffer = new_buffer_for_service ();
+      pause_buffer = new_buffer_for_service ();
 
       gtk_list_store_insert_with_values (self->priv->service_store, &iter, -1,
           COL_NAME, name,
@@ -935,8 +901,8 @@ debug_window_get_name_owner_cb (TpDBusDaemon *proxy,
           COL_PROXY, NULL,
           -1);
 
-      g_object_unref (active_buffer);
-      g_object_unref (pause_buffer);
+      empathy_debug_ring_buffer_unref (active_buffer);
+      empathy_debug_ring_buffer_unref (pause_buffer);
 
       if (self->priv->select_name != NULL &&
           !tp_strdiff (name, self->priv->select_name))
@@ -957,8 +923,6 @@ debug_window_get_name_owner_cb (TpDBusDaemon *proxy,
             COL_ACTIVE_BUFFER, NULL,
             -1);
 
-        self->priv->all_active_buffer = new_list_store_for_service ();
-
         /* Populate active buffers for all services */
         refresh_all_buffer (self);
 
@@ -1008,12 +972,12 @@ debug_window_name_owner_changed_cb (TpDBusDaemon *proxy,
            &found_at_iter, TRUE))
         {
           GtkTreeIter iter;
-          GtkListStore *active_buffer, *pause_buffer;
+          EmpathyDebugRingBuffer *active_buffer, *pause_buffer;
 
           DEBUG ("Adding new service '%s' at %s.", name, arg2);
 
-          active_buffer = new_list_store_for_service ();
-          pause_buffer = new_list_store_for_service ();
+          active_buffer = new_buffer_for_service ();
+          pause_buffer = new_buffer_for_service ();
 
           gtk_list_store_insert_with_values (self->priv->service_store,
               &iter, -1,
@@ -1025,21 +989,21 @@ debug_window_name_owner_changed_cb (TpDBusDaemon *proxy,
               COL_PROXY, NULL,
               -1);
 
-          g_object_unref (active_buffer);
-          g_object_unref (pause_buffer);
+          empathy_debug_ring_buffer_unref (active_buffer);
+          empathy_debug_ring_buffer_unref (pause_buffer);
         }
       else
         {
           /* a service with the same name is already in the service_store,
            * update it and set it as re-enabled.
            */
-          GtkListStore *active_buffer, *pause_buffer;
+          EmpathyDebugRingBuffer *active_buffer, *pause_buffer;
           TpProxy *stored_proxy;
 
           DEBUG ("Refreshing CM '%s' at '%s'.", name, arg2);
 
-          active_buffer= new_list_store_for_service ();
-          pause_buffer = new_list_store_for_service ();
+          active_buffer = new_buffer_for_service ();
+          pause_buffer = new_buffer_for_service ();
 
           gtk_tree_model_get (GTK_TREE_MODEL (self->priv->service_store),
               found_at_iter, COL_PROXY, &stored_proxy, -1);
@@ -1055,8 +1019,8 @@ debug_window_name_owner_changed_cb (TpDBusDaemon *proxy,
               COL_PROXY, NULL,
               -1);
 
-          g_object_unref (active_buffer);
-          g_object_unref (pause_buffer);
+          empathy_debug_ring_buffer_unref (active_buffer);
+          empathy_debug_ring_buffer_unref (pause_buffer);
 
           gtk_tree_iter_free (found_at_iter);
 
@@ -1191,22 +1155,24 @@ debug_window_pause_toggled_cb (GtkToggleToolButton *pause_,
            valid_iter;
            valid_iter = gtk_tree_model_iter_next (model, &iter))
         {
-          GtkListStore *pause_buffer, *active_buffer;
+          EmpathyDebugRingBuffer *pause_buffer, *active_buffer;
+          guint i;
 
           gtk_tree_model_get (service_store, &iter,
               COL_PAUSE_BUFFER, &pause_buffer,
               COL_ACTIVE_BUFFER, &active_buffer,
               -1);
 
-          gtk_tree_model_foreach (GTK_TREE_MODEL (pause_buffer),
-              copy_buffered_messages, active_buffer);
-          gtk_tree_model_foreach (GTK_TREE_MODEL (pause_buffer),
-              copy_buffered_messages, self->priv->all_active_buffer);
+          for (i = 0; i < empathy_debug_ring_buffer_get_length (pause_buffer);
+               i++)
+            empathy_debug_message_store_append (self->priv->store,
+                active_buffer,
+                empathy_debug_ring_buffer_get_message (pause_buffer, i));
 
-          gtk_list_store_clear (pause_buffer);
+          empathy_debug_ring_buffer_clear (pause_buffer);
 
-          g_object_unref (active_buffer);
-          g_object_unref (pause_buffer);
+          empathy_debug_ring_buffer_unref (active_buffer);
+          empathy_debug_ring_buffer_unref (pause_buffer);
         }
     }
 }
@@ -1215,33 +1181,17 @@ static void
 debug_window_filter_changed_cb (GtkComboBox *filter,
     EmpathyDebugWindow *self)
 {
-  gtk_tree_model_filter_refilter (
-      GTK_TREE_MODEL_FILTER (self->priv->store_filter));
+  debug_window_update_store (self);
 }
 
 static void
 debug_window_clear_clicked_cb (GtkToolButton *clear_button,
     EmpathyDebugWindow *self)
 {
-  GtkTreeIter iter;
-  GtkListStore *active_buffer;
-
-  /* "All" is the first choice in the service chooser and it's buffer is
-   * not saved in the service-store but is accessed using a self->private
-   * reference */
-  if (gtk_combo_box_get_active (GTK_COMBO_BOX (self->priv->chooser)) == 0)
-    {
-      gtk_list_store_clear (self->priv->all_active_buffer);
-      return;
-    }
-
-  gtk_combo_box_get_active_iter (GTK_COMBO_BOX (self->priv->chooser), &iter);
-  gtk_tree_model_get (GTK_TREE_MODEL (self->priv->service_store), &iter,
-      COL_ACTIVE_BUFFER, &active_buffer, -1);
-
-  gtk_list_store_clear (active_buffer);
-
-  g_object_unref (active_buffer);
+  /* "All" doesn't have a buffer of its own, so clearing it clears the
+   * buffers of all the services */
+  if (self->priv->store != NULL)
+    empathy_debug_message_store_clear (self->priv->store);
 }
 
 static void
@@ -1264,11 +1214,10 @@ debug_window_menu_copy_activate_cb (GtkMenuItem *menu_item,
       return;
     }
 
-  gtk_tree_model_get_iter (self->priv->store_filter, &iter, path);
+  gtk_tree_model_get_iter (GTK_TREE_MODEL (self->priv->store), &iter, path);
+  gtk_tree_path_free (path);
 
-  gtk_tree_model_get (self->priv->store_filter, &iter,
-      COL_DEBUG_MESSAGE, &msg,
-      -1);
+  msg = empathy_debug_message_store_get_message (self->priv->store, &iter);
 
   message = tp_debug_message_get_message (msg);
 
@@ -1283,8 +1232,6 @@ debug_window_menu_copy_activate_cb (GtkMenuItem *menu_item,
       GDK_SELECTION_CLIPBOARD);
 
   gtk_clipboard_set_text (clipboard, message, -1);
-
-  g_object_unref (msg);
 }
 
 typedef struct
@@ -1341,24 +1288,6 @@ debug_window_button_press_event_cb (GtkTreeView *view,
   return FALSE;
 }
 
-static gchar *
-debug_window_format_timestamp (TpDebugMessage *msg)
-{
-  GDateTime *t;
-  gchar *time_str, *text;
-  gint ms;
-
-  t = tp_debug_message_get_time (msg);
-
-  time_str = g_date_time_format (t, "%x %T");
-
-  ms = g_date_time_get_microsecond (t);
-  text = g_strdup_printf ("%s.%d", time_str, ms);
-
-  g_free (time_str);
-  return text;
-}
-
 static void
 debug_window_time_formatter (GtkTreeViewColumn *tree_column,
     GtkCellRenderer *cell,
@@ -1369,13 +1298,14 @@ debug_window_time_formatter (GtkTreeViewColumn *tree_column,
   TpDebugMessage *msg;
   gchar *time_str;
 
-  gtk_tree_model_get (tree_model, iter, COL_DEBUG_MESSAGE, &msg, -1);
+  msg = empathy_debug_message_store_get_message (
+      EMPATHY_DEBUG_MESSAGE_STORE (tree_model), iter);
 
-  time_str = debug_window_format_timestamp (msg);
+  time_str = empathy_debug_message_dup_time (msg);
 
   g_object_set (G_OBJECT (cell), "text", time_str, NULL);
 
-  g_object_unref (msg);
+  g_free (time_str);
 }
 
 static void
@@ -1387,12 +1317,11 @@ debug_window_domain_formatter (GtkTreeViewColumn *tree_column,
 {
   TpDebugMessage *msg;
 
-  gtk_tree_model_get (tree_model, iter, COL_DEBUG_MESSAGE, &msg, -1);
+  msg = empathy_debug_message_store_get_message (
+      EMPATHY_DEBUG_MESSAGE_STORE (tree_model), iter);
 
   g_object_set (G_OBJECT (cell), "text", tp_debug_message_get_domain (msg),
       NULL);
-
-  g_object_unref (msg);
 }
 
 static void
@@ -1405,13 +1334,12 @@ debug_window_category_formatter (GtkTreeViewColumn *tree_column,
   TpDebugMessage *msg;
   const gchar *category;
 
-  gtk_tree_model_get (tree_model, iter, COL_DEBUG_MESSAGE, &msg, -1);
+  msg = empathy_debug_message_store_get_message (
+      EMPATHY_DEBUG_MESSAGE_STORE (tree_model), iter);
 
   category = tp_debug_message_get_category (msg);
 
   g_object_set (G_OBJECT (cell), "text", category ? category : "", NULL);
-
-  g_object_unref (msg);
 }
 
 static void
@@ -1423,12 +1351,11 @@ debug_window_message_formatter (GtkTreeViewColumn *tree_column,
 {
   TpDebugMessage *msg;
 
-  gtk_tree_model_get (tree_model, iter, COL_DEBUG_MESSAGE, &msg, -1);
+  msg = empathy_debug_message_store_get_message (
+      EMPATHY_DEBUG_MESSAGE_STORE (tree_model), iter);
 
   g_object_set (G_OBJECT (cell), "text",
       tp_debug_message_get_message (msg), NULL);
-
-  g_object_unref (msg);
 }
 
 static void
@@ -1441,161 +1368,12 @@ debug_window_level_formatter (GtkTreeViewColumn *tree_column,
   TpDebugMessage *msg;
   const gchar *level;
 
-  gtk_tree_model_get (tree_model, iter, COL_DEBUG_MESSAGE, &msg, -1);
+  msg = empathy_debug_message_store_get_message (
+      EMPATHY_DEBUG_MESSAGE_STORE (tree_model), iter);
 
-  level = log_level_to_string (tp_debug_message_get_level (msg));
+  level = empathy_debug_level_to_string (tp_debug_message_get_level (msg));
 
   g_object_set (G_OBJECT (cell), "text", level, NULL);
-
-  g_object_unref (msg);
-}
-
-static gboolean
-debug_window_copy_model_foreach (GtkTreeModel *model,
-    GtkTreePath *path,
-    GtkTreeIter *iter,
-    gpointer user_data)
-{
-  gchar **text = (gchar **) user_data;
-  gchar *tmp;
-  gchar *level_upper;
-  const gchar *level_str, *category;
-  gchar *line, *time_str;
-  TpDebugMessage *msg;
-
-  if (*text == NULL)
-    *text = g_strdup ("");
-
-  gtk_tree_model_get (model, iter,
-      COL_DEBUG_MESSAGE, &msg,
-      -1);
-
-  level_str = log_level_to_string (tp_debug_message_get_level (msg));
-  level_upper = g_ascii_strup (level_str, -1);
-
-  time_str = debug_window_format_timestamp (msg);
-  category = tp_debug_message_get_category (msg);
-
-  line = g_strdup_printf ("%s%s%s-%s: %s: %s\n",
-      tp_debug_message_get_domain (msg),
-      category ? "" : "/", category ? category : "",
-      level_upper, time_str, tp_debug_message_get_message (msg));
-
-  g_free (time_str);
-
-  tmp = g_strconcat (*text, line, NULL);
-
-  g_free (*text);
-  g_free (line);
-  g_free (level_upper);
-  g_object_unref (msg);
-
-  *text = tmp;
-
-  return FALSE;
-}
-
-static void
-debug_window_save_file_chooser_response_cb (GtkDialog *dialog,
-    gint response_id,
-    EmpathyDebugWindow *self)
-{
-  gchar *filename = NULL;
-  GFile *gfile = NULL;
-  gchar *debug_data = NULL;
-  GFileOutputStream *output_stream = NULL;
-  GError *file_open_error = NULL;
-  GError *file_write_error = NULL;
-
-  if (response_id != GTK_RESPONSE_ACCEPT)
-    goto OUT;
-
-  filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
-
-  DEBUG ("Saving log as %s", filename);
-
-  gfile = g_file_new_for_path (filename);
-  output_stream = g_file_replace (gfile, NULL, FALSE,
-      G_FILE_CREATE_NONE, NULL, &file_open_error);
-
-  if (file_open_error != NULL)
-    {
-      DEBUG ("Failed to open file for writing: %s", file_open_error->message);
-      g_error_free (file_open_error);
-      goto OUT;
-    }
-
-  gtk_tree_model_foreach (self->priv->store_filter,
-      debug_window_copy_model_foreach, &debug_data);
-
-  g_output_stream_write (G_OUTPUT_STREAM (output_stream), debug_data,
-      strlen (debug_data), NULL, &file_write_error);
-  g_free (debug_data);
-
-  if (file_write_error != NULL)
-    {
-      DEBUG ("Failed to write to file: %s", file_write_error->message);
-      g_error_free (file_write_error);
-    }
-
-OUT:
-  if (gfile != NULL)
-    g_object_unref (gfile);
-
-  if (output_stream != NULL)
-    g_object_unref (output_stream);
-
-  if (filename != NULL)
-    g_free (filename);
-
-  gtk_widget_destroy (GTK_WIDGET (dialog));
-}
-
-static void
-debug_window_save_clicked_cb (GtkToolButton *tool_button,
-    EmpathyDebugWindow *self)
-{
-  GtkWidget *file_chooser;
-  gchar *name, *tmp = NULL;
-  char time_str[32];
-  time_t t;
-  struct tm *tm_s;
-
-  file_chooser = gtk_file_chooser_dialog_new (_("Save"),
-      GTK_WINDOW (self), GTK_FILE_CHOOSER_ACTION_SAVE,
-      GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
-      GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
-      NULL);
-
-  gtk_window_set_modal (GTK_WINDOW (file_chooser), TRUE);
-  gtk_file_chooser_set_do_overwrite_confirmation (
-      GTK_FILE_CHOOSER (file_chooser), TRUE);
-
-  gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (file_chooser),
-      g_get_home_dir ());
-
-  name = get_active_service_name (self);
-
-  t = time (NULL);
-  tm_s = localtime (&t);
-  if (tm_s != NULL)
-    {
-      if (strftime (time_str, sizeof (time_str), "%d-%m-%y_%H-%M-%S", tm_s))
-        tmp = g_strdup_printf ("%s-%s.log", name, time_str);
-    }
-
-  if (tmp == NULL)
-    tmp = g_strdup_printf ("%s.log", name);
-  g_free (name);
-
-  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (file_chooser), tmp);
-  g_free (tmp);
-
-  g_signal_connect (file_chooser, "response",
-      G_CALLBACK (debug_window_save_file_chooser_response_cb),
-      self);
-
-  gtk_widget_show (file_chooser);
 }
 
 static void
@@ -1711,41 +1489,391 @@ debug_window_send_to_pastebin (EmpathyDebugWindow *self,
       self);
 }
 
+typedef enum
+{
+  EXPORT_TO_FILE,
+  EXPORT_TO_BUNDLE,
+  EXPORT_TO_CLIPBOARD,
+  EXPORT_TO_PASTEBIN,
+} ExportTarget;
+
+typedef struct
+{
+  EmpathyDebugWindow *self;
+  ExportTarget target;
+  GOutputStream *stream;
+  /* owned TpDebugMessage being exported */
+  GPtrArray *messages;
+  /* file exports only */
+  gchar *filename;
+} ExportData;
+
+static void
+export_data_free (ExportData *data)
+{
+  g_object_unref (data->self);
+  g_object_unref (data->stream);
+  g_ptr_array_unref (data->messages);
+  g_free (data->filename);
+  g_slice_free (ExportData, data);
+}
+
+static void debug_window_bundle (EmpathyDebugWindow *self,
+    GPtrArray *messages);
+
 static void
-debug_window_send_to_pastebin_cb (GtkToolButton *tool_button,
+debug_window_show_save_error (EmpathyDebugWindow *self,
+    const GError *error)
+{
+  debug_window_message_dialog (self, N_("Unable to save the debug log"),
+      error->message);
+}
+
+static void
+debug_window_show_bundle (EmpathyDebugWindow *self,
+    const gchar *filename)
+{
+  GtkWidget *dialog;
+  gchar *dirname, *uri, *markup;
+
+  dirname = g_path_get_dirname (filename);
+  uri = g_filename_to_uri (dirname, NULL, NULL);
+
+  dialog = gtk_message_dialog_new (GTK_WINDOW (self),
+      GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_INFO, GTK_BUTTONS_CLOSE,
+      _("Debug log saved"));
+
+  markup = g_markup_printf_escaped (
+      _("Please attach <a href=\"%s\">%s</a> to your bug report."),
+      uri != NULL ? uri : "", filename);
+  gtk_message_dialog_format_secondary_markup (GTK_MESSAGE_DIALOG (dialog),
+      "%s", markup);
+
+  g_signal_connect (dialog, "response", G_CALLBACK (gtk_widget_destroy),
+      NULL);
+  gtk_widget_show (dialog);
+
+  g_free (markup);
+  g_free (uri);
+  g_free (dirname);
+}
+
+static void
+debug_window_export_progress_cb (guint n_exported,
+    guint n_total,
+    gpointer user_data)
+{
+  EmpathyDebugWindow *self = user_data;
+
+  gtk_progress_bar_set_fraction (
+      GTK_PROGRESS_BAR (self->priv->export_progress),
+      n_total > 0 ? (gdouble) n_exported / n_total : 1.0);
+}
+
+static void
+debug_window_export_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  ExportData *data = user_data;
+  EmpathyDebugWindow *self = data->self;
+  GMemoryOutputStream *mem;
+  GError *error = NULL;
+
+  if (!empathy_debug_export_finish (result, &error))
+    {
+      DEBUG ("Failed to export debug messages: %s", error->message);
+
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          /* The window is being destroyed */
+          goto out;
+        }
+    }
+
+  self->priv->n_exports--;
+  if (self->priv->n_exports == 0)
+    gtk_widget_hide (self->priv->export_progress);
+
+  switch (data->target)
+    {
+      case EXPORT_TO_FILE:
+      case EXPORT_TO_BUNDLE:
+        /* Keep the first error */
+        g_output_stream_close (data->stream, NULL,
+            error == NULL ? &error : NULL);
+
+        if (error != NULL)
+          debug_window_show_save_error (self, error);
+        else if (data->target == EXPORT_TO_BUNDLE)
+          debug_window_show_bundle (self, data->filename);
+        break;
+
+      case EXPORT_TO_CLIPBOARD:
+        if (error != NULL)
+          break;
+
+        mem = G_MEMORY_OUTPUT_STREAM (data->stream);
+
+        DEBUG ("Copying text to clipboard (length: %" G_GSIZE_FORMAT ")",
+            g_memory_output_stream_get_data_size (mem));
+
+        gtk_clipboard_set_text (
+            gtk_clipboard_get_for_display (
+                gtk_widget_get_display (GTK_WIDGET (self)),
+                GDK_SELECTION_CLIPBOARD),
+            g_memory_output_stream_get_data (mem),
+            g_memory_output_stream_get_data_size (mem));
+        break;
+
+      case EXPORT_TO_PASTEBIN:
+        if (error != NULL)
+          break;
+
+        mem = G_MEMORY_OUTPUT_STREAM (data->stream);
+
+        if (g_memory_output_stream_get_data_size (mem) > PASTEBIN_MAX_SIZE)
+          {
+            DEBUG ("Debug data is too large for pastebin, bundling it");
+            debug_window_bundle (self, data->messages);
+          }
+        else
+          {
+            gchar *debug_data;
+
+            debug_data = g_strndup (g_memory_output_stream_get_data (mem),
+                g_memory_output_stream_get_data_size (mem));
+            debug_window_send_to_pastebin (self, debug_data);
+            g_free (debug_data);
+          }
+        break;
+    }
+
+out:
+  g_clear_error (&error);
+  export_data_free (data);
+}
+
+/* Takes ownership of @stream */
+static void
+debug_window_export (EmpathyDebugWindow *self,
+    GPtrArray *messages,
+    GLogLevelFlags max_level,
+    GOutputStream *stream,
+    EmpathyDebugExportFlags flags,
+    ExportTarget target,
+    const gchar *filename)
+{
+  ExportData *data;
+
+  data = g_slice_new0 (ExportData);
+  data->self = g_object_ref (self);
+  data->target = target;
+  data->stream = stream;
+  data->messages = g_ptr_array_ref (messages);
+  data->filename = g_strdup (filename);
+
+  self->priv->n_exports++;
+  gtk_progress_bar_set_fraction (
+      GTK_PROGRESS_BAR (self->priv->export_progress), 0);
+  gtk_widget_show (self->priv->export_progress);
+
+  empathy_debug_export_async (messages, stream, flags, max_level,
+      self->priv->export_cancellable, debug_window_export_progress_cb,
+      self, debug_window_export_cb, data);
+}
+
+/* The rows of the view */
+static GPtrArray *
+debug_window_dup_shown_messages (EmpathyDebugWindow *self)
+{
+  if (self->priv->store == NULL)
+    return g_ptr_array_new ();
+
+  return empathy_debug_message_store_dup_messages (self->priv->store);
+}
+
+static void
+debug_window_export_to_file (EmpathyDebugWindow *self,
+    GPtrArray *messages,
+    GLogLevelFlags max_level,
+    const gchar *filename,
+    ExportTarget target)
+{
+  GFile *gfile;
+  GFileOutputStream *output_stream;
+  EmpathyDebugExportFlags flags = EMPATHY_DEBUG_EXPORT_NONE;
+  GError *error = NULL;
+
+  gfile = g_file_new_for_path (filename);
+  output_stream = g_file_replace (gfile, NULL, FALSE,
+      target == EXPORT_TO_BUNDLE ? G_FILE_CREATE_PRIVATE : G_FILE_CREATE_NONE,
+      NULL, &error);
+  g_object_unref (gfile);
+
+  if (error != NULL)
+    {
+      DEBUG ("Failed to open file for writing: %s", error->message);
+      debug_window_show_save_error (self, error);
+      g_error_free (error);
+      return;
+    }
+
+  if (g_str_has_suffix (filename, ".gz"))
+    flags |= EMPATHY_DEBUG_EXPORT_COMPRESS;
+
+  debug_window_export (self, messages, max_level,
+      G_OUTPUT_STREAM (output_stream), flags, target, filename);
+}
+
+static void
+debug_window_save_file_chooser_response_cb (GtkDialog *dialog,
+    gint response_id,
     EmpathyDebugWindow *self)
 {
-  gchar *debug_data = NULL;
+  gchar *filename;
+  GPtrArray *messages;
 
-  DEBUG ("Preparing debug data for sending to pastebin.");
+  if (response_id != GTK_RESPONSE_ACCEPT)
+    goto OUT;
 
-  gtk_tree_model_foreach (self->priv->store_filter,
-      debug_window_copy_model_foreach, &debug_data);
+  filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
 
-  debug_window_send_to_pastebin (self, debug_data);
-  g_free (debug_data);
+  DEBUG ("Saving log as %s", filename);
+
+  messages = debug_window_dup_shown_messages (self);
+  debug_window_export_to_file (self, messages,
+      debug_window_get_max_level (self), filename, EXPORT_TO_FILE);
+  g_ptr_array_unref (messages);
+
+  g_free (filename);
+
+OUT:
+  gtk_widget_destroy (GTK_WIDGET (dialog));
 }
 
 static void
-debug_window_copy_clicked_cb (GtkToolButton *tool_button,
+debug_window_save_clicked_cb (GtkToolButton *tool_button,
     EmpathyDebugWindow *self)
 {
-  GtkClipboard *clipboard;
-  gchar *text = NULL;
+  GtkWidget *file_chooser;
+  gchar *name, *tmp = NULL;
+  char time_str[32];
+  time_t t;
+  struct tm *tm_s;
 
-  gtk_tree_model_foreach (self->priv->store_filter,
-      debug_window_copy_model_foreach, &text);
+  file_chooser = gtk_file_chooser_dialog_new (_("Save"),
+      GTK_WINDOW (self), GTK_FILE_CHOOSER_ACTION_SAVE,
+      GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+      GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+      NULL);
 
-  clipboard = gtk_clipboard_get_for_display (
-      gtk_widget_get_display (GTK_WIDGET (tool_button)),
-      GDK_SELECTION_CLIPBOARD);
+  gtk_window_set_modal (GTK_WINDOW (file_chooser), TRUE);
+  gtk_file_chooser_set_do_overwrite_confirmation (
+      GTK_FILE_CHOOSER (file_chooser), TRUE);
 
-  DEBUG ("Copying text to clipboard (length: %" G_GSIZE_FORMAT ")",
-      strlen (text));
+  gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (file_chooser),
+      g_get_home_dir ());
 
-  gtk_clipboard_set_text (clipboard, text, -1);
+  name = get_active_service_name (self);
 
-  g_free (text);
+  t = time (NULL);
+  tm_s = localtime (&t);
+  if (tm_s != NULL)
+    {
+      if (strftime (time_str, sizeof (time_str), "%d-%m-%y_%H-%M-%S", tm_s))
+        tmp = g_strdup_printf ("%s-%s.log", name, time_str);
+    }
+
+  if (tmp == NULL)
+    tmp = g_strdup_printf ("%s.log", name);
+  g_free (name);
+
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (file_chooser), tmp);
+  g_free (tmp);
+
+  g_signal_connect (file_chooser, "response",
+      G_CALLBACK (debug_window_save_file_chooser_response_cb),
+      self);
+
+  gtk_widget_show (file_chooser);
+}
+
+/* Save @messages to a compressed file in the cache directory */
+static void
+debug_window_bundle (EmpathyDebugWindow *self,
+    GPtrArray *messages)
+{
+  GDateTime *now;
+  gchar *dirname, *basename, *filename;
+
+  dirname = g_build_filename (g_get_user_cache_dir (), "empathy", "debug",
+      NULL);
+  g_mkdir_with_parents (dirname, 0700);
+
+  now = g_date_time_new_now_local ();
+  basename = g_date_time_format (now,
+      "empathy-debug-%d-%m-%y_%H-%M-%S.log.gz");
+  filename = g_build_filename (dirname, basename, NULL);
+
+  DEBUG ("Bundling debug messages in %s", filename);
+
+  debug_window_export_to_file (self, messages, G_LOG_LEVEL_DEBUG, filename,
+      EXPORT_TO_BUNDLE);
+
+  g_free (filename);
+  g_free (basename);
+  g_date_time_unref (now);
+  g_free (dirname);
+}
+
+/* Bundles the messages of all the services, whatever the view shows */
+static void
+debug_window_bundle_clicked_cb (GtkToolButton *tool_button,
+    EmpathyDebugWindow *self)
+{
+  EmpathyDebugMessageStore *store;
+  GPtrArray *messages;
+
+  if (self->priv->all_buffers == NULL)
+    return;
+
+  /* A store over all the buffers merges them in arrival order */
+  store = empathy_debug_message_store_new (self->priv->all_buffers,
+      G_LOG_LEVEL_DEBUG);
+  messages = empathy_debug_message_store_dup_messages (store);
+  g_object_unref (store);
+
+  debug_window_bundle (self, messages);
+  g_ptr_array_unref (messages);
+}
+
+static void
+debug_window_send_to_pastebin_cb (GtkToolButton *tool_button,
+    EmpathyDebugWindow *self)
+{
+  GPtrArray *messages;
+
+  DEBUG ("Preparing debug data for sending to pastebin.");
+
+  messages = debug_window_dup_shown_messages (self);
+  debug_window_export (self, messages, debug_window_get_max_level (self),
+      g_memory_output_stream_new (NULL, 0, g_realloc, g_free),
+      EMPATHY_DEBUG_EXPORT_NONE, EXPORT_TO_PASTEBIN, NULL);
+  g_ptr_array_unref (messages);
+}
+
+static void
+debug_window_copy_clicked_cb (GtkToolButton *tool_button,
+    EmpathyDebugWindow *self)
+{
+  GPtrArray *messages;
+
+  messages = debug_window_dup_shown_messages (self);
+  debug_window_export (self, messages, debug_window_get_max_level (self),
+      g_memory_output_stream_new (NULL, 0, g_realloc, g_free),
+      EMPATHY_DEBUG_EXPORT_NONE, EXPORT_TO_CLIPBOARD, NULL);
+  g_ptr_array_unref (messages);
 }
 
 static gboolean
@@ -1847,8 +1975,8 @@ am_prepared_cb (GObject *am,
       G_TYPE_STRING,  /* COL_NAME */
       G_TYPE_STRING,  /* COL_UNIQUE_NAME */
       G_TYPE_BOOLEAN, /* COL_GONE */
-      G_TYPE_OBJECT,  /* COL_ACTIVE_BUFFER */
-      G_TYPE_OBJECT,  /* COL_PAUSE_BUFFER */
+      EMPATHY_TYPE_DEBUG_RING_BUFFER, /* COL_ACTIVE_BUFFER */
+      EMPATHY_TYPE_DEBUG_RING_BUFFER, /* COL_PAUSE_BUFFER */
       TP_TYPE_PROXY); /* COL_PROXY */
   gtk_combo_box_set_model (GTK_COMBO_BOX (self->priv->chooser),
       GTK_TREE_MODEL (self->priv->service_store));
@@ -1887,6 +2015,18 @@ am_prepared_cb (GObject *am,
       TRUE);
   gtk_toolbar_insert (GTK_TOOLBAR (toolbar), self->priv->send_to_pastebin, -1);
 
+  /* Bundle for bug report */
+  self->priv->bundle_button = gtk_tool_button_new_from_stock (
+      GTK_STOCK_SAVE_AS);
+  gtk_tool_button_set_label (GTK_TOOL_BUTTON (self->priv->bundle_button),
+      _("Bundle for bug report"));
+  g_signal_connect (self->priv->bundle_button, "clicked",
+      G_CALLBACK (debug_window_bundle_clicked_cb), object);
+  gtk_widget_show (GTK_WIDGET (self->priv->bundle_button));
+  gtk_tool_item_set_is_important (GTK_TOOL_ITEM (self->priv->bundle_button),
+      TRUE);
+  gtk_toolbar_insert (GTK_TOOLBAR (toolbar), self->priv->bundle_button, -1);
+
   /* Copy */
   self->priv->copy_button = gtk_tool_button_new_from_stock (GTK_STOCK_COPY);
   g_signal_connect (self->priv->copy_button, "clicked",
@@ -2047,10 +2187,9 @@ am_prepared_cb (GObject *am,
       -1, _("Message"), renderer,
       (GtkTreeCellDataFunc) debug_window_message_formatter, NULL, NULL);
 
-  self->priv->store_filter = NULL;
+  self->priv->store = NULL;
 
-  gtk_tree_view_set_model (GTK_TREE_VIEW (self->priv->view),
-      self->priv->store_filter);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (self->priv->view), NULL);
 
   /* Scrolled window */
   self->priv->scrolled_win = g_object_ref (gtk_scrolled_window_new (
@@ -2075,7 +2214,10 @@ am_prepared_cb (GObject *am,
 
   self->priv->view_visible = FALSE;
 
-  self->priv->all_active_buffer = NULL;
+  /* Export progress, only shown while exporting */
+  self->priv->export_progress = gtk_progress_bar_new ();
+  gtk_box_pack_end (GTK_BOX (vbox), self->priv->export_progress,
+      FALSE, FALSE, 0);
 
   debug_window_set_toolbar_sensitivity (EMPATHY_DEBUG_WINDOW (object), FALSE);
   debug_window_fill_service_chooser (EMPATHY_DEBUG_WINDOW (object));
@@ -2096,6 +2238,8 @@ empathy_debug_window_init (EmpathyDebugWindow *self)
 {
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
       EMPATHY_TYPE_DEBUG_WINDOW, EmpathyDebugWindowPriv);
+
+  self->priv->export_cancellable = g_cancellable_new ();
 }
 
 static void
@@ -2177,10 +2321,16 @@ debug_window_dispose (GObject *object)
   /* Disable Debug on all proxies */
   disable_all_debug_clients (self);
 
+  if (self->priv->export_cancellable != NULL)
+    g_cancellable_cancel (self->priv->export_cancellable);
+  g_clear_object (&self->priv->export_cancellable);
+
   g_clear_object (&self->priv->service_store);
   g_clear_object (&self->priv->dbus);
   g_clear_object (&self->priv->am);
-  g_clear_object (&self->priv->all_active_buffer);
+  g_clear_object (&self->priv->store);
+  tp_clear_pointer (&self->priv->shown_buffers, g_ptr_array_unref);
+  tp_clear_pointer (&self->priv->all_buffers, g_ptr_array_unref);
 
   (G_OBJECT_CLASS (empathy_debug_window_parent_class)->dispose) (object);
 }
@@ -29,10 +29,10 @@
 
 #include "empathy-call-utils.h"
 #include "empathy-connection-aggregator.h"
-#include "empathy-gsettings.h"
 #include "empathy-images.h"
 #include "empathy-presence-manager.h"
 #include "empathy-sasl-mechanisms.h"
+#include "empathy-settings-snapshot.h"
 #include "empathy-sound-manager.h"
 #include "empathy-subscription-dialog.h"
 #include "empathy-tp-chat.h"
@@ -51,6 +51,14 @@
 /* The time interval in milliseconds between 2 incoming rings */
 #define MS_BETWEEN_RING 500
 
+/* More presence changes than this on one account within
+ * PRESENCE_BURST_WINDOW are a burst, typically a reconnection. The burst
+ * ends after PRESENCE_BURST_QUIET seconds without presence changes and is
+ * then summed up in a single event. */
+#define PRESENCE_BURST_THRESHOLD 5
+#define PRESENCE_BURST_WINDOW (2 * G_USEC_PER_SEC)
+#define PRESENCE_BURST_QUIET 2 /* seconds */
+
 typedef struct {
   EmpathyEventManager *manager;
   TpChannelDispatchOperation *operation;
@@ -67,6 +75,19 @@ typedef struct {
   gboolean auto_approved;
 } EventManagerApproval;
 
+typedef struct {
+  EmpathyEventManager *manager;
+  TpAccount *account;
+  /* Start of the current rate window and number of changes in it */
+  gint64 window_start;
+  guint n_in_window;
+  /* Set while a burst is being aggregated */
+  guint summary_id;
+  gint64 last_change;
+  guint n_online;
+  guint n_offline;
+} PresenceBurst;
+
 typedef struct {
   TpBaseClient *approver;
   TpBaseClient *auth_approver;
@@ -77,13 +98,18 @@ typedef struct {
 
   gint ringing;
 
-  GSettings *gsettings_notif;
-  GSettings *gsettings_ui;
+  EmpathySettingsSnapshot *settings;
 
   EmpathySoundManager *sound_mgr;
+  EmpathyPresenceManager *presence_mgr;
 
   /* TpContact -> EmpathyContact */
   GHashTable *contacts;
+
+  /* owned TpAccount -> owned PresenceBurst */
+  GHashTable *presence_bursts;
+  guint n_presence_suppressed;
+  guint n_presence_summaries;
 } EmpathyEventManagerPriv;
 
 typedef struct _EventPriv EventPriv;
@@ -201,8 +227,8 @@ display_notify_area (EmpathyEventManager *self)
 {
   EmpathyEventManagerPriv *priv = GET_PRIV (self);
 
-  return g_settings_get_boolean (priv->gsettings_ui,
-      EMPATHY_PREFS_UI_EVENTS_NOTIFY_AREA);
+  return EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings,
+      ui_events_notify_area);
 }
 
 static void
@@ -1105,6 +1131,134 @@ event_manager_publish_state_changed_cb (TpContact *contact,
   check_publish_state (self, contact);
 }
 
+static void
+presence_burst_free (PresenceBurst *burst)
+{
+  if (burst->summary_id != 0)
+    g_source_remove (burst->summary_id);
+
+  g_object_unref (burst->account);
+  g_slice_free (PresenceBurst, burst);
+}
+
+static void
+presence_burst_summarize (PresenceBurst *burst)
+{
+  EmpathyEventManagerPriv *priv = GET_PRIV (burst->manager);
+  GPtrArray *parts;
+  gchar *message;
+
+  parts = g_ptr_array_new_with_free_func (g_free);
+
+  if (burst->n_online > 0 &&
+      EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings,
+        notifications_contact_signin))
+    g_ptr_array_add (parts, g_strdup_printf (
+          ngettext ("%u contact connected", "%u contacts connected",
+            burst->n_online), burst->n_online));
+
+  if (burst->n_offline > 0 &&
+      EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings,
+        notifications_contact_signout))
+    g_ptr_array_add (parts, g_strdup_printf (
+          ngettext ("%u contact disconnected", "%u contacts disconnected",
+            burst->n_offline), burst->n_offline));
+
+  if (parts->len > 0)
+    {
+      g_ptr_array_add (parts, NULL);
+      message = g_strjoinv (", ", (gchar **) parts->pdata);
+
+      priv->n_presence_summaries++;
+
+      event_manager_add (burst->manager, burst->account, NULL,
+          burst->n_online > 0 ? EMPATHY_EVENT_TYPE_PRESENCE_ONLINE :
+            EMPATHY_EVENT_TYPE_PRESENCE_OFFLINE,
+          TPAW_IMAGE_AVATAR_DEFAULT,
+          tp_account_get_display_name (burst->account), message,
+          NULL, NULL, NULL);
+
+      g_free (message);
+    }
+
+  g_ptr_array_unref (parts);
+}
+
+static gboolean
+presence_burst_summary_cb (gpointer user_data)
+{
+  PresenceBurst *burst = user_data;
+
+  if (g_get_monotonic_time () - burst->last_change <
+      PRESENCE_BURST_QUIET * G_USEC_PER_SEC)
+    return G_SOURCE_CONTINUE;
+
+  DEBUG ("Presence burst on %s is over: %u connected, %u disconnected",
+      tp_proxy_get_object_path (burst->account), burst->n_online,
+      burst->n_offline);
+
+  presence_burst_summarize (burst);
+
+  burst->summary_id = 0;
+  burst->n_online = 0;
+  burst->n_offline = 0;
+  burst->n_in_window = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Returns TRUE if this presence change is part of a burst, in which case
+ * it has been accounted for in the burst's summary */
+static gboolean
+presence_burst_add_change (EmpathyEventManager *self,
+    TpAccount *account,
+    gboolean online)
+{
+  EmpathyEventManagerPriv *priv = GET_PRIV (self);
+  PresenceBurst *burst;
+  gint64 now = g_get_monotonic_time ();
+
+  burst = g_hash_table_lookup (priv->presence_bursts, account);
+  if (burst == NULL)
+    {
+      burst = g_slice_new0 (PresenceBurst);
+      burst->manager = self;
+      burst->account = g_object_ref (account);
+      burst->window_start = now;
+
+      g_hash_table_insert (priv->presence_bursts, account, burst);
+    }
+
+  if (now - burst->window_start > PRESENCE_BURST_WINDOW)
+    {
+      burst->window_start = now;
+      burst->n_in_window = 0;
+    }
+
+  burst->n_in_window++;
+  burst->last_change = now;
+
+  if (burst->summary_id == 0)
+    {
+      if (burst->n_in_window <= PRESENCE_BURST_THRESHOLD)
+        return FALSE;
+
+      DEBUG ("Presence burst on %s, aggregating changes",
+          tp_proxy_get_object_path (account));
+
+      burst->summary_id = g_timeout_add_seconds (PRESENCE_BURST_QUIET,
+          presence_burst_summary_cb, burst);
+    }
+
+  if (online)
+    burst->n_online++;
+  else
+    burst->n_offline++;
+
+  priv->n_presence_suppressed++;
+  return TRUE;
+}
+
 static void
 check_presence (EmpathyEventManager *manager,
     EmpathyContact *contact,
@@ -1113,60 +1267,60 @@ check_presence (EmpathyEventManager *manager,
 {
   EmpathyEventManagerPriv *priv = GET_PRIV (manager);
   TpAccount *account;
-  EmpathyPresenceManager *presence_mgr;
+  gboolean was_online, is_online;
+
+  was_online = tp_connection_presence_type_cmp_availability (previous,
+      TP_CONNECTION_PRESENCE_TYPE_OFFLINE) > 0;
+  is_online = tp_connection_presence_type_cmp_availability (current,
+      TP_CONNECTION_PRESENCE_TYPE_OFFLINE) > 0;
+
+  if (was_online == is_online)
+    return;
 
   account = empathy_contact_get_account (contact);
-  presence_mgr = empathy_presence_manager_dup_singleton ();
 
-  if (empathy_presence_manager_account_is_just_connected (presence_mgr, account))
-    goto out;
+  if (empathy_presence_manager_account_is_just_connected (priv->presence_mgr,
+        account))
+    {
+      priv->n_presence_suppressed++;
+      return;
+    }
 
-  if (tp_connection_presence_type_cmp_availability (previous,
-        TP_CONNECTION_PRESENCE_TYPE_OFFLINE) > 0)
+  if (presence_burst_add_change (manager, account, is_online))
+    return;
+
+  if (!is_online)
     {
-      /* contact was online */
-      if (tp_connection_presence_type_cmp_availability (current,
-          TP_CONNECTION_PRESENCE_TYPE_OFFLINE) <= 0)
-        {
-          /* someone is logging off */
-          empathy_sound_manager_play (priv->sound_mgr, NULL,
-              EMPATHY_SOUND_CONTACT_DISCONNECTED);
+      /* someone is logging off */
+      empathy_sound_manager_play (priv->sound_mgr, NULL,
+          EMPATHY_SOUND_CONTACT_DISCONNECTED);
 
-          if (g_settings_get_boolean (priv->gsettings_notif,
-                EMPATHY_PREFS_NOTIFICATIONS_CONTACT_SIGNOUT))
-            {
-              event_manager_add (manager, NULL, contact,
-                  EMPATHY_EVENT_TYPE_PRESENCE_OFFLINE,
-                  TPAW_IMAGE_AVATAR_DEFAULT,
-                  empathy_contact_get_alias (contact), _("Disconnected"),
-                  NULL, NULL, NULL);
-            }
+      if (EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings,
+            notifications_contact_signout))
+        {
+          event_manager_add (manager, NULL, contact,
+              EMPATHY_EVENT_TYPE_PRESENCE_OFFLINE,
+              TPAW_IMAGE_AVATAR_DEFAULT,
+              empathy_contact_get_alias (contact), _("Disconnected"),
+              NULL, NULL, NULL);
         }
     }
   else
     {
-      /* contact was offline */
-      if (tp_connection_presence_type_cmp_availability (current,
-            TP_CONNECTION_PRESENCE_TYPE_OFFLINE) > 0)
-        {
-          /* someone is logging in */
-          empathy_sound_manager_play (priv->sound_mgr, NULL,
-              EMPATHY_SOUND_CONTACT_CONNECTED);
+      /* someone is logging in */
+      empathy_sound_manager_play (priv->sound_mgr, NULL,
+          EMPATHY_SOUND_CONTACT_CONNECTED);
 
-          if (g_settings_get_boolean (priv->gsettings_notif,
-                EMPATHY_PREFS_NOTIFICATIONS_CONTACT_SIGNIN))
-            {
-              event_manager_add (manager, NULL, contact,
-                  EMPATHY_EVENT_TYPE_PRESENCE_ONLINE,
-                  TPAW_IMAGE_AVATAR_DEFAULT,
-                  empathy_contact_get_alias (contact), _("Connected"),
-                  NULL, NULL, NULL);
-            }
+      if (EMPATHY_SETTINGS_SNAPSHOT_GET (priv->settings,
+            notifications_contact_signin))
+        {
+          event_manager_add (manager, NULL, contact,
+              EMPATHY_EVENT_TYPE_PRESENCE_ONLINE,
+              TPAW_IMAGE_AVATAR_DEFAULT,
+              empathy_contact_get_alias (contact), _("Connected"),
+              NULL, NULL, NULL);
         }
     }
-
-out:
-  g_object_unref (presence_mgr);
 }
 
 static void
@@ -1213,10 +1367,11 @@ event_manager_finalize (GObject *object)
   g_object_unref (priv->conn_aggregator);
   g_object_unref (priv->approver);
   g_object_unref (priv->auth_approver);
-  g_object_unref (priv->gsettings_notif);
-  g_object_unref (priv->gsettings_ui);
+  g_object_unref (priv->settings);
   g_object_unref (priv->sound_mgr);
+  g_object_unref (priv->presence_mgr);
   g_hash_table_unref (priv->contacts);
+  g_hash_table_unref (priv->presence_bursts);
 }
 
 static void
@@ -1323,11 +1478,15 @@ empathy_event_manager_init (EmpathyEventManager *manager)
 
   manager->priv = priv;
 
-  priv->gsettings_notif = g_settings_new (EMPATHY_PREFS_NOTIFICATIONS_SCHEMA);
-  priv->gsettings_ui = g_settings_new (EMPATHY_PREFS_UI_SCHEMA);
+  priv->settings = empathy_settings_snapshot_dup_singleton ();
 
   priv->sound_mgr = empathy_sound_manager_dup_singleton ();
 
+  priv->presence_mgr = empathy_presence_manager_dup_singleton ();
+
+  priv->presence_bursts = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) presence_burst_free);
+
   priv->contacts = g_hash_table_new_full (NULL, NULL, g_object_unref,
       g_object_unref);
 
@@ -1445,6 +1604,31 @@ empathy_event_manager_get_top_event (EmpathyEventManager *manager)
   return priv->events ? priv->events->data : NULL;
 }
 
+/* Number of contact presence changes which didn't get their own event,
+ * because the account just connected or because they were part of a burst */
+guint
+empathy_event_manager_get_n_suppressed_presence_events (
+    EmpathyEventManager *manager)
+{
+  EmpathyEventManagerPriv *priv = GET_PRIV (manager);
+
+  g_return_val_if_fail (EMPATHY_IS_EVENT_MANAGER (manager), 0);
+
+  return priv->n_presence_suppressed;
+}
+
+/* Number of events summing up a burst of presence changes */
+guint
+empathy_event_manager_get_n_presence_summaries (
+    EmpathyEventManager *manager)
+{
+  EmpathyEventManagerPriv *priv = GET_PRIV (manager);
+
+  g_return_val_if_fail (EMPATHY_IS_EVENT_MANAGER (manager), 0);
+
+  return priv->n_presence_summaries;
+}
+
 void
 empathy_event_activate (EmpathyEvent *event_public)
 {
@@ -75,6 +75,8 @@ GType                empathy_event_manager_get_type      (void) G_GNUC_CONST;
 EmpathyEventManager *empathy_event_manager_dup_singleton (void);
 EmpathyEvent *       empathy_event_manager_get_top_event (EmpathyEventManager *manager);
 GSList *             empathy_event_manager_get_events    (EmpathyEventManager *manager);
+guint                empathy_event_manager_get_n_suppressed_presence_events (EmpathyEventManager *manager);
+guint                empathy_event_manager_get_n_presence_summaries (EmpathyEventManager *manager);
 void                 empathy_event_activate              (EmpathyEvent        *event);
 void                 empathy_event_inhibit_updates       (EmpathyEvent        *event);
 void                 empathy_event_approve               (EmpathyEvent        *event);
@@ -33,13 +33,19 @@
 #include <glib/gi18n.h>
 #include <tp-account-widgets/tpaw-builder.h>
 
+#include "empathy-ft-scheduler.h"
 #include "empathy-geometry.h"
+#include "empathy-gsettings.h"
 #include "empathy-ui-utils.h"
 #include "empathy-utils.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_FT
 #include "empathy-debug.h"
 
+/* progress of all the transfers is shown at most this often, in a single
+ * pass over the rows which changed */
+#define PROGRESS_FLUSH_INTERVAL 250
+
 enum
 {
   COL_PERCENT,
@@ -49,9 +55,24 @@ enum
   COL_FT_OBJECT
 };
 
+/* the latest ::transfer-progress values of a handler, not shown yet */
+typedef struct {
+  guint64 current_bytes;
+  guint64 total_bytes;
+  guint remaining_time;
+  gdouble speed;
+} PendingProgress;
+
 typedef struct {
   GtkTreeModel *model;
   GHashTable *ft_handler_to_row_ref;
+  /* owned EmpathyFTHandler => owned PendingProgress */
+  GHashTable *pending_progress;
+  guint flush_progress_id;
+
+  GSettings *gsettings;
+  /* outgoing transfers wait in its queue before starting */
+  EmpathyFTScheduler *scheduler;
 
   /* Widgets */
   GtkWidget *window;
@@ -75,8 +96,16 @@ G_DEFINE_TYPE (EmpathyFTManager, empathy_ft_manager, G_TYPE_OBJECT);
 
 static EmpathyFTManager *manager_singleton = NULL;
 
+static void
+pending_progress_free (PendingProgress *progress)
+{
+  g_slice_free (PendingProgress, progress);
+}
+
 static void ft_handler_hashing_started_cb (EmpathyFTHandler *handler,
     EmpathyFTManager *manager);
+static void ft_manager_drop_progress (EmpathyFTManager *manager,
+    EmpathyFTHandler *handler);
 
 static gchar *
 ft_manager_format_interval (guint interval)
@@ -370,51 +399,6 @@ ft_manager_update_handler_message (EmpathyFTManager *manager,
   gtk_tree_path_free (path);
 }
 
-static void
-ft_manager_update_handler_progress (EmpathyFTManager *manager,
-                                    GtkTreeRowReference *row_ref,
-                                    int percentage)
-{
-  GtkTreePath *path;
-  GtkTreeIter iter;
-  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
-
-  /* Set new value in the store */
-  path = gtk_tree_row_reference_get_path (row_ref);
-  gtk_tree_model_get_iter (priv->model, &iter, path);
-  gtk_list_store_set (GTK_LIST_STORE (priv->model),
-      &iter,
-      COL_PERCENT, percentage,
-      -1);
-
-  gtk_tree_path_free (path);
-
-}
-
-static void
-ft_manager_update_handler_time (EmpathyFTManager *manager,
-                                GtkTreeRowReference *row_ref,
-                                guint remaining_time)
-{
-  GtkTreePath *path;
-  GtkTreeIter iter;
-  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
-  char *remaining_str;
-
-  remaining_str = ft_manager_format_interval (remaining_time);
-
-  /* Set new value in the store */
-  path = gtk_tree_row_reference_get_path (row_ref);
-  gtk_tree_model_get_iter (priv->model, &iter, path);
-  gtk_list_store_set (GTK_LIST_STORE (priv->model),
-      &iter,
-      COL_REMAINING, remaining_str,
-      -1);
-
-  gtk_tree_path_free (path);
-  g_free (remaining_str);
-}
-
 static void
 ft_manager_clear_handler_time (EmpathyFTManager *manager,
                                GtkTreeRowReference *row_ref)
@@ -444,6 +428,8 @@ ft_handler_transfer_error_cb (EmpathyFTHandler *handler,
 
   DEBUG ("Transfer error %s", error->message);
 
+  ft_manager_drop_progress (manager, handler);
+
   row_ref = ft_manager_get_row_from_handler (manager, handler);
   g_return_if_fail (row_ref != NULL);
 
@@ -515,6 +501,8 @@ ft_handler_transfer_done_cb (EmpathyFTHandler *handler,
                              TpFileTransferChannel *channel,
                              EmpathyFTManager *manager)
 {
+  ft_manager_drop_progress (manager, handler);
+
   if (empathy_ft_handler_is_incoming (handler) &&
       empathy_ft_handler_get_use_hash (handler))
     {
@@ -533,39 +521,135 @@ ft_handler_transfer_done_cb (EmpathyFTHandler *handler,
 }
 
 static void
-ft_handler_transfer_progress_cb (EmpathyFTHandler *handler,
-                                 guint64 current_bytes,
-                                 guint64 total_bytes,
-                                 guint remaining_time,
-                                 gdouble speed,
-                                 EmpathyFTManager *manager)
+ft_manager_show_progress (EmpathyFTManager *manager,
+                          EmpathyFTHandler *handler,
+                          PendingProgress *progress)
 {
-  char *first_line, *second_line, *message;
+  char *first_line, *second_line, *message, *remaining_str = NULL;
   int percentage;
   GtkTreeRowReference *row_ref;
-
-  DEBUG ("Transfer progress");
+  GtkTreePath *path;
+  GtkTreeIter iter;
+  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
 
   row_ref = ft_manager_get_row_from_handler (manager, handler);
   g_return_if_fail (row_ref != NULL);
 
   first_line = ft_manager_format_contact_info (handler);
   second_line = ft_manager_format_progress_bytes_and_percentage
-    (current_bytes, total_bytes, speed, &percentage);
+    (progress->current_bytes, progress->total_bytes, progress->speed,
+     &percentage);
 
   message = g_strdup_printf ("%s\n%s", first_line, second_line);
 
-  ft_manager_update_handler_message (manager, row_ref, message);
-  ft_manager_update_handler_progress (manager, row_ref, percentage);
+  if (progress->remaining_time > 0)
+    remaining_str = ft_manager_format_interval (progress->remaining_time);
 
-  if (remaining_time > 0)
-    ft_manager_update_handler_time (manager, row_ref, remaining_time);
+  /* a single row-changed for the whole update */
+  path = gtk_tree_row_reference_get_path (row_ref);
+  gtk_tree_model_get_iter (priv->model, &iter, path);
 
+  if (remaining_str != NULL)
+    gtk_list_store_set (GTK_LIST_STORE (priv->model), &iter,
+        COL_MESSAGE, message,
+        COL_PERCENT, percentage,
+        COL_REMAINING, remaining_str,
+        -1);
+  else
+    gtk_list_store_set (GTK_LIST_STORE (priv->model), &iter,
+        COL_MESSAGE, message,
+        COL_PERCENT, percentage,
+        -1);
+
+  gtk_tree_path_free (path);
+  g_free (remaining_str);
   g_free (message);
   g_free (first_line);
   g_free (second_line);
 }
 
+static void
+ft_manager_flush_progress (EmpathyFTManager *manager)
+{
+  GHashTableIter iter;
+  gpointer handler, progress;
+  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
+
+  if (priv->flush_progress_id != 0)
+    {
+      g_source_remove (priv->flush_progress_id);
+      priv->flush_progress_id = 0;
+    }
+
+  g_hash_table_iter_init (&iter, priv->pending_progress);
+  while (g_hash_table_iter_next (&iter, &handler, &progress))
+    {
+      ft_manager_show_progress (manager, handler, progress);
+      g_hash_table_iter_remove (&iter);
+    }
+}
+
+static gboolean
+ft_manager_flush_progress_cb (gpointer user_data)
+{
+  EmpathyFTManager *manager = user_data;
+  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
+
+  priv->flush_progress_id = 0;
+  ft_manager_flush_progress (manager);
+
+  return FALSE;
+}
+
+/* Forget the progress of a handler which has moved on to another state, so
+ * it doesn't overwrite that state's message. */
+static void
+ft_manager_drop_progress (EmpathyFTManager *manager,
+                          EmpathyFTHandler *handler)
+{
+  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
+
+  g_hash_table_remove (priv->pending_progress, handler);
+}
+
+static void
+ft_manager_window_map_cb (GtkWidget *widget,
+                          EmpathyFTManager *manager)
+{
+  /* progress isn't shown while the window is hidden */
+  ft_manager_flush_progress (manager);
+}
+
+static void
+ft_handler_transfer_progress_cb (EmpathyFTHandler *handler,
+                                 guint64 current_bytes,
+                                 guint64 total_bytes,
+                                 guint remaining_time,
+                                 gdouble speed,
+                                 EmpathyFTManager *manager)
+{
+  PendingProgress *progress;
+  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
+
+  progress = g_hash_table_lookup (priv->pending_progress, handler);
+
+  if (progress == NULL)
+    {
+      progress = g_slice_new (PendingProgress);
+      g_hash_table_insert (priv->pending_progress, g_object_ref (handler),
+          progress);
+    }
+
+  progress->current_bytes = current_bytes;
+  progress->total_bytes = total_bytes;
+  progress->remaining_time = remaining_time;
+  progress->speed = speed;
+
+  if (priv->flush_progress_id == 0 && gtk_widget_get_mapped (priv->window))
+    priv->flush_progress_id = g_timeout_add (PROGRESS_FLUSH_INTERVAL,
+        ft_manager_flush_progress_cb, manager);
+}
+
 static void
 ft_handler_transfer_started_cb (EmpathyFTHandler *handler,
                                 TpFileTransferChannel *channel,
@@ -686,11 +770,38 @@ ft_handler_hashing_started_cb (EmpathyFTHandler *handler,
   g_free (message);
 }
 
+static void
+ft_manager_scheduler_handler_started_cb (EmpathyFTScheduler *scheduler,
+                                         EmpathyFTHandler *handler,
+                                         EmpathyFTManager *manager)
+{
+  GtkTreeRowReference *row_ref;
+  char *first_line, *message;
+
+  /* ::hashing-started takes it from there */
+  if (empathy_ft_handler_get_use_hash (handler))
+    return;
+
+  row_ref = ft_manager_get_row_from_handler (manager, handler);
+  if (row_ref == NULL)
+    return;
+
+  first_line = ft_manager_format_contact_info (handler);
+  message = g_strdup_printf ("%s\n%s", first_line,
+      _("Waiting for the other participant's response"));
+
+  ft_manager_update_handler_message (manager, row_ref, message);
+
+  g_free (first_line);
+  g_free (message);
+}
+
 static void
 ft_manager_start_transfer (EmpathyFTManager *manager,
                            EmpathyFTHandler *handler)
 {
   gboolean is_outgoing;
+  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
 
   is_outgoing = !empathy_ft_handler_is_incoming (handler);
 
@@ -710,7 +821,13 @@ ft_manager_start_transfer (EmpathyFTManager *manager,
         G_CALLBACK (ft_handler_transfer_started_cb), manager);
   }
 
-  empathy_ft_handler_start_transfer (handler);
+  /* incoming transfers have been accepted by the user, who is waiting for
+   * them; outgoing ones wait for their turn */
+  if (is_outgoing)
+    empathy_ft_scheduler_add_handler (priv->scheduler, handler,
+        empathy_ft_handler_get_batch (handler));
+  else
+    empathy_ft_handler_start_transfer (handler);
 }
 
 static void
@@ -764,21 +881,28 @@ ft_manager_add_handler_to_list (EmpathyFTManager *manager,
     }
 
   /* update the row with the initial values.
-   * the only case where we postpone this is in case we're managing
-   * an outgoing+hashing transfer, as the hashing started signal will
-   * take care of updating the information.
+   * incoming transfers start right away; outgoing ones are queued until
+   * the scheduler starts them, when ::handler-started or ::hashing-started
+   * updates the row.
    */
-  if (empathy_ft_handler_is_incoming (handler) ||
-      !empathy_ft_handler_get_use_hash (handler)) {
-    first_line = ft_manager_format_contact_info (handler);
+  first_line = ft_manager_format_contact_info (handler);
+
+  if (empathy_ft_handler_is_incoming (handler))
     second_line = _("Waiting for the other participant's response");
-    message = g_strdup_printf ("%s\n%s", first_line, second_line);
+  else
+    second_line = _("Queued");
 
-    ft_manager_update_handler_message (manager, row_ref, message);
+  message = g_strdup_printf ("%s\n%s", first_line, second_line);
 
-    g_free (first_line);
-    g_free (message);
-  }
+  ft_manager_update_handler_message (manager, row_ref, message);
+
+  g_free (first_line);
+  g_free (message);
+
+  g_object_set (handler, "speed-window",
+      g_settings_get_uint (priv->gsettings,
+        EMPATHY_PREFS_FILE_TRANSFER_SPEED_WINDOW),
+      NULL);
 
   /* hook up the signals and start the transfer */
   ft_manager_start_transfer (manager, handler);
@@ -840,6 +964,7 @@ ft_manager_stop (EmpathyFTManager *manager)
   GtkTreeModel *model;
   EmpathyFTHandler *handler;
   EmpathyFTManagerPriv *priv;
+  guint id;
 
   priv = GET_PRIV (manager);
 
@@ -855,7 +980,24 @@ ft_manager_stop (EmpathyFTManager *manager)
       empathy_contact_get_alias (empathy_ft_handler_get_contact (handler)),
       empathy_ft_handler_get_filename (handler));
 
-  empathy_ft_handler_cancel_transfer (handler);
+  id = empathy_ft_scheduler_lookup_handler (priv->scheduler, handler);
+
+  if (id != 0 && empathy_ft_scheduler_remove (priv->scheduler, id))
+    {
+      GError *error;
+
+      /* it never started, so it won't report the error itself */
+      empathy_ft_handler_cancel_transfer (handler);
+
+      error = g_error_new_literal (EMPATHY_FT_ERROR_QUARK,
+          EMPATHY_FT_ERROR_FAILED, _("You canceled the file transfer"));
+      ft_handler_transfer_error_cb (handler, error, manager);
+      g_error_free (error);
+    }
+  else
+    {
+      empathy_ft_handler_cancel_transfer (handler);
+    }
 
   g_object_unref (handler);
 }
@@ -985,6 +1127,7 @@ ft_manager_build_ui (EmpathyFTManager *manager)
       "ft_manager_dialog", "response", ft_manager_response_cb,
       "ft_manager_dialog", "delete-event", ft_manager_delete_event_cb,
       "ft_manager_dialog", "key-press-event", ft_manager_key_press_event_cb,
+      "ft_manager_dialog", "map", ft_manager_window_map_cb,
       NULL);
 
   tpaw_builder_unref_and_keep_widget (gui, priv->window);
@@ -1077,6 +1220,12 @@ empathy_ft_manager_finalize (GObject *object)
   DEBUG ("FT Manager %p", object);
 
   g_hash_table_unref (priv->ft_handler_to_row_ref);
+  g_hash_table_unref (priv->pending_progress);
+  g_object_unref (priv->gsettings);
+  g_object_unref (priv->scheduler);
+
+  if (priv->flush_progress_id != 0)
+    g_source_remove (priv->flush_progress_id);
 
   G_OBJECT_CLASS (empathy_ft_manager_parent_class)->finalize (object);
 }
@@ -1094,6 +1243,23 @@ empathy_ft_manager_init (EmpathyFTManager *manager)
   priv->ft_handler_to_row_ref = g_hash_table_new_full (g_direct_hash,
       g_direct_equal, (GDestroyNotify) g_object_unref,
       (GDestroyNotify) gtk_tree_row_reference_free);
+  priv->pending_progress = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, (GDestroyNotify) g_object_unref,
+      (GDestroyNotify) pending_progress_free);
+
+  priv->gsettings = g_settings_new (EMPATHY_PREFS_SCHEMA);
+
+  priv->scheduler = empathy_ft_scheduler_dup_singleton ();
+  g_settings_bind (priv->gsettings, EMPATHY_PREFS_FILE_TRANSFER_MAX_ACTIVE,
+      priv->scheduler, "max-active", G_SETTINGS_BIND_GET);
+  g_settings_bind (priv->gsettings,
+      EMPATHY_PREFS_FILE_TRANSFER_MAX_ACTIVE_PER_CONTACT,
+      priv->scheduler, "max-active-per-contact", G_SETTINGS_BIND_GET);
+  g_settings_bind (priv->gsettings,
+      EMPATHY_PREFS_FILE_TRANSFER_SMALLEST_FIRST,
+      priv->scheduler, "smallest-first", G_SETTINGS_BIND_GET);
+  g_signal_connect_object (priv->scheduler, "handler-started",
+      G_CALLBACK (ft_manager_scheduler_handler_started_cb), manager, 0);
 
   ft_manager_build_ui (manager);
 }
@@ -51,6 +51,13 @@
 #define DEBUG_FLAG EMPATHY_DEBUG_OTHER
 #include "empathy-debug.h"
 
+/* Auto-connect rooms are joined a few at a time and not too quickly, so
+ * servers don't kick us for flooding and the chat window doesn't have to
+ * set them all up at once */
+#define AUTO_JOIN_MAX_PENDING 3
+/* in ms, between two joins on the same account */
+#define AUTO_JOIN_INTERVAL 1000
+
 #define EMPATHY_TYPE_APP (empathy_app_get_type ())
 #define EMPATHY_APP(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), EMPATHY_TYPE_APP, EmpathyApp))
 #define EMPATHY_APP_CLASS(obj) (G_TYPE_CHECK_CLASS_CAST ((obj), EMPATHY_TYPE_APP, EmpathyAppClass))
@@ -96,6 +103,12 @@ struct _EmpathyApp
   GSettings *gsettings;
   EmpathyNotificationsApprover *notifications_approver;
   EmpathyConnectionAggregator *conn_aggregator;
+  /* TpAccount => owned AutoJoin */
+  GHashTable *auto_joins;
+  /* rooms queued or being joined, for all accounts */
+  guint n_auto_join_left;
+  gboolean auto_join_reported;
+  gint64 start_time;
 #ifdef HAVE_GEOCLUE
   EmpathyLocationManager *location_manager;
 #endif
@@ -133,6 +146,7 @@ empathy_app_dispose (GObject *object)
   tp_clear_object (&self->icon);
   tp_clear_object (&self->account_manager);
   tp_clear_object (&self->log_manager);
+  tp_clear_pointer (&self->auto_joins, g_hash_table_unref);
   tp_clear_object (&self->chatroom_manager);
 #ifdef HAVE_GEOCLUE
   tp_clear_object (&self->location_manager);
@@ -654,20 +668,233 @@ account_manager_ready_cb (GObject *source_object,
     show_accounts_ui (self, gdk_screen_get_default (), TRUE);
 }
 
+typedef struct
+{
+  EmpathyApp *app;
+  TpAccount *account;
+  TpConnection *connection;
+  /* EmpathyChatroom, in the order they will be joined */
+  GQueue queue;
+  /* joins requested which didn't finish yet */
+  guint n_pending;
+  guint n_joined;
+  gint64 start_time;
+  gint64 last_join;
+  guint timeout_id;
+  /* set if the account disconnected while joins were pending; the struct
+   * is freed once they finish */
+  gboolean cancelled;
+} AutoJoin;
+
+static void auto_join_next (AutoJoin *auto_join);
+
+static void
+auto_join_free (AutoJoin *auto_join)
+{
+  g_queue_foreach (&auto_join->queue, (GFunc) g_object_unref, NULL);
+  g_queue_clear (&auto_join->queue);
+
+  if (auto_join->timeout_id != 0)
+    g_source_remove (auto_join->timeout_id);
+
+  g_object_unref (auto_join->account);
+  g_object_unref (auto_join->connection);
+  g_slice_free (AutoJoin, auto_join);
+}
+
+static void
+auto_join_report (EmpathyApp *self)
+{
+  if (self->n_auto_join_left > 0 || self->auto_join_reported)
+    return;
+
+  self->auto_join_reported = TRUE;
+
+  DEBUG ("Done joining auto-connect rooms, %.3f seconds after startup",
+      (g_get_monotonic_time () - self->start_time) / (gdouble) G_USEC_PER_SEC);
+}
+
+/* Called when the account disconnects or the app goes away */
+static void
+auto_join_cancel (AutoJoin *auto_join)
+{
+  EmpathyApp *self = auto_join->app;
+
+  self->n_auto_join_left -= g_queue_get_length (&auto_join->queue) +
+      auto_join->n_pending;
+
+  if (auto_join->n_pending == 0)
+    {
+      auto_join_free (auto_join);
+      return;
+    }
+
+  g_queue_foreach (&auto_join->queue, (GFunc) g_object_unref, NULL);
+  g_queue_clear (&auto_join->queue);
+
+  if (auto_join->timeout_id != 0)
+    {
+      g_source_remove (auto_join->timeout_id);
+      auto_join->timeout_id = 0;
+    }
+
+  auto_join->cancelled = TRUE;
+}
+
+static void
+auto_join_ensure_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  AutoJoin *auto_join = user_data;
+  GError *error = NULL;
+
+  auto_join->n_pending--;
+
+  if (!tp_account_channel_request_ensure_channel_finish (
+        TP_ACCOUNT_CHANNEL_REQUEST (source), result, &error))
+    {
+      DEBUG ("Failed to join a room on %s: %s",
+          tp_proxy_get_object_path (auto_join->account), error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      auto_join->n_joined++;
+    }
+
+  if (auto_join->cancelled)
+    {
+      if (auto_join->n_pending == 0)
+        auto_join_free (auto_join);
+      return;
+    }
+
+  auto_join->app->n_auto_join_left--;
+  auto_join_next (auto_join);
+}
+
+static gboolean
+auto_join_timeout_cb (gpointer user_data)
+{
+  AutoJoin *auto_join = user_data;
+
+  auto_join->timeout_id = 0;
+  auto_join_next (auto_join);
+
+  return FALSE;
+}
+
+static void
+auto_join_next (AutoJoin *auto_join)
+{
+  EmpathyApp *self = auto_join->app;
+
+  while (auto_join->timeout_id == 0 &&
+      auto_join->n_pending < AUTO_JOIN_MAX_PENDING &&
+      !g_queue_is_empty (&auto_join->queue))
+    {
+      EmpathyChatroom *room;
+      gint64 now, wait;
+
+      now = g_get_monotonic_time ();
+      wait = auto_join->last_join + AUTO_JOIN_INTERVAL * 1000 - now;
+
+      if (wait > 0)
+        {
+          auto_join->timeout_id = g_timeout_add (wait / 1000 + 1,
+              auto_join_timeout_cb, auto_join);
+          break;
+        }
+
+      room = g_queue_pop_head (&auto_join->queue);
+
+      /* It may have been changed since it was queued */
+      if (!empathy_chatroom_get_auto_connect (room))
+        {
+          self->n_auto_join_left--;
+          g_object_unref (room);
+          continue;
+        }
+
+      DEBUG ("Joining %s on %s", empathy_chatroom_get_room (room),
+          tp_proxy_get_object_path (auto_join->account));
+
+      auto_join->last_join = now;
+      auto_join->n_pending++;
+
+      empathy_join_muc_full (auto_join->account,
+          empathy_chatroom_get_room (room),
+          TP_USER_ACTION_TIME_NOT_USER_ACTION, auto_join_ensure_cb, auto_join);
+
+      g_object_unref (room);
+    }
+
+  if (auto_join->n_pending > 0 || !g_queue_is_empty (&auto_join->queue))
+    return;
+
+  DEBUG ("Joined %u rooms on %s in %.3f seconds", auto_join->n_joined,
+      tp_proxy_get_object_path (auto_join->account),
+      (g_get_monotonic_time () - auto_join->start_time) /
+        (gdouble) G_USEC_PER_SEC);
+
+  /* frees auto_join */
+  g_hash_table_remove (self->auto_joins, auto_join->account);
+  auto_join_report (self);
+}
+
+static gint
+auto_join_compare (gconstpointer a,
+    gconstpointer b,
+    gpointer user_data)
+{
+  EmpathyChatroom *room_a = (EmpathyChatroom *) a;
+  EmpathyChatroom *room_b = (EmpathyChatroom *) b;
+
+  /* Favorites first, then the rooms which always get our attention;
+   * g_queue_sort() keeps the order of the list otherwise */
+  if (empathy_chatroom_is_favorite (room_a) !=
+      empathy_chatroom_is_favorite (room_b))
+    return empathy_chatroom_is_favorite (room_a) ? -1 : 1;
+
+  if (empathy_chatroom_is_always_urgent (room_a) !=
+      empathy_chatroom_is_always_urgent (room_b))
+    return empathy_chatroom_is_always_urgent (room_a) ? -1 : 1;
+
+  return 0;
+}
+
 static void
-account_join_chatrooms (TpAccount *account,
-  EmpathyChatroomManager *chatroom_manager)
+account_join_chatrooms (EmpathyApp *self,
+    TpAccount *account)
 {
   TpConnection *conn;
+  AutoJoin *auto_join;
   GList *chatrooms, *p;
 
   /* Wait if we are not connected or the TpConnection is not prepared yet */
   conn = tp_account_get_connection (account);
   if (conn == NULL)
+    {
+      /* Rooms which are still queued will be joined on reconnection */
+      g_hash_table_remove (self->auto_joins, account);
+      return;
+    }
+
+  auto_join = g_hash_table_lookup (self->auto_joins, account);
+  if (auto_join != NULL && auto_join->connection == conn)
     return;
 
+  g_hash_table_remove (self->auto_joins, account);
+
+  auto_join = g_slice_new0 (AutoJoin);
+  auto_join->app = self;
+  auto_join->account = g_object_ref (account);
+  auto_join->connection = g_object_ref (conn);
+  auto_join->start_time = g_get_monotonic_time ();
+
   chatrooms = empathy_chatroom_manager_get_chatrooms (
-          chatroom_manager, account);
+          self->chatroom_manager, account);
 
   for (p = chatrooms; p != NULL; p = p->next)
     {
@@ -676,18 +903,33 @@ account_join_chatrooms (TpAccount *account,
       if (!empathy_chatroom_get_auto_connect (room))
         continue;
 
-      empathy_join_muc (account, empathy_chatroom_get_room (room),
-        TP_USER_ACTION_TIME_NOT_USER_ACTION);
+      g_queue_push_tail (&auto_join->queue, g_object_ref (room));
     }
   g_list_free (chatrooms);
+
+  if (g_queue_is_empty (&auto_join->queue))
+    {
+      auto_join_free (auto_join);
+      return;
+    }
+
+  g_queue_sort (&auto_join->queue, auto_join_compare, NULL);
+
+  DEBUG ("Joining %u rooms on %s", g_queue_get_length (&auto_join->queue),
+      tp_proxy_get_object_path (account));
+
+  self->n_auto_join_left += g_queue_get_length (&auto_join->queue);
+  g_hash_table_insert (self->auto_joins, account, auto_join);
+
+  auto_join_next (auto_join);
 }
 
 static void
 account_connection_changed_cb (TpAccount *account,
     GParamSpec *spec,
-    EmpathyChatroomManager *manager)
+    EmpathyApp *self)
 {
-  account_join_chatrooms (account, manager);
+  account_join_chatrooms (self, account);
 }
 
 static void
@@ -696,7 +938,7 @@ account_manager_chatroom_ready_cb (GObject *source_object,
     gpointer user_data)
 {
   TpAccountManager *account_manager = TP_ACCOUNT_MANAGER (source_object);
-  EmpathyChatroomManager *chatroom_manager = user_data;
+  EmpathyApp *self = user_data;
   GList *accounts, *l;
   GError *error = NULL;
 
@@ -714,11 +956,11 @@ account_manager_chatroom_ready_cb (GObject *source_object,
       TpAccount *account = TP_ACCOUNT (l->data);
 
       /* Try to join all rooms if we're connected */
-      account_join_chatrooms (account, chatroom_manager);
+      account_join_chatrooms (self, account);
 
       /* And/or join them on (re)connection */
       tp_g_signal_connect_object (account, "notify::connection",
-        G_CALLBACK (account_connection_changed_cb), chatroom_manager, 0);
+        G_CALLBACK (account_connection_changed_cb), self, 0);
     }
   g_list_free_full (accounts, g_object_unref);
 }
@@ -728,10 +970,10 @@ chatroom_manager_ready_cb (EmpathyChatroomManager *chatroom_manager,
     GParamSpec *pspec,
     gpointer user_data)
 {
-  TpAccountManager *account_manager = user_data;
+  EmpathyApp *self = user_data;
 
-  tp_proxy_prepare_async (account_manager, NULL,
-      account_manager_chatroom_ready_cb, chatroom_manager);
+  tp_proxy_prepare_async (self->account_manager, NULL,
+      account_manager_chatroom_ready_cb, self);
 }
 
 static void
@@ -745,6 +987,8 @@ empathy_app_constructed (GObject *object)
 
   gtk_window_set_default_icon_name ("empathy");
 
+  self->start_time = g_get_monotonic_time ();
+
 #ifdef ENABLE_DEBUG
   /* Set up debug sender */
   self->debug_sender = tp_debug_sender_dup ();
@@ -771,17 +1015,18 @@ empathy_app_constructed (GObject *object)
   self->log_manager = tpl_log_manager_dup_singleton ();
 
   self->chatroom_manager = empathy_chatroom_manager_dup_singleton (NULL);
+  self->auto_joins = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) auto_join_cancel);
 
   g_object_get (self->chatroom_manager, "ready", &chatroom_manager_ready, NULL);
   if (!chatroom_manager_ready)
     {
       g_signal_connect (G_OBJECT (self->chatroom_manager), "notify::ready",
-          G_CALLBACK (chatroom_manager_ready_cb), self->account_manager);
+          G_CALLBACK (chatroom_manager_ready_cb), self);
     }
   else
     {
-      chatroom_manager_ready_cb (self->chatroom_manager, NULL,
-          self->account_manager);
+      chatroom_manager_ready_cb (self->chatroom_manager, NULL, self);
     }
 
   /* Location mananger */
@@ -1,6 +1,9 @@
 #include "config.h"
 
+#include <glib/gstdio.h>
+
 #include "empathy-chatroom-manager.h"
+#include "empathy-client-factory.h"
 #include "test-helper.h"
 
 #define CHATROOM_SAMPLE "chatrooms-sample.xml"
@@ -375,6 +378,214 @@ START_TEST (test_empathy_chatroom_manager_change_chatroom)
 END_TEST
 #endif
 
+#define N_CHATROOMS 1000
+#define TEST_ACCOUNT_PATH TP_ACCOUNT_OBJECT_PATH_BASE "gabble/jabber/test0"
+
+typedef struct
+{
+  GMainLoop *loop;
+  gchar *file;
+  TpAccount *account;
+  guint n_added;
+  guint n_removed;
+} Test;
+
+static void
+write_chatrooms_file (const gchar *file,
+    guint n_chatrooms)
+{
+  GString *xml;
+  guint i;
+
+  xml = g_string_new ("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+      "<chatrooms>\n");
+
+  for (i = 0; i < n_chatrooms; i++)
+    g_string_append_printf (xml,
+        "  <chatroom>\n"
+        "    <name>name%u</name>\n"
+        "    <room>room%u</room>\n"
+        "    <account>%s</account>\n"
+        "    <auto_connect>no</auto_connect>\n"
+        "  </chatroom>\n", i, i, TEST_ACCOUNT_PATH);
+
+  g_string_append (xml, "</chatrooms>\n");
+
+  g_assert (g_file_set_contents (file, xml->str, xml->len, NULL));
+  g_string_free (xml, TRUE);
+}
+
+static EmpathyChatroomManager *
+dup_manager (Test *test)
+{
+  EmpathyChatroomManager *mgr;
+  gboolean ready;
+
+  mgr = empathy_chatroom_manager_dup_singleton (test->file);
+
+  g_object_get (mgr, "ready", &ready, NULL);
+  if (!ready)
+    {
+      gulong id;
+
+      id = g_signal_connect_swapped (mgr, "notify::ready",
+          G_CALLBACK (g_main_loop_quit), test->loop);
+      g_main_loop_run (test->loop);
+      g_signal_handler_disconnect (mgr, id);
+    }
+
+  return mgr;
+}
+
+static void
+chatroom_added_cb (EmpathyChatroomManager *mgr,
+    EmpathyChatroom *chatroom,
+    Test *test)
+{
+  test->n_added++;
+  g_main_loop_quit (test->loop);
+}
+
+static void
+chatroom_removed_cb (EmpathyChatroomManager *mgr,
+    EmpathyChatroom *chatroom,
+    Test *test)
+{
+  test->n_removed++;
+}
+
+static gboolean
+reload_timeout_cb (gpointer user_data)
+{
+  g_error ("the chatrooms file hasn't been reloaded");
+  return FALSE;
+}
+
+static void
+test_empathy_chatroom_manager_many (void)
+{
+  Test test = { NULL, };
+  EmpathyClientFactory *factory;
+  EmpathyChatroomManager *mgr;
+  EmpathyChatroom *chatroom, *room2;
+  GList *chatrooms;
+  gchar *room;
+  guint i, timeout_id;
+
+  test.loop = g_main_loop_new (NULL, FALSE);
+  test.file = get_user_xml_file ("chatrooms-many.xml");
+
+  factory = empathy_client_factory_dup ();
+  test.account = tp_simple_client_factory_ensure_account (
+      TP_SIMPLE_CLIENT_FACTORY (factory), TEST_ACCOUNT_PATH, NULL, NULL);
+  g_assert (test.account != NULL);
+
+  write_chatrooms_file (test.file, N_CHATROOMS);
+  mgr = dup_manager (&test);
+
+  /* the chatrooms are listed in the order of the file */
+  chatrooms = empathy_chatroom_manager_get_chatrooms (mgr, test.account);
+  g_assert_cmpuint (g_list_length (chatrooms), ==, N_CHATROOMS);
+  g_assert_cmpstr (empathy_chatroom_get_room (chatrooms->data), ==,
+      "room0");
+  g_assert_cmpstr (empathy_chatroom_get_room (g_list_last (chatrooms)->data),
+      ==, "room999");
+  g_list_free (chatrooms);
+
+  for (i = 0; i < N_CHATROOMS; i++)
+    {
+      gchar *name;
+
+      room = g_strdup_printf ("room%u", i);
+      name = g_strdup_printf ("name%u", i);
+
+      chatroom = empathy_chatroom_manager_find (mgr, test.account, room);
+      g_assert (chatroom != NULL);
+      g_assert_cmpstr (empathy_chatroom_get_name (chatroom), ==, name);
+      g_assert (empathy_chatroom_is_favorite (chatroom));
+
+      g_free (room);
+      g_free (name);
+    }
+
+  g_assert (empathy_chatroom_manager_find (mgr, test.account,
+        "not-a-room") == NULL);
+
+  /* renamed rooms are found by their new name only */
+  chatroom = empathy_chatroom_manager_find (mgr, test.account, "room3");
+  empathy_chatroom_set_room (chatroom, "new-room3");
+  g_assert (empathy_chatroom_manager_find (mgr, test.account,
+        "room3") == NULL);
+  g_assert (empathy_chatroom_manager_find (mgr, test.account,
+        "new-room3") == chatroom);
+
+  /* the changes are saved when the manager goes away */
+  chatroom = empathy_chatroom_manager_find (mgr, test.account, "room0");
+  empathy_chatroom_manager_remove (mgr, chatroom);
+
+  chatroom = empathy_chatroom_manager_find (mgr, test.account, "room1");
+  empathy_chatroom_set_name (chatroom, "new-name1");
+
+  chatroom = empathy_chatroom_new_full (test.account, "not-a-favorite",
+      "not-a-favorite", FALSE);
+  g_assert (empathy_chatroom_manager_add (mgr, chatroom));
+  g_assert (!empathy_chatroom_manager_add (mgr, chatroom));
+  g_object_unref (chatroom);
+
+  g_object_unref (mgr);
+  mgr = dup_manager (&test);
+
+  chatrooms = empathy_chatroom_manager_get_chatrooms (mgr, test.account);
+  g_assert_cmpuint (g_list_length (chatrooms), ==, N_CHATROOMS - 1);
+  g_list_free (chatrooms);
+
+  g_assert (empathy_chatroom_manager_find (mgr, test.account,
+        "room0") == NULL);
+  g_assert (empathy_chatroom_manager_find (mgr, test.account,
+        "new-room3") != NULL);
+  g_assert (empathy_chatroom_manager_find (mgr, test.account,
+        "not-a-favorite") == NULL);
+  chatroom = empathy_chatroom_manager_find (mgr, test.account, "room1");
+  g_assert_cmpstr (empathy_chatroom_get_name (chatroom), ==, "new-name1");
+
+  /* when the file is changed by someone else, only the chatrooms which
+   * changed are updated */
+  room2 = empathy_chatroom_manager_find (mgr, test.account, "room2");
+
+  g_signal_connect (mgr, "chatroom-added",
+      G_CALLBACK (chatroom_added_cb), &test);
+  g_signal_connect (mgr, "chatroom-removed",
+      G_CALLBACK (chatroom_removed_cb), &test);
+
+  write_chatrooms_file (test.file, N_CHATROOMS);
+
+  timeout_id = g_timeout_add_seconds (10, reload_timeout_cb, NULL);
+  while (test.n_added < 2)
+    g_main_loop_run (test.loop);
+  g_source_remove (timeout_id);
+
+  /* room0 and room3 are back, new-room3 is gone */
+  g_assert_cmpuint (test.n_added, ==, 2);
+  g_assert_cmpuint (test.n_removed, ==, 1);
+  g_assert (empathy_chatroom_manager_find (mgr, test.account,
+        "new-room3") == NULL);
+  g_assert (empathy_chatroom_manager_find (mgr, test.account,
+        "room2") == room2);
+  chatroom = empathy_chatroom_manager_find (mgr, test.account, "room1");
+  g_assert_cmpstr (empathy_chatroom_get_name (chatroom), ==, "name1");
+
+  chatrooms = empathy_chatroom_manager_get_chatrooms (mgr, test.account);
+  g_assert_cmpuint (g_list_length (chatrooms), ==, N_CHATROOMS);
+  g_list_free (chatrooms);
+
+  g_object_unref (mgr);
+  g_object_unref (test.account);
+  g_object_unref (factory);
+  g_main_loop_unref (test.loop);
+  g_unlink (test.file);
+  g_free (test.file);
+}
+
 int
 main (int argc,
     char **argv)
@@ -383,6 +594,9 @@ main (int argc,
 
   test_init (argc, argv);
 
+  g_test_add_func ("/chatroom-manager/many",
+      test_empathy_chatroom_manager_many);
+
 #if 0
   g_test_add_func ("/chatroom-manager/dup-singleton",
       test_empathy_chatroom_manager_dup_singleton);
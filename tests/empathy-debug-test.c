@@ -0,0 +1,82 @@
+#include "config.h"
+
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define N_CALLS 1000000
+
+/* The arguments of DEBUG() only have to be evaluated when the message is
+ * formatted, so counting the evaluations tells whether it was */
+static guint n_evaluations = 0;
+
+static const gchar *
+payload (void)
+{
+  n_evaluations++;
+  return "string";
+}
+
+static void
+test_disabled_debug (void)
+{
+  guint i;
+  gdouble elapsed;
+
+  /* main() made sure EMPATHY_DEBUG doesn't enable it */
+  g_assert (!empathy_debug_is_active (DEBUG_FLAG));
+
+  /* The first call does the one-off debug sender lookup */
+  DEBUG ("warming up %d", 0);
+
+  n_evaluations = 0;
+  g_test_timer_start ();
+
+  for (i = 0; i < N_CALLS; i++)
+    DEBUG ("message %u with a %s payload", i, payload ());
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_assert_cmpuint (n_evaluations, ==, 0);
+
+  g_test_minimized_result (elapsed * 1e9 / N_CALLS,
+      "disabled DEBUG (): %.2f ns per call", elapsed * 1e9 / N_CALLS);
+}
+
+#ifdef ENABLE_DEBUG
+static void
+test_enabled_debug (void)
+{
+  /* Flags can't be unset, so this has to run after the disabled test */
+  empathy_debug_set_flags ("Tests");
+  g_assert (empathy_debug_is_active (DEBUG_FLAG));
+
+  n_evaluations = 0;
+  DEBUG ("message with a %s payload", payload ());
+
+  g_assert_cmpuint (n_evaluations, ==, 1);
+}
+#endif
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  /* the flags are read from the environment when initializing, and a
+   * developer's EMPATHY_DEBUG would enable the path we measure disabled */
+  g_unsetenv ("EMPATHY_DEBUG");
+  test_init (argc, argv);
+
+  g_test_add_func ("/debug/disabled-is-not-formatted", test_disabled_debug);
+#ifdef ENABLE_DEBUG
+  g_test_add_func ("/debug/enabled-is-formatted", test_enabled_debug);
+#endif
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
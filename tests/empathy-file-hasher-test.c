@@ -0,0 +1,453 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "test-helper.h"
+#include "empathy-file-hasher.h"
+#include "empathy-ft-handler.h"
+
+#define FILE_SIZE (32 * 1024 * 1024)
+#define PERF_FILE_SIZE (256 * 1024 * 1024)
+
+/* what the handler used to do */
+#define NAIVE_BUFFER_SIZE 4096
+
+static gchar *
+generate_file (gsize size,
+    gchar **expected_md5)
+{
+  GChecksum *checksum;
+  GRand *rand;
+  guint32 *chunk;
+  gchar *path;
+  gsize written = 0;
+  guint i;
+  gint fd;
+  FILE *f;
+
+  fd = g_file_open_tmp ("empathy-file-hasher-test-XXXXXX", &path, NULL);
+  g_assert (fd >= 0);
+  f = fdopen (fd, "w");
+  g_assert (f != NULL);
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  rand = g_rand_new_with_seed (42);
+  chunk = g_new (guint32, 64 * 1024 / sizeof (guint32));
+
+  while (written < size)
+    {
+      for (i = 0; i < 64 * 1024 / sizeof (guint32); i++)
+        chunk[i] = g_rand_int (rand);
+
+      g_assert_cmpuint (fwrite (chunk, 64 * 1024, 1, f), ==, 1);
+      g_checksum_update (checksum, (guchar *) chunk, 64 * 1024);
+      written += 64 * 1024;
+    }
+
+  fclose (f);
+
+  *expected_md5 = g_strdup (g_checksum_get_string (checksum));
+
+  g_free (chunk);
+  g_rand_free (rand);
+  g_checksum_free (checksum);
+
+  return path;
+}
+
+static void
+test_growing_file (void)
+{
+  EmpathyFileHasher *hasher;
+  GChecksum *checksum;
+  GFile *file;
+  gchar *path;
+  guchar data[100000];
+  guint i;
+  gint fd;
+
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = i * 7;
+
+  fd = g_file_open_tmp ("empathy-file-hasher-test-XXXXXX", &path, NULL);
+  g_assert (fd >= 0);
+  file = g_file_new_for_path (path);
+
+  hasher = empathy_file_hasher_new (G_CHECKSUM_SHA1);
+  g_assert (empathy_file_hasher_open (hasher, file, NULL, NULL));
+
+  /* hash the file while it's being written, the way incoming transfers
+   * are */
+  for (i = 0; i < sizeof (data); i += 30000)
+    {
+      gsize len = MIN (30000, sizeof (data) - i);
+
+      g_assert_cmpint (write (fd, data + i, len), ==, len);
+
+      while (empathy_file_hasher_read (hasher, NULL, NULL) > 0)
+        ;
+
+      g_assert_cmpuint (empathy_file_hasher_get_offset (hasher), ==, i + len);
+    }
+
+  close (fd);
+
+  g_assert (empathy_file_hasher_is_reading (hasher, file));
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
+  g_checksum_update (checksum, data, sizeof (data));
+  g_assert_cmpstr (empathy_file_hasher_get_string (hasher), ==,
+      g_checksum_get_string (checksum));
+
+  empathy_file_hasher_close (hasher);
+  g_assert (!empathy_file_hasher_is_reading (hasher, file));
+
+  g_checksum_free (checksum);
+  empathy_file_hasher_free (hasher);
+  g_unlink (path);
+  g_object_unref (file);
+  g_free (path);
+}
+
+static GChecksumType
+checksum_type (TpFileHashType type)
+{
+  switch (type)
+    {
+      case TP_FILE_HASH_TYPE_MD5:
+        return G_CHECKSUM_MD5;
+      case TP_FILE_HASH_TYPE_SHA1:
+        return G_CHECKSUM_SHA1;
+      case TP_FILE_HASH_TYPE_SHA256:
+        return G_CHECKSUM_SHA256;
+      default:
+        g_assert_not_reached ();
+    }
+
+  return G_CHECKSUM_MD5;
+}
+
+/* Hashes @file the way the outgoing handler does, with the digests for
+ * the best two of the @offered types */
+static GArray *
+hash_outgoing (const guint *offered,
+    GFile *file,
+    gsize size,
+    gchar **digests)
+{
+  EmpathyFileHasher *hasher;
+  GArray *types;
+  guint i;
+
+  types = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (i = 0; offered[i] != TP_FILE_HASH_TYPE_NONE; i++)
+    g_array_append_val (types, offered[i]);
+  empathy_ft_hash_types_rank (types, size);
+  g_assert_cmpuint (types->len, >, 0);
+
+  hasher = empathy_ft_hash_types_new_hasher (types);
+  g_assert (empathy_file_hasher_open (hasher, file, NULL, NULL));
+  while (empathy_file_hasher_read (hasher, NULL, NULL) > 0)
+    ;
+  g_assert_cmpuint (empathy_file_hasher_get_offset (hasher), ==, size);
+
+  empathy_ft_hash_types_get_digests (types, hasher, digests);
+
+  empathy_file_hasher_free (hasher);
+
+  return types;
+}
+
+/* Hashes the destination the way the incoming handler does: while it's
+ * being written, and never reading it twice */
+static gchar *
+hash_incoming (TpFileHashType type,
+    const guchar *data,
+    gsize size)
+{
+  EmpathyFileHasher *hasher;
+  GFile *file;
+  gchar *path, *digest;
+  gsize i;
+  gint fd;
+
+  fd = g_file_open_tmp ("empathy-file-hasher-test-XXXXXX", &path, NULL);
+  g_assert (fd >= 0);
+  file = g_file_new_for_path (path);
+
+  hasher = empathy_file_hasher_new (checksum_type (type));
+  g_assert (empathy_file_hasher_open (hasher, file, NULL, NULL));
+
+  for (i = 0; i < size; i += 4096)
+    {
+      gsize len = MIN (4096, size - i);
+
+      g_assert_cmpint (write (fd, data + i, len), ==, len);
+
+      while (empathy_file_hasher_read (hasher, NULL, NULL) > 0)
+        ;
+    }
+
+  close (fd);
+
+  g_assert_cmpuint (empathy_file_hasher_get_offset (hasher), ==, size);
+  g_assert (empathy_file_hasher_is_reading (hasher, file));
+  digest = g_strdup (empathy_file_hasher_get_string (hasher));
+
+  empathy_file_hasher_free (hasher);
+  g_unlink (path);
+  g_object_unref (file);
+  g_free (path);
+
+  return digest;
+}
+
+typedef struct
+{
+  const gchar *path;
+  /* terminated by TP_FILE_HASH_TYPE_NONE */
+  guint offered[4];
+  /* the only type the connection manager accepts in requests, or
+   * TP_FILE_HASH_TYPE_NONE if the transfer can't be requested */
+  TpFileHashType accepted;
+} TransferTest;
+
+static const TransferTest transfer_tests[] = {
+  { "/file-hasher/transfer/md5",
+    { TP_FILE_HASH_TYPE_MD5 },
+    TP_FILE_HASH_TYPE_MD5 },
+  { "/file-hasher/transfer/sha1",
+    { TP_FILE_HASH_TYPE_MD5, TP_FILE_HASH_TYPE_SHA1 },
+    TP_FILE_HASH_TYPE_SHA1 },
+  { "/file-hasher/transfer/sha256",
+    { TP_FILE_HASH_TYPE_MD5, TP_FILE_HASH_TYPE_SHA256,
+      TP_FILE_HASH_TYPE_SHA1 },
+    TP_FILE_HASH_TYPE_SHA256 },
+  /* SHA-256 is offered but refused; SHA-1 was computed in the same pass */
+  { "/file-hasher/transfer/fallback",
+    { TP_FILE_HASH_TYPE_SHA256, TP_FILE_HASH_TYPE_SHA1 },
+    TP_FILE_HASH_TYPE_SHA1 },
+  /* only the best two are computed, MD5 would need another pass */
+  { "/file-hasher/transfer/refused",
+    { TP_FILE_HASH_TYPE_SHA256, TP_FILE_HASH_TYPE_SHA1,
+      TP_FILE_HASH_TYPE_MD5 },
+    TP_FILE_HASH_TYPE_NONE },
+};
+
+static void
+test_transfer (gconstpointer user_data)
+{
+  const TransferTest *test = user_data;
+  gchar *digests[TP_NUM_FILE_HASH_TYPES] = { NULL, };
+  TpFileHashType type;
+  GChecksum *checksum;
+  guchar data[50000];
+  GArray *types;
+  GFile *file;
+  gchar *path, *received, *incoming;
+  guint i;
+
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = i * 13;
+
+  path = g_build_filename (g_get_tmp_dir (),
+      "empathy-file-hasher-test-source", NULL);
+  g_assert (g_file_set_contents (path, (gchar *) data, sizeof (data), NULL));
+  file = g_file_new_for_path (path);
+
+  types = hash_outgoing (test->offered, file, sizeof (data), digests);
+
+  /* request the channel with the best type, then with the ones the
+   * handler retries after each refusal */
+  type = g_array_index (types, guint, 0);
+  g_assert (digests[type] != NULL);
+
+  while (type != TP_FILE_HASH_TYPE_NONE && type != test->accepted)
+    type = empathy_ft_hash_types_get_next (types, type, digests);
+
+  g_assert_cmpuint (type, ==, test->accepted);
+
+  if (type == TP_FILE_HASH_TYPE_NONE)
+    goto out;
+
+  checksum = g_checksum_new (checksum_type (type));
+  g_checksum_update (checksum, data, sizeof (data));
+  g_assert_cmpstr (digests[type], ==, g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
+
+  /* some peers send upper case digests */
+  received = g_ascii_strup (digests[type], -1);
+  incoming = hash_incoming (type, data, sizeof (data));
+  g_assert (empathy_ft_hash_matches (incoming, received));
+  g_assert (empathy_ft_hash_matches (incoming, digests[type]));
+
+  /* and a corrupted file doesn't match */
+  data[sizeof (data) / 2]++;
+  g_free (incoming);
+  incoming = hash_incoming (type, data, sizeof (data));
+  g_assert (!empathy_ft_hash_matches (incoming, received));
+
+  g_free (incoming);
+  g_free (received);
+
+out:
+  for (i = 0; i < TP_NUM_FILE_HASH_TYPES; i++)
+    g_free (digests[i]);
+
+  g_array_unref (types);
+  g_unlink (path);
+  g_object_unref (file);
+  g_free (path);
+}
+
+static void
+test_rank (void)
+{
+  GArray *types;
+  guint offered[] = { TP_FILE_HASH_TYPE_MD5, TP_FILE_HASH_TYPE_NONE,
+      TP_FILE_HASH_TYPE_SHA256, 42, TP_FILE_HASH_TYPE_SHA1,
+      TP_FILE_HASH_TYPE_MD5 };
+
+  types = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  /* the strongest hash for a usual file */
+  g_array_append_vals (types, offered, G_N_ELEMENTS (offered));
+  empathy_ft_hash_types_rank (types, 10 * 1024 * 1024);
+  g_assert_cmpuint (types->len, ==, 3);
+  g_assert_cmpuint (g_array_index (types, guint, 0), ==,
+      TP_FILE_HASH_TYPE_SHA256);
+  g_assert_cmpuint (g_array_index (types, guint, 1), ==,
+      TP_FILE_HASH_TYPE_SHA1);
+  g_assert_cmpuint (g_array_index (types, guint, 2), ==,
+      TP_FILE_HASH_TYPE_MD5);
+
+  /* a cheaper one for a big file, but never MD5 if something else is
+   * offered */
+  g_array_set_size (types, 0);
+  g_array_append_vals (types, offered, G_N_ELEMENTS (offered));
+  empathy_ft_hash_types_rank (types, G_GUINT64_CONSTANT (4) << 30);
+  g_assert_cmpuint (types->len, ==, 3);
+  g_assert_cmpuint (g_array_index (types, guint, 0), ==,
+      TP_FILE_HASH_TYPE_SHA1);
+  g_assert_cmpuint (g_array_index (types, guint, 2), ==,
+      TP_FILE_HASH_TYPE_MD5);
+
+  g_array_unref (types);
+}
+
+static gdouble
+hash_naive (GFile *file,
+    gchar **md5)
+{
+  GFileInputStream *stream;
+  GChecksum *checksum;
+  guchar *buffer;
+  gssize bytes_read;
+
+  g_test_timer_start ();
+
+  stream = g_file_read (file, NULL, NULL);
+  g_assert (stream != NULL);
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+
+  do
+    {
+      buffer = g_malloc0 (NAIVE_BUFFER_SIZE);
+      bytes_read = g_input_stream_read (G_INPUT_STREAM (stream), buffer,
+          NAIVE_BUFFER_SIZE, NULL, NULL);
+      g_assert (bytes_read >= 0);
+      g_checksum_update (checksum, buffer, bytes_read);
+      g_free (buffer);
+    }
+  while (bytes_read > 0);
+
+  *md5 = g_strdup (g_checksum_get_string (checksum));
+
+  g_checksum_free (checksum);
+  g_object_unref (stream);
+
+  return g_test_timer_elapsed ();
+}
+
+static gdouble
+hash_with_hasher (GFile *file,
+    gchar **md5)
+{
+  EmpathyFileHasher *hasher;
+  gssize bytes_read;
+
+  g_test_timer_start ();
+
+  hasher = empathy_file_hasher_new (G_CHECKSUM_MD5);
+  g_assert (empathy_file_hasher_open (hasher, file, NULL, NULL));
+
+  do
+    bytes_read = empathy_file_hasher_read (hasher, NULL, NULL);
+  while (bytes_read > 0);
+
+  g_assert_cmpint (bytes_read, ==, 0);
+
+  *md5 = g_strdup (empathy_file_hasher_get_string (hasher));
+  empathy_file_hasher_free (hasher);
+
+  return g_test_timer_elapsed ();
+}
+
+static void
+test_throughput (void)
+{
+  gsize size = g_test_perf () ? PERF_FILE_SIZE : FILE_SIZE;
+  gchar *path, *expected, *md5;
+  gdouble naive, elapsed, mb;
+  GFile *file;
+
+  path = generate_file (size, &expected);
+  file = g_file_new_for_path (path);
+  mb = (gdouble) size / (1024 * 1024);
+
+  /* the file was just written so it's in the page cache for both; this
+   * measures the per-chunk overhead rather than the disk */
+  naive = hash_naive (file, &md5);
+  g_assert_cmpstr (md5, ==, expected);
+  g_free (md5);
+
+  elapsed = hash_with_hasher (file, &md5);
+  g_assert_cmpstr (md5, ==, expected);
+  g_free (md5);
+
+  g_test_message ("%u KiB chunks: %.1f MB/s", NAIVE_BUFFER_SIZE / 1024,
+      mb / naive);
+  g_test_maximized_result (mb / elapsed, "EmpathyFileHasher: %.1f MB/s",
+      mb / elapsed);
+
+  g_unlink (path);
+  g_object_unref (file);
+  g_free (expected);
+  g_free (path);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+  guint i;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/file-hasher/growing-file", test_growing_file);
+  g_test_add_func ("/file-hasher/rank", test_rank);
+
+  for (i = 0; i < G_N_ELEMENTS (transfer_tests); i++)
+    g_test_add_data_func (transfer_tests[i].path, &transfer_tests[i],
+        test_transfer);
+
+  g_test_add_func ("/file-hasher/throughput", test_throughput);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
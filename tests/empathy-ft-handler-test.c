@@ -0,0 +1,500 @@
+#include "config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "empathy-ft-handler.h"
+#include "test-ft-connection.h"
+#include "test-helper.h"
+#include "test-roster.h"
+
+/* a few chunks of the hasher, the last one partial */
+#define FILE_SIZE (2 * 1024 * 1024 + 12345)
+
+static TestRoster *roster;
+
+typedef struct
+{
+  GMainLoop *loop;
+  gchar *dir;
+  GBytes *contents;
+  /* of contents, indexed by TpFileHashType */
+  gchar *digests[TP_NUM_FILE_HASH_TYPES];
+
+  TpConnection *connection;
+  EmpathyContact *contact;
+  TestFTDispatcher *dispatcher;
+
+  /* incoming only */
+  TestFTChannel *chan;
+  TpChannel *channel;
+
+  EmpathyFTHandler *handler;
+  gboolean transfer_done;
+  gboolean hashing_started;
+  gboolean hashing_done;
+  GError *error;
+} Test;
+
+static GChecksumType
+checksum_type (TpFileHashType type)
+{
+  switch (type)
+    {
+      case TP_FILE_HASH_TYPE_MD5:
+        return G_CHECKSUM_MD5;
+      case TP_FILE_HASH_TYPE_SHA1:
+        return G_CHECKSUM_SHA1;
+      case TP_FILE_HASH_TYPE_SHA256:
+        return G_CHECKSUM_SHA256;
+      default:
+        g_assert_not_reached ();
+    }
+
+  return G_CHECKSUM_MD5;
+}
+
+static void
+proxy_prepared_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+  GError *error = NULL;
+
+  tp_proxy_prepare_finish (source, result, &error);
+  g_assert_no_error (error);
+
+  g_main_loop_quit (test->loop);
+}
+
+static void
+contact_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+  TpContact *contact;
+  GError *error = NULL;
+
+  contact = tp_connection_dup_contact_by_id_finish (TP_CONNECTION (source),
+      result, &error);
+  g_assert_no_error (error);
+
+  test->contact = empathy_contact_dup_from_tp_contact (contact);
+  g_object_unref (contact);
+
+  g_main_loop_quit (test->loop);
+}
+
+static void
+setup (Test *test,
+    gconstpointer data)
+{
+  GQuark features[] = { TP_CONNECTION_FEATURE_CONNECTED,
+      TP_CONNECTION_FEATURE_CAPABILITIES, 0 };
+  TpAccountManager *manager;
+  TpDBusDaemon *dbus;
+  TpAccount *account;
+  GList *accounts;
+  guchar *contents;
+  GError *error = NULL;
+  gchar *id;
+  guint i;
+
+  test->loop = g_main_loop_new (NULL, FALSE);
+
+  test->dir = g_dir_make_tmp ("empathy-ft-handler-test-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  contents = g_malloc (FILE_SIZE);
+  for (i = 0; i < FILE_SIZE; i++)
+    contents[i] = i * 13;
+  test->contents = g_bytes_new_take (contents, FILE_SIZE);
+
+  for (i = TP_FILE_HASH_TYPE_MD5; i <= TP_FILE_HASH_TYPE_SHA256; i++)
+    test->digests[i] = g_compute_checksum_for_bytes (checksum_type (i),
+        test->contents);
+
+  dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+  test->dispatcher = test_ft_dispatcher_new (dbus);
+  g_object_unref (dbus);
+
+  manager = tp_account_manager_dup ();
+  tp_proxy_prepare_async (manager, NULL, proxy_prepared_cb, test);
+  g_main_loop_run (test->loop);
+
+  accounts = tp_account_manager_dup_valid_accounts (manager);
+  g_assert_cmpuint (g_list_length (accounts), ==, 1);
+  account = accounts->data;
+
+  /* the roster connected it before the account manager was prepared */
+  while (tp_account_get_connection (account) == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  test->connection = g_object_ref (tp_account_get_connection (account));
+  tp_proxy_prepare_async (test->connection, features, proxy_prepared_cb,
+      test);
+  g_main_loop_run (test->loop);
+
+  id = test_roster_dup_contact_id (0, 0);
+  tp_connection_dup_contact_by_id_async (test->connection, id, 0, NULL,
+      contact_cb, test);
+  g_main_loop_run (test->loop);
+  g_free (id);
+
+  g_list_free_full (accounts, g_object_unref);
+  g_object_unref (manager);
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data)
+{
+  guint i;
+
+  tp_clear_object (&test->handler);
+  tp_clear_object (&test->channel);
+  tp_clear_object (&test->chan);
+  g_clear_error (&test->error);
+
+  g_object_unref (test->contact);
+  g_object_unref (test->connection);
+  g_object_unref (test->dispatcher);
+
+  for (i = 0; i < TP_NUM_FILE_HASH_TYPES; i++)
+    g_free (test->digests[i]);
+
+  g_bytes_unref (test->contents);
+  remove_dir (test->dir);
+  g_free (test->dir);
+  g_main_loop_unref (test->loop);
+}
+
+static void
+handler_ready_cb (EmpathyFTHandler *handler,
+    GError *error,
+    gpointer user_data)
+{
+  Test *test = user_data;
+
+  g_assert_no_error (error);
+  test->handler = g_object_ref (handler);
+
+  g_main_loop_quit (test->loop);
+}
+
+static void
+transfer_done_cb (EmpathyFTHandler *handler,
+    TpFileTransferChannel *channel,
+    Test *test)
+{
+  test->transfer_done = TRUE;
+
+  /* otherwise the file is checked first */
+  if (!empathy_ft_handler_get_use_hash (handler))
+    g_main_loop_quit (test->loop);
+}
+
+static void
+transfer_error_cb (EmpathyFTHandler *handler,
+    GError *error,
+    Test *test)
+{
+  /* the last signal of the handler */
+  g_assert (test->error == NULL);
+  test->error = g_error_copy (error);
+
+  g_main_loop_quit (test->loop);
+}
+
+static void
+hashing_started_cb (EmpathyFTHandler *handler,
+    Test *test)
+{
+  test->hashing_started = TRUE;
+}
+
+static void
+hashing_done_cb (EmpathyFTHandler *handler,
+    Test *test)
+{
+  test->hashing_done = TRUE;
+
+  /* the outgoing ones go on with the request */
+  if (empathy_ft_handler_is_incoming (handler))
+    g_main_loop_quit (test->loop);
+}
+
+/* Starts the handler and waits for its last signal */
+static void
+run_handler (Test *test)
+{
+  g_signal_connect (test->handler, "transfer-done",
+      G_CALLBACK (transfer_done_cb), test);
+  g_signal_connect (test->handler, "transfer-error",
+      G_CALLBACK (transfer_error_cb), test);
+  g_signal_connect (test->handler, "hashing-started",
+      G_CALLBACK (hashing_started_cb), test);
+  g_signal_connect (test->handler, "hashing-done",
+      G_CALLBACK (hashing_done_cb), test);
+
+  empathy_ft_handler_start_transfer (test->handler);
+  g_main_loop_run (test->loop);
+}
+
+typedef struct
+{
+  const gchar *path;
+  /* what the dispatcher refuses the requests with, in order; the next
+   * ones are refused with TP_ERROR_NOT_AVAILABLE */
+  guint n_failures;
+  TpError failures[2];
+  /* the hash types of the requests the handler makes */
+  guint n_requests;
+  TpFileHashType requests[2];
+  /* what the transfer fails with in the end */
+  TpError error;
+} RetryTest;
+
+/* the connection offers all the types, and the handler prefers SHA-256
+ * for a file of this size */
+static const RetryTest retry_tests[] = {
+  { "/ft-handler/retry/invalid-argument",
+    1, { TP_ERROR_INVALID_ARGUMENT },
+    2, { TP_FILE_HASH_TYPE_SHA256, TP_FILE_HASH_TYPE_SHA1 },
+    TP_ERROR_NOT_AVAILABLE },
+  { "/ft-handler/retry/not-implemented",
+    1, { TP_ERROR_NOT_IMPLEMENTED },
+    2, { TP_FILE_HASH_TYPE_SHA256, TP_FILE_HASH_TYPE_SHA1 },
+    TP_ERROR_NOT_AVAILABLE },
+  /* these aren't about the hash type */
+  { "/ft-handler/retry/not-available",
+    0, { 0 },
+    1, { TP_FILE_HASH_TYPE_SHA256 },
+    TP_ERROR_NOT_AVAILABLE },
+  { "/ft-handler/retry/permission-denied",
+    1, { TP_ERROR_PERMISSION_DENIED },
+    1, { TP_FILE_HASH_TYPE_SHA256 },
+    TP_ERROR_PERMISSION_DENIED },
+  /* only the best two types are computed, MD5 would need another pass */
+  { "/ft-handler/retry/all-refused",
+    2, { TP_ERROR_INVALID_ARGUMENT, TP_ERROR_NOT_IMPLEMENTED },
+    2, { TP_FILE_HASH_TYPE_SHA256, TP_FILE_HASH_TYPE_SHA1 },
+    TP_ERROR_NOT_IMPLEMENTED },
+};
+
+static void
+test_retry (Test *test,
+    gconstpointer data)
+{
+  const RetryTest *retry = data;
+  GPtrArray *requests;
+  GFile *file;
+  gchar *path;
+  GError *error = NULL;
+  guint i;
+
+  path = g_build_filename (test->dir, "outgoing", NULL);
+  g_file_set_contents (path, g_bytes_get_data (test->contents, NULL),
+      g_bytes_get_size (test->contents), &error);
+  g_assert_no_error (error);
+  file = g_file_new_for_path (path);
+
+  for (i = 0; i < retry->n_failures; i++)
+    test_ft_dispatcher_add_failure (test->dispatcher, retry->failures[i]);
+
+  empathy_ft_handler_new_outgoing (test->contact, file,
+      TP_USER_ACTION_TIME_NOT_USER_ACTION, handler_ready_cb, test);
+  g_main_loop_run (test->loop);
+  g_assert (empathy_ft_handler_get_use_hash (test->handler));
+
+  run_handler (test);
+
+  g_assert_error (test->error, TP_ERROR, retry->error);
+  g_assert (test->hashing_done);
+  g_assert (!test->transfer_done);
+
+  /* each request announces the file with the next type */
+  requests = test_ft_dispatcher_get_requests (test->dispatcher);
+  g_assert_cmpuint (requests->len, ==, retry->n_requests);
+
+  for (i = 0; i < requests->len; i++)
+    {
+      GHashTable *request = g_ptr_array_index (requests, i);
+      TpFileHashType type = retry->requests[i];
+
+      g_assert_cmpstr (tp_asv_get_string (request,
+            TP_PROP_CHANNEL_CHANNEL_TYPE), ==,
+          TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER);
+      g_assert_cmpuint (tp_asv_get_uint64 (request,
+            TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_SIZE, NULL), ==, FILE_SIZE);
+      g_assert_cmpuint (tp_asv_get_uint32 (request,
+            TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_CONTENT_HASH_TYPE, NULL), ==,
+          type);
+      g_assert_cmpstr (tp_asv_get_string (request,
+            TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_CONTENT_HASH), ==,
+          test->digests[type]);
+    }
+
+  g_object_unref (file);
+  g_free (path);
+}
+
+typedef enum
+{
+  HASH_SAME,
+  /* some peers send upper case digests */
+  HASH_UPPER_CASE,
+  /* the digest of other data */
+  HASH_OTHER,
+  HASH_NONE
+} HashKind;
+
+typedef struct
+{
+  const gchar *path;
+  TpFileHashType type;
+  HashKind hash;
+} IncomingTest;
+
+static const IncomingTest incoming_tests[] = {
+  { "/ft-handler/incoming/hash-matches",
+    TP_FILE_HASH_TYPE_SHA256, HASH_SAME },
+  { "/ft-handler/incoming/hash-upper-case",
+    TP_FILE_HASH_TYPE_MD5, HASH_UPPER_CASE },
+  { "/ft-handler/incoming/hash-mismatch",
+    TP_FILE_HASH_TYPE_SHA1, HASH_OTHER },
+  /* the type alone doesn't make the file checked */
+  { "/ft-handler/incoming/no-hash",
+    TP_FILE_HASH_TYPE_SHA1, HASH_NONE },
+};
+
+static void
+test_incoming (Test *test,
+    gconstpointer data)
+{
+  const IncomingTest *incoming = data;
+  GQuark features[] = { TP_CHANNEL_FEATURE_CONTACTS,
+      TP_FILE_TRANSFER_CHANNEL_FEATURE_CORE, 0 };
+  GHashTable *properties;
+  GFile *file;
+  gchar *id, *hash, *path, *received;
+  gsize size;
+  GError *error = NULL;
+
+  switch (incoming->hash)
+    {
+      case HASH_SAME:
+        hash = g_strdup (test->digests[incoming->type]);
+        break;
+      case HASH_UPPER_CASE:
+        hash = g_ascii_strup (test->digests[incoming->type], -1);
+        break;
+      case HASH_OTHER:
+        hash = g_compute_checksum_for_string (
+            checksum_type (incoming->type), "something else", -1);
+        break;
+      default:
+        hash = NULL;
+        break;
+    }
+
+  id = test_roster_dup_contact_id (0, 0);
+  test->chan = test_ft_channel_new_incoming (
+      TEST_FT_CONNECTION (test_roster_get_connection (roster, 0)), id,
+      "incoming", test->contents, incoming->type, hash);
+  g_free (id);
+  g_free (hash);
+
+  properties = test_ft_channel_dup_immutable_properties (test->chan);
+  test->channel = tp_simple_client_factory_ensure_channel (
+      tp_proxy_get_factory (test->connection), test->connection,
+      tp_base_channel_get_object_path (TP_BASE_CHANNEL (test->chan)),
+      properties, &error);
+  g_assert_no_error (error);
+  g_assert (TP_IS_FILE_TRANSFER_CHANNEL (test->channel));
+  g_hash_table_unref (properties);
+
+  tp_proxy_prepare_async (test->channel, features, proxy_prepared_cb, test);
+  g_main_loop_run (test->loop);
+
+  empathy_ft_handler_new_incoming (TP_FILE_TRANSFER_CHANNEL (test->channel),
+      handler_ready_cb, test);
+  g_main_loop_run (test->loop);
+
+  path = g_build_filename (test->dir, "incoming", NULL);
+  file = g_file_new_for_path (path);
+  empathy_ft_handler_incoming_set_destination (test->handler, file);
+
+  run_handler (test);
+
+  g_assert (test->transfer_done);
+
+  if (incoming->hash == HASH_NONE)
+    {
+      g_assert_no_error (test->error);
+      g_assert (!test->hashing_started);
+      g_assert (!test->hashing_done);
+    }
+  else if (incoming->hash == HASH_OTHER)
+    {
+      g_assert_error (test->error, EMPATHY_FT_ERROR_QUARK,
+          EMPATHY_FT_ERROR_HASH_MISMATCH);
+      g_assert (test->hashing_started);
+      g_assert (!test->hashing_done);
+    }
+  else
+    {
+      g_assert_no_error (test->error);
+      g_assert (test->hashing_started);
+      g_assert (test->hashing_done);
+    }
+
+  /* it was checked once it was all written, which the handler doesn't
+   * wait for otherwise */
+  if (test->hashing_started)
+    {
+      g_file_get_contents (path, &received, &size, &error);
+      g_assert_no_error (error);
+      g_assert_cmpuint (size, ==, FILE_SIZE);
+      g_assert (memcmp (received, g_bytes_get_data (test->contents, NULL),
+            FILE_SIZE) == 0);
+      g_free (received);
+    }
+
+  g_object_unref (file);
+  g_free (path);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+  guint i;
+
+  roster = test_roster_new (42);
+  test_init (argc, argv);
+
+  /* the account manager looks for services which aren't on the private
+   * bus */
+  g_log_set_always_fatal (G_LOG_FATAL_MASK | G_LOG_LEVEL_CRITICAL);
+
+  test_roster_add_account_with_type (roster, TEST_TYPE_FT_CONNECTION, 1, 0);
+
+  for (i = 0; i < G_N_ELEMENTS (retry_tests); i++)
+    g_test_add (retry_tests[i].path, Test, &retry_tests[i],
+        setup, test_retry, teardown);
+
+  for (i = 0; i < G_N_ELEMENTS (incoming_tests); i++)
+    g_test_add (incoming_tests[i].path, Test, &incoming_tests[i],
+        setup, test_incoming, teardown);
+
+  result = g_test_run ();
+  test_deinit ();
+  test_roster_free (roster);
+
+  return result;
+}
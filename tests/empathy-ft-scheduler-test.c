@@ -0,0 +1,431 @@
+#include "config.h"
+
+#include "test-helper.h"
+#include "empathy-ft-scheduler.h"
+
+/* number of chunks the mock channel sends its file in */
+#define N_CHUNKS 4
+
+#define ACCOUNT_PATH TP_ACCOUNT_OBJECT_PATH_BASE "mock/mock/account0"
+#define OTHER_ACCOUNT_PATH TP_ACCOUNT_OBJECT_PATH_BASE "mock/mock/account1"
+
+typedef struct {
+  EmpathyFTScheduler *scheduler;
+  GMainLoop *loop;
+
+  /* the transfers' sizes, in the order they started */
+  GArray *started;
+
+  guint n_active;
+  guint max_active_seen;
+  /* account path and contact id => number of running transfers */
+  GHashTable *active_per_contact;
+  guint max_active_per_contact_seen;
+
+  guint n_finished;
+  guint n_expected;
+} Test;
+
+/* Stands in for a file transfer channel, sending its file by chunks from
+ * the main loop */
+typedef struct {
+  Test *test;
+  gchar *contact_key;
+  guint64 size;
+  guint64 sent;
+  guint id;
+} MockChannel;
+
+static void
+test_setup (Test *test)
+{
+  test->scheduler = empathy_ft_scheduler_new ();
+  test->loop = g_main_loop_new (NULL, FALSE);
+  test->started = g_array_new (FALSE, FALSE, sizeof (guint64));
+  test->active_per_contact = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+}
+
+static void
+test_teardown (Test *test)
+{
+  g_object_unref (test->scheduler);
+  g_main_loop_unref (test->loop);
+  g_array_unref (test->started);
+  g_hash_table_unref (test->active_per_contact);
+}
+
+static void
+mock_channel_free (MockChannel *channel)
+{
+  g_free (channel->contact_key);
+  g_slice_free (MockChannel, channel);
+}
+
+static gboolean
+mock_channel_send_cb (gpointer user_data)
+{
+  MockChannel *channel = user_data;
+  Test *test = channel->test;
+  guint n;
+
+  channel->sent = MIN (channel->size,
+      channel->sent + MAX (channel->size / N_CHUNKS, 1));
+  empathy_ft_scheduler_progress (test->scheduler, channel->id,
+      channel->sent);
+
+  if (channel->sent < channel->size)
+    return TRUE;
+
+  test->n_active--;
+  n = GPOINTER_TO_UINT (g_hash_table_lookup (test->active_per_contact,
+        channel->contact_key));
+  g_hash_table_insert (test->active_per_contact,
+      g_strdup (channel->contact_key), GUINT_TO_POINTER (n - 1));
+
+  /* frees channel */
+  empathy_ft_scheduler_finished (test->scheduler, channel->id);
+
+  test->n_finished++;
+  if (test->n_finished == test->n_expected)
+    g_main_loop_quit (test->loop);
+
+  return FALSE;
+}
+
+static void
+mock_channel_start (EmpathyFTScheduler *scheduler,
+    guint id,
+    gpointer user_data)
+{
+  MockChannel *channel = user_data;
+  Test *test = channel->test;
+  guint n;
+
+  g_assert_cmpuint (id, ==, channel->id);
+  g_assert (!empathy_ft_scheduler_is_queued (scheduler, id));
+
+  g_array_append_val (test->started, channel->size);
+
+  test->n_active++;
+  test->max_active_seen = MAX (test->max_active_seen, test->n_active);
+
+  n = GPOINTER_TO_UINT (g_hash_table_lookup (test->active_per_contact,
+        channel->contact_key)) + 1;
+  g_hash_table_insert (test->active_per_contact,
+      g_strdup (channel->contact_key), GUINT_TO_POINTER (n));
+  test->max_active_per_contact_seen = MAX (
+      test->max_active_per_contact_seen, n);
+
+  g_timeout_add (1, mock_channel_send_cb, channel);
+}
+
+static guint
+add_transfer_full (Test *test,
+    const gchar *account_path,
+    const gchar *contact_id,
+    guint64 size,
+    guint batch)
+{
+  MockChannel *channel;
+
+  channel = g_slice_new0 (MockChannel);
+  channel->test = test;
+  channel->contact_key = g_strdup_printf ("%s %s", account_path, contact_id);
+  channel->size = size;
+  channel->id = empathy_ft_scheduler_add (test->scheduler, account_path,
+      contact_id, size, batch, mock_channel_start, channel,
+      (GDestroyNotify) mock_channel_free);
+
+  test->n_expected++;
+
+  return channel->id;
+}
+
+static guint
+add_transfer (Test *test,
+    const gchar *contact_id,
+    guint64 size)
+{
+  return add_transfer_full (test, ACCOUNT_PATH, contact_id, size, 0);
+}
+
+static void
+test_limits (void)
+{
+  Test test = { NULL, };
+
+  test_setup (&test);
+
+  g_object_set (test.scheduler,
+      "max-active", 3,
+      "max-active-per-contact", 2,
+      NULL);
+
+  add_transfer (&test, "alice", 100);
+  add_transfer (&test, "alice", 100);
+  add_transfer (&test, "alice", 100);
+  add_transfer (&test, "alice", 100);
+  add_transfer (&test, "bob", 100);
+  add_transfer (&test, "bob", 100);
+  add_transfer (&test, "bob", 100);
+  add_transfer (&test, "carol", 100);
+
+  /* nothing starts before the main loop runs */
+  g_assert_cmpuint (test.started->len, ==, 0);
+
+  g_main_loop_run (test.loop);
+
+  g_assert_cmpuint (test.started->len, ==, 8);
+  g_assert_cmpuint (test.n_active, ==, 0);
+  g_assert_cmpuint (test.max_active_seen, ==, 3);
+  g_assert_cmpuint (test.max_active_per_contact_seen, ==, 2);
+
+  test_teardown (&test);
+}
+
+typedef struct {
+  const gchar *path;
+  gboolean smallest_first;
+  guint64 expected[3];
+} OrderTest;
+
+static const OrderTest order_tests[] = {
+  { "/ft-scheduler/order/fifo", FALSE, { 300, 100, 200 } },
+  { "/ft-scheduler/order/smallest-first", TRUE, { 100, 200, 300 } },
+};
+
+static void
+test_order (gconstpointer user_data)
+{
+  const OrderTest *order_test = user_data;
+  Test test = { NULL, };
+  guint i;
+
+  test_setup (&test);
+
+  g_object_set (test.scheduler,
+      "max-active", 1,
+      "smallest-first", order_test->smallest_first,
+      NULL);
+
+  add_transfer (&test, "alice", 300);
+  add_transfer (&test, "bob", 100);
+  add_transfer (&test, "carol", 200);
+
+  g_main_loop_run (test.loop);
+
+  g_assert_cmpuint (test.started->len, ==, 3);
+  for (i = 0; i < 3; i++)
+    g_assert_cmpuint (g_array_index (test.started, guint64, i), ==,
+        order_test->expected[i]);
+
+  test_teardown (&test);
+}
+
+static void
+test_pause (void)
+{
+  Test test = { NULL, };
+  guint paused, removed;
+
+  test_setup (&test);
+
+  g_object_set (test.scheduler, "max-active", 1, NULL);
+
+  add_transfer (&test, "alice", 100);
+  paused = add_transfer (&test, "alice", 200);
+  add_transfer (&test, "alice", 300);
+  removed = add_transfer (&test, "alice", 400);
+
+  g_assert (empathy_ft_scheduler_pause (test.scheduler, paused));
+  g_assert (empathy_ft_scheduler_remove (test.scheduler, removed));
+  g_assert (!empathy_ft_scheduler_is_queued (test.scheduler, removed));
+  test.n_expected -= 2;
+
+  /* the paused transfer is skipped */
+  g_main_loop_run (test.loop);
+
+  g_assert_cmpuint (test.started->len, ==, 2);
+  g_assert_cmpuint (g_array_index (test.started, guint64, 0), ==, 100);
+  g_assert_cmpuint (g_array_index (test.started, guint64, 1), ==, 300);
+  g_assert (empathy_ft_scheduler_is_queued (test.scheduler, paused));
+
+  test.n_expected++;
+  empathy_ft_scheduler_resume (test.scheduler, paused);
+  g_main_loop_run (test.loop);
+
+  g_assert_cmpuint (test.started->len, ==, 3);
+  g_assert_cmpuint (g_array_index (test.started, guint64, 2), ==, 200);
+
+  /* finished transfers can't be paused or removed */
+  g_assert (!empathy_ft_scheduler_pause (test.scheduler, paused));
+  g_assert (!empathy_ft_scheduler_remove (test.scheduler, paused));
+
+  test_teardown (&test);
+}
+
+/* the same id on two accounts is two different contacts */
+static void
+test_accounts (void)
+{
+  Test test = { NULL, };
+
+  test_setup (&test);
+
+  g_object_set (test.scheduler,
+      "max-active", 0,
+      "max-active-per-contact", 1,
+      NULL);
+
+  add_transfer (&test, "alice", 100);
+  add_transfer (&test, "alice", 100);
+  add_transfer_full (&test, OTHER_ACCOUNT_PATH, "alice", 100, 0);
+
+  g_main_loop_run (test.loop);
+
+  g_assert_cmpuint (test.started->len, ==, 3);
+  g_assert_cmpuint (test.max_active_seen, ==, 2);
+  g_assert_cmpuint (test.max_active_per_contact_seen, ==, 1);
+
+  test_teardown (&test);
+}
+
+typedef struct {
+  guint batch;
+  guint64 last_transferred;
+  guint64 last_total;
+  guint n_progress;
+  gboolean done;
+} BatchTest;
+
+static void
+batch_progress_cb (EmpathyFTScheduler *scheduler,
+    guint batch,
+    guint64 transferred_bytes,
+    guint64 total_bytes,
+    BatchTest *batch_test)
+{
+  g_assert_cmpuint (batch, ==, batch_test->batch);
+  g_assert (!batch_test->done);
+  g_assert_cmpuint (transferred_bytes, >=, batch_test->last_transferred);
+  g_assert_cmpuint (transferred_bytes, <=, total_bytes);
+
+  batch_test->last_transferred = transferred_bytes;
+  batch_test->last_total = total_bytes;
+  batch_test->n_progress++;
+}
+
+static void
+batch_done_cb (EmpathyFTScheduler *scheduler,
+    guint batch,
+    BatchTest *batch_test)
+{
+  g_assert_cmpuint (batch, ==, batch_test->batch);
+  g_assert (!batch_test->done);
+
+  batch_test->done = TRUE;
+}
+
+/* transfers join their batch as they become ready, so it has to survive
+ * the ones finishing before the others are added */
+static void
+test_batch (void)
+{
+  Test test = { NULL, };
+  BatchTest batch_test = { 0, };
+  guint64 transferred, total;
+  guint removed;
+
+  test_setup (&test);
+
+  g_object_set (test.scheduler, "max-active", 2, NULL);
+
+  g_signal_connect (test.scheduler, "batch-progress",
+      G_CALLBACK (batch_progress_cb), &batch_test);
+  g_signal_connect (test.scheduler, "batch-done",
+      G_CALLBACK (batch_done_cb), &batch_test);
+
+  batch_test.batch = empathy_ft_scheduler_new_batch (test.scheduler);
+
+  add_transfer_full (&test, ACCOUNT_PATH, "alice", 1000, batch_test.batch);
+
+  g_assert (empathy_ft_scheduler_get_batch_progress (test.scheduler,
+        batch_test.batch, &transferred, &total));
+  g_assert_cmpuint (transferred, ==, 0);
+  g_assert_cmpuint (total, ==, 1000);
+
+  g_main_loop_run (test.loop);
+
+  /* still open */
+  g_assert (!batch_test.done);
+  g_assert_cmpuint (batch_test.n_progress, >=, N_CHUNKS);
+  g_assert (empathy_ft_scheduler_get_batch_progress (test.scheduler,
+        batch_test.batch, &transferred, &total));
+  g_assert_cmpuint (transferred, ==, 1000);
+  g_assert_cmpuint (total, ==, 1000);
+
+  add_transfer_full (&test, ACCOUNT_PATH, "alice", 2000, batch_test.batch);
+  add_transfer_full (&test, ACCOUNT_PATH, "bob", 3000, batch_test.batch);
+  removed = add_transfer_full (&test, ACCOUNT_PATH, "carol", 4000,
+      batch_test.batch);
+  /* not part of the batch */
+  add_transfer (&test, "bob", 5000);
+
+  g_assert (empathy_ft_scheduler_get_batch_progress (test.scheduler,
+        batch_test.batch, &transferred, &total));
+  g_assert_cmpuint (transferred, ==, 1000);
+  g_assert_cmpuint (total, ==, 10000);
+
+  /* removing a transfer takes it out of the totals */
+  g_assert (empathy_ft_scheduler_remove (test.scheduler, removed));
+  test.n_expected--;
+  g_assert_cmpuint (batch_test.last_transferred, ==, 1000);
+  g_assert_cmpuint (batch_test.last_total, ==, 6000);
+
+  empathy_ft_scheduler_close_batch (test.scheduler, batch_test.batch);
+  g_assert (!batch_test.done);
+
+  g_main_loop_run (test.loop);
+
+  g_assert (batch_test.done);
+  g_assert_cmpuint (batch_test.last_transferred, ==, 6000);
+  g_assert_cmpuint (batch_test.last_total, ==, 6000);
+  g_assert_cmpuint (batch_test.n_progress, >=, 3 * N_CHUNKS);
+
+  /* forgotten once done */
+  g_assert (!empathy_ft_scheduler_get_batch_progress (test.scheduler,
+        batch_test.batch, NULL, NULL));
+
+  /* a batch whose transfers all are finished is done when closed */
+  batch_test.batch = empathy_ft_scheduler_new_batch (test.scheduler);
+  batch_test.done = FALSE;
+  empathy_ft_scheduler_close_batch (test.scheduler, batch_test.batch);
+  g_assert (batch_test.done);
+
+  test_teardown (&test);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+  guint i;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/ft-scheduler/limits", test_limits);
+
+  for (i = 0; i < G_N_ELEMENTS (order_tests); i++)
+    g_test_add_data_func (order_tests[i].path, &order_tests[i], test_order);
+
+  g_test_add_func ("/ft-scheduler/pause", test_pause);
+  g_test_add_func ("/ft-scheduler/accounts", test_accounts);
+  g_test_add_func ("/ft-scheduler/batch", test_batch);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
@@ -0,0 +1,431 @@
+#include "config.h"
+
+#include <telepathy-logger/telepathy-logger.h>
+
+#include "test-helper.h"
+#include "test-log-store.h"
+#include "empathy-account-chooser.h"
+#include "empathy-log-index.h"
+
+/* Quick sizes by default, so the benchmarks are also tests; realistic
+ * ones with "-m perf", which is what the timings should be tracked with */
+typedef struct {
+  /* with the contact whose logs are loaded */
+  guint n_days;
+  guint n_messages;
+  /* other contacts, each with a month of logs */
+  guint n_contacts;
+  /* other accounts, each with one contact */
+  guint n_accounts;
+} Sizes;
+
+static const Sizes quick_sizes = { 30, 20, 5, 3 };
+static const Sizes perf_sizes = { 365, 100, 50, 20 };
+
+#define ACCOUNT_PATH TP_ACCOUNT_OBJECT_PATH_BASE "gabble/jabber/me0"
+#define CONTACT_ID "alice@example.com"
+#define ROOM_ID "room@conference.example.com"
+/* an account without logs */
+#define EMPTY_ACCOUNT_PATH TP_ACCOUNT_OBJECT_PATH_BASE "gabble/jabber/empty"
+
+/* Days of events fetched at the same time, like the log window does */
+#define MAX_RUNNING_FETCHES 4
+
+static TestLogStore *store = NULL;
+static const Sizes *sizes = NULL;
+
+typedef struct {
+  GMainLoop *loop;
+  TplLogManager *manager;
+  TpAccount *account;
+  TplEntity *contact;
+  GTimer *timer;
+
+  GList *dates;
+  GList *next_date;
+  guint n_running;
+  guint n_events;
+  gdouble first_day_time;
+
+  guint n_pending;
+  guint n_with_logs;
+} Test;
+
+static void
+setup (Test *test,
+    gconstpointer data)
+{
+  test->loop = g_main_loop_new (NULL, FALSE);
+  test->manager = tpl_log_manager_dup_singleton ();
+  test->account = test_log_store_dup_account (store, ACCOUNT_PATH);
+  test->contact = tpl_entity_new (CONTACT_ID, TPL_ENTITY_CONTACT, NULL,
+      NULL);
+  test->timer = g_timer_new ();
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data)
+{
+  g_main_loop_unref (test->loop);
+  g_object_unref (test->manager);
+  g_object_unref (test->account);
+  g_object_unref (test->contact);
+  g_timer_destroy (test->timer);
+  g_list_free_full (test->dates, (GDestroyNotify) g_date_free);
+}
+
+static void
+report (Test *test,
+    const gchar *what)
+{
+  gdouble elapsed = g_timer_elapsed (test->timer, NULL);
+
+  g_test_minimized_result (elapsed, "%s: %.3f s", what, elapsed);
+}
+
+static void
+populate (void)
+{
+  guint i;
+
+  test_log_store_add_history (store, ACCOUNT_PATH, CONTACT_ID, FALSE,
+      sizes->n_days, sizes->n_messages);
+  test_log_store_add_history (store, ACCOUNT_PATH, ROOM_ID, TRUE,
+      30, sizes->n_messages);
+
+  for (i = 0; i < sizes->n_contacts; i++)
+    {
+      gchar *id = g_strdup_printf ("contact%u@example.com", i);
+
+      test_log_store_add_history (store, ACCOUNT_PATH, id, FALSE, 30,
+          sizes->n_messages);
+      g_free (id);
+    }
+
+  for (i = 1; i <= sizes->n_accounts; i++)
+    {
+      gchar *path = g_strdup_printf ("%sgabble/jabber/me%u",
+          TP_ACCOUNT_OBJECT_PATH_BASE, i);
+
+      test_log_store_add_history (store, path, CONTACT_ID, FALSE, 30,
+          sizes->n_messages);
+      g_free (path);
+    }
+}
+
+/* Opening a chat: the backlog is the 5 last messages, fetched like
+ * chat_add_logs() does */
+
+static gboolean
+backlog_filter (TplEvent *event,
+    gpointer user_data)
+{
+  return TRUE;
+}
+
+static void
+backlog_got_events_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+  GList *events;
+  GError *error = NULL;
+
+  tpl_log_walker_get_events_finish (TPL_LOG_WALKER (source), result,
+      &events, &error);
+  g_assert_no_error (error);
+
+  test->n_events = g_list_length (events);
+  g_list_free_full (events, g_object_unref);
+
+  g_main_loop_quit (test->loop);
+}
+
+static void
+test_chat_backlog (Test *test,
+    gconstpointer data)
+{
+  TplLogWalker *walker;
+  guint n_pages = 0;
+
+  g_timer_start (test->timer);
+
+  walker = tpl_log_manager_walk_filtered_events (test->manager,
+      test->account, test->contact, TPL_EVENT_MASK_TEXT, backlog_filter,
+      test);
+  tpl_log_walker_get_events_async (walker, 5, backlog_got_events_cb, test);
+  g_main_loop_run (test->loop);
+
+  g_assert_cmpuint (test->n_events, ==, 5);
+  report (test, "chat backlog");
+
+  /* scrolling back through a week of messages */
+  g_timer_start (test->timer);
+
+  while (n_pages * 5 < 7 * sizes->n_messages &&
+      !tpl_log_walker_is_end (walker))
+    {
+      tpl_log_walker_get_events_async (walker, 5, backlog_got_events_cb,
+          test);
+      g_main_loop_run (test->loop);
+      n_pages++;
+    }
+
+  report (test, "chat backlog, a week more");
+
+  g_object_unref (walker);
+}
+
+/* Searching, with the logger and with the log index */
+
+static void
+search_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+  GList *hits;
+  GError *error = NULL;
+
+  tpl_log_manager_search_finish (TPL_LOG_MANAGER (source), result, &hits,
+      &error);
+  g_assert_no_error (error);
+
+  test->n_events = g_list_length (hits);
+  tpl_log_manager_search_free (hits);
+
+  g_main_loop_quit (test->loop);
+}
+
+static void
+test_search (Test *test,
+    gconstpointer data)
+{
+  EmpathyLogIndex *index;
+  GList *hits;
+  guint day, message;
+
+  g_timer_start (test->timer);
+
+  tpl_log_manager_search_async (test->manager, "needle",
+      TPL_EVENT_MASK_TEXT, search_cb, test);
+  g_main_loop_run (test->loop);
+
+  g_assert_cmpuint (test->n_events, >, 0);
+  report (test, "search logs");
+
+  /* The index is filled with the same messages as the logger's, as it
+   * needs an account manager to sync with the logger itself */
+  index = empathy_log_index_new (NULL);
+  g_timer_start (test->timer);
+
+  for (day = 0; day < sizes->n_days; day++)
+    {
+      for (message = 0; message < sizes->n_messages; message++)
+        {
+          gchar *text = test_log_store_dup_text (day, message);
+
+          empathy_log_index_add_text (index, ACCOUNT_PATH, CONTACT_ID,
+              "Alice", FALSE,
+              test_log_store_get_timestamp (sizes->n_days, day, message),
+              text);
+          g_free (text);
+        }
+    }
+
+  report (test, "index logs of a contact");
+
+  g_timer_start (test->timer);
+  hits = empathy_log_index_search (index, "needle", NULL, NULL, NULL);
+  report (test, "search log index");
+
+  g_assert (hits != NULL);
+  g_list_free_full (hits, (GDestroyNotify) empathy_log_index_hit_free);
+  g_object_unref (index);
+}
+
+/* Loading all the days of a contact, like the log window does when
+ * "Anytime" is selected */
+
+static void
+year_fetch_next (Test *test);
+
+static void
+year_got_events_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+  GList *events;
+  GError *error = NULL;
+
+  tpl_log_manager_get_events_for_date_finish (TPL_LOG_MANAGER (source),
+      result, &events, &error);
+  g_assert_no_error (error);
+
+  if (test->first_day_time == 0)
+    test->first_day_time = g_timer_elapsed (test->timer, NULL);
+
+  test->n_events += g_list_length (events);
+  g_list_free_full (events, g_object_unref);
+
+  test->n_running--;
+  year_fetch_next (test);
+}
+
+static void
+year_fetch_next (Test *test)
+{
+  while (test->n_running < MAX_RUNNING_FETCHES && test->next_date != NULL)
+    {
+      tpl_log_manager_get_events_for_date_async (test->manager,
+          test->account, test->contact, TPL_EVENT_MASK_ANY,
+          test->next_date->data, year_got_events_cb, test);
+
+      test->next_date = test->next_date->next;
+      test->n_running++;
+    }
+
+  if (test->n_running == 0)
+    g_main_loop_quit (test->loop);
+}
+
+static void
+year_got_dates_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+  GError *error = NULL;
+
+  tpl_log_manager_get_dates_finish (TPL_LOG_MANAGER (source), result,
+      &test->dates, &error);
+  g_assert_no_error (error);
+
+  test->next_date = test->dates;
+  year_fetch_next (test);
+}
+
+static void
+test_year (Test *test,
+    gconstpointer data)
+{
+  g_timer_start (test->timer);
+
+  tpl_log_manager_get_dates_async (test->manager, test->account,
+      test->contact, TPL_EVENT_MASK_ANY, year_got_dates_cb, test);
+  g_main_loop_run (test->loop);
+
+  g_assert_cmpuint (g_list_length (test->dates), ==, sizes->n_days);
+  g_assert_cmpuint (test->n_events, ==, sizes->n_days * sizes->n_messages);
+
+  g_test_minimized_result (test->first_day_time, "first day of logs: %.3f s",
+      test->first_day_time);
+  report (test, "all the days of logs");
+}
+
+/* Filtering the account chooser on the accounts having logs, when it's
+ * opened the first time and then again */
+
+static void
+chooser_filter_cb (gboolean has_logs,
+    gpointer user_data)
+{
+  Test *test = user_data;
+
+  if (has_logs)
+    test->n_with_logs++;
+
+  if (--test->n_pending == 0)
+    g_main_loop_quit (test->loop);
+}
+
+static void
+chooser_filter (Test *test,
+    const gchar *account_path)
+{
+  TpAccount *account = test_log_store_dup_account (store, account_path);
+
+  test->n_pending++;
+  empathy_account_chooser_filter_has_logs (account, chooser_filter_cb, test,
+      NULL);
+
+  g_object_unref (account);
+}
+
+static void
+chooser_open (Test *test)
+{
+  guint i;
+
+  test->n_with_logs = 0;
+  /* so the loop isn't quit before all the accounts are filtered */
+  test->n_pending = 1;
+
+  chooser_filter (test, ACCOUNT_PATH);
+  chooser_filter (test, EMPTY_ACCOUNT_PATH);
+
+  for (i = 1; i <= sizes->n_accounts; i++)
+    {
+      gchar *path = g_strdup_printf ("%sgabble/jabber/me%u",
+          TP_ACCOUNT_OBJECT_PATH_BASE, i);
+
+      chooser_filter (test, path);
+      g_free (path);
+    }
+
+  if (--test->n_pending > 0)
+    g_main_loop_run (test->loop);
+
+  g_assert_cmpuint (test->n_with_logs, ==, sizes->n_accounts + 1);
+}
+
+static void
+test_account_chooser (Test *test,
+    gconstpointer data)
+{
+  g_timer_start (test->timer);
+  chooser_open (test);
+  report (test, "filter account chooser");
+
+  /* only the account without logs is asked about again */
+  g_timer_start (test->timer);
+  chooser_open (test);
+  report (test, "filter account chooser again");
+
+  /* deleting logs forgets everything */
+  empathy_account_chooser_filter_has_logs_reset ();
+  g_timer_start (test->timer);
+  chooser_open (test);
+  report (test, "filter account chooser after deleting logs");
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  store = test_log_store_new ();
+  test_init (argc, argv);
+
+  sizes = g_test_perf () ? &perf_sizes : &quick_sizes;
+  populate ();
+
+  g_test_add ("/log-benchmark/chat-backlog", Test, NULL,
+      setup, test_chat_backlog, teardown);
+  g_test_add ("/log-benchmark/search", Test, NULL,
+      setup, test_search, teardown);
+  g_test_add ("/log-benchmark/year", Test, NULL,
+      setup, test_year, teardown);
+  g_test_add ("/log-benchmark/account-chooser", Test, NULL,
+      setup, test_account_chooser, teardown);
+
+  result = g_test_run ();
+  test_deinit ();
+  test_log_store_free (store);
+
+  return result;
+}
@@ -0,0 +1,277 @@
+#include "config.h"
+
+#include <glib/gstdio.h>
+
+#include "test-helper.h"
+#include "empathy-log-index.h"
+
+#define ACCOUNT1 TP_ACCOUNT_OBJECT_PATH_BASE "gabble/jabber/test1"
+#define ACCOUNT2 TP_ACCOUNT_OBJECT_PATH_BASE "gabble/jabber/test2"
+
+/* 2014-01-01 00:00:00 UTC */
+#define DAY1 G_GINT64_CONSTANT (1388534400)
+#define DAY2 (DAY1 + 24 * 60 * 60)
+#define DAY3 (DAY2 + 24 * 60 * 60)
+
+static void
+add_messages (EmpathyLogIndex *index)
+{
+  empathy_log_index_add_text (index, ACCOUNT1, "alice@example.com", "Alice",
+      FALSE, DAY1 + 10, "Shall we have lunch at the Indian place?");
+  empathy_log_index_add_text (index, ACCOUNT1, "alice@example.com", "Alice",
+      FALSE, DAY1 + 20, "Sure, the LUNCH menu there is great");
+  empathy_log_index_add_text (index, ACCOUNT1, "bob@example.com", "Bob",
+      FALSE, DAY2 + 10, "I had lunch with Alice");
+  empathy_log_index_add_text (index, ACCOUNT2, "room@conf.example.com",
+      NULL, TRUE, DAY3 + 10, "place your bets: lunch or dinner?");
+  empathy_log_index_add_text (index, ACCOUNT2, "room@conf.example.com",
+      NULL, TRUE, DAY3 + 20, "Café au lait");
+}
+
+/* The hits as "target_id day-of-year" strings */
+static gchar *
+search (EmpathyLogIndex *index,
+    const gchar *query,
+    const gchar *account_path,
+    const GDate *from,
+    const GDate *to)
+{
+  GList *hits, *l;
+  GString *str;
+
+  hits = empathy_log_index_search (index, query, account_path, from, to);
+  str = g_string_new ("");
+
+  for (l = hits; l != NULL; l = g_list_next (l))
+    {
+      EmpathyLogIndexHit *hit = l->data;
+
+      if (str->len > 0)
+        g_string_append_c (str, ',');
+
+      g_string_append_printf (str, "%s %u", hit->target_id,
+          g_date_get_day_of_year (&hit->date));
+    }
+
+  g_list_free_full (hits, (GDestroyNotify) empathy_log_index_hit_free);
+
+  return g_string_free (str, FALSE);
+}
+
+static void
+check_search (EmpathyLogIndex *index,
+    const gchar *query,
+    const gchar *account_path,
+    const GDate *from,
+    const GDate *to,
+    const gchar *expected)
+{
+  gchar *result = search (index, query, account_path, from, to);
+
+  g_assert_cmpstr (result, ==, expected);
+  g_free (result);
+}
+
+static void
+test_search (void)
+{
+  EmpathyLogIndex *index;
+  GDate *day2;
+
+  index = empathy_log_index_new (NULL);
+  add_messages (index);
+
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 5);
+  g_assert (!empathy_log_index_is_ready (index));
+
+  /* adding a message twice doesn't index it twice */
+  empathy_log_index_add_text (index, ACCOUNT1, "alice@example.com", "Alice",
+      FALSE, DAY1 + 10, "Shall we have lunch at the Indian place?");
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 5);
+
+  /* hits are per day and per target, sorted by date; the dates are
+   * checked in test_dates */
+  check_search (index, "lunch", NULL, NULL, NULL,
+      "alice@example.com 1,bob@example.com 2,room@conf.example.com 3");
+  check_search (index, "LUN", NULL, NULL, NULL,
+      "alice@example.com 1,bob@example.com 2,room@conf.example.com 3");
+  check_search (index, "supper", NULL, NULL, NULL, "");
+
+  /* all the words have to match */
+  check_search (index, "lunch alice", NULL, NULL, NULL,
+      "bob@example.com 2");
+  check_search (index, "pla lunch", NULL, NULL, NULL,
+      "alice@example.com 1,room@conf.example.com 3");
+
+  /* phrases */
+  check_search (index, "\"lunch menu\"", NULL, NULL, NULL,
+      "alice@example.com 1");
+  check_search (index, "\"lunch men\"", NULL, NULL, NULL, "");
+  check_search (index, "\"menu lunch\"", NULL, NULL, NULL, "");
+  check_search (index, "\"the lunch", NULL, NULL, NULL,
+      "alice@example.com 1");
+  check_search (index, "bets:lunch", NULL, NULL, NULL,
+      "room@conf.example.com 3");
+
+  /* case and accents */
+  check_search (index, "CAFÉ", NULL, NULL, NULL, "room@conf.example.com 3");
+  check_search (index, "cafe", NULL, NULL, NULL, "");
+
+  /* filters */
+  check_search (index, "lunch", ACCOUNT2, NULL, NULL,
+      "room@conf.example.com 3");
+
+  day2 = g_date_new_dmy (2, G_DATE_JANUARY, 2014);
+  check_search (index, "lunch", NULL, day2, NULL,
+      "bob@example.com 2,room@conf.example.com 3");
+  check_search (index, "lunch", NULL, NULL, day2,
+      "alice@example.com 1,bob@example.com 2");
+  check_search (index, "lunch", ACCOUNT1, day2, day2, "bob@example.com 2");
+  g_date_free (day2);
+
+  /* nothing to look for */
+  g_assert (empathy_log_index_search (index, " \"\" ", NULL, NULL,
+        NULL) == NULL);
+
+  g_object_unref (index);
+}
+
+static void
+test_dates (void)
+{
+  EmpathyLogIndex *index;
+  EmpathyLogIndexHit *hit;
+  GList *hits;
+
+  index = empathy_log_index_new (NULL);
+
+  /* 23:59:59 UTC is still the same day, whatever the time zone */
+  empathy_log_index_add_text (index, ACCOUNT1, "alice@example.com", "Alice",
+      FALSE, DAY2 - 1, "late");
+
+  hits = empathy_log_index_search (index, "late", NULL, NULL, NULL);
+  g_assert_cmpuint (g_list_length (hits), ==, 1);
+
+  hit = hits->data;
+  g_assert_cmpstr (hit->account_path, ==, ACCOUNT1);
+  g_assert_cmpstr (hit->target_alias, ==, "Alice");
+  g_assert (!hit->is_chatroom);
+  g_assert_cmpuint (g_date_get_day (&hit->date), ==, 1);
+  g_assert_cmpuint (g_date_get_month (&hit->date), ==, G_DATE_JANUARY);
+  g_assert_cmpuint (g_date_get_year (&hit->date), ==, 2014);
+
+  g_list_free_full (hits, (GDestroyNotify) empathy_log_index_hit_free);
+  g_object_unref (index);
+}
+
+static void
+test_save (void)
+{
+  EmpathyLogIndex *index;
+  gchar *filename;
+  gchar *before, *after;
+  GError *error = NULL;
+
+  filename = g_build_filename (g_get_tmp_dir (), "empathy-log-index-test",
+      "log-index", NULL);
+  g_unlink (filename);
+
+  index = empathy_log_index_new (filename);
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 0);
+
+  add_messages (index);
+  before = search (index, "lunch", NULL, NULL, NULL);
+
+  g_assert (empathy_log_index_save (index, &error));
+  g_assert_no_error (error);
+  g_object_unref (index);
+
+  index = empathy_log_index_new (filename);
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 5);
+  /* never synced with the logger */
+  g_assert (!empathy_log_index_is_ready (index));
+
+  after = search (index, "lunch", NULL, NULL, NULL);
+  g_assert_cmpstr (before, ==, after);
+  check_search (index, "\"lunch menu\"", NULL, NULL, NULL,
+      "alice@example.com 1");
+  check_search (index, "café", NULL, NULL, NULL, "room@conf.example.com 3");
+
+  /* loaded messages aren't indexed twice */
+  add_messages (index);
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 5);
+
+  g_object_unref (index);
+
+  g_unlink (filename);
+  g_free (before);
+  g_free (after);
+  g_free (filename);
+}
+
+static void
+test_clear (void)
+{
+  EmpathyLogIndex *index;
+  gchar *filename;
+  GError *error = NULL;
+
+  filename = g_build_filename (g_get_tmp_dir (), "empathy-log-index-test",
+      "log-index-clear", NULL);
+  g_unlink (filename);
+
+  index = empathy_log_index_new (filename);
+  add_messages (index);
+
+  empathy_log_index_clear (index, ACCOUNT2);
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 3);
+  check_search (index, "lunch", NULL, NULL, NULL,
+      "alice@example.com 1,bob@example.com 2");
+  check_search (index, "place", NULL, NULL, NULL, "alice@example.com 1");
+  check_search (index, "\"lunch menu\"", NULL, NULL, NULL,
+      "alice@example.com 1");
+  check_search (index, "café", NULL, NULL, NULL, "");
+
+  /* the cleared events are gone from the disk too */
+  g_assert (empathy_log_index_save (index, &error));
+  g_assert_no_error (error);
+  g_object_unref (index);
+
+  index = empathy_log_index_new (filename);
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 3);
+  check_search (index, "lunch", ACCOUNT2, NULL, NULL, "");
+
+  empathy_log_index_clear (index, NULL);
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 0);
+  check_search (index, "lunch", NULL, NULL, NULL, "");
+
+  /* and can be indexed again */
+  add_messages (index);
+  g_assert_cmpuint (empathy_log_index_get_n_events (index), ==, 5);
+  check_search (index, "lunch", ACCOUNT2, NULL, NULL,
+      "room@conf.example.com 3");
+
+  g_object_unref (index);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/log-index/search", test_search);
+  g_test_add_func ("/log-index/dates", test_dates);
+  g_test_add_func ("/log-index/save", test_save);
+  g_test_add_func ("/log-index/clear", test_clear);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
@@ -0,0 +1,436 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test-helper.h"
+#include "test-roster.h"
+#include "empathy-individual-manager.h"
+#include "empathy-individual-store-manager.h"
+#include "empathy-roster-model-manager.h"
+#include "empathy-roster-view.h"
+
+/* Quick sizes by default, so the benchmarks are also tests; realistic
+ * ones with "-m perf", which is what the timings should be tracked with */
+typedef struct {
+  guint n_accounts;
+  /* of each account */
+  guint n_contacts;
+  guint n_groups;
+  /* presence or alias changes in a burst */
+  guint n_changes;
+  guint n_reconnects;
+} Sizes;
+
+static const Sizes quick_sizes = { 2, 100, 5, 50, 2 };
+static const Sizes perf_sizes = { 4, 1000, 20, 1000, 5 };
+
+/* SEARCH_TIMEOUT of empathy-roster-view.c, the search is only done once
+ * the user stopped typing for that long */
+#define ROSTER_VIEW_SEARCH_TIMEOUT 500
+
+/* Generous, as folks does everything in the main loop too */
+#define WAIT_TIMEOUT 60
+
+static TestRoster *roster = NULL;
+static const Sizes *sizes = NULL;
+/* kept around so the roster is only loaded once */
+static EmpathyIndividualManager *manager = NULL;
+
+typedef struct {
+  GMainLoop *loop;
+  GTimer *timer;
+
+  /* individuals of the manager, but the user's */
+  guint n_members;
+  guint n_expected;
+  guint timeout_id;
+} Test;
+
+static guint
+count_contacts (GList *individuals)
+{
+  GList *l;
+  guint n = 0;
+
+  for (l = individuals; l != NULL; l = g_list_next (l))
+    {
+      if (!folks_individual_get_is_user (l->data))
+        n++;
+    }
+
+  return n;
+}
+
+static void
+members_changed_cb (EmpathyIndividualManager *mgr,
+    const gchar *message,
+    GList *added,
+    GList *removed,
+    guint reason,
+    Test *test)
+{
+  test->n_members += count_contacts (added);
+  test->n_members -= count_contacts (removed);
+
+  if (test->n_members == test->n_expected)
+    g_main_loop_quit (test->loop);
+}
+
+static gboolean
+wait_timeout_cb (gpointer user_data)
+{
+  Test *test = user_data;
+
+  test->timeout_id = 0;
+  g_assert_cmpuint (test->n_members, ==, test->n_expected);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Waits for the manager to have @n_expected contacts */
+static void
+wait_for_members (Test *test,
+    guint n_expected)
+{
+  test->n_expected = n_expected;
+
+  if (test->n_members == n_expected)
+    return;
+
+  test->timeout_id = g_timeout_add_seconds (WAIT_TIMEOUT, wait_timeout_cb,
+      test);
+  g_main_loop_run (test->loop);
+
+  g_source_remove (test->timeout_id);
+  test->timeout_id = 0;
+}
+
+/* Also makes @test count the members, if setup() couldn't */
+static void
+ensure_population (Test *test)
+{
+  guint i;
+
+  if (manager != NULL)
+    return;
+
+  manager = empathy_individual_manager_dup_singleton ();
+  g_signal_connect (manager, "members-changed",
+      G_CALLBACK (members_changed_cb), test);
+
+  for (i = 0; i < sizes->n_accounts; i++)
+    test_roster_add_account (roster, sizes->n_contacts, sizes->n_groups);
+
+  wait_for_members (test, test_roster_get_n_contacts (roster));
+}
+
+static void
+setup (Test *test,
+    gconstpointer data)
+{
+  GList *members;
+
+  test->loop = g_main_loop_new (NULL, FALSE);
+  test->timer = g_timer_new ();
+
+  if (manager == NULL)
+    return;
+
+  members = empathy_individual_manager_get_members (manager);
+  test->n_members = count_contacts (members);
+  g_list_free (members);
+
+  g_signal_connect (manager, "members-changed",
+      G_CALLBACK (members_changed_cb), test);
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data)
+{
+  if (manager != NULL)
+    g_signal_handlers_disconnect_by_func (manager, members_changed_cb, test);
+
+  g_main_loop_unref (test->loop);
+  g_timer_destroy (test->timer);
+}
+
+static void
+report (Test *test,
+    const gchar *what)
+{
+  gdouble elapsed = g_timer_elapsed (test->timer, NULL);
+
+  g_test_minimized_result (elapsed, "%s: %.3f s", what, elapsed);
+}
+
+/* In bytes */
+static gsize
+get_resident_size (void)
+{
+  gchar *contents;
+  gulong size = 0, resident = 0;
+
+  if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    return 0;
+
+  sscanf (contents, "%lu %lu", &size, &resident);
+  g_free (contents);
+
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
+static void
+report_memory (gsize before,
+    const gchar *what)
+{
+  gdouble mib = 0;
+  gsize after = get_resident_size ();
+
+  if (after > before)
+    mib = (after - before) / (1024. * 1024.);
+
+  g_test_minimized_result (mib, "%s: %.1f MiB", what, mib);
+}
+
+/* Loading the rosters of all the accounts */
+
+static void
+test_population (Test *test,
+    gconstpointer data)
+{
+  gsize rss = get_resident_size ();
+
+  g_timer_start (test->timer);
+  ensure_population (test);
+  report (test, "roster population");
+  report_memory (rss, "roster population memory");
+}
+
+/* Scripted churn: bursts of presence and alias changes, and all the
+ * accounts losing their connection at once and coming back */
+
+static void
+test_presence_burst (Test *test,
+    gconstpointer data)
+{
+  ensure_population (test);
+
+  g_timer_start (test->timer);
+  test_roster_change_presences (roster, sizes->n_changes);
+  test_roster_flush (roster);
+  report (test, "presence burst");
+}
+
+static void
+test_alias_burst (Test *test,
+    gconstpointer data)
+{
+  ensure_population (test);
+
+  g_timer_start (test->timer);
+  test_roster_change_aliases (roster, sizes->n_changes);
+  test_roster_flush (roster);
+  report (test, "alias burst");
+}
+
+static void
+test_reconnect (Test *test,
+    gconstpointer data)
+{
+  guint n_contacts, i;
+
+  ensure_population (test);
+  n_contacts = test_roster_get_n_contacts (roster);
+
+  g_timer_start (test->timer);
+
+  for (i = 0; i < sizes->n_reconnects; i++)
+    {
+      test_roster_disconnect (roster);
+      wait_for_members (test, 0);
+
+      test_roster_connect (roster);
+      wait_for_members (test, n_contacts);
+    }
+
+  report (test, "reconnect storm");
+}
+
+/* The roster of the main window */
+
+static gdouble
+get_cpu_time (void)
+{
+  return (gdouble) clock () / CLOCKS_PER_SEC;
+}
+
+static gboolean
+search_timeout_cb (gpointer user_data)
+{
+  Test *test = user_data;
+
+  g_main_loop_quit (test->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_roster_view (Test *test,
+    gconstpointer data)
+{
+  EmpathyRosterModel *model;
+  GtkWidget *window, *view, *search;
+  gchar *alias;
+  gdouble cpu_time;
+  gsize rss;
+  guint i;
+
+  ensure_population (test);
+  rss = get_resident_size ();
+
+  g_timer_start (test->timer);
+
+  model = EMPATHY_ROSTER_MODEL (empathy_roster_model_manager_new (manager));
+  view = empathy_roster_view_new (model);
+  empathy_roster_view_show_groups (EMPATHY_ROSTER_VIEW (view), TRUE);
+  empathy_roster_view_show_offline (EMPATHY_ROSTER_VIEW (view), TRUE);
+
+  window = gtk_offscreen_window_new ();
+  gtk_container_add (GTK_CONTAINER (window), view);
+  gtk_widget_show_all (window);
+
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  g_assert (!empathy_roster_view_is_empty (EMPATHY_ROSTER_VIEW (view)));
+  report (test, "roster view population");
+  report_memory (rss, "roster view memory");
+
+  /* Typing the name of a contact; only the time spent filtering is
+   * counted, not the time waited for the user to stop typing */
+  search = tpaw_live_search_new (view);
+  empathy_roster_view_set_live_search (EMPATHY_ROSTER_VIEW (view),
+      TPAW_LIVE_SEARCH (search));
+
+  alias = test_roster_dup_alias (0, 0);
+  cpu_time = get_cpu_time ();
+
+  for (i = 1; i <= 4 && alias[i - 1] != '\0'; i++)
+    {
+      gchar *prefix = g_strndup (alias, i);
+
+      tpaw_live_search_set_text (TPAW_LIVE_SEARCH (search), prefix);
+      g_timeout_add (ROSTER_VIEW_SEARCH_TIMEOUT + 100, search_timeout_cb,
+          test);
+      g_main_loop_run (test->loop);
+
+      g_free (prefix);
+    }
+
+  cpu_time = (get_cpu_time () - cpu_time) / (i - 1);
+  g_test_minimized_result (cpu_time, "roster view search keystroke: %.3f s",
+      cpu_time);
+
+  tpaw_live_search_set_text (TPAW_LIVE_SEARCH (search), "");
+  g_timeout_add (ROSTER_VIEW_SEARCH_TIMEOUT + 100, search_timeout_cb, test);
+  g_main_loop_run (test->loop);
+
+  /* Each change invalidates the sorting of the view */
+  g_timer_start (test->timer);
+  test_roster_change_presences (roster, sizes->n_changes);
+  test_roster_flush (roster);
+  report (test, "roster view presence burst");
+
+  g_timer_start (test->timer);
+  test_roster_change_aliases (roster, sizes->n_changes);
+  test_roster_flush (roster);
+  report (test, "roster view alias burst");
+
+  g_free (alias);
+  gtk_widget_destroy (window);
+  g_object_unref (model);
+}
+
+/* The contact list of the dialogs, which have a tree view */
+
+static void
+test_individual_store (Test *test,
+    gconstpointer data)
+{
+  EmpathyIndividualStoreManager *store;
+  gsize rss;
+
+  ensure_population (test);
+  rss = get_resident_size ();
+
+  g_timer_start (test->timer);
+
+  store = empathy_individual_store_manager_new (manager);
+  empathy_individual_store_set_show_groups (EMPATHY_INDIVIDUAL_STORE (store),
+      TRUE);
+
+  /* it's filled in an idle */
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  g_assert (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (store),
+        NULL) > 0);
+  report (test, "individual store population");
+  report_memory (rss, "individual store memory");
+
+  g_timer_start (test->timer);
+  empathy_individual_store_set_sort_criterium (
+      EMPATHY_INDIVIDUAL_STORE (store), EMPATHY_INDIVIDUAL_STORE_SORT_NAME);
+  report (test, "individual store sort by name");
+
+  g_timer_start (test->timer);
+  empathy_individual_store_set_sort_criterium (
+      EMPATHY_INDIVIDUAL_STORE (store), EMPATHY_INDIVIDUAL_STORE_SORT_STATE);
+  report (test, "individual store sort by state");
+
+  g_timer_start (test->timer);
+  test_roster_change_presences (roster, sizes->n_changes);
+  test_roster_flush (roster);
+  report (test, "individual store presence burst");
+
+  g_object_unref (store);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  roster = test_roster_new (42);
+  test_init (argc, argv);
+
+  /* folks complains about the services it can't find on the private bus */
+  g_log_set_always_fatal (G_LOG_FATAL_MASK | G_LOG_LEVEL_CRITICAL);
+
+  sizes = g_test_perf () ? &perf_sizes : &quick_sizes;
+
+  g_test_add ("/roster-benchmark/population", Test, NULL,
+      setup, test_population, teardown);
+  g_test_add ("/roster-benchmark/presence-burst", Test, NULL,
+      setup, test_presence_burst, teardown);
+  g_test_add ("/roster-benchmark/alias-burst", Test, NULL,
+      setup, test_alias_burst, teardown);
+  g_test_add ("/roster-benchmark/reconnect", Test, NULL,
+      setup, test_reconnect, teardown);
+  g_test_add ("/roster-benchmark/roster-view", Test, NULL,
+      setup, test_roster_view, teardown);
+  g_test_add ("/roster-benchmark/individual-store", Test, NULL,
+      setup, test_individual_store, teardown);
+
+  result = g_test_run ();
+
+  tp_clear_object (&manager);
+  test_deinit ();
+  test_roster_free (roster);
+
+  return result;
+}
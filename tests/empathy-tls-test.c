@@ -301,6 +301,9 @@ setup (Test *test, gconstpointer data)
   gcr_pkcs11_set_modules (NULL);
   gcr_pkcs11_add_module (module);
   gcr_pkcs11_set_trust_lookup_uris (trust_uris);
+
+  /* Each test starts with an empty trust store */
+  empathy_tls_verifier_trust_changed ();
 }
 
 static void
@@ -715,6 +718,64 @@ test_certificate_verify_pinned_wrong_host (Test *test,
   g_object_unref (verifier);
 }
 
+static void
+verify_server_cert (Test *test,
+    GError **error)
+{
+  TpTLSCertificateRejectReason reason = 0;
+  EmpathyTLSVerifier *verifier;
+  const gchar *reference_identities[] = {
+    "test-server.empathy.gnome.org",
+    NULL
+  };
+
+  verifier = empathy_tls_verifier_new (test->cert, "test-server.empathy.gnome.org",
+      reference_identities);
+  empathy_tls_verifier_verify_async (verifier, fetch_callback_result, test);
+  g_main_loop_run (test->loop);
+
+  empathy_tls_verifier_verify_finish (verifier, test->result, &reason,
+      NULL, error);
+
+  g_object_unref (test->result);
+  test->result = NULL;
+  g_object_unref (verifier);
+}
+
+static void
+test_certificate_verify_cached (Test *test,
+        gconstpointer data G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+
+  test->mock = mock_tls_certificate_new_and_register (test->dbus,
+          "server-cert.cer", NULL);
+
+  add_certificate_to_mock (test, "certificate-authority.cer", NULL);
+
+  ensure_certificate_proxy (test);
+
+  verify_server_cert (test, &error);
+  g_assert_no_error (error);
+
+  /* Empty the trust store behind the verifier's back: the chain isn't
+   * verified again, so the result doesn't change */
+  mock_C_Finalize (NULL);
+  mock_C_Initialize (NULL);
+
+  verify_server_cert (test, &error);
+  g_assert_no_error (error);
+
+  /* Until we say the trust store changed */
+  empathy_tls_verifier_trust_changed ();
+
+  verify_server_cert (test, &error);
+  g_assert_error (error, G_IO_ERROR,
+      TP_TLS_CERTIFICATE_REJECT_REASON_SELF_SIGNED);
+
+  g_clear_error (&error);
+}
+
 int
 main (int argc,
     char **argv)
@@ -742,6 +803,8 @@ main (int argc,
           setup, test_certificate_verify_success_with_pinned, teardown);
   g_test_add ("/tls/certificate_verify_pinned_wrong_host", Test, NULL,
           setup, test_certificate_verify_pinned_wrong_host, teardown);
+  g_test_add ("/tls/certificate_verify_cached", Test, NULL,
+          setup, test_certificate_verify_cached, teardown);
 
   result = g_test_run ();
   test_deinit ();
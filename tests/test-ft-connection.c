@@ -0,0 +1,823 @@
+/*
+ * test-ft-connection.c - Stand-ins of file transfers
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* What a connection manager and the channel dispatcher do in a file
+ * transfer, as far as EmpathyFTHandler can tell: the connection offers
+ * hashed transfers, sends incoming files over a local socket and the
+ * dispatcher refuses outgoing requests with the errors it's told to. */
+
+#include "config.h"
+#include "test-ft-connection.h"
+
+#include <gio/gunixsocketaddress.h>
+#include <telepathy-glib/telepathy-glib-dbus.h>
+
+#include "test-helper.h"
+
+/* The ones a transfer can be requested with, besides none */
+static const TpFileHashType hash_types[] = {
+  TP_FILE_HASH_TYPE_MD5,
+  TP_FILE_HASH_TYPE_SHA1,
+  TP_FILE_HASH_TYPE_SHA256,
+};
+
+static const gchar * const allowed_properties[] = {
+  TP_PROP_CHANNEL_TARGET_HANDLE,
+  TP_PROP_CHANNEL_TARGET_ID,
+  TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_CONTENT_TYPE,
+  TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_FILENAME,
+  TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_SIZE,
+  TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_CONTENT_HASH,
+  TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_DESCRIPTION,
+  TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_DATE,
+  TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_URI,
+  NULL
+};
+
+/* The channel manager, only there for the requestable channel classes */
+
+typedef struct _TestFTChannelManager TestFTChannelManager;
+typedef struct _TestFTChannelManagerClass TestFTChannelManagerClass;
+
+struct _TestFTChannelManagerClass
+{
+  GObjectClass parent_class;
+};
+
+struct _TestFTChannelManager
+{
+  GObject parent;
+};
+
+/* Forward decl */
+GType test_ft_channel_manager_get_type (void);
+
+static void channel_manager_iface_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestFTChannelManager, test_ft_channel_manager,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_CHANNEL_MANAGER,
+      channel_manager_iface_init))
+
+static GHashTable *
+channel_class_new (void)
+{
+  return tp_asv_new (
+      TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
+        TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER,
+      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT,
+        TP_HANDLE_TYPE_CONTACT,
+      NULL);
+}
+
+/* One class without hash, for tp_capabilities_supports_file_transfer(),
+ * then one per hash type, like Gabble */
+static void
+channel_manager_foreach_channel_class (TpChannelManager *manager,
+    TpChannelManagerChannelClassFunc func,
+    gpointer user_data)
+{
+  GHashTable *fixed;
+  guint i;
+
+  fixed = channel_class_new ();
+  func (manager, fixed, allowed_properties, user_data);
+  g_hash_table_unref (fixed);
+
+  for (i = 0; i < G_N_ELEMENTS (hash_types); i++)
+    {
+      fixed = channel_class_new ();
+      tp_asv_set_uint32 (fixed,
+          TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_CONTENT_HASH_TYPE,
+          hash_types[i]);
+
+      func (manager, fixed, allowed_properties, user_data);
+      g_hash_table_unref (fixed);
+    }
+}
+
+static void
+channel_manager_iface_init (gpointer g_iface,
+    gpointer iface_data)
+{
+  TpChannelManagerIface *iface = g_iface;
+
+  iface->foreach_channel_class = channel_manager_foreach_channel_class;
+}
+
+static void
+test_ft_channel_manager_class_init (TestFTChannelManagerClass *klass)
+{
+}
+
+static void
+test_ft_channel_manager_init (TestFTChannelManager *self)
+{
+}
+
+/* The connection */
+
+G_DEFINE_TYPE (TestFTConnection, test_ft_connection,
+    TEST_TYPE_ROSTER_CONNECTION)
+
+static GPtrArray *
+create_channel_managers (TpBaseConnection *base)
+{
+  GPtrArray *managers;
+
+  managers = TP_BASE_CONNECTION_CLASS (
+      test_ft_connection_parent_class)->create_channel_managers (base);
+
+  /* the base connection owns it */
+  g_ptr_array_add (managers,
+      g_object_new (test_ft_channel_manager_get_type (), NULL));
+
+  return managers;
+}
+
+static void
+test_ft_connection_class_init (TestFTConnectionClass *klass)
+{
+  TpBaseConnectionClass *base_class = TP_BASE_CONNECTION_CLASS (klass);
+
+  base_class->create_channel_managers = create_channel_managers;
+}
+
+static void
+test_ft_connection_init (TestFTConnection *self)
+{
+}
+
+/* The incoming channel */
+
+struct _TestFTChannelPriv
+{
+  gchar *filename;
+  GBytes *contents;
+  TpFileHashType hash_type;
+  gchar *hash;
+
+  TpFileTransferState state;
+  guint64 transferred_bytes;
+
+  /* the socket the file is sent over, once the file is accepted */
+  gchar *dir;
+  GSocketService *service;
+  GSocketConnection *connection;
+};
+
+static void file_transfer_iface_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestFTChannel, test_ft_channel,
+    TP_TYPE_BASE_CHANNEL,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_TYPE_FILE_TRANSFER,
+      file_transfer_iface_init))
+
+static TpDBusPropertiesMixinPropImpl file_transfer_properties[] = {
+  { "State", NULL, NULL },
+  { "ContentType", NULL, NULL },
+  { "Filename", NULL, NULL },
+  { "Size", NULL, NULL },
+  { "ContentHashType", NULL, NULL },
+  { "ContentHash", NULL, NULL },
+  { "Description", NULL, NULL },
+  { "Date", NULL, NULL },
+  { "AvailableSocketTypes", NULL, NULL },
+  { "TransferredBytes", NULL, NULL },
+  { "InitialOffset", NULL, NULL },
+  { NULL }
+};
+
+/* Unix sockets only, as anybody can connect to the others */
+static GHashTable *
+dup_socket_types (void)
+{
+  GHashTable *types;
+  GArray *access_controls;
+  guint access_control = TP_SOCKET_ACCESS_CONTROL_LOCALHOST;
+
+  types = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_array_unref);
+
+  access_controls = g_array_sized_new (FALSE, FALSE, sizeof (guint), 1);
+  g_array_append_val (access_controls, access_control);
+  g_hash_table_insert (types, GUINT_TO_POINTER (TP_SOCKET_ADDRESS_TYPE_UNIX),
+      access_controls);
+
+  return types;
+}
+
+static void
+file_transfer_get_property (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  TestFTChannel *self = TEST_FT_CHANNEL (object);
+  const gchar *property = g_quark_to_string (name);
+
+  if (!tp_strdiff (property, "State"))
+    {
+      g_value_set_uint (value, self->priv->state);
+    }
+  else if (!tp_strdiff (property, "ContentType"))
+    {
+      g_value_set_string (value, "application/octet-stream");
+    }
+  else if (!tp_strdiff (property, "Filename"))
+    {
+      g_value_set_string (value, self->priv->filename);
+    }
+  else if (!tp_strdiff (property, "Size"))
+    {
+      g_value_set_uint64 (value, g_bytes_get_size (self->priv->contents));
+    }
+  else if (!tp_strdiff (property, "ContentHashType"))
+    {
+      g_value_set_uint (value, self->priv->hash_type);
+    }
+  else if (!tp_strdiff (property, "ContentHash"))
+    {
+      g_value_set_string (value, self->priv->hash);
+    }
+  else if (!tp_strdiff (property, "Description"))
+    {
+      g_value_set_string (value, "");
+    }
+  else if (!tp_strdiff (property, "AvailableSocketTypes"))
+    {
+      g_value_take_boxed (value, dup_socket_types ());
+    }
+  else if (!tp_strdiff (property, "TransferredBytes"))
+    {
+      g_value_set_uint64 (value, self->priv->transferred_bytes);
+    }
+  else if (!tp_strdiff (property, "Date") ||
+      !tp_strdiff (property, "InitialOffset"))
+    {
+      g_value_set_uint64 (value, 0);
+    }
+}
+
+static void
+channel_set_state (TestFTChannel *self,
+    TpFileTransferState state)
+{
+  self->priv->state = state;
+
+  tp_svc_channel_type_file_transfer_emit_file_transfer_state_changed (self,
+      state, TP_FILE_TRANSFER_STATE_CHANGE_REASON_NONE);
+}
+
+static void
+channel_splice_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TestFTChannel *self = user_data;
+  GError *error = NULL;
+  gssize size;
+
+  size = g_output_stream_splice_finish (G_OUTPUT_STREAM (source), result,
+      &error);
+  g_assert_no_error (error);
+
+  /* the receiver reads until the end of the stream */
+  g_io_stream_close (G_IO_STREAM (self->priv->connection), NULL, &error);
+  g_assert_no_error (error);
+  g_clear_object (&self->priv->connection);
+
+  self->priv->transferred_bytes = size;
+  tp_svc_channel_type_file_transfer_emit_transferred_bytes_changed (self,
+      size);
+
+  /* like real connection managers, without waiting for the receiver to
+   * have written the file */
+  channel_set_state (self, TP_FILE_TRANSFER_STATE_COMPLETED);
+
+  g_object_unref (self);
+}
+
+static gboolean
+channel_incoming_cb (GSocketService *service,
+    GSocketConnection *connection,
+    GObject *source_object,
+    TestFTChannel *self)
+{
+  GInputStream *input;
+
+  /* a transfer has a single receiver */
+  g_socket_service_stop (service);
+
+  self->priv->connection = g_object_ref (connection);
+
+  input = g_memory_input_stream_new_from_bytes (self->priv->contents);
+  g_output_stream_splice_async (
+      g_io_stream_get_output_stream (G_IO_STREAM (connection)), input,
+      G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE, G_PRIORITY_DEFAULT, NULL,
+      channel_splice_cb, g_object_ref (self));
+  g_object_unref (input);
+
+  return TRUE;
+}
+
+static void
+file_transfer_accept_file (TpSvcChannelTypeFileTransfer *iface,
+    guint address_type,
+    guint access_control,
+    const GValue *access_control_param,
+    guint64 offset,
+    DBusGMethodInvocation *context)
+{
+  TestFTChannel *self = TEST_FT_CHANNEL (iface);
+  TpSocketAddressType type;
+  GSocketAddress *address;
+  GValue *address_value;
+  GError *error = NULL;
+  gchar *path;
+
+  if (self->priv->state != TP_FILE_TRANSFER_STATE_PENDING ||
+      address_type != TP_SOCKET_ADDRESS_TYPE_UNIX ||
+      access_control != TP_SOCKET_ACCESS_CONTROL_LOCALHOST ||
+      offset != 0)
+    {
+      GError e = { TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "Only from the start, over a Unix socket" };
+
+      dbus_g_method_return_error (context, &e);
+      return;
+    }
+
+  self->priv->dir = g_dir_make_tmp ("empathy-ft-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  path = g_build_filename (self->priv->dir, "socket", NULL);
+  address = g_unix_socket_address_new (path);
+  g_free (path);
+
+  self->priv->service = g_socket_service_new ();
+  g_socket_listener_add_address (G_SOCKET_LISTENER (self->priv->service),
+      address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL,
+      &error);
+  g_assert_no_error (error);
+
+  g_signal_connect (self->priv->service, "incoming",
+      G_CALLBACK (channel_incoming_cb), self);
+  g_socket_service_start (self->priv->service);
+
+  address_value = tp_address_variant_from_g_socket_address (address, &type,
+      &error);
+  g_assert_no_error (error);
+
+  tp_svc_channel_type_file_transfer_return_from_accept_file (context,
+      address_value);
+
+  /* the sender is there at once */
+  tp_svc_channel_type_file_transfer_emit_initial_offset_defined (self, 0);
+  channel_set_state (self, TP_FILE_TRANSFER_STATE_ACCEPTED);
+  channel_set_state (self, TP_FILE_TRANSFER_STATE_OPEN);
+
+  tp_g_value_slice_free (address_value);
+  g_object_unref (address);
+}
+
+static void
+file_transfer_iface_init (gpointer g_iface,
+    gpointer iface_data)
+{
+  TpSvcChannelTypeFileTransferClass *klass = g_iface;
+
+  tp_svc_channel_type_file_transfer_implement_accept_file (klass,
+      file_transfer_accept_file);
+}
+
+static gchar *
+channel_get_object_path_suffix (TpBaseChannel *base)
+{
+  return g_strdup_printf ("FileTransferChannel%p", base);
+}
+
+static void
+channel_close (TpBaseChannel *base)
+{
+  tp_base_channel_destroyed (base);
+}
+
+static void
+test_ft_channel_dispose (GObject *object)
+{
+  TestFTChannel *self = TEST_FT_CHANNEL (object);
+
+  if (self->priv->service != NULL)
+    {
+      g_socket_service_stop (self->priv->service);
+      g_socket_listener_close (G_SOCKET_LISTENER (self->priv->service));
+      g_clear_object (&self->priv->service);
+    }
+
+  G_OBJECT_CLASS (test_ft_channel_parent_class)->dispose (object);
+}
+
+static void
+test_ft_channel_finalize (GObject *object)
+{
+  TestFTChannel *self = TEST_FT_CHANNEL (object);
+
+  if (self->priv->dir != NULL)
+    remove_dir (self->priv->dir);
+
+  g_free (self->priv->dir);
+  g_free (self->priv->filename);
+  g_free (self->priv->hash);
+  g_bytes_unref (self->priv->contents);
+
+  G_OBJECT_CLASS (test_ft_channel_parent_class)->finalize (object);
+}
+
+static void
+test_ft_channel_class_init (TestFTChannelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  TpBaseChannelClass *base_class = TP_BASE_CHANNEL_CLASS (klass);
+
+  object_class->dispose = test_ft_channel_dispose;
+  object_class->finalize = test_ft_channel_finalize;
+
+  base_class->channel_type = TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER;
+  base_class->target_handle_type = TP_HANDLE_TYPE_CONTACT;
+  base_class->get_object_path_suffix = channel_get_object_path_suffix;
+  base_class->close = channel_close;
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      TP_IFACE_QUARK_CHANNEL_TYPE_FILE_TRANSFER, file_transfer_get_property,
+      NULL, file_transfer_properties);
+
+  g_type_class_add_private (object_class, sizeof (TestFTChannelPriv));
+}
+
+static void
+test_ft_channel_init (TestFTChannel *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      TEST_TYPE_FT_CHANNEL, TestFTChannelPriv);
+
+  self->priv->state = TP_FILE_TRANSFER_STATE_PENDING;
+}
+
+/**
+ * test_ft_channel_new_incoming:
+ * @conn: a connected #TestFTConnection
+ * @sender_id: the identifier of the contact sending the file
+ * @filename: the name of the file
+ * @contents: what the file holds
+ * @hash_type: the type of @hash
+ * @hash: the digest the sender announces, or %NULL
+ *
+ * Return value: a new channel, already on the bus, sending @contents to
+ *  whoever accepts it
+ */
+TestFTChannel *
+test_ft_channel_new_incoming (TestFTConnection *conn,
+    const gchar *sender_id,
+    const gchar *filename,
+    GBytes *contents,
+    TpFileHashType hash_type,
+    const gchar *hash)
+{
+  TestFTChannel *self;
+  TpHandleRepoIface *contact_repo;
+  TpHandle handle;
+  GError *error = NULL;
+
+  contact_repo = tp_base_connection_get_handles (TP_BASE_CONNECTION (conn),
+      TP_HANDLE_TYPE_CONTACT);
+  handle = tp_handle_ensure (contact_repo, sender_id, NULL, &error);
+  g_assert_no_error (error);
+
+  self = g_object_new (TEST_TYPE_FT_CHANNEL,
+      "connection", conn,
+      "handle", handle,
+      "initiator-handle", handle,
+      "requested", FALSE,
+      NULL);
+
+  self->priv->filename = g_strdup (filename);
+  self->priv->contents = g_bytes_ref (contents);
+  self->priv->hash_type = hash_type;
+  self->priv->hash = g_strdup (hash != NULL ? hash : "");
+
+  tp_base_channel_register (TP_BASE_CHANNEL (self));
+
+  return self;
+}
+
+/**
+ * test_ft_channel_dup_immutable_properties:
+ * @self: a #TestFTChannel
+ *
+ * Return value: the properties a client is given with the channel, to
+ *  create its #TpFileTransferChannel
+ */
+GHashTable *
+test_ft_channel_dup_immutable_properties (TestFTChannel *self)
+{
+  return tp_dbus_properties_mixin_make_properties_hash (G_OBJECT (self),
+      TP_IFACE_CHANNEL, "ChannelType",
+      TP_IFACE_CHANNEL, "TargetHandleType",
+      TP_IFACE_CHANNEL, "TargetHandle",
+      TP_IFACE_CHANNEL, "TargetID",
+      TP_IFACE_CHANNEL, "InitiatorHandle",
+      TP_IFACE_CHANNEL, "InitiatorID",
+      TP_IFACE_CHANNEL, "Requested",
+      TP_IFACE_CHANNEL, "Interfaces",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentType",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Filename",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Size",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHashType",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHash",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Description",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Date",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "AvailableSocketTypes",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "InitialOffset",
+      NULL);
+}
+
+/* The channel requests of the dispatcher */
+
+typedef struct _TestFTChannelRequest TestFTChannelRequest;
+typedef struct _TestFTChannelRequestClass TestFTChannelRequestClass;
+
+struct _TestFTChannelRequestClass
+{
+  GObjectClass parent_class;
+};
+
+struct _TestFTChannelRequest
+{
+  GObject parent;
+
+  /* what it fails with once the client lets it proceed */
+  TpError code;
+};
+
+/* Forward decl */
+GType test_ft_channel_request_get_type (void);
+
+static void channel_request_iface_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestFTChannelRequest, test_ft_channel_request,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_REQUEST,
+      channel_request_iface_init))
+
+static void
+channel_request_proceed (TpSvcChannelRequest *iface,
+    DBusGMethodInvocation *context)
+{
+  TestFTChannelRequest *self = (TestFTChannelRequest *) iface;
+
+  tp_svc_channel_request_return_from_proceed (context);
+
+  tp_svc_channel_request_emit_failed (self,
+      tp_error_get_dbus_name (self->code), "Refused by the test");
+}
+
+static void
+channel_request_iface_init (gpointer g_iface,
+    gpointer iface_data)
+{
+  TpSvcChannelRequestClass *klass = g_iface;
+
+  tp_svc_channel_request_implement_proceed (klass, channel_request_proceed);
+}
+
+static void
+test_ft_channel_request_class_init (TestFTChannelRequestClass *klass)
+{
+}
+
+static void
+test_ft_channel_request_init (TestFTChannelRequest *self)
+{
+}
+
+/* The channel dispatcher */
+
+typedef struct _TestFTDispatcherClass TestFTDispatcherClass;
+
+struct _TestFTDispatcherClass
+{
+  GObjectClass parent_class;
+};
+
+struct _TestFTDispatcher
+{
+  GObject parent;
+
+  TpDBusDaemon *dbus;
+  /* TpError, with GUINT_TO_POINTER() */
+  GQueue failures;
+  /* the requested properties, in the order of the requests */
+  GPtrArray *requests;
+  /* owned TestFTChannelRequest */
+  GPtrArray *channel_requests;
+};
+
+static void dispatcher_iface_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestFTDispatcher, test_ft_dispatcher,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_DISPATCHER,
+      dispatcher_iface_init))
+
+static gchar *
+dispatcher_add_request (TestFTDispatcher *self,
+    GHashTable *requested_properties)
+{
+  /* paths aren't reused, the proxies of the old ones may still exist */
+  static guint n_requests = 0;
+  TestFTChannelRequest *request;
+  gchar *path;
+
+  g_ptr_array_add (self->requests, g_hash_table_ref (requested_properties));
+
+  request = g_object_new (test_ft_channel_request_get_type (), NULL);
+
+  if (g_queue_is_empty (&self->failures))
+    request->code = TP_ERROR_NOT_AVAILABLE;
+  else
+    request->code = GPOINTER_TO_UINT (g_queue_pop_head (&self->failures));
+
+  path = g_strdup_printf ("%s/Request%u", TP_CHANNEL_DISPATCHER_OBJECT_PATH,
+      n_requests++);
+  tp_dbus_daemon_register_object (self->dbus, path, request);
+  g_ptr_array_add (self->channel_requests, request);
+
+  return path;
+}
+
+static void
+dispatcher_create_channel (TpSvcChannelDispatcher *iface,
+    const gchar *account,
+    GHashTable *requested_properties,
+    gint64 user_action_time,
+    const gchar *preferred_handler,
+    DBusGMethodInvocation *context)
+{
+  TestFTDispatcher *self = (TestFTDispatcher *) iface;
+  gchar *path;
+
+  path = dispatcher_add_request (self, requested_properties);
+  tp_svc_channel_dispatcher_return_from_create_channel (context, path);
+  g_free (path);
+}
+
+static void
+dispatcher_create_channel_with_hints (TpSvcChannelDispatcher *iface,
+    const gchar *account,
+    GHashTable *requested_properties,
+    gint64 user_action_time,
+    const gchar *preferred_handler,
+    GHashTable *hints,
+    DBusGMethodInvocation *context)
+{
+  TestFTDispatcher *self = (TestFTDispatcher *) iface;
+  gchar *path;
+
+  path = dispatcher_add_request (self, requested_properties);
+  tp_svc_channel_dispatcher_return_from_create_channel_with_hints (context,
+      path);
+  g_free (path);
+}
+
+static void
+dispatcher_iface_init (gpointer g_iface,
+    gpointer iface_data)
+{
+  TpSvcChannelDispatcherClass *klass = g_iface;
+
+  tp_svc_channel_dispatcher_implement_create_channel (klass,
+      dispatcher_create_channel);
+  tp_svc_channel_dispatcher_implement_create_channel_with_hints (klass,
+      dispatcher_create_channel_with_hints);
+}
+
+static void
+test_ft_dispatcher_dispose (GObject *object)
+{
+  TestFTDispatcher *self = (TestFTDispatcher *) object;
+
+  if (self->dbus != NULL)
+    {
+      tp_dbus_daemon_release_name (self->dbus, TP_CHANNEL_DISPATCHER_BUS_NAME,
+          NULL);
+      tp_dbus_daemon_unregister_object (self->dbus, self);
+      g_clear_object (&self->dbus);
+    }
+
+  G_OBJECT_CLASS (test_ft_dispatcher_parent_class)->dispose (object);
+}
+
+static void
+test_ft_dispatcher_finalize (GObject *object)
+{
+  TestFTDispatcher *self = (TestFTDispatcher *) object;
+
+  g_queue_clear (&self->failures);
+  g_ptr_array_unref (self->requests);
+  g_ptr_array_unref (self->channel_requests);
+
+  G_OBJECT_CLASS (test_ft_dispatcher_parent_class)->finalize (object);
+}
+
+static void
+test_ft_dispatcher_class_init (TestFTDispatcherClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = test_ft_dispatcher_dispose;
+  object_class->finalize = test_ft_dispatcher_finalize;
+}
+
+static void
+test_ft_dispatcher_init (TestFTDispatcher *self)
+{
+  g_queue_init (&self->failures);
+  self->requests = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) g_hash_table_unref);
+  self->channel_requests = g_ptr_array_new_with_free_func (g_object_unref);
+}
+
+/**
+ * test_ft_dispatcher_new:
+ * @dbus: the bus of the accounts
+ *
+ * Return value: a new dispatcher, owning the name of the channel dispatcher
+ *  on @dbus until it is disposed
+ */
+TestFTDispatcher *
+test_ft_dispatcher_new (TpDBusDaemon *dbus)
+{
+  TestFTDispatcher *self;
+  GError *error = NULL;
+
+  self = g_object_new (test_ft_dispatcher_get_type (), NULL);
+  self->dbus = g_object_ref (dbus);
+
+  tp_dbus_daemon_register_object (dbus, TP_CHANNEL_DISPATCHER_OBJECT_PATH,
+      self);
+  tp_dbus_daemon_request_name (dbus, TP_CHANNEL_DISPATCHER_BUS_NAME, FALSE,
+      &error);
+  g_assert_no_error (error);
+
+  return self;
+}
+
+/**
+ * test_ft_dispatcher_add_failure:
+ * @self: a #TestFTDispatcher
+ * @code: a #TpError
+ *
+ * Makes the next request which hasn't got an error yet fail with @code.
+ * The ones left fail with %TP_ERROR_NOT_AVAILABLE.
+ */
+void
+test_ft_dispatcher_add_failure (TestFTDispatcher *self,
+    TpError code)
+{
+  g_queue_push_tail (&self->failures, GUINT_TO_POINTER (code));
+}
+
+/**
+ * test_ft_dispatcher_get_requests:
+ * @self: a #TestFTDispatcher
+ *
+ * Return value: (transfer none) (element-type GHashTable): the properties
+ *  of the channels requested so far
+ */
+GPtrArray *
+test_ft_dispatcher_get_requests (TestFTDispatcher *self)
+{
+  return self->requests;
+}
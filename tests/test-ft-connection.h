@@ -0,0 +1,105 @@
+/*
+ * test-ft-connection.h - Header for the stand-ins of file transfers
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TEST_FT_CONNECTION_H__
+#define __TEST_FT_CONNECTION_H__
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "test-roster-connection.h"
+
+G_BEGIN_DECLS
+
+/* A roster connection which also transfers files */
+
+typedef struct _TestFTConnection TestFTConnection;
+typedef struct _TestFTConnectionClass TestFTConnectionClass;
+
+struct _TestFTConnectionClass
+{
+  TestRosterConnectionClass parent_class;
+};
+
+struct _TestFTConnection
+{
+  TestRosterConnection parent;
+};
+
+GType test_ft_connection_get_type (void);
+
+#define TEST_TYPE_FT_CONNECTION \
+  (test_ft_connection_get_type ())
+#define TEST_FT_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TEST_TYPE_FT_CONNECTION, \
+    TestFTConnection))
+#define TEST_IS_FT_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TEST_TYPE_FT_CONNECTION))
+
+/* An incoming file transfer channel of a TestFTConnection */
+
+typedef struct _TestFTChannel TestFTChannel;
+typedef struct _TestFTChannelClass TestFTChannelClass;
+typedef struct _TestFTChannelPriv TestFTChannelPriv;
+
+struct _TestFTChannelClass
+{
+  TpBaseChannelClass parent_class;
+};
+
+struct _TestFTChannel
+{
+  TpBaseChannel parent;
+
+  TestFTChannelPriv *priv;
+};
+
+GType test_ft_channel_get_type (void);
+
+#define TEST_TYPE_FT_CHANNEL \
+  (test_ft_channel_get_type ())
+#define TEST_FT_CHANNEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TEST_TYPE_FT_CHANNEL, \
+    TestFTChannel))
+#define TEST_IS_FT_CHANNEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TEST_TYPE_FT_CHANNEL))
+
+TestFTChannel * test_ft_channel_new_incoming (TestFTConnection *conn,
+    const gchar *sender_id,
+    const gchar *filename,
+    GBytes *contents,
+    TpFileHashType hash_type,
+    const gchar *hash);
+
+GHashTable * test_ft_channel_dup_immutable_properties (TestFTChannel *self);
+
+/* A channel dispatcher which refuses all the requests */
+
+typedef struct _TestFTDispatcher TestFTDispatcher;
+
+GType test_ft_dispatcher_get_type (void);
+
+TestFTDispatcher * test_ft_dispatcher_new (TpDBusDaemon *dbus);
+
+void test_ft_dispatcher_add_failure (TestFTDispatcher *self,
+    TpError code);
+GPtrArray * test_ft_dispatcher_get_requests (TestFTDispatcher *self);
+
+G_END_DECLS
+
+#endif
@@ -20,6 +20,8 @@
 #include "config.h"
 #include "test-helper.h"
 
+#include <glib/gstdio.h>
+
 #include "empathy-ui-utils.h"
 
 void
@@ -73,3 +75,30 @@ copy_xml_file (const gchar *orig,
   g_free (buffer);
 }
 
+/* Removes @path and everything in it */
+void
+remove_dir (const gchar *path)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          gchar *child = g_build_filename (path, name, NULL);
+
+          if (g_file_test (child, G_FILE_TEST_IS_DIR))
+            remove_dir (child);
+          else
+            g_unlink (child);
+
+          g_free (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_rmdir (path);
+}
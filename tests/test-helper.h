@@ -30,6 +30,7 @@ void test_deinit (void);
 gchar * get_xml_file (const gchar *filename);
 gchar * get_user_xml_file (const gchar *filename);
 void copy_xml_file (const gchar *orig, const gchar *dest);
+void remove_dir (const gchar *path);
 TpAccount * get_test_account (void);
 void destroy_test_account (TpAccount *account);
 
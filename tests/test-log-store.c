@@ -0,0 +1,288 @@
+/*
+ * test-log-store.c - Synthetic logs used by the benchmarks
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* telepathy-logger reads the logs itself, in the process asking for them,
+ * so standing in for it means writing logs where its XML store looks for
+ * them: $XDG_DATA_HOME/TpLogger/logs/<account>/[chatrooms/]<id>/<day>.log.
+ * The accounts are proxies on a private bus, which nothing else uses. */
+
+#include "config.h"
+#include "test-log-store.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "test-helper.h"
+
+#define DAY (24 * 60 * 60)
+
+struct _TestLogStore
+{
+  GTestDBus *bus;
+  gchar *data_dir;
+  TpSimpleClientFactory *factory;
+};
+
+static const gchar *words[] = {
+  "lunch", "meeting", "tomorrow", "coffee", "release", "branch", "patch",
+  "review", "weekend", "train", "office", "holiday", "bug", "crash",
+  "build", "server", "music", "concert", "dinner", "pizza", "football",
+  "weather", "rain", "sunny", "birthday", "present", "book", "film",
+  "deadline", "email", "phone", "later",
+};
+
+/**
+ * test_log_store_new:
+ *
+ * Starts a private bus and makes telepathy-logger look for logs in an empty
+ * temporary directory. This has to be called before anything connects to
+ * the bus or looks up the user directories, so before test_init().
+ *
+ * Return value: a new #TestLogStore, free with test_log_store_free()
+ */
+TestLogStore *
+test_log_store_new (void)
+{
+  TestLogStore *store = g_slice_new0 (TestLogStore);
+  GError *error = NULL;
+
+  store->bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (store->bus);
+
+  store->data_dir = g_dir_make_tmp ("empathy-log-store-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  g_setenv ("XDG_DATA_HOME", store->data_dir, TRUE);
+
+  return store;
+}
+
+void
+test_log_store_free (TestLogStore *store)
+{
+  remove_dir (store->data_dir);
+  g_free (store->data_dir);
+
+  g_clear_object (&store->factory);
+
+  g_test_dbus_down (store->bus);
+  g_object_unref (store->bus);
+
+  g_slice_free (TestLogStore, store);
+}
+
+/**
+ * test_log_store_dup_account:
+ * @store: a #TestLogStore
+ * @account_path: the object path of the account
+ *
+ * Return value: (transfer full): an account with that path on the private
+ * bus, which is enough for telepathy-logger
+ */
+TpAccount *
+test_log_store_dup_account (TestLogStore *store,
+    const gchar *account_path)
+{
+  TpAccount *account;
+  GError *error = NULL;
+
+  if (store->factory == NULL)
+    {
+      TpDBusDaemon *dbus = tp_dbus_daemon_dup (&error);
+
+      g_assert_no_error (error);
+      store->factory = tp_simple_client_factory_new (dbus);
+      g_object_unref (dbus);
+    }
+
+  account = tp_simple_client_factory_ensure_account (store->factory,
+      account_path, NULL, &error);
+  g_assert_no_error (error);
+
+  return account;
+}
+
+/**
+ * test_log_store_get_timestamp:
+ * @n_days: the number of days of the history
+ * @day: the day of the message, 0 being the oldest
+ * @message: the position of the message in the day
+ *
+ * Messages are a minute apart from 9:00 UTC, so a day can have up to 900.
+ *
+ * Return value: the timestamp of the message
+ */
+gint64
+test_log_store_get_timestamp (guint n_days,
+    guint day,
+    guint message)
+{
+  return TEST_LOG_STORE_LAST_DAY - (gint64) (n_days - 1 - day) * DAY +
+      9 * 60 * 60 + message * 60;
+}
+
+/**
+ * test_log_store_dup_text:
+ * @day: the day of the message
+ * @message: the position of the message in the day
+ *
+ * Return value: the text of the message, which is the same in every history
+ */
+gchar *
+test_log_store_dup_text (guint day,
+    guint message)
+{
+  GString *text = g_string_new (NULL);
+  guint n = day * 1000 + message;
+  guint32 seed = n * 2654435761u;
+  guint i;
+
+  for (i = 0; i < 8; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+
+      if (text->len > 0)
+        g_string_append_c (text, ' ');
+      g_string_append (text, words[(seed >> 16) % G_N_ELEMENTS (words)]);
+    }
+
+  if (n % TEST_LOG_STORE_NEEDLE_EVERY == 0)
+    g_string_append (text, " needle");
+
+  return g_string_free (text, FALSE);
+}
+
+static gchar *
+get_dir (TestLogStore *store,
+    const gchar *account_path,
+    const gchar *target_id,
+    gboolean is_chatroom)
+{
+  gchar *account_dir, *dir;
+
+  g_assert (g_str_has_prefix (account_path, TP_ACCOUNT_OBJECT_PATH_BASE));
+
+  account_dir = g_strdelimit (
+      g_strdup (account_path + strlen (TP_ACCOUNT_OBJECT_PATH_BASE)),
+      "/", '_');
+
+  if (is_chatroom)
+    dir = g_build_filename (store->data_dir, "TpLogger", "logs", account_dir,
+        "chatrooms", target_id, NULL);
+  else
+    dir = g_build_filename (store->data_dir, "TpLogger", "logs", account_dir,
+        target_id, NULL);
+
+  g_free (account_dir);
+
+  return dir;
+}
+
+/**
+ * test_log_store_add_history:
+ * @store: a #TestLogStore
+ * @account_path: the object path of the account
+ * @target_id: the identifier of the contact or room
+ * @is_chatroom: whether @target_id is a room
+ * @n_days: the number of days with messages, ending on
+ *  %TEST_LOG_STORE_LAST_DAY
+ * @n_messages: the number of messages each day
+ *
+ * Writes the logs of a conversation, alternating between messages from
+ * the user and from the contact or the members of the room.
+ */
+void
+test_log_store_add_history (TestLogStore *store,
+    const gchar *account_path,
+    const gchar *target_id,
+    gboolean is_chatroom,
+    guint n_days,
+    guint n_messages)
+{
+  GString *contents;
+  gchar *dir;
+  guint day, message;
+
+  g_assert_cmpuint (n_messages, <=, 900);
+
+  dir = get_dir (store, account_path, target_id, is_chatroom);
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+  contents = g_string_new (NULL);
+
+  for (day = 0; day < n_days; day++)
+    {
+      GDateTime *date;
+      gchar *basename, *filename;
+      GError *error = NULL;
+
+      g_string_assign (contents,
+          "<?xml version='1.0' encoding='utf-8'?>\n"
+          "<?xml-stylesheet type=\"text/xsl\" href=\"log-store-xml.xsl\"?>\n"
+          "<log>\n");
+
+      for (message = 0; message < n_messages; message++)
+        {
+          gboolean is_user = message % 2 == 0;
+          gchar *sender, *time, *text, *line;
+
+          date = g_date_time_new_from_unix_utc (
+              test_log_store_get_timestamp (n_days, day, message));
+          time = g_date_time_format (date, "%Y%m%dT%H:%M:%S");
+          g_date_time_unref (date);
+
+          if (is_user)
+            sender = g_strdup (TEST_LOG_STORE_SELF_ID);
+          else if (is_chatroom)
+            sender = g_strdup_printf ("member%u@example.com", message % 7);
+          else
+            sender = g_strdup (target_id);
+
+          text = test_log_store_dup_text (day, message);
+
+          line = g_markup_printf_escaped ("<message time='%s' id='%s' "
+              "name='%s' token='' isuser='%s' type='normal'>%s</message>\n",
+              time, sender, sender, is_user ? "true" : "false", text);
+          g_string_append (contents, line);
+
+          g_free (line);
+          g_free (text);
+          g_free (sender);
+          g_free (time);
+        }
+
+      g_string_append (contents, "</log>\n");
+
+      date = g_date_time_new_from_unix_utc (
+          test_log_store_get_timestamp (n_days, day, 0));
+      basename = g_date_time_format (date, "%Y%m%d.log");
+      filename = g_build_filename (dir, basename, NULL);
+      g_date_time_unref (date);
+
+      g_file_set_contents (filename, contents->str, contents->len, &error);
+      g_assert_no_error (error);
+
+      g_free (filename);
+      g_free (basename);
+    }
+
+  g_string_free (contents, TRUE);
+  g_free (dir);
+}
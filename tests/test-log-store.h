@@ -0,0 +1,55 @@
+/*
+ * test-log-store.h - Header for the synthetic logs used by the benchmarks
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TEST_LOG_STORE_H__
+#define __TEST_LOG_STORE_H__
+
+#include <telepathy-glib/telepathy-glib.h>
+
+/* The identifier of the user in the synthetic logs */
+#define TEST_LOG_STORE_SELF_ID "me@example.com"
+
+/* Every history ends on 2014-12-31 */
+#define TEST_LOG_STORE_LAST_DAY G_GINT64_CONSTANT (1419984000)
+
+/* One message out of this many has the word "needle" */
+#define TEST_LOG_STORE_NEEDLE_EVERY 100
+
+typedef struct _TestLogStore TestLogStore;
+
+TestLogStore * test_log_store_new (void);
+void test_log_store_free (TestLogStore *store);
+
+TpAccount * test_log_store_dup_account (TestLogStore *store,
+    const gchar *account_path);
+
+void test_log_store_add_history (TestLogStore *store,
+    const gchar *account_path,
+    const gchar *target_id,
+    gboolean is_chatroom,
+    guint n_days,
+    guint n_messages);
+
+gint64 test_log_store_get_timestamp (guint n_days,
+    guint day,
+    guint message);
+gchar * test_log_store_dup_text (guint day,
+    guint message);
+
+#endif
@@ -0,0 +1,1166 @@
+/*
+ * test-roster-connection.c - Connection of the synthetic rosters
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* A connection standing in for a real connection manager: it is exported
+ * on the bus by the test itself and publishes a roster whose contacts,
+ * groups, aliases, avatars and presences only depend on their numbers, so
+ * two runs see the same roster. */
+
+#include "config.h"
+#include "test-roster-connection.h"
+
+#include <string.h>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <telepathy-glib/telepathy-glib-dbus.h>
+
+#define AVATAR_SIZE 96
+
+static const gchar *first_names[] = {
+  "Alice", "Bob", "Carol", "Dave", "Eve", "Frank", "Grace", "Heidi",
+  "Ivan", "Judy", "Karl", "Laura", "Mallory", "Niaj", "Olivia", "Peggy",
+  "Quentin", "Rupert", "Sybil", "Trent", "Ursula", "Victor", "Walter",
+  "Xavier", "Yvonne", "Zoë", "Amélie", "Björn", "Chloé", "Dmitri",
+  "Élodie", "François",
+};
+
+static const gchar *last_names[] = {
+  "Smith", "Jones", "Taylor", "Brown", "Williams", "Wilson", "Johnson",
+  "Davies", "Robinson", "Wright", "Thompson", "Evans", "Walker", "White",
+  "Roberts", "Green", "Hall", "Wood", "Jackson", "Clarke", "Martin",
+  "Bernard", "Dubois", "Durand", "Lefèvre", "Müller", "Schmidt", "Rossi",
+  "García", "Novák", "Kowalski", "Andersson",
+};
+
+/* The avatars are plain squares of these colours; contacts with the same
+ * avatar have the same token, like with hashes of the image */
+static const guint32 avatar_colours[] = {
+  0xcc0000ff, 0x4e9a06ff, 0x3465a4ff, 0xc4a000ff,
+  0x75507bff, 0xce5c00ff, 0x06989aff, 0x555753ff,
+};
+
+/* The first four are the ones contacts go through */
+enum {
+  STATUS_AVAILABLE,
+  STATUS_AWAY,
+  STATUS_BUSY,
+  STATUS_OFFLINE,
+  STATUS_UNKNOWN,
+  STATUS_ERROR
+};
+
+static const TpPresenceStatusSpec statuses[] = {
+  { "available", TP_CONNECTION_PRESENCE_TYPE_AVAILABLE, TRUE, NULL },
+  { "away", TP_CONNECTION_PRESENCE_TYPE_AWAY, TRUE, NULL },
+  { "busy", TP_CONNECTION_PRESENCE_TYPE_BUSY, TRUE, NULL },
+  { "offline", TP_CONNECTION_PRESENCE_TYPE_OFFLINE, FALSE, NULL },
+  { "unknown", TP_CONNECTION_PRESENCE_TYPE_UNKNOWN, FALSE, NULL },
+  { "error", TP_CONNECTION_PRESENCE_TYPE_ERROR, FALSE, NULL },
+  { NULL }
+};
+
+/* Most contacts start online */
+static const guint initial_statuses[] = {
+  STATUS_AVAILABLE, STATUS_AVAILABLE, STATUS_AWAY, STATUS_BUSY, STATUS_OFFLINE
+};
+
+static const gchar *avatar_mime_types[] = { "image/png", NULL };
+
+typedef struct
+{
+  /* in the roster, from 0 */
+  guint index;
+  gchar *alias;
+  /* how many times it has been renamed */
+  guint revision;
+  /* NULL if it has no avatar */
+  gchar *avatar_token;
+  guint status;
+  GStrv groups;
+} Contact;
+
+static void
+contact_free (Contact *contact)
+{
+  g_free (contact->alias);
+  g_free (contact->avatar_token);
+  g_strfreev (contact->groups);
+  g_slice_free (Contact, contact);
+}
+
+/* The contact list */
+
+typedef struct _TestRosterContactList TestRosterContactList;
+typedef struct _TestRosterContactListClass TestRosterContactListClass;
+
+struct _TestRosterContactListClass
+{
+  TpBaseContactListClass parent_class;
+};
+
+struct _TestRosterContactList
+{
+  TpBaseContactList parent;
+};
+
+/* Forward decl */
+GType test_roster_contact_list_get_type (void);
+
+static void contact_group_list_iface_init (TpContactGroupListInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestRosterContactList, test_roster_contact_list,
+    TP_TYPE_BASE_CONTACT_LIST,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_CONTACT_GROUP_LIST,
+      contact_group_list_iface_init))
+
+/* The connection */
+
+struct _TestRosterConnectionPriv
+{
+  guint account;
+  guint n_contacts;
+  guint n_groups;
+
+  /* TpHandle => owned Contact */
+  GHashTable *contacts;
+  /* TpHandle, in the order of the contacts */
+  GArray *handles;
+
+  /* borrowed, the base connection owns it */
+  TestRosterContactList *contact_list;
+};
+
+enum
+{
+  PROP_ACCOUNT = 1,
+  PROP_N_CONTACTS,
+  PROP_N_GROUPS,
+};
+
+static void aliasing_iface_init (gpointer g_iface, gpointer iface_data);
+static void avatars_iface_init (gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestRosterConnection, test_roster_connection,
+    TP_TYPE_BASE_CONNECTION,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_ALIASING,
+      aliasing_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_AVATARS,
+      avatars_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_CONTACTS,
+      tp_contacts_mixin_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_CONTACT_LIST,
+      tp_base_contact_list_mixin_list_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_CONTACT_GROUPS,
+      tp_base_contact_list_mixin_groups_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+      tp_presence_mixin_simple_presence_iface_init))
+
+static const gchar *interfaces_always_present[] = {
+  TP_IFACE_CONNECTION_INTERFACE_ALIASING,
+  TP_IFACE_CONNECTION_INTERFACE_AVATARS,
+  TP_IFACE_CONNECTION_INTERFACE_CONTACTS,
+  TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST,
+  TP_IFACE_CONNECTION_INTERFACE_CONTACT_GROUPS,
+  TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+  NULL
+};
+
+static gchar *
+dup_group_name (guint group)
+{
+  return g_strdup_printf ("Group %u", group);
+}
+
+/**
+ * test_roster_dup_self_id:
+ * @account: the number of the account
+ *
+ * Return value: the identifier of the user on the account
+ */
+gchar *
+test_roster_dup_self_id (guint account)
+{
+  return g_strdup_printf ("me@account%u.example.com", account);
+}
+
+/**
+ * test_roster_dup_contact_id:
+ * @account: the number of the account
+ * @contact: the number of the contact in its roster
+ *
+ * Return value: the identifier of the contact
+ */
+gchar *
+test_roster_dup_contact_id (guint account,
+    guint contact)
+{
+  return g_strdup_printf ("contact%u@account%u.example.com", contact,
+      account);
+}
+
+/**
+ * test_roster_dup_alias:
+ * @contact: the number of the contact in its roster
+ * @revision: how many times the contact has been renamed
+ *
+ * Aliases are made of a first and a last name, so searches match several
+ * contacts, and renaming a contact moves it in rosters sorted by name.
+ *
+ * Return value: the alias of the contact
+ */
+gchar *
+test_roster_dup_alias (guint contact,
+    guint revision)
+{
+  guint n_first = G_N_ELEMENTS (first_names);
+  guint n_last = G_N_ELEMENTS (last_names);
+  guint n = contact + revision * 1009;
+  const gchar *first, *last;
+
+  first = first_names[n % n_first];
+  last = last_names[(n / n_first) % n_last];
+
+  if (contact < n_first * n_last)
+    return g_strdup_printf ("%s %s", first, last);
+
+  return g_strdup_printf ("%s %s %u", first, last,
+      contact / (n_first * n_last) + 1);
+}
+
+/* The avatar of the contacts with token "avatar<n>", shared by all the
+ * connections */
+static const GArray *
+get_avatar (guint n)
+{
+  static GArray *avatars[G_N_ELEMENTS (avatar_colours)] = { NULL, };
+
+  if (avatars[n] == NULL)
+    {
+      GdkPixbuf *pixbuf;
+      gchar *buffer;
+      gsize size;
+      GError *error = NULL;
+
+      pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, AVATAR_SIZE,
+          AVATAR_SIZE);
+      gdk_pixbuf_fill (pixbuf, avatar_colours[n]);
+
+      gdk_pixbuf_save_to_buffer (pixbuf, &buffer, &size, "png", &error, NULL);
+      g_assert_no_error (error);
+
+      avatars[n] = g_array_sized_new (FALSE, FALSE, sizeof (gchar), size);
+      g_array_append_vals (avatars[n], buffer, size);
+
+      g_free (buffer);
+      g_object_unref (pixbuf);
+    }
+
+  return avatars[n];
+}
+
+static Contact *
+contact_new (guint n_groups,
+    guint index)
+{
+  Contact *contact = g_slice_new0 (Contact);
+  GPtrArray *groups;
+
+  contact->index = index;
+  contact->alias = test_roster_dup_alias (index, 0);
+
+  /* One contact out of four has no avatar */
+  if (index % 4 != 3)
+    contact->avatar_token = g_strdup_printf ("avatar%u",
+        index % G_N_ELEMENTS (avatar_colours));
+
+  contact->status = initial_statuses[index % G_N_ELEMENTS (initial_statuses)];
+
+  /* In a group, and one contact out of five in another one too */
+  groups = g_ptr_array_new ();
+
+  if (n_groups > 0)
+    g_ptr_array_add (groups, dup_group_name (index % n_groups));
+
+  if (n_groups > 1 && index % 5 == 0)
+    g_ptr_array_add (groups, dup_group_name ((index + 1) % n_groups));
+
+  g_ptr_array_add (groups, NULL);
+  contact->groups = (GStrv) g_ptr_array_free (groups, FALSE);
+
+  return contact;
+}
+
+static Contact *
+lookup_contact (TestRosterConnection *self,
+    TpHandle handle)
+{
+  return g_hash_table_lookup (self->priv->contacts, GUINT_TO_POINTER (handle));
+}
+
+static const gchar *
+get_alias (TestRosterConnection *self,
+    TpHandle handle)
+{
+  TpBaseConnection *base = TP_BASE_CONNECTION (self);
+  Contact *contact;
+
+  if (handle == tp_base_connection_get_self_handle (base))
+    return "Me";
+
+  contact = lookup_contact (self, handle);
+  if (contact != NULL)
+    return contact->alias;
+
+  return tp_handle_inspect (
+      tp_base_connection_get_handles (base, TP_HANDLE_TYPE_CONTACT), handle);
+}
+
+/* "" if @handle has no avatar */
+static const gchar *
+get_avatar_token (TestRosterConnection *self,
+    TpHandle handle)
+{
+  Contact *contact = lookup_contact (self, handle);
+
+  if (contact == NULL || contact->avatar_token == NULL)
+    return "";
+
+  return contact->avatar_token;
+}
+
+static TestRosterConnection *
+contact_list_get_connection (TpBaseContactList *list)
+{
+  return TEST_ROSTER_CONNECTION (
+      tp_base_contact_list_get_connection (list, NULL));
+}
+
+static TpHandleSet *
+contact_list_dup_contacts (TpBaseContactList *list)
+{
+  TestRosterConnection *conn = contact_list_get_connection (list);
+  TpHandleSet *contacts;
+  guint i;
+
+  contacts = tp_handle_set_new (tp_base_connection_get_handles (
+        TP_BASE_CONNECTION (conn), TP_HANDLE_TYPE_CONTACT));
+
+  for (i = 0; i < conn->priv->handles->len; i++)
+    tp_handle_set_add (contacts,
+        g_array_index (conn->priv->handles, TpHandle, i));
+
+  return contacts;
+}
+
+static void
+contact_list_dup_states (TpBaseContactList *list,
+    TpHandle handle,
+    TpSubscriptionState *subscribe,
+    TpSubscriptionState *publish,
+    gchar **publish_request)
+{
+  TestRosterConnection *conn = contact_list_get_connection (list);
+  TpSubscriptionState state;
+
+  if (lookup_contact (conn, handle) != NULL)
+    state = TP_SUBSCRIPTION_STATE_YES;
+  else
+    state = TP_SUBSCRIPTION_STATE_NO;
+
+  if (subscribe != NULL)
+    *subscribe = state;
+
+  if (publish != NULL)
+    *publish = state;
+
+  if (publish_request != NULL)
+    *publish_request = NULL;
+}
+
+static GStrv
+contact_list_dup_groups (TpBaseContactList *list)
+{
+  TestRosterConnection *conn = contact_list_get_connection (list);
+  GPtrArray *groups;
+  guint i;
+
+  groups = g_ptr_array_sized_new (conn->priv->n_groups + 1);
+
+  for (i = 0; i < conn->priv->n_groups; i++)
+    g_ptr_array_add (groups, dup_group_name (i));
+
+  g_ptr_array_add (groups, NULL);
+
+  return (GStrv) g_ptr_array_free (groups, FALSE);
+}
+
+static GStrv
+contact_list_dup_contact_groups (TpBaseContactList *list,
+    TpHandle handle)
+{
+  Contact *contact;
+
+  contact = lookup_contact (contact_list_get_connection (list), handle);
+  if (contact == NULL)
+    return g_new0 (gchar *, 1);
+
+  return g_strdupv (contact->groups);
+}
+
+static TpHandleSet *
+contact_list_dup_group_members (TpBaseContactList *list,
+    const gchar *group)
+{
+  TestRosterConnection *conn = contact_list_get_connection (list);
+  TpHandleSet *members;
+  GHashTableIter iter;
+  gpointer handle, contact;
+
+  members = tp_handle_set_new (tp_base_connection_get_handles (
+        TP_BASE_CONNECTION (conn), TP_HANDLE_TYPE_CONTACT));
+
+  g_hash_table_iter_init (&iter, conn->priv->contacts);
+  while (g_hash_table_iter_next (&iter, &handle, &contact))
+    {
+      if (tp_strv_contains ((const gchar * const *)
+            ((Contact *) contact)->groups, group))
+        tp_handle_set_add (members, GPOINTER_TO_UINT (handle));
+    }
+
+  return members;
+}
+
+static void
+test_roster_contact_list_init (TestRosterContactList *self)
+{
+}
+
+static void
+test_roster_contact_list_class_init (TestRosterContactListClass *klass)
+{
+  TpBaseContactListClass *list_class = TP_BASE_CONTACT_LIST_CLASS (klass);
+
+  list_class->dup_contacts = contact_list_dup_contacts;
+  list_class->dup_states = contact_list_dup_states;
+}
+
+static void
+contact_group_list_iface_init (TpContactGroupListInterface *iface)
+{
+  iface->dup_groups = contact_list_dup_groups;
+  iface->dup_contact_groups = contact_list_dup_contact_groups;
+  iface->dup_group_members = contact_list_dup_group_members;
+}
+
+/* Aliasing */
+
+static void
+aliasing_fill_contact_attributes (GObject *object,
+    const GArray *contacts,
+    GHashTable *attributes)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (object);
+  guint i;
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+
+      tp_contacts_mixin_set_contact_attribute (attributes, handle,
+          TP_TOKEN_CONNECTION_INTERFACE_ALIASING_ALIAS,
+          tp_g_value_slice_new_string (get_alias (self, handle)));
+    }
+}
+
+static gboolean
+check_contacts (TestRosterConnection *self,
+    const GArray *contacts,
+    DBusGMethodInvocation *context)
+{
+  TpHandleRepoIface *contact_repo;
+  GError *error = NULL;
+
+  contact_repo = tp_base_connection_get_handles (TP_BASE_CONNECTION (self),
+      TP_HANDLE_TYPE_CONTACT);
+
+  if (!tp_handles_are_valid (contact_repo, contacts, FALSE, &error))
+    {
+      dbus_g_method_return_error (context, error);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+aliasing_get_alias_flags (TpSvcConnectionInterfaceAliasing *iface,
+    DBusGMethodInvocation *context)
+{
+  TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (TP_BASE_CONNECTION (iface),
+      context);
+
+  tp_svc_connection_interface_aliasing_return_from_get_alias_flags (context,
+      0);
+}
+
+static void
+aliasing_get_aliases (TpSvcConnectionInterfaceAliasing *iface,
+    const GArray *contacts,
+    DBusGMethodInvocation *context)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (iface);
+  GHashTable *aliases;
+  guint i;
+
+  TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (TP_BASE_CONNECTION (iface),
+      context);
+
+  if (!check_contacts (self, contacts, context))
+    return;
+
+  aliases = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+
+      g_hash_table_insert (aliases, GUINT_TO_POINTER (handle),
+          (gchar *) get_alias (self, handle));
+    }
+
+  tp_svc_connection_interface_aliasing_return_from_get_aliases (context,
+      aliases);
+  g_hash_table_unref (aliases);
+}
+
+static void
+aliasing_request_aliases (TpSvcConnectionInterfaceAliasing *iface,
+    const GArray *contacts,
+    DBusGMethodInvocation *context)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (iface);
+  const gchar **aliases;
+  guint i;
+
+  TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (TP_BASE_CONNECTION (iface),
+      context);
+
+  if (!check_contacts (self, contacts, context))
+    return;
+
+  aliases = g_new0 (const gchar *, contacts->len + 1);
+
+  for (i = 0; i < contacts->len; i++)
+    aliases[i] = get_alias (self, g_array_index (contacts, TpHandle, i));
+
+  tp_svc_connection_interface_aliasing_return_from_request_aliases (context,
+      aliases);
+  g_free (aliases);
+}
+
+static void
+aliasing_iface_init (gpointer g_iface,
+    gpointer iface_data)
+{
+  TpSvcConnectionInterfaceAliasingClass *klass = g_iface;
+
+#define IMPLEMENT(x) tp_svc_connection_interface_aliasing_implement_##x (\
+    klass, aliasing_##x)
+  IMPLEMENT (get_alias_flags);
+  IMPLEMENT (get_aliases);
+  IMPLEMENT (request_aliases);
+#undef IMPLEMENT
+}
+
+/* Avatars */
+
+static TpDBusPropertiesMixinPropImpl avatars_properties[] = {
+  { "SupportedAvatarMIMETypes", NULL, NULL },
+  { "MinimumAvatarHeight", NULL, NULL },
+  { "MinimumAvatarWidth", NULL, NULL },
+  { "RecommendedAvatarHeight", NULL, NULL },
+  { "RecommendedAvatarWidth", NULL, NULL },
+  { "MaximumAvatarHeight", NULL, NULL },
+  { "MaximumAvatarWidth", NULL, NULL },
+  { "MaximumAvatarBytes", NULL, NULL },
+  { NULL }
+};
+
+static void
+avatars_get_property (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  const gchar *property = g_quark_to_string (name);
+
+  if (!tp_strdiff (property, "SupportedAvatarMIMETypes"))
+    g_value_set_boxed (value, avatar_mime_types);
+  else if (g_str_has_prefix (property, "Minimum"))
+    g_value_set_uint (value, 0);
+  else if (!tp_strdiff (property, "MaximumAvatarBytes"))
+    g_value_set_uint (value, 64 * 1024);
+  else
+    g_value_set_uint (value, AVATAR_SIZE);
+}
+
+static void
+avatars_fill_contact_attributes (GObject *object,
+    const GArray *contacts,
+    GHashTable *attributes)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (object);
+  guint i;
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+
+      tp_contacts_mixin_set_contact_attribute (attributes, handle,
+          TP_TOKEN_CONNECTION_INTERFACE_AVATARS_TOKEN,
+          tp_g_value_slice_new_string (get_avatar_token (self, handle)));
+    }
+}
+
+static void
+avatars_get_known_avatar_tokens (TpSvcConnectionInterfaceAvatars *iface,
+    const GArray *contacts,
+    DBusGMethodInvocation *context)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (iface);
+  GHashTable *tokens;
+  guint i;
+
+  TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (TP_BASE_CONNECTION (iface),
+      context);
+
+  if (!check_contacts (self, contacts, context))
+    return;
+
+  tokens = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+
+      g_hash_table_insert (tokens, GUINT_TO_POINTER (handle),
+          (gchar *) get_avatar_token (self, handle));
+    }
+
+  tp_svc_connection_interface_avatars_return_from_get_known_avatar_tokens (
+      context, tokens);
+  g_hash_table_unref (tokens);
+}
+
+static void
+avatars_request_avatars (TpSvcConnectionInterfaceAvatars *iface,
+    const GArray *contacts,
+    DBusGMethodInvocation *context)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (iface);
+  guint i;
+
+  TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (TP_BASE_CONNECTION (iface),
+      context);
+
+  if (!check_contacts (self, contacts, context))
+    return;
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+      Contact *contact = lookup_contact (self, handle);
+
+      if (contact == NULL || contact->avatar_token == NULL)
+        continue;
+
+      tp_svc_connection_interface_avatars_emit_avatar_retrieved (self,
+          handle, contact->avatar_token,
+          get_avatar (contact->index % G_N_ELEMENTS (avatar_colours)),
+          avatar_mime_types[0]);
+    }
+
+  tp_svc_connection_interface_avatars_return_from_request_avatars (context);
+}
+
+static void
+avatars_iface_init (gpointer g_iface,
+    gpointer iface_data)
+{
+  TpSvcConnectionInterfaceAvatarsClass *klass = g_iface;
+
+#define IMPLEMENT(x) tp_svc_connection_interface_avatars_implement_##x (\
+    klass, avatars_##x)
+  IMPLEMENT (get_known_avatar_tokens);
+  IMPLEMENT (request_avatars);
+#undef IMPLEMENT
+}
+
+/* Presence */
+
+static gboolean
+status_available (GObject *object,
+    guint which)
+{
+  return TRUE;
+}
+
+static GHashTable *
+get_contact_statuses (GObject *object,
+    const GArray *contacts,
+    GError **error)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (object);
+  TpHandle self_handle;
+  GHashTable *result;
+  guint i;
+
+  self_handle = tp_base_connection_get_self_handle (TP_BASE_CONNECTION (self));
+  result = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) tp_presence_status_free);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+      Contact *contact = lookup_contact (self, handle);
+      guint status;
+
+      if (handle == self_handle)
+        status = STATUS_AVAILABLE;
+      else if (contact != NULL)
+        status = contact->status;
+      else
+        status = STATUS_UNKNOWN;
+
+      g_hash_table_insert (result, GUINT_TO_POINTER (handle),
+          tp_presence_status_new (status, NULL));
+    }
+
+  return result;
+}
+
+static gboolean
+set_own_status (GObject *object,
+    const TpPresenceStatus *status,
+    GError **error)
+{
+  return TRUE;
+}
+
+/* TpBaseConnection */
+
+static gchar *
+normalize_contact (TpHandleRepoIface *repo,
+    const gchar *id,
+    gpointer context,
+    GError **error)
+{
+  if (strchr (id, '@') == NULL)
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_INVALID_HANDLE,
+          "Not a contact identifier: %s", id);
+      return NULL;
+    }
+
+  return g_utf8_strdown (id, -1);
+}
+
+static void
+create_handle_repos (TpBaseConnection *base,
+    TpHandleRepoIface *repos[TP_NUM_HANDLE_TYPES])
+{
+  repos[TP_HANDLE_TYPE_CONTACT] = tp_dynamic_handle_repo_new (
+      TP_HANDLE_TYPE_CONTACT, normalize_contact, NULL);
+}
+
+static GPtrArray *
+create_channel_managers (TpBaseConnection *base)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (base);
+  GPtrArray *managers = g_ptr_array_sized_new (1);
+
+  self->priv->contact_list = g_object_new (
+      test_roster_contact_list_get_type (),
+      "connection", self,
+      NULL);
+  g_ptr_array_add (managers, self->priv->contact_list);
+
+  return managers;
+}
+
+static GPtrArray *
+get_interfaces_always_present (TpBaseConnection *base)
+{
+  GPtrArray *interfaces;
+  guint i;
+
+  interfaces = TP_BASE_CONNECTION_CLASS (
+      test_roster_connection_parent_class)->get_interfaces_always_present (
+          base);
+
+  for (i = 0; interfaces_always_present[i] != NULL; i++)
+    g_ptr_array_add (interfaces, (gchar *) interfaces_always_present[i]);
+
+  return interfaces;
+}
+
+/* The whole roster is there as soon as we're connected */
+static gboolean
+start_connecting (TpBaseConnection *base,
+    GError **error)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (base);
+  TpHandleRepoIface *contact_repo;
+  TpHandle self_handle;
+  gchar *id;
+  guint i;
+
+  contact_repo = tp_base_connection_get_handles (base,
+      TP_HANDLE_TYPE_CONTACT);
+
+  id = test_roster_dup_self_id (self->priv->account);
+  self_handle = tp_handle_ensure (contact_repo, id, NULL, error);
+  g_free (id);
+
+  if (self_handle == 0)
+    return FALSE;
+
+  tp_base_connection_set_self_handle (base, self_handle);
+  tp_base_connection_change_status (base, TP_CONNECTION_STATUS_CONNECTING,
+      TP_CONNECTION_STATUS_REASON_REQUESTED);
+
+  for (i = 0; i < self->priv->n_contacts; i++)
+    {
+      TpHandle handle;
+
+      id = test_roster_dup_contact_id (self->priv->account, i);
+      handle = tp_handle_ensure (contact_repo, id, NULL, NULL);
+      g_free (id);
+
+      g_array_append_val (self->priv->handles, handle);
+      g_hash_table_insert (self->priv->contacts, GUINT_TO_POINTER (handle),
+          contact_new (self->priv->n_groups, i));
+    }
+
+  tp_base_connection_change_status (base, TP_CONNECTION_STATUS_CONNECTED,
+      TP_CONNECTION_STATUS_REASON_REQUESTED);
+  tp_base_contact_list_set_list_received (
+      TP_BASE_CONTACT_LIST (self->priv->contact_list));
+
+  return TRUE;
+}
+
+static void
+shut_down (TpBaseConnection *base)
+{
+  tp_base_connection_finish_shutdown (base);
+}
+
+static void
+test_roster_connection_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (object);
+
+  switch (property_id)
+    {
+      case PROP_ACCOUNT:
+        g_value_set_uint (value, self->priv->account);
+        break;
+      case PROP_N_CONTACTS:
+        g_value_set_uint (value, self->priv->n_contacts);
+        break;
+      case PROP_N_GROUPS:
+        g_value_set_uint (value, self->priv->n_groups);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+test_roster_connection_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (object);
+
+  switch (property_id)
+    {
+      case PROP_ACCOUNT:
+        self->priv->account = g_value_get_uint (value);
+        break;
+      case PROP_N_CONTACTS:
+        self->priv->n_contacts = g_value_get_uint (value);
+        break;
+      case PROP_N_GROUPS:
+        self->priv->n_groups = g_value_get_uint (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+test_roster_connection_constructed (GObject *object)
+{
+  TpBaseConnection *base = TP_BASE_CONNECTION (object);
+
+  G_OBJECT_CLASS (test_roster_connection_parent_class)->constructed (object);
+
+  tp_contacts_mixin_init (object,
+      G_STRUCT_OFFSET (TestRosterConnection, contacts_mixin));
+  tp_base_connection_register_with_contacts_mixin (base);
+  tp_base_contact_list_mixin_register_with_contacts_mixin (base);
+
+  tp_contacts_mixin_add_contact_attributes_iface (object,
+      TP_IFACE_CONNECTION_INTERFACE_ALIASING,
+      aliasing_fill_contact_attributes);
+  tp_contacts_mixin_add_contact_attributes_iface (object,
+      TP_IFACE_CONNECTION_INTERFACE_AVATARS,
+      avatars_fill_contact_attributes);
+
+  tp_presence_mixin_init (object,
+      G_STRUCT_OFFSET (TestRosterConnection, presence_mixin));
+  tp_presence_mixin_simple_presence_register_with_contacts_mixin (object);
+}
+
+static void
+test_roster_connection_finalize (GObject *object)
+{
+  TestRosterConnection *self = TEST_ROSTER_CONNECTION (object);
+
+  tp_contacts_mixin_finalize (object);
+  tp_presence_mixin_finalize (object);
+
+  g_hash_table_unref (self->priv->contacts);
+  g_array_unref (self->priv->handles);
+
+  G_OBJECT_CLASS (test_roster_connection_parent_class)->finalize (object);
+}
+
+static void
+test_roster_connection_class_init (TestRosterConnectionClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  TpBaseConnectionClass *base_class = TP_BASE_CONNECTION_CLASS (klass);
+  GParamSpec *spec;
+
+  object_class->get_property = test_roster_connection_get_property;
+  object_class->set_property = test_roster_connection_set_property;
+  object_class->constructed = test_roster_connection_constructed;
+  object_class->finalize = test_roster_connection_finalize;
+
+  base_class->create_handle_repos = create_handle_repos;
+  base_class->create_channel_managers = create_channel_managers;
+  base_class->get_interfaces_always_present = get_interfaces_always_present;
+  base_class->start_connecting = start_connecting;
+  base_class->shut_down = shut_down;
+
+  spec = g_param_spec_uint ("account", "Account",
+      "The number of the account of the connection",
+      0, G_MAXUINT, 0,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_ACCOUNT, spec);
+
+  spec = g_param_spec_uint ("n-contacts", "Contacts",
+      "The number of contacts in the roster",
+      0, G_MAXUINT, 0,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_N_CONTACTS, spec);
+
+  spec = g_param_spec_uint ("n-groups", "Groups",
+      "The number of groups in the roster",
+      0, G_MAXUINT, 0,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_N_GROUPS, spec);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS, avatars_get_property,
+      NULL, avatars_properties);
+
+  tp_contacts_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (TestRosterConnectionClass, contacts_mixin));
+
+  tp_presence_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (TestRosterConnectionClass, presence_mixin),
+      status_available, get_contact_statuses, set_own_status, statuses);
+  tp_presence_mixin_simple_presence_init_dbus_properties (object_class);
+
+  tp_base_contact_list_mixin_class_init (base_class);
+
+  g_type_class_add_private (object_class, sizeof (TestRosterConnectionPriv));
+}
+
+static void
+test_roster_connection_init (TestRosterConnection *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      TEST_TYPE_ROSTER_CONNECTION, TestRosterConnectionPriv);
+
+  self->priv->contacts = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) contact_free);
+  self->priv->handles = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+}
+
+/**
+ * test_roster_connection_new:
+ * @account: the number of the account
+ * @n_contacts: the number of contacts in the roster
+ * @n_groups: the number of groups they are in
+ *
+ * Return value: a new connection, to be registered on the bus with
+ * tp_base_connection_register() and then connected
+ */
+TestRosterConnection *
+test_roster_connection_new (guint account,
+    guint n_contacts,
+    guint n_groups)
+{
+  return g_object_new (TEST_TYPE_ROSTER_CONNECTION,
+      "protocol", TEST_ROSTER_PROTOCOL_NAME,
+      "account", account,
+      "n-contacts", n_contacts,
+      "n-groups", n_groups,
+      NULL);
+}
+
+/**
+ * test_roster_connection_connect:
+ * @self: a #TestRosterConnection
+ *
+ * Connects right away, without waiting for the Connect() call a real
+ * account manager would make, and publishes the whole roster.
+ */
+void
+test_roster_connection_connect (TestRosterConnection *self)
+{
+  GError *error = NULL;
+
+  start_connecting (TP_BASE_CONNECTION (self), &error);
+  g_assert_no_error (error);
+}
+
+/**
+ * test_roster_connection_disconnect:
+ * @self: a #TestRosterConnection
+ *
+ * Disconnects as if the network had gone away.
+ */
+void
+test_roster_connection_disconnect (TestRosterConnection *self)
+{
+  tp_base_connection_change_status (TP_BASE_CONNECTION (self),
+      TP_CONNECTION_STATUS_DISCONNECTED,
+      TP_CONNECTION_STATUS_REASON_NETWORK_ERROR);
+}
+
+static Contact *
+pick_contact (TestRosterConnection *self,
+    GRand *rand,
+    TpHandle *handle)
+{
+  guint n = g_rand_int_range (rand, 0, self->priv->handles->len);
+
+  *handle = g_array_index (self->priv->handles, TpHandle, n);
+
+  return lookup_contact (self, *handle);
+}
+
+/**
+ * test_roster_connection_change_presences:
+ * @self: a #TestRosterConnection
+ * @rand: where the contacts and their presences are picked from
+ * @n_changes: the number of changes
+ *
+ * Changes the presence of random contacts, in a burst of signals, as
+ * servers send them one by one.
+ */
+void
+test_roster_connection_change_presences (TestRosterConnection *self,
+    GRand *rand,
+    guint n_changes)
+{
+  guint i;
+
+  g_return_if_fail (self->priv->handles->len > 0);
+
+  for (i = 0; i < n_changes; i++)
+    {
+      TpHandle handle;
+      Contact *contact = pick_contact (self, rand, &handle);
+      TpPresenceStatus *status;
+
+      /* Any other one of available, away, busy and offline */
+      contact->status = (contact->status + g_rand_int_range (rand, 1, 4)) %
+          (STATUS_OFFLINE + 1);
+
+      status = tp_presence_status_new (contact->status, NULL);
+      tp_presence_mixin_emit_one_presence_update (G_OBJECT (self), handle,
+          status);
+      tp_presence_status_free (status);
+    }
+}
+
+/**
+ * test_roster_connection_change_aliases:
+ * @self: a #TestRosterConnection
+ * @rand: where the contacts are picked from
+ * @n_changes: the number of changes
+ *
+ * Renames random contacts, in a burst of signals.
+ */
+void
+test_roster_connection_change_aliases (TestRosterConnection *self,
+    GRand *rand,
+    guint n_changes)
+{
+  guint i;
+
+  g_return_if_fail (self->priv->handles->len > 0);
+
+  for (i = 0; i < n_changes; i++)
+    {
+      TpHandle handle;
+      Contact *contact = pick_contact (self, rand, &handle);
+      GPtrArray *aliases;
+
+      contact->revision++;
+      g_free (contact->alias);
+      contact->alias = test_roster_dup_alias (contact->index,
+          contact->revision);
+
+      aliases = g_ptr_array_new ();
+      g_ptr_array_add (aliases, tp_value_array_build (2,
+            G_TYPE_UINT, handle,
+            G_TYPE_STRING, contact->alias,
+            G_TYPE_INVALID));
+
+      tp_svc_connection_interface_aliasing_emit_aliases_changed (self,
+          aliases);
+      g_boxed_free (TP_ARRAY_TYPE_ALIAS_PAIR_LIST, aliases);
+    }
+}
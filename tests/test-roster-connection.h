@@ -0,0 +1,84 @@
+/*
+ * test-roster-connection.h - Header for the connection of the synthetic
+ * rosters
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TEST_ROSTER_CONNECTION_H__
+#define __TEST_ROSTER_CONNECTION_H__
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+/* The connection manager and protocol of the synthetic accounts */
+#define TEST_ROSTER_CM_NAME "rostercm"
+#define TEST_ROSTER_PROTOCOL_NAME "roster"
+
+typedef struct _TestRosterConnection TestRosterConnection;
+typedef struct _TestRosterConnectionClass TestRosterConnectionClass;
+typedef struct _TestRosterConnectionPriv TestRosterConnectionPriv;
+
+struct _TestRosterConnectionClass
+{
+  TpBaseConnectionClass parent_class;
+  TpContactsMixinClass contacts_mixin;
+  TpPresenceMixinClass presence_mixin;
+};
+
+struct _TestRosterConnection
+{
+  TpBaseConnection parent;
+  TpContactsMixin contacts_mixin;
+  TpPresenceMixin presence_mixin;
+
+  TestRosterConnectionPriv *priv;
+};
+
+GType test_roster_connection_get_type (void);
+
+#define TEST_TYPE_ROSTER_CONNECTION \
+  (test_roster_connection_get_type ())
+#define TEST_ROSTER_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TEST_TYPE_ROSTER_CONNECTION, \
+    TestRosterConnection))
+#define TEST_IS_ROSTER_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TEST_TYPE_ROSTER_CONNECTION))
+
+TestRosterConnection * test_roster_connection_new (guint account,
+    guint n_contacts,
+    guint n_groups);
+
+void test_roster_connection_connect (TestRosterConnection *self);
+void test_roster_connection_disconnect (TestRosterConnection *self);
+
+void test_roster_connection_change_presences (TestRosterConnection *self,
+    GRand *rand,
+    guint n_changes);
+void test_roster_connection_change_aliases (TestRosterConnection *self,
+    GRand *rand,
+    guint n_changes);
+
+gchar * test_roster_dup_self_id (guint account);
+gchar * test_roster_dup_contact_id (guint account,
+    guint contact);
+gchar * test_roster_dup_alias (guint contact,
+    guint revision);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,723 @@
+/*
+ * test-roster.c - Synthetic rosters used by the benchmarks
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Folks only gets contacts from accounts of the account manager, and
+ * Empathy only keeps the individuals having a Telepathy contact, so the
+ * rosters are published by an account manager and connections exported by
+ * the test itself, on a private bus. Nothing else runs there: folks only
+ * uses its Telepathy backend, and caches in a temporary directory. */
+
+#include "config.h"
+#include "test-roster.h"
+
+#include <telepathy-glib/telepathy-glib-dbus.h>
+
+#include "test-helper.h"
+
+struct _TestRoster
+{
+  GTestDBus *bus;
+  gchar *dir;
+  TpDBusDaemon *dbus;
+  GRand *rand;
+
+  GObject *manager;
+  /* owned TestRosterAccount */
+  GPtrArray *accounts;
+};
+
+/* An account of the account manager */
+
+typedef struct _TestRosterAccount TestRosterAccount;
+typedef struct _TestRosterAccountClass TestRosterAccountClass;
+
+struct _TestRosterAccountClass
+{
+  GObjectClass parent_class;
+  TpDBusPropertiesMixinClass dbus_props_class;
+};
+
+struct _TestRosterAccount
+{
+  GObject parent;
+
+  guint index;
+  gchar *path;
+  guint n_contacts;
+  guint n_groups;
+  /* a TestRosterConnection subclass */
+  GType conn_type;
+
+  /* NULL when disconnected */
+  TestRosterConnection *conn;
+  gchar *conn_path;
+  TpConnectionStatus status;
+  TpConnectionStatusReason reason;
+};
+
+/* Forward decl */
+GType test_roster_account_get_type (void);
+
+G_DEFINE_TYPE_WITH_CODE (TestRosterAccount, test_roster_account,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_ACCOUNT, NULL);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
+      tp_dbus_properties_mixin_iface_init))
+
+#define TEST_ROSTER_ACCOUNT(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), test_roster_account_get_type (), \
+    TestRosterAccount))
+
+static const gchar *no_interfaces[] = { NULL };
+
+static GValueArray *
+account_dup_presence (TestRosterAccount *self)
+{
+  if (self->status == TP_CONNECTION_STATUS_CONNECTED)
+    return tp_value_array_build (3,
+        G_TYPE_UINT, TP_CONNECTION_PRESENCE_TYPE_AVAILABLE,
+        G_TYPE_STRING, "available",
+        G_TYPE_STRING, "",
+        G_TYPE_INVALID);
+
+  return tp_value_array_build (3,
+      G_TYPE_UINT, TP_CONNECTION_PRESENCE_TYPE_OFFLINE,
+      G_TYPE_STRING, "offline",
+      G_TYPE_STRING, "",
+      G_TYPE_INVALID);
+}
+
+static const gchar *
+account_get_error (TestRosterAccount *self)
+{
+  if (self->reason == TP_CONNECTION_STATUS_REASON_NETWORK_ERROR)
+    return TP_ERROR_STR_NETWORK_ERROR;
+
+  return "";
+}
+
+static TpDBusPropertiesMixinPropImpl account_properties[] = {
+  { "Interfaces", NULL, NULL },
+  { "DisplayName", NULL, NULL },
+  { "Icon", NULL, NULL },
+  { "Valid", NULL, NULL },
+  { "Enabled", NULL, NULL },
+  { "Nickname", NULL, NULL },
+  { "Service", NULL, NULL },
+  { "Parameters", NULL, NULL },
+  { "AutomaticPresence", NULL, NULL },
+  { "ConnectAutomatically", NULL, NULL },
+  { "Connection", NULL, NULL },
+  { "ConnectionStatus", NULL, NULL },
+  { "ConnectionStatusReason", NULL, NULL },
+  { "ConnectionError", NULL, NULL },
+  { "ConnectionErrorDetails", NULL, NULL },
+  { "CurrentPresence", NULL, NULL },
+  { "RequestedPresence", NULL, NULL },
+  { "ChangingPresence", NULL, NULL },
+  { "NormalizedName", NULL, NULL },
+  { "HasBeenOnline", NULL, NULL },
+  { "Supersedes", NULL, NULL },
+  { NULL }
+};
+
+static void
+account_get_property (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  TestRosterAccount *self = TEST_ROSTER_ACCOUNT (object);
+  const gchar *property = g_quark_to_string (name);
+
+  if (!tp_strdiff (property, "Interfaces"))
+    {
+      g_value_set_boxed (value, no_interfaces);
+    }
+  else if (!tp_strdiff (property, "DisplayName"))
+    {
+      g_value_take_string (value,
+          g_strdup_printf ("Roster account %u", self->index));
+    }
+  else if (!tp_strdiff (property, "Icon"))
+    {
+      g_value_set_string (value, "im-jabber");
+    }
+  else if (!tp_strdiff (property, "Valid") ||
+      !tp_strdiff (property, "Enabled") ||
+      !tp_strdiff (property, "ConnectAutomatically") ||
+      !tp_strdiff (property, "HasBeenOnline"))
+    {
+      g_value_set_boolean (value, TRUE);
+    }
+  else if (!tp_strdiff (property, "ChangingPresence"))
+    {
+      g_value_set_boolean (value, FALSE);
+    }
+  else if (!tp_strdiff (property, "Nickname"))
+    {
+      g_value_set_string (value, "Me");
+    }
+  else if (!tp_strdiff (property, "Service"))
+    {
+      g_value_set_string (value, TEST_ROSTER_PROTOCOL_NAME);
+    }
+  else if (!tp_strdiff (property, "Parameters"))
+    {
+      gchar *id = test_roster_dup_self_id (self->index);
+
+      g_value_take_boxed (value, tp_asv_new (
+            "account", G_TYPE_STRING, id,
+            NULL));
+      g_free (id);
+    }
+  else if (!tp_strdiff (property, "NormalizedName"))
+    {
+      g_value_take_string (value, test_roster_dup_self_id (self->index));
+    }
+  else if (!tp_strdiff (property, "AutomaticPresence") ||
+      !tp_strdiff (property, "RequestedPresence"))
+    {
+      g_value_take_boxed (value, tp_value_array_build (3,
+            G_TYPE_UINT, TP_CONNECTION_PRESENCE_TYPE_AVAILABLE,
+            G_TYPE_STRING, "available",
+            G_TYPE_STRING, "",
+            G_TYPE_INVALID));
+    }
+  else if (!tp_strdiff (property, "CurrentPresence"))
+    {
+      g_value_take_boxed (value, account_dup_presence (self));
+    }
+  else if (!tp_strdiff (property, "Connection"))
+    {
+      g_value_set_boxed (value, self->conn_path);
+    }
+  else if (!tp_strdiff (property, "ConnectionStatus"))
+    {
+      g_value_set_uint (value, self->status);
+    }
+  else if (!tp_strdiff (property, "ConnectionStatusReason"))
+    {
+      g_value_set_uint (value, self->reason);
+    }
+  else if (!tp_strdiff (property, "ConnectionError"))
+    {
+      g_value_set_string (value, account_get_error (self));
+    }
+  else if (!tp_strdiff (property, "ConnectionErrorDetails"))
+    {
+      g_value_take_boxed (value, tp_asv_new (NULL, NULL));
+    }
+  else if (!tp_strdiff (property, "Supersedes"))
+    {
+      g_value_take_boxed (value, g_ptr_array_new ());
+    }
+}
+
+static void
+account_emit_connection_changed (TestRosterAccount *self)
+{
+  GHashTable *changes, *details;
+  GValueArray *presence;
+
+  details = tp_asv_new (NULL, NULL);
+  presence = account_dup_presence (self);
+
+  changes = tp_asv_new (
+      "Connection", DBUS_TYPE_G_OBJECT_PATH, self->conn_path,
+      "ConnectionStatus", G_TYPE_UINT, self->status,
+      "ConnectionStatusReason", G_TYPE_UINT, self->reason,
+      "ConnectionError", G_TYPE_STRING, account_get_error (self),
+      "ConnectionErrorDetails", TP_HASH_TYPE_STRING_VARIANT_MAP, details,
+      "CurrentPresence", TP_STRUCT_TYPE_SIMPLE_PRESENCE, presence,
+      NULL);
+
+  tp_svc_account_emit_account_property_changed (self, changes);
+
+  g_hash_table_unref (changes);
+  g_hash_table_unref (details);
+  tp_value_array_free (presence);
+}
+
+static void
+account_connect (TestRosterAccount *self)
+{
+  gchar *bus_name, *object_path;
+  GError *error = NULL;
+
+  g_return_if_fail (self->conn == NULL);
+
+  self->conn = g_object_new (self->conn_type,
+      "protocol", TEST_ROSTER_PROTOCOL_NAME,
+      "account", self->index,
+      "n-contacts", self->n_contacts,
+      "n-groups", self->n_groups,
+      NULL);
+
+  tp_base_connection_register (TP_BASE_CONNECTION (self->conn),
+      TEST_ROSTER_CM_NAME, &bus_name, &object_path, &error);
+  g_assert_no_error (error);
+
+  test_roster_connection_connect (self->conn);
+
+  g_free (self->conn_path);
+  self->conn_path = object_path;
+  self->status = TP_CONNECTION_STATUS_CONNECTED;
+  self->reason = TP_CONNECTION_STATUS_REASON_REQUESTED;
+
+  account_emit_connection_changed (self);
+
+  g_free (bus_name);
+}
+
+static void
+account_disconnect (TestRosterAccount *self)
+{
+  g_return_if_fail (self->conn != NULL);
+
+  test_roster_connection_disconnect (self->conn);
+  g_clear_object (&self->conn);
+
+  g_free (self->conn_path);
+  self->conn_path = g_strdup ("/");
+  self->status = TP_CONNECTION_STATUS_DISCONNECTED;
+  self->reason = TP_CONNECTION_STATUS_REASON_NETWORK_ERROR;
+
+  account_emit_connection_changed (self);
+}
+
+static void
+test_roster_account_finalize (GObject *object)
+{
+  TestRosterAccount *self = TEST_ROSTER_ACCOUNT (object);
+
+  if (self->conn != NULL)
+    account_disconnect (self);
+
+  g_free (self->path);
+  g_free (self->conn_path);
+
+  G_OBJECT_CLASS (test_roster_account_parent_class)->finalize (object);
+}
+
+static void
+test_roster_account_class_init (TestRosterAccountClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] = {
+    { TP_IFACE_ACCOUNT, account_get_property, NULL, account_properties },
+    { NULL }
+  };
+
+  object_class->finalize = test_roster_account_finalize;
+
+  klass->dbus_props_class.interfaces = prop_interfaces;
+  tp_dbus_properties_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (TestRosterAccountClass, dbus_props_class));
+}
+
+static void
+test_roster_account_init (TestRosterAccount *self)
+{
+  self->conn_path = g_strdup ("/");
+  self->status = TP_CONNECTION_STATUS_DISCONNECTED;
+  self->reason = TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED;
+}
+
+/* The account manager */
+
+typedef struct _TestRosterAccountManager TestRosterAccountManager;
+typedef struct _TestRosterAccountManagerClass TestRosterAccountManagerClass;
+
+struct _TestRosterAccountManagerClass
+{
+  GObjectClass parent_class;
+  TpDBusPropertiesMixinClass dbus_props_class;
+};
+
+struct _TestRosterAccountManager
+{
+  GObject parent;
+
+  /* borrowed, the roster owns it */
+  GPtrArray *accounts;
+};
+
+/* Forward decl */
+GType test_roster_account_manager_get_type (void);
+
+G_DEFINE_TYPE_WITH_CODE (TestRosterAccountManager,
+    test_roster_account_manager, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_ACCOUNT_MANAGER, NULL);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
+      tp_dbus_properties_mixin_iface_init))
+
+static TpDBusPropertiesMixinPropImpl account_manager_properties[] = {
+  { "Interfaces", NULL, NULL },
+  { "ValidAccounts", NULL, NULL },
+  { "InvalidAccounts", NULL, NULL },
+  { "SupportedAccountProperties", NULL, NULL },
+  { NULL }
+};
+
+static void
+account_manager_get_property (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  TestRosterAccountManager *self = (TestRosterAccountManager *) object;
+  const gchar *property = g_quark_to_string (name);
+
+  if (!tp_strdiff (property, "ValidAccounts"))
+    {
+      GPtrArray *paths = g_ptr_array_sized_new (self->accounts->len);
+      guint i;
+
+      for (i = 0; i < self->accounts->len; i++)
+        {
+          TestRosterAccount *account = g_ptr_array_index (self->accounts, i);
+
+          g_ptr_array_add (paths, g_strdup (account->path));
+        }
+
+      g_value_take_boxed (value, paths);
+    }
+  else if (!tp_strdiff (property, "InvalidAccounts"))
+    {
+      g_value_take_boxed (value, g_ptr_array_new ());
+    }
+  else
+    {
+      g_value_set_boxed (value, no_interfaces);
+    }
+}
+
+static void
+test_roster_account_manager_class_init (
+    TestRosterAccountManagerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] = {
+    { TP_IFACE_ACCOUNT_MANAGER, account_manager_get_property, NULL,
+      account_manager_properties },
+    { NULL }
+  };
+
+  klass->dbus_props_class.interfaces = prop_interfaces;
+  tp_dbus_properties_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (TestRosterAccountManagerClass, dbus_props_class));
+}
+
+static void
+test_roster_account_manager_init (TestRosterAccountManager *self)
+{
+}
+
+/* The roster */
+
+/**
+ * test_roster_new:
+ * @seed: the seed of the changes to the rosters, for runs to be the same
+ *
+ * Starts a private bus with an account manager, which has no account yet.
+ * This has to be called before anything connects to the bus or looks up the
+ * user directories, so before test_init().
+ *
+ * Return value: a new #TestRoster, free with test_roster_free()
+ */
+TestRoster *
+test_roster_new (guint32 seed)
+{
+  TestRoster *roster = g_slice_new0 (TestRoster);
+  TestRosterAccountManager *manager;
+  gchar *path;
+  GError *error = NULL;
+
+  roster->bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (roster->bus);
+
+  roster->dir = g_dir_make_tmp ("empathy-roster-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  path = g_build_filename (roster->dir, "cache", NULL);
+  g_setenv ("XDG_CACHE_HOME", path, TRUE);
+  g_free (path);
+
+  path = g_build_filename (roster->dir, "data", NULL);
+  g_setenv ("XDG_DATA_HOME", path, TRUE);
+  g_free (path);
+
+  g_setenv ("FOLKS_BACKENDS_ALLOWED", "telepathy", TRUE);
+
+  roster->dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+
+  roster->rand = g_rand_new_with_seed (seed);
+  roster->accounts = g_ptr_array_new_with_free_func (g_object_unref);
+
+  manager = g_object_new (test_roster_account_manager_get_type (), NULL);
+  manager->accounts = roster->accounts;
+  roster->manager = G_OBJECT (manager);
+
+  tp_dbus_daemon_register_object (roster->dbus,
+      TP_ACCOUNT_MANAGER_OBJECT_PATH, roster->manager);
+  tp_dbus_daemon_request_name (roster->dbus, TP_ACCOUNT_MANAGER_BUS_NAME,
+      FALSE, &error);
+  g_assert_no_error (error);
+
+  return roster;
+}
+
+void
+test_roster_free (TestRoster *roster)
+{
+  tp_dbus_daemon_release_name (roster->dbus, TP_ACCOUNT_MANAGER_BUS_NAME,
+      NULL);
+  tp_dbus_daemon_unregister_object (roster->dbus, roster->manager);
+  g_object_unref (roster->manager);
+
+  /* Disconnects them */
+  g_ptr_array_unref (roster->accounts);
+
+  g_rand_free (roster->rand);
+  g_object_unref (roster->dbus);
+
+  remove_dir (roster->dir);
+  g_free (roster->dir);
+
+  g_test_dbus_down (roster->bus);
+  g_object_unref (roster->bus);
+
+  g_slice_free (TestRoster, roster);
+}
+
+/**
+ * test_roster_add_account:
+ * @roster: a #TestRoster
+ * @n_contacts: the number of contacts in the roster of the account
+ * @n_groups: the number of groups they are in
+ *
+ * Adds a connected account to the account manager.
+ */
+void
+test_roster_add_account (TestRoster *roster,
+    guint n_contacts,
+    guint n_groups)
+{
+  test_roster_add_account_with_type (roster, TEST_TYPE_ROSTER_CONNECTION,
+      n_contacts, n_groups);
+}
+
+/**
+ * test_roster_add_account_with_type:
+ * @roster: a #TestRoster
+ * @conn_type: the type of the connections of the account, a subclass of
+ *  #TestRosterConnection
+ * @n_contacts: the number of contacts in the roster of the account
+ * @n_groups: the number of groups they are in
+ *
+ * Like test_roster_add_account(), for connections which can do more than
+ * publishing the roster.
+ */
+void
+test_roster_add_account_with_type (TestRoster *roster,
+    GType conn_type,
+    guint n_contacts,
+    guint n_groups)
+{
+  TestRosterAccount *account;
+
+  account = g_object_new (test_roster_account_get_type (), NULL);
+  account->index = roster->accounts->len;
+  account->path = g_strdup_printf ("%s%s/%s/account%u",
+      TP_ACCOUNT_OBJECT_PATH_BASE, TEST_ROSTER_CM_NAME,
+      TEST_ROSTER_PROTOCOL_NAME, account->index);
+  account->n_contacts = n_contacts;
+  account->n_groups = n_groups;
+  account->conn_type = conn_type;
+
+  g_ptr_array_add (roster->accounts, account);
+  tp_dbus_daemon_register_object (roster->dbus, account->path, account);
+
+  account_connect (account);
+
+  tp_svc_account_manager_emit_account_validity_changed (roster->manager,
+      account->path, TRUE);
+}
+
+/**
+ * test_roster_get_connection:
+ * @roster: a #TestRoster
+ * @account: the number of the account
+ *
+ * Return value: (transfer none): the connection of the account, or %NULL
+ *  if it is disconnected
+ */
+TestRosterConnection *
+test_roster_get_connection (TestRoster *roster,
+    guint account)
+{
+  TestRosterAccount *self;
+
+  g_return_val_if_fail (account < roster->accounts->len, NULL);
+
+  self = g_ptr_array_index (roster->accounts, account);
+
+  return self->conn;
+}
+
+/**
+ * test_roster_get_n_contacts:
+ * @roster: a #TestRoster
+ *
+ * Return value: the number of contacts of all the accounts
+ */
+guint
+test_roster_get_n_contacts (TestRoster *roster)
+{
+  guint i, n = 0;
+
+  for (i = 0; i < roster->accounts->len; i++)
+    {
+      TestRosterAccount *account = g_ptr_array_index (roster->accounts, i);
+
+      n += account->n_contacts;
+    }
+
+  return n;
+}
+
+/**
+ * test_roster_connect:
+ * @roster: a #TestRoster
+ *
+ * Connects all the accounts again, with new connections.
+ */
+void
+test_roster_connect (TestRoster *roster)
+{
+  guint i;
+
+  for (i = 0; i < roster->accounts->len; i++)
+    account_connect (g_ptr_array_index (roster->accounts, i));
+}
+
+/**
+ * test_roster_disconnect:
+ * @roster: a #TestRoster
+ *
+ * Disconnects all the accounts at once, like when the network goes away.
+ */
+void
+test_roster_disconnect (TestRoster *roster)
+{
+  guint i;
+
+  for (i = 0; i < roster->accounts->len; i++)
+    account_disconnect (g_ptr_array_index (roster->accounts, i));
+}
+
+static TestRosterConnection *
+pick_connection (TestRoster *roster)
+{
+  TestRosterAccount *account;
+
+  account = g_ptr_array_index (roster->accounts,
+      g_rand_int_range (roster->rand, 0, roster->accounts->len));
+  g_assert (account->conn != NULL);
+
+  return account->conn;
+}
+
+/**
+ * test_roster_change_presences:
+ * @roster: a #TestRoster
+ * @n_changes: the number of changes
+ *
+ * Changes the presence of random contacts of all the accounts, in a burst.
+ * Call test_roster_flush() to wait for them to be received.
+ */
+void
+test_roster_change_presences (TestRoster *roster,
+    guint n_changes)
+{
+  guint i;
+
+  for (i = 0; i < n_changes; i++)
+    test_roster_connection_change_presences (pick_connection (roster),
+        roster->rand, 1);
+}
+
+/**
+ * test_roster_change_aliases:
+ * @roster: a #TestRoster
+ * @n_changes: the number of changes
+ *
+ * Renames random contacts of all the accounts, in a burst. Call
+ * test_roster_flush() to wait for them to be received.
+ */
+void
+test_roster_change_aliases (TestRoster *roster,
+    guint n_changes)
+{
+  guint i;
+
+  for (i = 0; i < n_changes; i++)
+    test_roster_connection_change_aliases (pick_connection (roster),
+        roster->rand, 1);
+}
+
+static void
+flush_cb (TpDBusDaemon *proxy,
+    const gchar *unique_name,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  g_assert_no_error (error);
+
+  g_main_loop_quit (user_data);
+}
+
+/**
+ * test_roster_flush:
+ * @roster: a #TestRoster
+ *
+ * Waits for the signals the accounts and connections have emitted to be
+ * received, and for what they have queued in the main loop to be done.
+ *
+ * The services and their clients share a connection to the bus, which
+ * routes the signals back to us before it replies to a call made after them.
+ */
+void
+test_roster_flush (TestRoster *roster)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+  tp_cli_dbus_daemon_call_get_name_owner (roster->dbus, -1,
+      TP_ACCOUNT_MANAGER_BUS_NAME, flush_cb, loop, NULL, NULL);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
@@ -0,0 +1,53 @@
+/*
+ * test-roster.h - Header for the synthetic rosters used by the benchmarks
+ * Copyright (C) 2014 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TEST_ROSTER_H__
+#define __TEST_ROSTER_H__
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "test-roster-connection.h"
+
+typedef struct _TestRoster TestRoster;
+
+TestRoster * test_roster_new (guint32 seed);
+void test_roster_free (TestRoster *roster);
+
+void test_roster_add_account (TestRoster *roster,
+    guint n_contacts,
+    guint n_groups);
+void test_roster_add_account_with_type (TestRoster *roster,
+    GType conn_type,
+    guint n_contacts,
+    guint n_groups);
+TestRosterConnection * test_roster_get_connection (TestRoster *roster,
+    guint account);
+guint test_roster_get_n_contacts (TestRoster *roster);
+
+void test_roster_connect (TestRoster *roster);
+void test_roster_disconnect (TestRoster *roster);
+
+void test_roster_change_presences (TestRoster *roster,
+    guint n_changes);
+void test_roster_change_aliases (TestRoster *roster,
+    guint n_changes);
+
+void test_roster_flush (TestRoster *roster);
+
+#endif